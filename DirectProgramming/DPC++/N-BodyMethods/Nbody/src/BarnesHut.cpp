@@ -0,0 +1,328 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+// The oneDPL headers have to be included before the SYCL headers
+#include <oneapi/dpl/algorithm>
+#include <oneapi/dpl/execution>
+
+#include "BarnesHut.hpp"
+
+#include <limits>
+
+using namespace sycl;
+
+constexpr int kWorkGroupSize = 128;
+// Number of bits of a Morton code per coordinate
+constexpr int kMortonBits = 21;
+// Depth of the stack of the tree walk. The Morton codes have 63 bits, and the
+// particles with equal codes are split by their index, which has 32 bits, so
+// no path from the root to a leaf is longer than 95 nodes.
+constexpr int kStackSize = 96;
+
+// Spreads the low 21 bits of x to every third bit
+static inline uint64_t SpreadBits(uint64_t x) {
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffff;
+  x = (x | x << 16) & 0x1f0000ff0000ff;
+  x = (x | x << 8) & 0x100f00f00f00f00f;
+  x = (x | x << 4) & 0x10c30c30c30c30c3;
+  x = (x | x << 2) & 0x1249249249249249;
+  return x;
+}
+
+// Global range of the kernels over the n particles, rounded up to a whole
+// number of work-groups
+static nd_range<1> ParticleRange(int n) {
+  return nd_range<1>(
+      range<1>((n + kWorkGroupSize - 1) / kWorkGroupSize * kWorkGroupSize),
+      range<1>(kWorkGroupSize));
+}
+
+BarnesHut::BarnesHut(queue &q, int n, RealType theta)
+    : q_(q), npart_(n), theta_(theta) {
+  bounds_ = malloc_device<RealType>(6, q_);
+  codes_ = malloc_device<uint64_t>(n, q_);
+  order_ = malloc_device<int>(n, q_);
+  left_ = malloc_device<int>(n - 1, q_);
+  right_ = malloc_device<int>(n - 1, q_);
+  parent_ = malloc_device<int>(2 * n - 1, q_);
+  visits_ = malloc_device<uint32_t>(n - 1, q_);
+  size_ = malloc_device<RealType>(n - 1, q_);
+  com_x_ = malloc_device<RealType>(2 * n - 1, q_);
+  com_y_ = malloc_device<RealType>(2 * n - 1, q_);
+  com_z_ = malloc_device<RealType>(2 * n - 1, q_);
+  com_m_ = malloc_device<RealType>(2 * n - 1, q_);
+}
+
+BarnesHut::~BarnesHut() {
+  free(bounds_, q_);
+  free(codes_, q_);
+  free(order_, q_);
+  free(left_, q_);
+  free(right_, q_);
+  free(parent_, q_);
+  free(visits_, q_);
+  free(size_, q_);
+  free(com_x_, q_);
+  free(com_y_, q_);
+  free(com_z_, q_);
+  free(com_m_, q_);
+}
+
+/* Computes the bounding box of the particles: each work-group reduces the
+ * coordinates of its particles, and merges them into bounds_ with atomics */
+void BarnesHut::ComputeBounds(const RealType *x, const RealType *y,
+                              const RealType *z) {
+  int n = npart_;
+  RealType *bounds = bounds_;
+
+  q_.fill(bounds, std::numeric_limits<RealType>::max(), 3);
+  q_.fill(bounds + 3, std::numeric_limits<RealType>::lowest(), 3);
+  q_.parallel_for(ParticleRange(n), [=](nd_item<1> it) {
+    using atomic_real =
+        atomic_ref<RealType, memory_order::relaxed, memory_scope::device,
+                   access::address_space::global_space>;
+    auto g = it.get_group();
+    // The work-items past the last particle repeat the first one
+    int i = it.get_global_id(0) < n ? it.get_global_id(0) : 0;
+
+    RealType lo_x = reduce_over_group(g, x[i], minimum<RealType>());
+    RealType lo_y = reduce_over_group(g, y[i], minimum<RealType>());
+    RealType lo_z = reduce_over_group(g, z[i], minimum<RealType>());
+    RealType hi_x = reduce_over_group(g, x[i], maximum<RealType>());
+    RealType hi_y = reduce_over_group(g, y[i], maximum<RealType>());
+    RealType hi_z = reduce_over_group(g, z[i], maximum<RealType>());
+    if (it.get_local_id(0) == 0) {
+      atomic_real(bounds[0]).fetch_min(lo_x);
+      atomic_real(bounds[1]).fetch_min(lo_y);
+      atomic_real(bounds[2]).fetch_min(lo_z);
+      atomic_real(bounds[3]).fetch_max(hi_x);
+      atomic_real(bounds[4]).fetch_max(hi_y);
+      atomic_real(bounds[5]).fetch_max(hi_z);
+    }
+  });
+}
+
+/* Computes the Morton codes of the particles in their bounding box, and sorts
+ * the particles by code */
+void BarnesHut::SortParticles(const RealType *x, const RealType *y,
+                              const RealType *z) {
+  int n = npart_;
+  const RealType *bounds = bounds_;
+  uint64_t *codes = codes_;
+  int *order = order_;
+
+  q_.parallel_for(range<1>(n), [=](id<1> idx) {
+    int i = idx[0];
+    // The codes are the coordinates in a cube whose side is the largest
+    // side of the bounding box
+    RealType side = sycl::fmax(bounds[3] - bounds[0],
+                               sycl::fmax(bounds[4] - bounds[1],
+                                          bounds[5] - bounds[2]));
+    constexpr RealType kMaxCell = (1 << kMortonBits) - 1;
+    RealType scale = side > 0.f ? kMaxCell / side : 0.f;
+
+    uint64_t cx = sycl::fmin((x[i] - bounds[0]) * scale, kMaxCell);
+    uint64_t cy = sycl::fmin((y[i] - bounds[1]) * scale, kMaxCell);
+    uint64_t cz = sycl::fmin((z[i] - bounds[2]) * scale, kMaxCell);
+    codes[i] = SpreadBits(cx) | SpreadBits(cy) << 1 | SpreadBits(cz) << 2;
+    order[i] = i;
+  });
+
+  oneapi::dpl::sort_by_key(oneapi::dpl::execution::make_device_policy(q_),
+                           codes, codes + n, order);
+}
+
+/* Builds the binary radix tree over the sorted Morton codes. Each internal
+ * node is built independently, as described in "Maximizing Parallelism in the
+ * Construction of BVHs, Octrees, and k-d Trees" (T. Karras, HPG 2012). */
+void BarnesHut::BuildTree() {
+  int n = npart_;
+  const RealType *bounds = bounds_;
+  const uint64_t *codes = codes_;
+  int *left = left_;
+  int *right = right_;
+  int *parent = parent_;
+  RealType *size = size_;
+
+  q_.parallel_for(range<1>(n - 1), [=](id<1> idx) {
+    int i = idx[0];
+    // Length of the common prefix of the codes i and j, or -1 if j is out of
+    // range. The equal codes are told apart by their index.
+    auto delta = [=](int i, int j) -> int {
+      if (j < 0 || j >= n) return -1;
+      uint64_t ci = codes[i], cj = codes[j];
+      if (ci == cj) return 64 + sycl::clz((uint32_t)(i ^ j));
+      return sycl::clz(ci ^ cj);
+    };
+
+    // Direction of the range of the node, and an upper bound of its length
+    int d = delta(i, i + 1) - delta(i, i - 1) > 0 ? 1 : -1;
+    int delta_min = delta(i, i - d);
+    int l_max = 2;
+    while (delta(i, i + l_max * d) > delta_min) l_max *= 2;
+
+    // Other end j of the range, by binary search
+    int l = 0;
+    for (int t = l_max / 2; t >= 1; t /= 2)
+      if (delta(i, i + (l + t) * d) > delta_min) l += t;
+    int j = i + l * d;
+
+    // Split position gamma, by binary search: the last position that shares
+    // more than delta_node bits with i
+    int delta_node = delta(i, j);
+    int s = 0;
+    for (int div = 2, t = (l + 1) / 2;; div *= 2, t = (l + div - 1) / div) {
+      if (delta(i, i + (s + t) * d) > delta_node) s += t;
+      if (t <= 1) break;
+    }
+    int gamma = i + s * d + sycl::min(d, 0);
+
+    // The children are leaves when their range has a single particle
+    int first = sycl::min(i, j), last = sycl::max(i, j);
+    int left_child = first == gamma ? n - 1 + gamma : gamma;
+    int right_child = last == gamma + 1 ? n - 1 + gamma + 1 : gamma + 1;
+    left[i] = left_child;
+    right[i] = right_child;
+    parent[left_child] = i;
+    parent[right_child] = i;
+    if (i == 0) parent[0] = -1;
+
+    // The codes have 63 bits, so the top bit is always common. A common prefix
+    // of 3k bits of the codes places the particles in an octree cell of
+    // level k.
+    RealType side = sycl::fmax(bounds[3] - bounds[0],
+                               sycl::fmax(bounds[4] - bounds[1],
+                                          bounds[5] - bounds[2]));
+    int level = sycl::min(delta_node - 1, 3 * kMortonBits) / 3;
+    size[i] = sycl::ldexp(side, -level);
+  });
+}
+
+/* Computes the centers of mass bottom-up: each work-item starts from a leaf
+ * and goes up the tree, and stops at the first internal node whose other
+ * child is not done yet. */
+void BarnesHut::ComputeCentersOfMass(const RealType *x, const RealType *y,
+                                     const RealType *z, const RealType *m) {
+  int n = npart_;
+  const int *order = order_;
+  const int *left = left_;
+  const int *right = right_;
+  const int *parent = parent_;
+  uint32_t *visits = visits_;
+  RealType *com_x = com_x_;
+  RealType *com_y = com_y_;
+  RealType *com_z = com_z_;
+  RealType *com_m = com_m_;
+
+  q_.memset(visits, 0, (n - 1) * sizeof(uint32_t));
+  q_.parallel_for(range<1>(n), [=](id<1> idx) {
+    int k = idx[0];
+    int leaf = n - 1 + k;
+    int p = order[k];
+    com_x[leaf] = x[p];
+    com_y[leaf] = y[p];
+    com_z[leaf] = z[p];
+    com_m[leaf] = m[p];
+
+    for (int node = parent[leaf]; node >= 0; node = parent[node]) {
+      // The release makes the center of mass of this child visible to the
+      // work-item that does the node, and the acquire makes the center of
+      // mass of the other child visible to this one.
+      atomic_ref<uint32_t, memory_order::acq_rel, memory_scope::device,
+                 access::address_space::global_space>
+          node_visits(visits[node]);
+      if (node_visits.fetch_add(1u) == 0) break;
+
+      int l = left[node], r = right[node];
+      RealType ml = com_m[l], mr = com_m[r];
+      RealType mass = ml + mr;
+      RealType wl = mass > 0.f ? ml / mass : 0.5f;
+      RealType wr = 1.f - wl;
+      com_x[node] = wl * com_x[l] + wr * com_x[r];
+      com_y[node] = wl * com_y[l] + wr * com_y[r];
+      com_z[node] = wl * com_z[l] + wr * com_z[r];
+      com_m[node] = mass;
+    }
+  });
+}
+
+void BarnesHut::Step(const RealType *x, const RealType *y, const RealType *z,
+                     const RealType *m, RealType *vx, RealType *vy,
+                     RealType *vz, RealType *x_next, RealType *y_next,
+                     RealType *z_next, RealType dt, RealType *energy) {
+  ComputeBounds(x, y, z);
+  SortParticles(x, y, z);
+  BuildTree();
+  ComputeCentersOfMass(x, y, z, m);
+
+  int n = npart_;
+  RealType theta_sqr = theta_ * theta_;
+  const int *order = order_;
+  const int *left = left_;
+  const int *right = right_;
+  const RealType *size = size_;
+  const RealType *com_x = com_x_;
+  const RealType *com_y = com_y_;
+  const RealType *com_z = com_z_;
+  const RealType *com_m = com_m_;
+
+  // The work-items take the particles in sorted order, so that neighboring
+  // work-items walk through similar parts of the tree.
+  q_.submit([&](handler &h) {
+     #if(__SYCL_COMPILER_VERSION <= 20200827)
+     h.parallel_for(ParticleRange(n), intel::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
+     #else
+     h.parallel_for(ParticleRange(n), ext::oneapi::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
+     #endif
+       int k = it.get_global_id(0);
+       if (k >= n) return;
+       int i = order[k];
+       RealType xi = x[i], yi = y[i], zi = z[i];
+       RealType acc0 = 0.f, acc1 = 0.f, acc2 = 0.f;
+
+       int stack[kStackSize];
+       int top = 0;
+       int node = 0;
+       while (true) {
+         RealType dx = com_x[node] - xi;
+         RealType dy = com_y[node] - yi;
+         RealType dz = com_z[node] - zi;
+         RealType distance_sqr = dx * dx + dy * dy + dz * dz;
+
+         if (node >= n - 1 ||
+             size[node] * size[node] < theta_sqr * distance_sqr) {
+           // A leaf, or a node far enough to stand for all its particles
+           RealType distance_inv =
+               1.0f / sycl::sqrt(distance_sqr + kSofteningSquared);
+           RealType s = kG * com_m[node] * distance_inv * distance_inv *
+                        distance_inv;
+           acc0 += dx * s;
+           acc1 += dy * s;
+           acc2 += dz * s;
+           if (top == 0) break;
+           node = stack[--top];
+         } else {
+           stack[top++] = right[node];
+           node = left[node];
+         }
+       }
+
+       RealType vxi = vx[i] + acc0 * dt;
+       RealType vyi = vy[i] + acc1 * dt;
+       RealType vzi = vz[i] + acc2 * dt;
+       vx[i] = vxi;
+       vy[i] = vyi;
+       vz[i] = vzi;
+
+       x_next[i] = xi + vxi * dt;
+       y_next[i] = yi + vyi * dt;
+       z_next[i] = zi + vzi * dt;
+
+       energy += (m[i] * (vxi * vxi + vyi * vyi + vzi * vzi));
+     });
+   });
+}
@@ -0,0 +1,75 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#ifndef _BARNESHUT_HPP
+#define _BARNESHUT_HPP
+
+#include <CL/sycl.hpp>
+#include <cstdint>
+
+#include "Particle.hpp"
+
+// Barnes-Hut solver: approximates the force that a distant group of particles
+// exerts on a particle by the force of a single particle at the group's center
+// of mass, which takes O(N log N) time per step instead of O(N^2).
+//
+// The tree is rebuilt on the device at every step:
+//  1. The particles are sorted along a Z-order curve by their Morton codes,
+//     which interleave the bits of their coordinates in the bounding box.
+//  2. Each internal node of the binary radix tree over the sorted codes is
+//     built independently: its range of particles and its split point follow
+//     from the common prefixes of the codes. A node whose particles share a
+//     prefix of 3k bits lies in an octree cell of level k, and takes the size
+//     of that cell.
+//  3. The centers of mass are computed bottom-up, from the leaves: of the two
+//     work-items that reach an internal node, the second one computes it.
+//  4. The forces are computed by walking the tree from the root, and using a
+//     node's center of mass whenever size / distance < theta.
+class BarnesHut {
+ public:
+  BarnesHut(sycl::queue &q, int n, RealType theta);
+  ~BarnesHut();
+
+  // Computes the accelerations of the particles at the positions x, y, z with
+  // masses m, updates their velocities vx, vy, vz and writes their new
+  // positions to x_next, y_next, z_next, and adds their kinetic energy to
+  // energy. All the pointers are device USM.
+  void Step(const RealType *x, const RealType *y, const RealType *z,
+            const RealType *m, RealType *vx, RealType *vy, RealType *vz,
+            RealType *x_next, RealType *y_next, RealType *z_next,
+            RealType dt, RealType *energy);
+
+ private:
+  sycl::queue &q_;
+  int npart_;
+  RealType theta_;
+
+  // Bounding box of the particles: the minimum x, y, z and the maximum x, y, z
+  RealType *bounds_;
+  // Morton codes of the particles, and the particle of each sorted code
+  uint64_t *codes_;
+  int *order_;
+
+  // The nodes of the tree: the internal nodes are 0 ... n - 2, with the root
+  // at 0, and the leaves, one per sorted particle, are n - 1 ... 2n - 2
+  int *left_;           // children of the internal nodes
+  int *right_;
+  int *parent_;         // parent of each node, -1 for the root
+  uint32_t *visits_;    // number of children of an internal node done
+  RealType *size_;      // size of the octree cell of an internal node
+  RealType *com_x_;     // center of mass of each node
+  RealType *com_y_;
+  RealType *com_z_;
+  RealType *com_m_;     // mass of each node
+
+  void ComputeBounds(const RealType *x, const RealType *y, const RealType *z);
+  void SortParticles(const RealType *x, const RealType *y, const RealType *z);
+  void BuildTree();
+  void ComputeCentersOfMass(const RealType *x, const RealType *y,
+                            const RealType *z, const RealType *m);
+};
+
+#endif
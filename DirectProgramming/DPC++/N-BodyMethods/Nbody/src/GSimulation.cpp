@@ -6,12 +6,25 @@
 
 #include "GSimulation.hpp"
 
+#include <algorithm>
+#include <memory>
+
+#include "BarnesHut.hpp"
+#include "SnapshotWriter.hpp"
+
 // dpc_common.hpp can be found in the dev-utilities include folder.
 // e.g., $ONEAPI_ROOT/dev-utilities/latest/include/dpc_common.hpp
 #include "dpc_common.hpp"
 
 using namespace sycl;
 
+// Number of work-items in a work-group, which is also the number of particles
+// in a tile of the force computation
+constexpr int kTileSize = 128;
+// Largest relative difference between the kinetic energies of the Barnes-Hut
+// and direct solvers that --validate accepts
+constexpr double kValidationTolerance = 1e-2;
+
 /* Default Constructor for the GSimulation class which sets up the default
  * values for number of particles, number of integration steps, time steo and
  * sample frequency */
@@ -24,6 +37,10 @@ GSimulation::GSimulation() {
   set_nsteps(10);
   set_tstep(0.1);
   set_sfreq(1);
+  SetSolver(Solver::kDirect);
+  SetTheta(0.5);
+  SetValidate(false);
+  SetSnapshots(0, "nbody");
 }
 
 /* Set the number of particles */
@@ -32,6 +49,23 @@ void GSimulation::SetNumberOfParticles(int N) { set_npart(N); }
 /* Set the number of integration steps */
 void GSimulation::SetNumberOfSteps(int N) { set_nsteps(N); }
 
+/* Set how the forces are computed */
+void GSimulation::SetSolver(Solver solver) { solver_ = solver; }
+
+/* Set the opening angle of the Barnes-Hut solver: a node of the tree stands
+ * for all its particles when its size / distance < theta */
+void GSimulation::SetTheta(RealType theta) { theta_ = theta; }
+
+/* Compare the Barnes-Hut solver with the direct one instead of simulating */
+void GSimulation::SetValidate(bool validate) { validate_ = validate; }
+
+/* Write a snapshot of the particles to <prefix>_<step>.bin every freq steps,
+ * or never if freq is 0 */
+void GSimulation::SetSnapshots(int freq, const std::string &prefix) {
+  snapshot_freq_ = freq;
+  snapshot_prefix_ = prefix;
+}
+
 /* Initialize the position of all the particles using random number generator
  * between 0 and 1.0 */
 void GSimulation::InitPos() {
@@ -40,9 +74,9 @@ void GSimulation::InitPos() {
   std::uniform_real_distribution<RealType> unif_d(0, 1.0);
 
   for (int i = 0; i < get_npart(); ++i) {
-    particles_[i].pos[0] = unif_d(gen);
-    particles_[i].pos[1] = unif_d(gen);
-    particles_[i].pos[2] = unif_d(gen);
+    particles_.pos[0][i] = unif_d(gen);
+    particles_.pos[1][i] = unif_d(gen);
+    particles_.pos[2][i] = unif_d(gen);
   }
 }
 
@@ -54,18 +88,9 @@ void GSimulation::InitVel() {
   std::uniform_real_distribution<RealType> unif_d(-1.0, 1.0);
 
   for (int i = 0; i < get_npart(); ++i) {
-    particles_[i].vel[0] = unif_d(gen) * 1.0e-3f;
-    particles_[i].vel[1] = unif_d(gen) * 1.0e-3f;
-    particles_[i].vel[2] = unif_d(gen) * 1.0e-3f;
-  }
-}
-
-/* Initialize the acceleration of all the particles to 0 */
-void GSimulation::InitAcc() {
-  for (int i = 0; i < get_npart(); ++i) {
-    particles_[i].acc[0] = 0.f;
-    particles_[i].acc[1] = 0.f;
-    particles_[i].acc[2] = 0.f;
+    particles_.vel[0][i] = unif_d(gen) * 1.0e-3f;
+    particles_.vel[1][i] = unif_d(gen) * 1.0e-3f;
+    particles_.vel[2][i] = unif_d(gen) * 1.0e-3f;
   }
 }
 
@@ -78,157 +103,314 @@ void GSimulation::InitMass() {
   std::uniform_real_distribution<RealType> unif_d(0.0, 1.0);
 
   for (int i = 0; i < get_npart(); ++i) {
-    particles_[i].mass = n * unif_d(gen);
+    particles_.mass[i] = n * unif_d(gen);
   }
 }
 
-/* This function does the simulation logic for Nbody */
-void GSimulation::Start() {
-  RealType dt = get_tstep();
+/* This function does the simulation logic for Nbody, and returns false if the
+ * validation fails */
+bool GSimulation::Start() {
   int n = get_npart();
   particles_.resize(n);
 
   InitPos();
   InitVel();
-  InitAcc();
   InitMass();
 
   PrintHeader();
 
-  total_time_ = 0.;
+  if (validate_) return Validate();
+  Run(solver_, true);
+  return true;
+}
 
-  constexpr float kSofteningSquared = 1e-3f;
-  // prevents explosion in the case the particles are really close to each other
-  constexpr float kG = 6.67259e-11f;
-  double gflops = 1e-9 * ((11. + 18.) * n * n + n * 19.);
-  int nf = 0;
-  double av = 0.0, dev = 0.0;
-  // Create global range
-  auto r = range<1>(n);
+/* Computes the accelerations of all particles with all pairs of particles,
+ * updates their velocities and positions, and adds their kinetic energy to
+ * energy, in a single kernel */
+void GSimulation::DirectStep(queue &q, const RealType *x, const RealType *y,
+                             const RealType *z, const RealType *m,
+                             RealType *vx, RealType *vy, RealType *vz,
+                             RealType *x_next, RealType *y_next,
+                             RealType *z_next, RealType dt, RealType *energy) {
+  int n = get_npart();
+  // Create global range, rounded up to a whole number of tiles
+  auto r = range<1>((n + kTileSize - 1) / kTileSize * kTileSize);
   // Create local range
-  auto lr = range<1>(128);
+  auto lr = range<1>(kTileSize);
   // Create ndrange 
   auto ndrange = nd_range<1>(r, lr);
-  // Create a queue to the selected device and enabled asynchronous exception
-  // handling for that queue
-  queue q(default_selector{}, dpc_common::exception_handler);
-  // Create SYCL buffer for the Particle array of size "n"
-  buffer pbuf(particles_.data(), r,
-              {cl::sycl::property::buffer::use_host_ptr()});
-  // Allocate energy using USM allocator shared
-  RealType *energy = malloc_shared<RealType>(1,q);
-  *energy = 0.f;
 
-  dpc_common::TimeInterval t0;
-  int nsteps = get_nsteps();
-  // Looping across integration steps
-  for (int s = 1; s <= nsteps; ++s) {
-    dpc_common::TimeInterval ts0;
-    // Submitting first kernel to device which computes acceleration of all
-    // particles
-    q.submit([&](handler& h) {
-       auto p = pbuf.get_access(h);
-       h.parallel_for(ndrange, [=](nd_item<1> it) {
-	 auto i = it.get_global_id();
-         RealType acc0 = p[i].acc[0];
-         RealType acc1 = p[i].acc[1];
-         RealType acc2 = p[i].acc[2];
-         for (int j = 0; j < n; j++) {
+  q.submit([&](handler& h) {
+     // The positions and masses of a tile of particles, which all the
+     // work-items of the work-group read from local memory
+     accessor<RealType, 1, access::mode::read_write, access::target::local>
+         tile_x(lr, h), tile_y(lr, h), tile_z(lr, h), tile_m(lr, h);
+     #if(__SYCL_COMPILER_VERSION <= 20200827)
+     h.parallel_for(ndrange, intel::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
+     #else
+     h.parallel_for(ndrange, ext::oneapi::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
+     #endif
+       int i = it.get_global_id(0);
+       int l = it.get_local_id(0);
+       // The work-items past the last particle only load tiles
+       bool active = i < n;
+       RealType xi = active ? x[i] : 0.f;
+       RealType yi = active ? y[i] : 0.f;
+       RealType zi = active ? z[i] : 0.f;
+       RealType acc0 = 0.f;
+       RealType acc1 = 0.f;
+       RealType acc2 = 0.f;
+       for (int tile = 0; tile < n; tile += kTileSize) {
+         // Each work-item loads one particle of the tile. The particles
+         // past the last one have no mass, and so exert no force.
+         int j = tile + l;
+         tile_x[l] = j < n ? x[j] : 0.f;
+         tile_y[l] = j < n ? y[j] : 0.f;
+         tile_z[l] = j < n ? z[j] : 0.f;
+         tile_m[l] = j < n ? m[j] : 0.f;
+         it.barrier(access::fence_space::local_space);
+
+         for (int k = 0; k < kTileSize; k++) {
            RealType dx, dy, dz;
            RealType distance_sqr = 0.0f;
            RealType distance_inv = 0.0f;
 
-           dx = p[j].pos[0] - p[i].pos[0];  // 1flop
-           dy = p[j].pos[1] - p[i].pos[1];  // 1flop
-           dz = p[j].pos[2] - p[i].pos[2];  // 1flop
+           dx = tile_x[k] - xi;  // 1flop
+           dy = tile_y[k] - yi;  // 1flop
+           dz = tile_z[k] - zi;  // 1flop
 
            distance_sqr =
                dx * dx + dy * dy + dz * dz + kSofteningSquared;  // 6flops
            distance_inv = 1.0f / sycl::sqrt(distance_sqr);       // 1div+1sqrt
 
-           acc0 += dx * kG * p[j].mass * distance_inv * distance_inv *
+           acc0 += dx * kG * tile_m[k] * distance_inv * distance_inv *
                    distance_inv;  // 6flops
-           acc1 += dy * kG * p[j].mass * distance_inv * distance_inv *
+           acc1 += dy * kG * tile_m[k] * distance_inv * distance_inv *
                    distance_inv;  // 6flops
-           acc2 += dz * kG * p[j].mass * distance_inv * distance_inv *
+           acc2 += dz * kG * tile_m[k] * distance_inv * distance_inv *
                    distance_inv;  // 6flops
          }
-         p[i].acc[0] = acc0;
-         p[i].acc[1] = acc1;
-         p[i].acc[2] = acc2;
-       });
-     }).wait_and_throw();
-    // Second kernel updates the velocity and position for all particles
-    q.submit([&](handler& h) {
-       auto p = pbuf.get_access(h);
-       #if(__SYCL_COMPILER_VERSION <= 20200827)
-       h.parallel_for(ndrange, intel::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
-       #else
-       h.parallel_for(ndrange, ext::oneapi::reduction(energy, 0.f, std::plus<RealType>()), [=](nd_item<1> it, auto& energy) {
-       #endif
-	 auto i = it.get_global_id();
-         p[i].vel[0] += p[i].acc[0] * dt;  // 2flops
-         p[i].vel[1] += p[i].acc[1] * dt;  // 2flops
-         p[i].vel[2] += p[i].acc[2] * dt;  // 2flops
-
-         p[i].pos[0] += p[i].vel[0] * dt;  // 2flops
-         p[i].pos[1] += p[i].vel[1] * dt;  // 2flops
-         p[i].pos[2] += p[i].vel[2] * dt;  // 2flops
-
-         p[i].acc[0] = 0.f;
-         p[i].acc[1] = 0.f;
-         p[i].acc[2] = 0.f;
-
-         energy += (p[i].mass *
-                (p[i].vel[0] * p[i].vel[0] + p[i].vel[1] * p[i].vel[1] +
-                 p[i].vel[2] * p[i].vel[2]));  // 7flops
-       });
-     }).wait_and_throw();
-    kenergy_ = 0.5 * (*energy);
-    *energy = 0.f;
-    double elapsed_seconds = ts0.Elapsed();
+         it.barrier(access::fence_space::local_space);
+       }
+
+       if (active) {
+         RealType vxi = vx[i] + acc0 * dt;  // 2flops
+         RealType vyi = vy[i] + acc1 * dt;  // 2flops
+         RealType vzi = vz[i] + acc2 * dt;  // 2flops
+         vx[i] = vxi;
+         vy[i] = vyi;
+         vz[i] = vzi;
+
+         x_next[i] = xi + vxi * dt;  // 2flops
+         y_next[i] = yi + vyi * dt;  // 2flops
+         z_next[i] = zi + vzi * dt;  // 2flops
+
+         energy += (m[i] * (vxi * vxi + vyi * vyi + vzi * vzi));  // 7flops
+       }
+     });
+   });
+}
+
+/* Runs the simulation from the current state of the particles with the given
+ * solver, and returns the kinetic energy at each sample. If print is true,
+ * prints the energy, time and performance of each sample. */
+std::vector<RealType> GSimulation::Run(Solver solver, bool print) {
+  RealType dt = get_tstep();
+  int n = get_npart();
+  std::vector<RealType> energies;
+
+  total_time_ = 0.;
+
+  double gflops = 1e-9 * ((11. + 18.) * n * n + n * 19.);
+  int nf = 0;
+  double av = 0.0, dev = 0.0;
+  // Create a queue to the selected device and enabled asynchronous exception
+  // handling for that queue. The queue is in order, so each step runs after
+  // the previous one without the host waiting in between.
+  queue q(default_selector{}, dpc_common::exception_handler,
+          property::queue::in_order());
+
+  // Allocate the particles on the device. The positions are double buffered:
+  // each step reads the positions of the previous step and writes new ones,
+  // so no particle moves while another work-item still reads it.
+  RealType *pos[2][3], *vel[3];
+  for (int d = 0; d < 3; ++d) {
+    pos[0][d] = malloc_device<RealType>(n, q);
+    pos[1][d] = malloc_device<RealType>(n, q);
+    vel[d] = malloc_device<RealType>(n, q);
+    q.memcpy(pos[0][d], particles_.pos[d].data(), n * sizeof(RealType));
+    q.memcpy(vel[d], particles_.vel[d].data(), n * sizeof(RealType));
+  }
+  RealType *mass = malloc_device<RealType>(n, q);
+  q.memcpy(mass, particles_.mass.data(), n * sizeof(RealType));
+
+  int nsteps = get_nsteps();
+  // Allocate the kinetic energy of each step using USM allocator shared, so
+  // the host only reads it at the sample frequency
+  RealType *energy = malloc_shared<RealType>(nsteps, q);
+  for (int s = 0; s < nsteps; ++s) energy[s] = 0.f;
+  int cur = 0;  // index of the current positions in pos
+
+  // The Barnes-Hut tree needs at least two particles; a single particle has
+  // no force either way
+  std::unique_ptr<BarnesHut> tree;
+  if (solver == Solver::kBarnesHut && n > 1)
+    tree = std::make_unique<BarnesHut>(q, n, theta_);
+
+  // The snapshots are copied to the host and written in the background while
+  // the simulation goes on. The validation runs write none.
+  std::unique_ptr<SnapshotWriter> snapshots;
+  if (print && snapshot_freq_ > 0) {
+    snapshots = std::make_unique<SnapshotWriter>(q, n, particles_.mass.data(),
+                                                 snapshot_prefix_);
+    snapshots->Write(0, 0., pos[cur], vel);
+  }
+
+  dpc_common::TimeInterval t0;
+  dpc_common::TimeInterval ts0;
+  // Looping across integration steps
+  for (int s = 1; s <= nsteps; ++s) {
+    RealType **p = pos[cur], **p_next = pos[1 - cur];
+    if (tree)
+      tree->Step(p[0], p[1], p[2], mass, vel[0], vel[1], vel[2], p_next[0],
+                 p_next[1], p_next[2], dt, energy + s - 1);
+    else
+      DirectStep(q, p[0], p[1], p[2], mass, vel[0], vel[1], vel[2], p_next[0],
+                 p_next[1], p_next[2], dt, energy + s - 1);
+    cur = 1 - cur;
+
+    if (snapshots && (s % snapshot_freq_) == 0)
+      snapshots->Write(s, s * dt, pos[cur], vel);
+
     if ((s % get_sfreq()) == 0) {
+      // Wait for the steps since the last sample
+      q.wait_and_throw();
+      kenergy_ = 0.5 * energy[s - 1];
+      energies.push_back(kenergy_);
+      double elapsed_seconds = ts0.Elapsed();
+      // The performance is in GFLOPS for the direct solver, whose number of
+      // operations is known, and in seconds per step for Barnes-Hut
+      double perf = tree ? elapsed_seconds / get_sfreq()
+                         : gflops * get_sfreq() / elapsed_seconds;
       nf += 1;
-      std::cout << " " << std::left << std::setw(8) << s << std::left
-                << std::setprecision(5) << std::setw(8) << s * get_tstep()
-                << std::left << std::setprecision(5) << std::setw(12)
-                << kenergy_ << std::left << std::setprecision(5)
-                << std::setw(12) << elapsed_seconds << std::left
-                << std::setprecision(5) << std::setw(12)
-                << gflops * get_sfreq() / elapsed_seconds << "\n";
+      if (print)
+        std::cout << " " << std::left << std::setw(8) << s << std::left
+                  << std::setprecision(5) << std::setw(8) << s * get_tstep()
+                  << std::left << std::setprecision(5) << std::setw(12)
+                  << kenergy_ << std::left << std::setprecision(5)
+                  << std::setw(12) << elapsed_seconds << std::left
+                  << std::setprecision(5) << std::setw(12) << perf << "\n";
       if (nf > 2) {
-        av += gflops * get_sfreq() / elapsed_seconds;
-        dev += gflops * get_sfreq() * gflops * get_sfreq() /
-               (elapsed_seconds * elapsed_seconds);
+        av += perf;
+        dev += perf * perf;
       }
+      ts0 = dpc_common::TimeInterval();
     }
 
   }  // end of the time step loop
+  q.wait_and_throw();
   total_time_ = t0.Elapsed();
   total_flops_ = gflops * get_nsteps();
   av /= (double)(nf - 2);
   dev = sqrt(dev / (double)(nf - 2) - av * av);
 
+  // Wait for the last snapshots before their device arrays are freed
+  if (snapshots) snapshots->Finish();
+
+  // Copy the final state of the particles back to the host
+  for (int d = 0; d < 3; ++d) {
+    q.memcpy(particles_.pos[d].data(), pos[cur][d], n * sizeof(RealType));
+    q.memcpy(particles_.vel[d].data(), vel[d], n * sizeof(RealType));
+  }
+  q.wait_and_throw();
+
+  tree.reset();
+  for (int d = 0; d < 3; ++d) {
+    free(pos[0][d], q);
+    free(pos[1][d], q);
+    free(vel[d], q);
+  }
+  free(mass, q);
+  free(energy, q);
+
+  if (print) {
+    std::cout << "\n";
+    std::cout << "# Total Time (s)     : " << total_time_ << "\n";
+    if (solver == Solver::kBarnesHut)
+      std::cout << "# Average Time per Step (s) : " << av << " +- " << dev
+                << "\n";
+    else
+      std::cout << "# Average Performance : " << av << " +- " << dev << "\n";
+    if (snapshots) {
+      std::cout << "# Snapshots Written   : " << snapshots->NumWritten()
+                << " (" << snapshots->BytesWritten() * 1e-6 << " MB)\n";
+      // The time the step loop waited for a free staging buffer, which is
+      // part of the total time, and the time the last snapshots took to be
+      // written after it
+      std::cout << "# Time Blocked on Output (s) : "
+                << snapshots->BlockedTime() << "\n";
+      std::cout << "# Time Draining Output (s)   : " << snapshots->DrainTime()
+                << "\n";
+    }
+    std::cout << "==============================="
+              << "\n";
+  }
+  return energies;
+}
+
+/* Runs the simulation from the same initial state with the direct solver and
+ * with the Barnes-Hut solver, compares their kinetic energies, and returns
+ * whether they agree within kValidationTolerance */
+bool GSimulation::Validate() {
+  ParticleSoA initial = particles_;
+  std::vector<RealType> direct = Run(Solver::kDirect, false);
+  particles_ = initial;
+  std::vector<RealType> tree = Run(Solver::kBarnesHut, false);
+
+  double max_error = 0.;
+  for (size_t k = 0; k < direct.size(); ++k) {
+    int s = (k + 1) * get_sfreq();
+    double error = std::abs(tree[k] - direct[k]) / std::abs(direct[k]);
+    max_error = std::max(max_error, error);
+    std::cout << " " << std::left << std::setw(8) << s << std::left
+              << std::setprecision(5) << std::setw(8) << s * get_tstep()
+              << std::left << std::setprecision(5) << std::setw(12)
+              << direct[k] << std::left << std::setprecision(5)
+              << std::setw(12) << tree[k] << std::left
+              << std::setprecision(5) << std::setw(12) << error << "\n";
+  }
+
   std::cout << "\n";
-  std::cout << "# Total Time (s)     : " << total_time_ << "\n";
-  std::cout << "# Average Performance : " << av << " +- " << dev << "\n";
+  std::cout << "# Maximum Relative Error : " << max_error << "\n";
+  bool success = max_error <= kValidationTolerance;
+  std::cout << (success ? "Success" : "Failed") << "\n";
   std::cout << "==============================="
             << "\n";
+  return success;
 }
 
 /* Print the headers for the output */
 void GSimulation::PrintHeader() {
   std::cout << " nPart = " << get_npart() << "; "
             << "nSteps = " << get_nsteps() << "; "
-            << "dt = " << get_tstep() << "\n";
+            << "dt = " << get_tstep();
+  if (validate_ || solver_ == Solver::kBarnesHut)
+    std::cout << "; theta = " << theta_;
+  std::cout << "\n";
 
   std::cout << "------------------------------------------------"
             << "\n";
   std::cout << " " << std::left << std::setw(8) << "s" << std::left
-            << std::setw(8) << "dt" << std::left << std::setw(12) << "kenergy"
-            << std::left << std::setw(12) << "time (s)" << std::left
-            << std::setw(12) << "GFLOPS"
-            << "\n";
+            << std::setw(8) << "dt" << std::left;
+  // The validation compares the kinetic energies of the two solvers
+  if (validate_)
+    std::cout << std::setw(12) << "direct" << std::left << std::setw(12)
+              << "Barnes-Hut" << std::left << std::setw(12) << "rel. error";
+  else
+    std::cout << std::setw(12) << "kenergy" << std::left << std::setw(12)
+              << "time (s)" << std::left << std::setw(12)
+              << (solver_ == Solver::kBarnesHut ? "s/step" : "GFLOPS");
+  std::cout << "\n";
   std::cout << "------------------------------------------------"
             << "\n";
 }
@@ -21,22 +21,38 @@
 
 class GSimulation {
  public:
+  // How the forces between the particles are computed
+  enum class Solver {
+    kDirect,    // all pairs, O(N^2)
+    kBarnesHut  // tree of centers of mass, O(N log N)
+  };
+
   GSimulation();
 
   void Init();
   void SetNumberOfParticles(int N);
   void SetNumberOfSteps(int N);
-  void Start();
+  void SetSolver(Solver solver);
+  void SetTheta(RealType theta);
+  void SetValidate(bool validate);
+  void SetSnapshots(int freq, const std::string &prefix);
+  bool Start();
 
  private:
-  //  Particle *particles_;
-  std::vector<Particle> particles_;
+  ParticleSoA particles_;
   int npart_;       // number of particles
   int nsteps_;      // number of integration steps
   RealType tstep_;  // time step of the simulation
 
   int sfreq_;  // sample frequency
 
+  Solver solver_;   // force computation
+  RealType theta_;  // opening angle of the Barnes-Hut solver
+  bool validate_;   // compare the Barnes-Hut solver with the direct one
+
+  int snapshot_freq_;            // steps between snapshots, 0 for none
+  std::string snapshot_prefix_;  // path prefix of the snapshot files
+
   RealType kenergy_;  // kinetic energy
 
   double total_time_;   // total time of the simulation
@@ -44,9 +60,16 @@ class GSimulation {
 
   void InitPos();
   void InitVel();
-  void InitAcc();
   void InitMass();
 
+  std::vector<RealType> Run(Solver solver, bool print);
+  bool Validate();
+  void DirectStep(sycl::queue &q, const RealType *x, const RealType *y,
+                  const RealType *z, const RealType *m, RealType *vx,
+                  RealType *vy, RealType *vz, RealType *x_next,
+                  RealType *y_next, RealType *z_next, RealType dt,
+                  RealType *energy);
+
   void set_npart(const int &N) { npart_ = N; }
   int get_npart() const { return npart_; }
 
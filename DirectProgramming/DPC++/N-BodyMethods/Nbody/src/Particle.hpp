@@ -1,16 +1,32 @@
 #ifndef _PARTICLE_HPP
 #define _PARTICLE_HPP
 #include <cmath>
+#include <vector>
 
 #include "type.hpp"
 
-struct Particle {
+// Softening of the gravitational force, which prevents explosion in the case
+// the particles are really close to each other
+constexpr float kSofteningSquared = 1e-3f;
+// Gravitational constant
+constexpr float kG = 6.67259e-11f;
+
+// The particles are stored as a structure of arrays: each component of the
+// positions, velocities and masses is a contiguous array, so consecutive
+// work-items access consecutive addresses.
+struct ParticleSoA {
  public:
-  Particle() : pos{}, vel{}, acc{}, mass{} {};
-  RealType pos[3];
-  RealType vel[3];
-  RealType acc[3];
-  RealType mass;
+  std::vector<RealType> pos[3];
+  std::vector<RealType> vel[3];
+  std::vector<RealType> mass;
+
+  void resize(int n) {
+    for (int d = 0; d < 3; ++d) {
+      pos[d].resize(n);
+      vel[d].resize(n);
+    }
+    mass.resize(n);
+  }
 };
 
 #endif
@@ -0,0 +1,150 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#include "SnapshotWriter.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// dpc_common.hpp can be found in the dev-utilities include folder.
+// e.g., $ONEAPI_ROOT/dev-utilities/latest/include/dpc_common.hpp
+#include "dpc_common.hpp"
+
+using namespace sycl;
+
+SnapshotWriter::SnapshotWriter(queue &q, int n, const RealType *mass,
+                               const std::string &prefix, int num_buffers)
+    : q_(q),
+      npart_(n),
+      mass_(mass, mass + n),
+      prefix_(prefix),
+      done_(false),
+      blocked_time_(0.),
+      drain_time_(0.),
+      num_written_(0),
+      bytes_written_(0) {
+  // The staging buffers are in host USM, so that the device copies into them
+  // directly
+  buffers_.resize(num_buffers);
+  for (int b = 0; b < num_buffers; ++b) {
+    buffers_[b].data = malloc_host<RealType>(6 * (size_t)n, q_);
+    free_.push_back(b);
+  }
+  thread_ = std::thread(&SnapshotWriter::WriterLoop, this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  Finish();
+  for (auto &buffer : buffers_) free(buffer.data, q_);
+}
+
+void SnapshotWriter::Write(int step, double time, RealType *const pos[3],
+                           RealType *const vel[3]) {
+  int b;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (free_.empty()) {
+      dpc_common::TimeInterval blocked;
+      buffer_freed_.wait(lock, [this] { return !free_.empty(); });
+      blocked_time_ += blocked.Elapsed();
+    }
+    b = free_.front();
+    free_.pop_front();
+  }
+
+  Staging &buffer = buffers_[b];
+  size_t n = npart_;
+  buffer.step = step;
+  buffer.time = time;
+  buffer.copies.clear();
+  for (int d = 0; d < 3; ++d) {
+    buffer.copies.push_back(
+        q_.memcpy(buffer.data + d * n, pos[d], n * sizeof(RealType)));
+    buffer.copies.push_back(
+        q_.memcpy(buffer.data + (3 + d) * n, vel[d], n * sizeof(RealType)));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.push_back(b);
+  }
+  buffer_pending_.notify_one();
+}
+
+void SnapshotWriter::Finish() {
+  if (!thread_.joinable()) return;
+  dpc_common::TimeInterval drain;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+  }
+  buffer_pending_.notify_one();
+  thread_.join();
+  drain_time_ = drain.Elapsed();
+}
+
+/* Writes the pending snapshots in order, until Finish() is called and none is
+ * left */
+void SnapshotWriter::WriterLoop() {
+  bool failed = false;
+  for (;;) {
+    int b;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      buffer_pending_.wait(lock, [this] { return done_ || !pending_.empty(); });
+      if (pending_.empty()) return;
+      b = pending_.front();
+      pending_.pop_front();
+    }
+
+    // The simulation goes on while this thread waits for the copies and
+    // writes the file. After a failed write, the snapshots are dropped, but
+    // the buffers still go around so that the simulation never blocks for
+    // good.
+    event::wait(buffers_[b].copies);
+    if (!failed) failed = !WriteFile(buffers_[b]);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      free_.push_back(b);
+    }
+    buffer_freed_.notify_one();
+  }
+}
+
+/* Writes the snapshot in a staging buffer to its file, and returns whether it
+ * succeeded */
+bool SnapshotWriter::WriteFile(const Staging &buffer) {
+  std::ostringstream name;
+  name << prefix_ << "_" << std::setw(6) << std::setfill('0') << buffer.step
+       << ".bin";
+
+  SnapshotHeader header = {{'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P'},
+                           1,
+                           sizeof(RealType),
+                           (uint64_t)npart_,
+                           (uint64_t)buffer.step,
+                           buffer.time};
+  size_t n = npart_;
+  std::ofstream file(name.str(), std::ios::binary);
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(buffer.data),
+             6 * n * sizeof(RealType));
+  file.write(reinterpret_cast<const char *>(mass_.data()),
+             n * sizeof(RealType));
+  file.close();
+
+  if (!file) {
+    std::cerr << "Failed to write the snapshot " << name.str()
+              << "; no more snapshots are written\n";
+    return false;
+  }
+  num_written_++;
+  bytes_written_ += sizeof(header) + 7 * n * sizeof(RealType);
+  return true;
+}
@@ -0,0 +1,94 @@
+//==============================================================
+// Copyright © 2020 Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+// =============================================================
+
+#ifndef _SNAPSHOTWRITER_HPP
+#define _SNAPSHOTWRITER_HPP
+
+#include <CL/sycl.hpp>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Particle.hpp"
+
+// Header of a snapshot file. It is followed by the arrays x, y, z, vx, vy, vz
+// and mass, of n values of type RealType each.
+struct SnapshotHeader {
+  char magic[8];       // "NBODYSNP"
+  uint32_t version;    // 1
+  uint32_t real_size;  // sizeof(RealType)
+  uint64_t n;          // number of particles
+  uint64_t step;       // integration step
+  double time;         // simulated time
+};
+
+// Writes snapshots of the particles to binary files without stalling the
+// simulation.
+//
+// Write() only enqueues copies of the positions and velocities from the
+// device into one of a rotating set of host staging buffers, and returns. A
+// background thread waits for each copy to complete and writes the snapshot
+// to a file with a few large sequential writes, after which the buffer is
+// free again. Write() only blocks when all the staging buffers are still
+// being written, and the time it spends blocked is accumulated.
+class SnapshotWriter {
+ public:
+  // mass is the host array of the n masses, which do not change during the
+  // simulation. The snapshot of step s is written to <prefix>_<s>.bin.
+  SnapshotWriter(sycl::queue &q, int n, const RealType *mass,
+                 const std::string &prefix, int num_buffers = 3);
+  ~SnapshotWriter();
+
+  // Enqueues the copy of the device USM positions and velocities of the
+  // particles at the given step, after the work already submitted to q
+  void Write(int step, double time, RealType *const pos[3],
+             RealType *const vel[3]);
+  // Waits for all the snapshots to be written
+  void Finish();
+
+  // Time spent in Write() waiting for a free staging buffer, in seconds
+  double BlockedTime() const { return blocked_time_; }
+  // Time spent in Finish() waiting for the last snapshots, in seconds
+  double DrainTime() const { return drain_time_; }
+  int NumWritten() const { return num_written_; }
+  uint64_t BytesWritten() const { return bytes_written_; }
+
+ private:
+  struct Staging {
+    RealType *data;                   // x, y, z, vx, vy, vz, in host USM
+    std::vector<sycl::event> copies;  // copies from the device into data
+    int step;
+    double time;
+  };
+
+  sycl::queue &q_;
+  int npart_;
+  std::vector<RealType> mass_;
+  std::string prefix_;
+
+  std::vector<Staging> buffers_;
+  std::deque<int> free_;     // staging buffers that Write() can fill
+  std::deque<int> pending_;  // staging buffers to write, in order
+  bool done_;                // no more snapshots after the pending ones
+  std::mutex mutex_;
+  std::condition_variable buffer_freed_;
+  std::condition_variable buffer_pending_;
+  std::thread thread_;
+
+  double blocked_time_;
+  double drain_time_;
+  int num_written_;
+  uint64_t bytes_written_;
+
+  void WriterLoop();
+  bool WriteFile(const Staging &buffer);
+};
+
+#endif
@@ -5,12 +5,17 @@
 // =============================================================
 
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include "GSimulation.hpp"
 
 int main(int argc, char** argv) {
   int n;      // number of particles
   int nstep;  // number ot integration steps
+  std::vector<char*> args;  // the arguments that are not options
+  int snapshot_freq = 0;    // steps between snapshots, 0 for none
+  std::string snapshot_prefix = "nbody";  // path prefix of the snapshots
 
   GSimulation sim;
 
@@ -19,16 +24,42 @@ int main(int argc, char** argv) {
   std::cout << "[ENV] SYCL_BE = " << (env ? env : "<not set>") << "\n";
 #endif
 
-  if (argc > 1) {
-    n = std::atoi(argv[1]);
+  // Options:
+  //   --barnes-hut           use the Barnes-Hut solver
+  //   --theta=<t>            use the Barnes-Hut solver with opening angle t
+  //   --validate             compare the Barnes-Hut solver with the direct one
+  //   --snapshot=<k>         write a snapshot of the particles every k steps
+  //   --snapshot-prefix=<p>  write the snapshots to <p>_<step>.bin
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--barnes-hut") {
+      sim.SetSolver(GSimulation::Solver::kBarnesHut);
+    } else if (arg.compare(0, 8, "--theta=") == 0) {
+      sim.SetSolver(GSimulation::Solver::kBarnesHut);
+      sim.SetTheta(std::atof(arg.c_str() + 8));
+    } else if (arg == "--validate") {
+      sim.SetValidate(true);
+    } else if (arg.compare(0, 11, "--snapshot=") == 0) {
+      snapshot_freq = std::atoi(arg.c_str() + 11);
+    } else if (arg.compare(0, 18, "--snapshot-prefix=") == 0) {
+      snapshot_prefix = arg.substr(18);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  sim.SetSnapshots(snapshot_freq, snapshot_prefix);
+
+  if (args.size() > 0) {
+    n = std::atoi(args[0]);
     sim.SetNumberOfParticles(n);
-    if (argc == 3) {
-      nstep = std::atoi(argv[2]);
+    if (args.size() == 2) {
+      nstep = std::atoi(args[1]);
       sim.SetNumberOfSteps(nstep);
     }
   }
 
-  sim.Start();
+  // A failed validation makes the run fail
+  if (!sim.Start()) return 1;
 
   return 0;
 }
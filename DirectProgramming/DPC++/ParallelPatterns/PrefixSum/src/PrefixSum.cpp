@@ -32,8 +32,13 @@
 // the number of iterations of the outer loop.
 //
 
+#include <algorithm>
+#include <cstdint>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <string>
+#include <vector>
 // dpc_common.hpp can be found in the dev-utilities include folder.
 // e.g., $ONEAPI_ROOT/dev-utilities/<version>/include/dpc_common.hpp
 #include "dpc_common.hpp"
@@ -51,53 +56,395 @@ void Show(int a[], int arraysize) {
   return;
 }
 
-int* ParallelPrefixSum(int* current, int* next, unsigned int nb, queue& q) {
+// Runs the Hillis-Steele scan of the nb elements of sequence_buf, using
+// sequence_next_buf as the second array. Returns true if the result is in
+// sequence_next_buf, and false if it is in sequence_buf.
+bool HillisSteeleScan(buffer<int>& sequence_buf,
+                      buffer<int>& sequence_next_buf, unsigned int nb,
+                      queue& q) {
   unsigned int two_power = 1;
   unsigned int num_iter = log2(nb);
-  // unsigned int uintmax = UINT_MAX;
+  bool result_in_next = false;
+
+  // Iterate over the necessary iterations.
+  for (unsigned int iter = 0; iter < num_iter; iter++, two_power *= 2) {
+    // Submit command group for execution
+    q.submit([&](auto& h) {
+      // Create accessors
+      accessor sequence(sequence_buf, h);
+      accessor sequence_next(sequence_next_buf, h);
+
+      if (iter % 2 == 0) {
+        h.parallel_for(nb, [=](id<1> j) {
+          if (j < two_power) {
+            sequence_next[j] = sequence[j];
+          } else {
+            sequence_next[j] = sequence[j] + sequence[j - two_power];
+          }
+        });  // end parallel for loop in kernel
+        result_in_next = true;
+      } else {
+        h.parallel_for(nb, [=](id<1> j) {
+          if (j < two_power) {
+            sequence[j] = sequence_next[j];
+          } else {
+            sequence[j] = sequence_next[j] + sequence_next[j - two_power];
+          }
+        });  // end parallel for loop in kernel
+        result_in_next = false;
+      }
+    });  // end device queue
+  }      // end iteration
+
+  return result_in_next;
+}
+
+int* ParallelPrefixSum(int* current, int* next, unsigned int nb, queue& q) {
   int* result = NULL;
 
-  //  cout << "uintmax " << uintmax << " " << log2(uintmax) << "\n";
   // Buffer scope
   {
     buffer sequence_buf(current, range(nb));
     buffer sequence_next_buf(next, range(nb));
 
-    // Iterate over the necessary iterations.
-    for (unsigned int iter = 0; iter < num_iter; iter++, two_power *= 2) {
-      // Submit command group for execution
-      q.submit([&](auto& h) {
-        // Create accessors
-        accessor sequence(sequence_buf, h);
-        accessor sequence_next(sequence_next_buf, h);
-
-        if (iter % 2 == 0) {
-          h.parallel_for(nb, [=](id<1> j) {
-            if (j < two_power) {
-              sequence_next[j] = sequence[j];
-            } else {
-              sequence_next[j] = sequence[j] + sequence[j - two_power];
-            }
-          });  // end parallel for loop in kernel
-          result = next;
+    bool result_in_next =
+        HillisSteeleScan(sequence_buf, sequence_next_buf, nb, q);
+    result = result_in_next ? next : current;
+  }  // Buffer scope
+
+  // Wait for commands to complete. Enforce synchronization on the command queue
+  q.wait_and_throw();
+
+  return result;
+}
+
+// Decoupled look-back scan: a single-pass scan in which each work-group scans
+// one tile of the input, and finds the sum of all the tiles before its own by
+// looking back at the descriptors that the other work-groups publish, rather
+// than in a second pass over the data. Each element is read and written once,
+// in a single kernel.
+//
+// Each work-group:
+//  1. Takes the next tile id from a global counter. Tiles are numbered in the
+//     order the work-groups start, not by group id, so that every tile a
+//     work-group waits for belongs to a work-group that is already running.
+//  2. Loads its tile into local memory, and scans it: each work-item adds its
+//     kScanItemsPerWorkItem consecutive elements, and the work-group scans
+//     the work-item sums.
+//  3. Publishes the sum of the tile (its aggregate) in the tile's descriptor,
+//     then looks back at the descriptors of the previous tiles, adding their
+//     aggregates until it finds one with an inclusive prefix, i.e. the sum
+//     of all the elements up to and including that tile. It then publishes
+//     its own inclusive prefix, which ends the look-back of the later tiles.
+//  4. Adds the sum of the previous tiles to its scan, and stores the tile.
+//
+// The status of a descriptor is written with release semantics after its
+// value, and read with acquire semantics before it, so a work-group never
+// sees a status without its value.
+constexpr size_t kScanWorkGroupSize = 256;
+constexpr size_t kScanItemsPerWorkItem = 8;
+
+enum TileStatus : uint32_t { kTileInvalid = 0, kTileAggregate, kTilePrefix };
+
+// std has an atomic_ref and a memory_order too
+using global_atomic_ref =
+    sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed,
+                     sycl::memory_scope::device,
+                     access::address_space::global_space>;
+
+template <typename T>
+void DecoupledLookbackScan(buffer<T>& in_buf, buffer<T>& out_buf, size_t n,
+                           bool inclusive, queue& q) {
+  if (n == 0) return;
+
+  const size_t wg_size =
+      min(kScanWorkGroupSize,
+          q.get_device().get_info<info::device::max_work_group_size>());
+  const size_t tile_size = wg_size * kScanItemsPerWorkItem;
+  const size_t num_tiles = (n + tile_size - 1) / tile_size;
+
+  // The tile descriptors, and the counter that hands out the tile ids
+  buffer<uint32_t> status_buf{range(num_tiles)};
+  buffer<T> aggregate_buf{range(num_tiles)};
+  buffer<T> prefix_buf{range(num_tiles)};
+  buffer<uint32_t> counter_buf{range(1)};
+
+  q.submit([&](auto& h) {
+    accessor status(status_buf, h, write_only, no_init);
+    h.fill(status, uint32_t(kTileInvalid));
+  });
+  q.submit([&](auto& h) {
+    accessor counter(counter_buf, h, write_only, no_init);
+    h.fill(counter, uint32_t(0));
+  });
+
+  q.submit([&](auto& h) {
+    accessor in(in_buf, h, read_only);
+    accessor out(out_buf, h, write_only, no_init);
+    accessor status(status_buf, h);
+    accessor aggregate(aggregate_buf, h);
+    accessor prefix(prefix_buf, h);
+    accessor counter(counter_buf, h);
+
+    // The tile, the sum of the previous tiles and the tile id, shared by the
+    // work-items of the work-group
+    accessor<T, 1, access::mode::read_write, access::target::local> tile(
+        range<1>(tile_size), h);
+    accessor<T, 1, access::mode::read_write, access::target::local>
+        tile_exclusive(range<1>(1), h);
+    accessor<uint32_t, 1, access::mode::read_write, access::target::local>
+        tile_id_local(range<1>(1), h);
+
+    h.parallel_for(nd_range(range(num_tiles * wg_size), range(wg_size)),
+                   [=](nd_item<1> it) {
+      const size_t lid = it.get_local_id(0);
+      auto g = it.get_group();
+
+      if (lid == 0) {
+        tile_id_local[0] = global_atomic_ref(counter[0]).fetch_add(1u);
+      }
+      it.barrier(access::fence_space::local_space);
+      const size_t tile_id = tile_id_local[0];
+      const size_t base = tile_id * tile_size;
+
+      // Load the tile with consecutive work-items reading consecutive
+      // elements. The elements past the end of the input are 0, which does
+      // not change the sums.
+      for (size_t k = 0; k < kScanItemsPerWorkItem; k++) {
+        const size_t i = k * wg_size + lid;
+        tile[i] = base + i < n ? in[base + i] : T(0);
+      }
+      it.barrier(access::fence_space::local_space);
+
+      // Scan the sums of the kScanItemsPerWorkItem consecutive elements of
+      // each work-item
+      T item_sum = 0;
+      for (size_t k = 0; k < kScanItemsPerWorkItem; k++)
+        item_sum += tile[lid * kScanItemsPerWorkItem + k];
+      const T item_exclusive =
+          exclusive_scan_over_group(g, item_sum, sycl::plus<T>());
+      const T tile_sum =
+          group_broadcast(g, item_exclusive + item_sum, wg_size - 1);
+
+      // Publish the tile's aggregate, and look back for the sum of the
+      // previous tiles
+      if (lid == 0) {
+        T exclusive = 0;
+        if (tile_id == 0) {
+          prefix[0] = tile_sum;
+          global_atomic_ref(status[0])
+              .store(kTilePrefix, sycl::memory_order::release);
         } else {
-          h.parallel_for(nb, [=](id<1> j) {
-            if (j < two_power) {
-              sequence[j] = sequence_next[j];
-            } else {
-              sequence[j] = sequence_next[j] + sequence_next[j - two_power];
+          aggregate[tile_id] = tile_sum;
+          global_atomic_ref(status[tile_id])
+              .store(kTileAggregate, sycl::memory_order::release);
+
+          for (size_t j = tile_id - 1;; j--) {
+            uint32_t s;
+            do {
+              s = global_atomic_ref(status[j])
+                      .load(sycl::memory_order::acquire);
+            } while (s == kTileInvalid);
+
+            if (s == kTilePrefix) {
+              exclusive += prefix[j];
+              break;
             }
-          });  // end parallel for loop in kernel
-          result = current;
+            exclusive += aggregate[j];
+          }
+
+          prefix[tile_id] = exclusive + tile_sum;
+          global_atomic_ref(status[tile_id])
+              .store(kTilePrefix, sycl::memory_order::release);
         }
-      });  // end device queue
-    }      // end iteration
-  }        // Buffer scope
+        tile_exclusive[0] = exclusive;
+      }
+      it.barrier(access::fence_space::local_space);
+
+      // Scan the elements of each work-item, starting from the sum of all the
+      // elements before them
+      T running = tile_exclusive[0] + item_exclusive;
+      for (size_t k = 0; k < kScanItemsPerWorkItem; k++) {
+        const size_t i = lid * kScanItemsPerWorkItem + k;
+        const T x = tile[i];
+        if (inclusive) {
+          running += x;
+          tile[i] = running;
+        } else {
+          tile[i] = running;
+          running += x;
+        }
+      }
+      it.barrier(access::fence_space::local_space);
+
+      for (size_t k = 0; k < kScanItemsPerWorkItem; k++) {
+        const size_t i = k * wg_size + lid;
+        if (base + i < n) out[base + i] = tile[i];
+      }
+    });
+  });
+}
+
+// Computes the inclusive or exclusive prefix sum of the n elements of data
+// into result with the decoupled look-back scan.
+template <typename T>
+void LookbackPrefixSum(T* data, T* result, size_t n, bool inclusive,
+                       queue& q) {
+  // Buffer scope
+  {
+    buffer data_buf(data, range(n));
+    buffer result_buf(result, range(n));
+    DecoupledLookbackScan(data_buf, result_buf, n, inclusive, q);
+  }  // Buffer scope
 
-  // Wait for commands to complete. Enforce synchronization on the command queue
   q.wait_and_throw();
+}
 
-  return result;
+// Verifies that result is the inclusive or exclusive prefix sum of data
+template <typename T>
+bool CheckPrefixSum(const T* data, const T* result, size_t n, bool inclusive) {
+  T sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (inclusive) sum += data[i];
+    if (result[i] != sum) return false;
+    if (!inclusive) sum += data[i];
+  }
+  return true;
+}
+
+// Returns the largest value (at most 9) that the random elements of a scan
+// of n elements of type T can take, so that the sums cannot overflow T.
+template <typename T>
+int MaxElement(size_t n) {
+  return std::min<size_t>(9, numeric_limits<T>::max() / std::max<size_t>(n, 1));
+}
+
+// Runs the decoupled look-back scan on n random elements of type T, checks
+// the result and prints the time it took.
+template <typename T>
+bool RunLookbackPrefixSum(size_t n, bool inclusive, const char* type_name,
+                          queue& q) {
+  vector<T> data(n), result(n);
+  const int max_element = MaxElement<T>(n);
+  for (size_t i = 0; i < n; i++) data[i] = rand() % (max_element + 1);
+
+  dpc_common::TimeInterval t;
+  LookbackPrefixSum(data.data(), result.data(), n, inclusive, q);
+  auto elapsed_time = t.Elapsed();
+
+  bool equal = CheckPrefixSum(data.data(), result.data(), n, inclusive);
+  cout << "  " << (inclusive ? "inclusive" : "exclusive") << ", " << type_name
+       << ", " << n << " elements: " << elapsed_time << " s, "
+       << (equal ? "Success" : "Failed") << "\n";
+  return equal;
+}
+
+// Returns the bandwidth in GB/s of a scan of n elements of type T that took
+// the given time. A scan reads and writes each element at least once, so
+// this is the bandwidth the scan would need if it did nothing else.
+template <typename T>
+double ScanBandwidth(size_t n, double seconds) {
+  return 2.0 * n * sizeof(T) / seconds * 1e-9;
+}
+
+// Times fn, which submits a scan, and returns the best of kRuns runs after
+// one untimed run. reset, which is not timed, runs before each run.
+template <typename F, typename R>
+double BestTime(F fn, R reset, queue& q) {
+  constexpr int kRuns = 5;
+  double best = numeric_limits<double>::max();
+  for (int run = 0; run <= kRuns; run++) {
+    reset();
+    q.wait_and_throw();
+    dpc_common::TimeInterval t;
+    fn();
+    q.wait_and_throw();
+    if (run > 0) best = min(best, t.Elapsed());
+  }
+  return best;
+}
+
+template <typename F>
+double BestTime(F fn, queue& q) {
+  return BestTime(fn, [] {}, q);
+}
+
+// Compares the Hillis-Steele scan with the decoupled look-back scan, on data
+// already on the device, for sizes 2^10 to 2^max_exponent. The decoupled
+// look-back scan also runs on a size that is not a power of 2.
+int Benchmark(int max_exponent, queue& q) {
+  cout << "Bandwidth in GB/s, counting one read and one write per element\n";
+  cout << setw(12) << "Elements" << setw(16) << "Hillis-Steele" << setw(16)
+       << "Look-back i32" << setw(16) << "Exclusive i32" << setw(16)
+       << "Look-back i64" << "\n";
+
+  bool equal = true;
+  for (int e = 10; e <= max_exponent; e += 2) {
+    for (size_t n : {size_t(1) << e, (size_t(1) << e) * 3 / 4 + 1}) {
+      const bool power_of_2 = (n & (n - 1)) == 0;
+      vector<int> data(n), result(n);
+      vector<int64_t> data64(n), result64(n);
+      const int max_element = MaxElement<int>(n);
+      for (size_t i = 0; i < n; i++)
+        data64[i] = data[i] = rand() % (max_element + 1);
+
+      buffer<int> a_buf{range(n)}, b_buf{range(n)}, out_buf{range(n)};
+      buffer<int64_t> a64_buf{range(n)}, out64_buf{range(n)};
+      auto restore_input = [&] {
+        q.submit([&](auto& h) {
+          accessor a(a_buf, h, write_only, no_init);
+          h.copy(data.data(), a);
+        });
+      };
+      restore_input();
+      q.submit([&](auto& h) {
+        accessor a(a64_buf, h, write_only, no_init);
+        h.copy(data64.data(), a);
+      });
+
+      cout << setw(12) << n << fixed << setprecision(2);
+      if (power_of_2) {
+        // The scan works in place, so the input is restored before each run
+        double t = BestTime([&] { HillisSteeleScan(a_buf, b_buf, n, q); },
+                            restore_input, q);
+        cout << setw(16) << ScanBandwidth<int>(n, t);
+        restore_input();
+      } else {
+        cout << setw(16) << "-";
+      }
+
+      double t = BestTime(
+          [&] { DecoupledLookbackScan(a_buf, out_buf, n, true, q); }, q);
+      cout << setw(16) << ScanBandwidth<int>(n, t);
+      {
+        host_accessor out(out_buf, read_only);
+        equal = equal && CheckPrefixSum(data.data(), &out[0], n, true);
+      }
+
+      t = BestTime(
+          [&] { DecoupledLookbackScan(a_buf, out_buf, n, false, q); }, q);
+      cout << setw(16) << ScanBandwidth<int>(n, t);
+      {
+        host_accessor out(out_buf, read_only);
+        equal = equal && CheckPrefixSum(data.data(), &out[0], n, false);
+      }
+
+      t = BestTime(
+          [&] { DecoupledLookbackScan(a64_buf, out64_buf, n, true, q); }, q);
+      cout << setw(16) << ScanBandwidth<int64_t>(n, t) << "\n";
+      {
+        host_accessor out(out64_buf, read_only);
+        equal = equal && CheckPrefixSum(data64.data(), &out[0], n, true);
+      }
+    }
+  }
+
+  if (!equal) {
+    cout << "\nFailed: " << std::endl;
+    return -2;
+  }
+  cout << "\nSuccess!" << std::endl;
+  return 0;
 }
 /*
 void PrefixSum(int* x, unsigned int nb)
@@ -123,18 +470,38 @@ void PrefixSum(int* x, unsigned int nb)
 */
 void Usage(string prog_name, int exponent) {
   cout << " Incorrect parameters\n";
-  cout << " Usage: " << prog_name << " n k \n\n";
+  cout << " Usage: " << prog_name << " n k \n";
+  cout << "        " << prog_name << " --benchmark [n]\n\n";
   cout << " n: Integer exponent presenting the size of the input array.\n";
   cout << "    The number of element in the array must be power of 2\n";
   cout << "    (e.g., 1, 2, 4, ...). Please enter the corresponding exponent\n";
   cout << "    betwwen 0 and " << exponent - 1 << ".\n";
   cout << " k: Seed used to generate a random sequence.\n";
+  cout << " --benchmark: compare the bandwidth of the scans for sizes up to\n";
+  cout << "    2^n (default 2^24).\n";
 }
 
 int main(int argc, char* argv[]) {
   unsigned int nb, seed;
   int n, exp_max = log2(numeric_limits<int>::max());
 
+  if (argc > 1 && string(argv[1]) == "--benchmark") {
+    try {
+      n = argc > 2 ? stoi(argv[2]) : 24;
+    } catch (...) {
+      Usage(argv[0], exp_max);
+      return -1;
+    }
+    if (n < 10 || n >= exp_max) {
+      Usage(argv[0], exp_max);
+      return -1;
+    }
+
+    queue q(default_selector{}, dpc_common::exception_handler);
+    cout << "Device: " << q.get_device().get_info<info::device::name>() << "\n";
+    return Benchmark(n, q);
+  }
+
   // Read parameters.
   try {
     n = stoi(argv[1]);
@@ -172,9 +539,11 @@ int main(int argc, char* argv[]) {
 
   srand(seed);
 
-  // Initialize data arrays
+  // Initialize data arrays, with values small enough that the sums fit in
+  // an int
+  const int max_element = MaxElement<int>(nb);
   for (int i = 0; i < nb; i++) {
-    data[i] = prefix_sum1[i] = rand() % 10;
+    data[i] = prefix_sum1[i] = rand() % (max_element + 1);
     prefix_sum2[i] = 0;
   }
 
@@ -207,6 +576,14 @@ int main(int argc, char* argv[]) {
   delete[] prefix_sum1;
   delete[] prefix_sum2;
 
+  // The single-pass decoupled look-back scan, in both modes, with 32 and 64
+  // bit elements, and on a length that is not a power of 2
+  cout << "Decoupled look-back scan:\n";
+  equal = RunLookbackPrefixSum<int>(nb, true, "int32", q) && equal;
+  equal = RunLookbackPrefixSum<int>(nb, false, "int32", q) && equal;
+  equal = RunLookbackPrefixSum<int64_t>(nb, true, "int64", q) && equal;
+  equal = RunLookbackPrefixSum<int>(nb / 3 * 2 + 1, true, "int32", q) && equal;
+
   if (!equal) {
     cout << "\nFailed: " << std::endl;
     return -2;
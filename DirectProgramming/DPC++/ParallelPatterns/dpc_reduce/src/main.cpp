@@ -16,6 +16,7 @@
 #include <iomanip>  // setprecision library
 #include <iostream>
 #include <numeric> 
+#include <tuple>
 
 // dpc_common.hpp can be found in the dev-utilities include folder.
 // e.g., $ONEAPI_ROOT/dev-utilities/<version>/include/dpc_common.hpp
@@ -170,113 +171,6 @@ struct slice_area {
 };
 
 
-// a way to get value_type from both accessors and USM that is needed for transform_init
-template <typename Unknown>
-struct accessor_traits_impl
-{
-};
-
-template <typename T, int Dim, sycl::access::mode AccMode, sycl::access::target AccTarget,
-          sycl::access::placeholder Placeholder>
-struct accessor_traits_impl<sycl::accessor<T, Dim, AccMode, AccTarget, Placeholder>>
-{
-    using value_type = typename sycl::accessor<T, Dim, AccMode, AccTarget, Placeholder>::value_type;
-};
-
-template <typename RawArrayValueType>
-struct accessor_traits_impl<RawArrayValueType*>
-{
-    using value_type = RawArrayValueType;
-};
-
-template <typename Unknown>
-using accessor_traits = accessor_traits_impl<typename std::decay<Unknown>::type>;
-
-// calculate shift where we should start processing on current item
-template <typename NDItemId, typename GlobalIdx, typename SizeNIter, typename SizeN>
-SizeN
-calc_shift(const NDItemId item_id, const GlobalIdx global_idx, SizeNIter& n_iter, const SizeN n)
-{
-    auto global_range_size = item_id.get_global_range().size();
-
-    auto start = n_iter * global_idx;
-    auto global_shift = global_idx + n_iter * global_range_size;
-    if (n_iter > 0 && global_shift > n)
-    {
-        start += n % global_range_size - global_idx;
-    }
-    else if (global_shift < n)
-    {
-        n_iter++;
-    }
-    return start;
-}
-
-
-template <typename ExecutionPolicy, typename Operation1, typename Operation2>
-struct transform_init
-{
-    Operation1 binary_op;
-    Operation2 unary_op;
-
-    template <typename NDItemId, typename GlobalIdx, typename Size, typename AccLocal, typename... Acc>
-    void
-    operator()(const NDItemId item_id, const GlobalIdx global_idx, Size n, AccLocal& local_mem,
-               const Acc&... acc) const 
-    {
-        auto local_idx = item_id.get_local_id(0);
-        auto global_range_size = item_id.get_global_range().size();
-        auto n_iter = n / global_range_size;
-        auto start = calc_shift(item_id, global_idx, n_iter, n);
-        auto shifted_global_idx = global_idx + start;
-
-        typename accessor_traits<AccLocal>::value_type res;
-        if (global_idx < n)
-        {
-            res = unary_op(shifted_global_idx, acc...);
-        }
-        // Add neighbour to the current local_mem
-        for (decltype(n_iter) i = 1; i < n_iter; ++i)
-        {
-            res = binary_op(res, unary_op(shifted_global_idx + i, acc...));
-        }
-        if (global_idx < n)
-        {
-            local_mem[local_idx] = res;
-        }
-    }
-};
-
-
-// Reduce on local memory
-template <typename ExecutionPolicy, typename BinaryOperation1, typename Tp>
-struct reduce
-{
-    BinaryOperation1 bin_op1;
-
-    template <typename NDItemId, typename GlobalIdx, typename Size, typename AccLocal>
-    Tp
-    operator()(const NDItemId item_id, const GlobalIdx global_idx, const Size n, AccLocal& local_mem) const 
-    {
-        auto local_idx = item_id.get_local_id(0);
-        auto group_size = item_id.get_local_range().size();
-
-        auto k = 1;
-        do
-        {
-            item_id.barrier(sycl::access::fence_space::local_space);
-            if (local_idx % (2 * k) == 0 && local_idx + k < group_size && global_idx < n &&
-                global_idx + k < n)
-            {
-                local_mem[local_idx] = bin_op1(local_mem[local_idx], local_mem[local_idx + k]);
-            }
-            k *= 2;
-        } while (k < group_size);
-        return local_mem[local_idx];
-    }
-};
-
-
 // walk through the data
 template <typename ExecutionPolicy, typename F>
 struct walk_n
@@ -291,10 +185,125 @@ struct walk_n
     }
 };
 
+// Reduces x over the work-group of item_id: first within each sub-group, and
+// then the sub-group results, which go through local memory, within the first
+// sub-group. The result is only valid in work-item 0. binary_op must be one of
+// the function objects that reduce_over_group supports, e.g. std::plus.
+template <typename T, typename BinaryOperation, typename AccLocal>
+T reduce_work_group(const nd_item<1>& item_id, T x, T identity,
+                    BinaryOperation binary_op,
+                    const AccLocal& sub_group_results) {
+  auto sg = item_id.get_sub_group();
+  auto sg_id = sg.get_group_id()[0];
+  auto sg_local_id = sg.get_local_id()[0];
+
+  x = reduce_over_group(sg, x, binary_op);
+  if (sg_local_id == 0) sub_group_results[sg_id] = x;
+  item_id.barrier(access::fence_space::local_space);
+
+  if (sg_id == 0) {
+    x = identity;
+    for (size_t i = sg_local_id; i < sg.get_group_range()[0];
+         i += sg.get_local_range()[0])
+      x = binary_op(x, sub_group_results[i]);
+    x = reduce_over_group(sg, x, binary_op);
+  }
+  return x;
+}
+
+// Computes binary_op(identity, unary_op(0, acc...), ...,
+// unary_op(n - 1, acc...)) in a single kernel, where acc... are read-only
+// accessors to bufs. The transform is fused into the reduction, so nothing is
+// written to global memory but one partial result per work-group:
+//  1. Each work-item transforms and reduces the elements i, i + global range,
+//     i + 2 * global range, ... in registers.
+//  2. The work-group reduces the results of its work-items, first within each
+//     sub-group, and then across the sub-groups.
+//  3. Each work-group stores its result and counts itself done with a
+//     device-scope atomic. The last work-group to finish reduces the results
+//     of all the work-groups.
+// The number of work-groups is the number of compute units, or fewer if n is
+// small, so the last work-group has few results to reduce.
+template <typename T, typename BinaryOperation, typename UnaryOperation,
+          typename... Buffers>
+T transform_reduce_single_kernel(queue& q, size_t n, T identity,
+                                 BinaryOperation binary_op,
+                                 UnaryOperation unary_op, Buffers&... bufs) {
+  auto workgroup_size =
+      q.get_device().template get_info<info::device::max_work_group_size>();
+  auto max_comp_u =
+      q.get_device().template get_info<info::device::max_compute_units>();
+  auto n_groups = (n - 1) / workgroup_size + 1;
+  n_groups = std::min(decltype(n_groups)(max_comp_u), n_groups);
+
+  buffer<T, 1> partial_buf{range<1>(n_groups)};
+  buffer<T, 1> result_buf{range<1>(1)};
+  unsigned int zero = 0;
+  buffer<unsigned int, 1> done_buf{&zero, range<1>(1)};
+
+  q.submit([&](handler& h) {
+    auto accs = std::make_tuple(accessor(bufs, h, read_only)...);
+    accessor partial_acc(partial_buf, h);
+    accessor result_acc(result_buf, h, write_only, no_init);
+    accessor done_acc(done_buf, h);
+    // One entry per sub-group; a work-group has at most one sub-group per
+    // work-item
+    accessor<T, 1, access::mode::read_write, access::target::local>
+        sub_group_results(range<1>(workgroup_size), h);
+    accessor<bool, 1, access::mode::read_write, access::target::local> is_last(
+        range<1>(1), h);
+
+    h.parallel_for(
+        nd_range<1>(range<1>(n_groups * workgroup_size),
+                    range<1>(workgroup_size)),
+        [=](nd_item<1> item_id) {
+          auto local_idx = item_id.get_local_id(0);
+          auto global_range_size = item_id.get_global_range(0);
+
+          // 1. Transform and reduce within the work-item
+          T x = identity;
+          for (size_t i = item_id.get_global_id(0); i < n;
+               i += global_range_size)
+            x = binary_op(x, std::apply(
+                                 [&](const auto&... acc) {
+                                   return unary_op(i, acc...);
+                                 },
+                                 accs));
+
+          // 2. Reduce within the work-group
+          x = reduce_work_group(item_id, x, identity, binary_op,
+                                sub_group_results);
+
+          // 3. The last work-group to finish reduces the work-group results
+          if (local_idx == 0) {
+            partial_acc[item_id.get_group(0)] = x;
+            atomic_ref<unsigned int, memory_order::acq_rel,
+                       memory_scope::device,
+                       access::address_space::global_space>
+                done(done_acc[0]);
+            is_last[0] = done.fetch_add(1u) == n_groups - 1;
+          }
+          item_id.barrier(access::fence_space::global_and_local);
+
+          if (is_last[0]) {
+            x = identity;
+            for (size_t g = local_idx; g < n_groups; g += workgroup_size)
+              x = binary_op(x, partial_acc[g]);
+            x = reduce_work_group(item_id, x, identity, binary_op,
+                                  sub_group_results);
+            if (local_idx == 0) result_acc[0] = x;
+          }
+        });
+  });
+
+  host_accessor answer(result_buf, read_only);
+  return answer[0];
+}
+
 
 // This option uses a parallel for to fill the buffer and then
-// uses a tranform_init with plus/no_op and then
-// a local reduction then global reduction.
+// transform_reduce_single_kernel with plus/no_op to reduce it: the work-group
+// and the global reductions are done by a single kernel.
 template <typename Policy>
 float calc_pi_onedpl_native3(size_t num_steps, int groups, Policy&& policy) {
   float data[num_steps];
@@ -311,89 +320,22 @@ float calc_pi_onedpl_native3(size_t num_steps, int groups, Policy&& policy) {
       writeresult[idx[0]] = 4.0f / (1.0f + x * x);
     });
   });
-  policy.queue().wait();
 
   using Functor = walk_n<Policy, my_no_op>;
 
-  // Functor will do nothing for tranform_init and will use plus for reduce.
-  // In this example we have done the calculation and filled the buffer above
-  // The way transform_init works is that you need to have the value already
-  // populated in the buffer.
-  auto tf_init = transform_init<Policy, std::plus<float>,
-                   Functor>{std::plus<float>(), Functor{my_no_op()}};
-
-  auto combine = std::plus<float>();
-  auto brick_reduce = reduce<Policy, std::plus<float>, float>{
-          std::plus<float>()};
-  auto workgroup_size =
-      policy.queue()
-          .get_device()
-          .template get_info<info::device::max_work_group_size>();
-  auto max_comp_u = policy.queue()
-                        .get_device()
-                        .template get_info<info::device::max_compute_units>();
-  auto n_groups = (num_steps - 1) / workgroup_size + 1;
-  n_groups =
-      std::min(decltype(n_groups)(max_comp_u),
-               n_groups);  // make groups max number of compute units or less
-
-  // 0. Create temporary global buffer to store temporary value
-  auto temp_buf = buffer<float, 1>(range<1>(n_groups));
-  // 1. Reduce over each work_group
-  auto local_reduce_event =
-      policy.queue().submit([&buf, &temp_buf, &brick_reduce, &tf_init,
-                             num_steps, n_groups, workgroup_size](handler& h) {
-        accessor access_buf(buf,h);
-        accessor temp_acc(temp_buf,h,write_only);
-        // Create temporary local buffer
-        accessor<float, 1, access::mode::read_write, access::target::local>
-            temp_buf_local(range<1>(workgroup_size), h);
-        h.parallel_for(nd_range<1>(range<1>(n_groups * workgroup_size),
-                                   range<1>(workgroup_size)),
-                       [=](nd_item<1> item_id) {
-                         auto global_idx = item_id.get_global_id(0);
-                         // 1. Initialization (transform part).
-                         tf_init(item_id, global_idx, num_steps,
-                                 temp_buf_local, access_buf);
-                         // 2. Reduce within work group
-                         float local_result = brick_reduce(
-                             item_id, global_idx, num_steps, temp_buf_local);
-                         if (item_id.get_local_id(0) == 0) {
-                           temp_acc[item_id.get_group(0)] = local_result;
-                         }
-                       });
-      });
+  // Functor will do nothing for the transform and will use plus for reduce.
+  // In this example we have done the calculation and filled the buffer above,
+  // so the transform only reads the value already populated in the buffer.
+  float result = transform_reduce_single_kernel(
+      policy.queue(), num_steps, 0.0f, std::plus<float>(),
+      Functor{my_no_op()}, buf);
 
-  // 2. global reduction
-  auto reduce_event = local_reduce_event;
-  if (n_groups > 1) {
-    auto countby2 = decltype(n_groups)(1);
-    do {
-      reduce_event = policy.queue().submit([&reduce_event, &temp_buf, &combine,
-                                            countby2, n_groups](handler& h) {
-        h.depends_on(reduce_event);
-        accessor temp_acc(temp_buf,h);
-        h.parallel_for(range<1>(n_groups), [=](item<1> item_id) {
-          auto global_idx = item_id.get_linear_id();
-
-          if (global_idx % (2 * countby2) == 0 &&
-              global_idx + countby2 < n_groups) {
-            temp_acc[global_idx] =
-                combine(temp_acc[global_idx], temp_acc[global_idx + countby2]);
-          }
-        });
-      });
-      countby2 *= 2;
-    } while (countby2 < n_groups);
-  }
-  
-  host_accessor answer(temp_buf,read_only) ; 
-  return answer[0]/(float)num_steps; 
+  return result / (float)num_steps;
 }
 
 // onedpl_native4 fills a buffer with number 1...num_steps and then
-// calls transform_init to calculate the slices and then
-// does a reduction in two steps - global and then local.
+// calls transform_reduce_single_kernel, which calculates the slices and
+// reduces them in the same kernel.
 template <typename Policy>
 float calc_pi_onedpl_native4(size_t num_steps, int groups, Policy&& policy) {
   std::vector<float> data(num_steps);
@@ -406,92 +348,29 @@ float calc_pi_onedpl_native4(size_t num_steps, int groups, Policy&& policy) {
     h.parallel_for(range<1>{num_steps},
                    [=](id<1> idx) { writeresult[idx[0]] = (float)idx[0]; });
   });
-  policy.queue().wait();
 
   using Functor2 = walk_n<Policy, slice_area>;
 
   // The buffer has 1...num it at and now we will use that as an input
   // to the slice structue which will calculate the area of each
   // rectangle.
-  auto tf_init = transform_init<Policy, std::plus<float>,
-                                                 Functor2>{
-          std::plus<float>(), Functor2{slice_area(num_steps)}};
-
-  auto combine = std::plus<float>();
-  auto brick_reduce = reduce<Policy, std::plus<float>, float>{
-          std::plus<float>()};
-
-  // get workgroup_size from the device
-  auto workgroup_size =
-      policy.queue()
-          .get_device()
-          .template get_info<info::device::max_work_group_size>();
+  float result = transform_reduce_single_kernel(
+      policy.queue(), num_steps, 0.0f, std::plus<float>(),
+      Functor2{slice_area(num_steps)}, buf2);
 
-  // get number of compute units from device.
-  auto max_comp_u = policy.queue()
-                        .get_device()
-                        .template get_info<info::device::max_compute_units>();
-
-  auto n_groups = (num_steps - 1) / workgroup_size + 1;
-
-  // use the smaller of the number of workgroups device has or the
-  // number of steps/workgroups
-  n_groups = std::min(decltype(n_groups)(max_comp_u), n_groups);
+  return result / (float)num_steps;
+}
 
-  // Create temporary global buffer to store temporary value
-  auto temp_buf = buffer<float, 1>(range<1>(n_groups));
-
-  // Reduce over each work_group
-  auto local_reduce_event =
-      policy.queue().submit([&buf2, &temp_buf, &brick_reduce, &tf_init,
-                             num_steps, n_groups, workgroup_size](handler& h) {
-        // grab access to the previous input
-        accessor access_buf(buf2,h);
-        accessor temp_acc(temp_buf,h,write_only);
-        // Create temporary local buffer
-        accessor<float, 1, access::mode::read_write, access::target::local>
-            temp_buf_local(range<1>(workgroup_size), h);
-        h.parallel_for(nd_range<1>(range<1>(n_groups * workgroup_size),
-                                   range<1>(workgroup_size)),
-                       [=](nd_item<1> item_id) {
-                         auto global_idx = item_id.get_global_id(0);
-                         // 1. Initialization (transform part). Fill local
-                         // memory
-                         tf_init(item_id, global_idx, num_steps,
-                                 temp_buf_local, access_buf);
-                         // 2. Reduce within work group
-                         float local_result = brick_reduce(
-                             item_id, global_idx, num_steps, temp_buf_local);
-                         if (item_id.get_local_id(0) == 0) {
-                           temp_acc[item_id.get_group(0)] = local_result;
-                         }
-                       });
-      });
+// onedpl_native5 needs no buffer at all: transform_reduce_single_kernel
+// calculates the area of each rectangle from its index and reduces the areas
+// in one kernel, the only kernel this function launches.
+template <typename Policy>
+float calc_pi_onedpl_native5(size_t num_steps, Policy&& policy) {
+  float result = transform_reduce_single_kernel(
+      policy.queue(), num_steps, 0.0f, std::plus<float>(),
+      slice_area(num_steps));
 
-  // global reduction
-  auto reduce_event = local_reduce_event;
-  if (n_groups > 1) {
-    auto countby2 = decltype(n_groups)(1);
-    do {
-      reduce_event = policy.queue().submit([&reduce_event, &temp_buf, &combine,
-                                            countby2, n_groups](handler& h) {
-        h.depends_on(reduce_event);
-        accessor temp_acc(temp_buf,h);
-        h.parallel_for(range<1>(n_groups), [=](item<1> item_id) {
-          auto global_idx = item_id.get_linear_id();
-
-          if (global_idx % (2 * countby2) == 0 &&
-              global_idx + countby2 < n_groups) {
-            temp_acc[global_idx] =
-                combine(temp_acc[global_idx], temp_acc[global_idx + countby2]);
-          }
-        });
-      });
-      countby2 *= 2;
-    } while (countby2 < n_groups);
-  }
-  host_accessor answer(temp_buf,read_only) ; 
-  return answer[0]/(float)num_steps; 
+  return result / (float)num_steps;
 }
 
 // This function shows the use of two different oneAPI DPC++ Library calls.
@@ -661,6 +540,7 @@ int main(int argc, char** argv) {
     pi = calc_pi_onedpl_native2(num_steps, policy, groups);
     pi = calc_pi_onedpl_native3(num_steps, groups, policy);
     pi = calc_pi_onedpl_native4(num_steps, groups, policy);
+    pi = calc_pi_onedpl_native5(num_steps, policy);
 
     pi = calc_pi_onedpl_two_steps_lib(num_steps, policy);
     pi = calc_pi_onedpl_onestep(num_steps, policy);
@@ -707,6 +587,13 @@ int main(int argc, char** argv) {
     std::cout << std::setprecision(3) << "PI =" << pi;
     std::cout << " in " << stop3c << " seconds\n";
 
+    dpc_common::TimeInterval T3d;
+    pi = calc_pi_onedpl_native5(num_steps, policy);
+    auto stop3d = T3d.Elapsed();
+    std::cout << "oneDPL native5:\t\t";
+    std::cout << std::setprecision(3) << "PI =" << pi;
+    std::cout << " in " << stop3d << " seconds\n";
+
     dpc_common::TimeInterval T4;
     pi = calc_pi_onedpl_two_steps_lib(num_steps, policy);
     auto stop4 = T4.Elapsed();
@@ -8,8 +8,12 @@
 #include <oneapi/dpl/algorithm>
 #include <oneapi/dpl/numeric>
 #include <CL/sycl.hpp>
+#include <algorithm>
+#include <iomanip>
 #include <random>
 #include <iostream>
+#include <string>
+#include <vector>
 
 // dpc_common.hpp can be found in the dev-utilities include folder.
 // e.g., $ONEAPI_ROOT/dev-utilities//include/dpc_common.hpp
@@ -22,7 +26,9 @@
 // i.e., for the sparse algorithm, the same input will give the following output
 // [(0,1) (1,2)(2,1)(4,2)]
 
-void dense_histogram(std::vector<uint64_t> &input) {
+// The sort-based dense histogram: sorts the input, and returns the count of
+// each value from 0 to the maximum value of the input.
+std::vector<uint64_t> sort_dense_histogram(std::vector<uint64_t> &input) {
   const int N = input.size();
   cl::sycl::buffer<uint64_t, 1> histogram_buf{input.data(),
                                               cl::sycl::range<1>(N)};
@@ -53,18 +59,31 @@ void dense_histogram(std::vector<uint64_t> &input) {
                            oneapi::dpl::end(histogram_new_buf),
                            oneapi::dpl::begin(bins));
 
-  std::cout << "Dense Histogram:\n";
-  {
-    sycl::host_accessor histogram_new(bins, sycl::read_only);
-    std::cout << "[";
-    for (int i = 0; i < num_bins; i++) {
-      std::cout << "(" << i << ", " << histogram_new[i] << ") ";
-    }
-    std::cout << "]\n";
+  sycl::host_accessor histogram_new(bins, sycl::read_only);
+  return std::vector<uint64_t>(histogram_new.get_pointer(),
+                               histogram_new.get_pointer() + num_bins);
+}
+
+void print_dense_histogram(const std::vector<uint64_t> &bins) {
+  std::cout << "[";
+  for (size_t i = 0; i < bins.size(); i++) {
+    std::cout << "(" << i << ", " << bins[i] << ") ";
   }
+  std::cout << "]\n";
 }
 
-void sparse_histogram(std::vector<uint64_t> &input) {
+std::vector<uint64_t> dense_histogram(std::vector<uint64_t> &input) {
+  std::vector<uint64_t> bins = sort_dense_histogram(input);
+  std::cout << "Dense Histogram:\n";
+  print_dense_histogram(bins);
+  return bins;
+}
+
+// The sort-based sparse histogram: sorts the input, and returns the number of
+// distinct values, with the values and their counts in values and counts.
+int sort_sparse_histogram(std::vector<uint64_t> &input,
+                          std::vector<uint64_t> &values,
+                          std::vector<uint64_t> &counts) {
   const int N = input.size();
   cl::sycl::buffer<uint64_t, 1> histogram_buf{input.data(),
                                               cl::sycl::range<1>(N)};
@@ -95,20 +114,236 @@ void sparse_histogram(std::vector<uint64_t> &input) {
       oneapi::dpl::begin(histogram_values_buf),
       oneapi::dpl::begin(histogram_counts_buf));
 
+  sycl::host_accessor histogram_value(histogram_values_buf, sycl::read_only);
+  sycl::host_accessor histogram_count(histogram_counts_buf, sycl::read_only);
+  values.assign(histogram_value.get_pointer(),
+                histogram_value.get_pointer() + num_bins);
+  counts.assign(histogram_count.get_pointer(),
+                histogram_count.get_pointer() + num_bins);
+  return num_bins;
+}
+
+void sparse_histogram(std::vector<uint64_t> &input) {
+  std::vector<uint64_t> values, counts;
+  int num_bins = sort_sparse_histogram(input, values, counts);
+
   std::cout << "Sparse Histogram:\n";
   std::cout << "[";
   for (int i = 0; i < num_bins; i++) {
-    sycl::host_accessor histogram_value(histogram_values_buf, sycl::read_only);
-    sycl::host_accessor histogram_count(histogram_counts_buf, sycl::read_only);
-    std::cout << "(" << histogram_value[i] << ", " << histogram_count[i]
-              << ") ";
+    std::cout << "(" << values[i] << ", " << counts[i] << ") ";
   }
   std::cout << "]\n";
 }
 
-int main(void) {
+// The direct histogram computes the dense histogram in a single pass over the
+// input, without sorting it, with one of two kernels:
+//
+// - Local: each work-group counts its share of the input in a private copy of
+//   the bins in local memory, with local atomics, and then adds its non-zero
+//   bins to the histogram in global memory with global atomics. Most of the
+//   atomics stay in local memory, which is much faster than global memory.
+//   This needs the bins to fit in local memory. At most half of it is used,
+//   so that two work-groups can share a compute unit.
+//
+// - Sub-group: when there are too many bins for local memory, each sub-group
+//   combines the equal values of its work-items (match-based aggregation),
+//   and adds the count of each distinct value to the global histogram with a
+//   single global atomic. This reduces the contention on the frequent bins.
+//
+// The counts are 32-bit, so the input must have fewer than 2^32 values.
+enum class DirectMethod { Local, SubGroup };
+
+constexpr size_t kWorkGroupSize = 256;
+
+std::vector<uint64_t> direct_histogram_bins(sycl::queue &q,
+                                            std::vector<uint64_t> &input,
+                                            size_t num_bins,
+                                            DirectMethod *method = nullptr) {
+  const size_t N = input.size();
+  std::vector<uint32_t> counts(num_bins, 0);
+
+  auto device = q.get_device();
+  const size_t wg_size = std::min(
+      kWorkGroupSize,
+      device.get_info<sycl::info::device::max_work_group_size>());
+  const size_t local_mem_size =
+      device.get_info<sycl::info::device::local_mem_size>();
+  const size_t compute_units =
+      device.get_info<sycl::info::device::max_compute_units>();
+
+  // Enough work-groups to fill the device, but no more: each work-group of the
+  // local kernel also zeroes and merges all the bins.
+  const size_t groups = std::max<size_t>(
+      1, std::min((N + wg_size - 1) / wg_size, 4 * compute_units));
+  const bool use_local = num_bins * sizeof(uint32_t) <= local_mem_size / 2;
+  if (method != nullptr)
+    *method = use_local ? DirectMethod::Local : DirectMethod::SubGroup;
+
+  {
+    sycl::buffer<uint64_t, 1> input_buf{input.data(), sycl::range<1>(N)};
+    sycl::buffer<uint32_t, 1> counts_buf{counts.data(),
+                                         sycl::range<1>(num_bins)};
+
+    q.submit([&](sycl::handler &h) {
+      sycl::accessor in(input_buf, h, sycl::read_only);
+      sycl::accessor hist(counts_buf, h, sycl::read_write);
+      sycl::nd_range<1> range{sycl::range<1>(groups * wg_size),
+                              sycl::range<1>(wg_size)};
+
+      if (use_local) {
+        sycl::accessor<uint32_t, 1, sycl::access::mode::read_write,
+                       sycl::access::target::local>
+            local_hist(sycl::range<1>(num_bins), h);
+
+        h.parallel_for(range, [=](sycl::nd_item<1> it) {
+          const size_t lid = it.get_local_id(0);
+          for (size_t b = lid; b < num_bins; b += wg_size) local_hist[b] = 0;
+          it.barrier(sycl::access::fence_space::local_space);
+
+          for (size_t i = it.get_global_id(0); i < N;
+               i += it.get_global_range(0)) {
+            sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed,
+                             sycl::memory_scope::work_group,
+                             sycl::access::address_space::local_space>
+                bin(local_hist[in[i]]);
+            bin.fetch_add(1);
+          }
+          it.barrier(sycl::access::fence_space::local_space);
+
+          // Merge the private bins into the global histogram
+          for (size_t b = lid; b < num_bins; b += wg_size) {
+            if (local_hist[b] != 0) {
+              sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed,
+                               sycl::memory_scope::device,
+                               sycl::access::address_space::global_space>
+                  bin(hist[b]);
+              bin.fetch_add(local_hist[b]);
+            }
+          }
+        });
+      } else {
+        h.parallel_for(range, [=](sycl::nd_item<1> it) {
+          auto sg = it.get_sub_group();
+          const uint32_t lane = sg.get_local_id()[0];
+
+          // Every work-item of a sub-group runs the same number of iterations,
+          // as the group functions below need all of them.
+          for (size_t base = it.get_global_id(0) - lane; base < N;
+               base += it.get_global_range(0)) {
+            const size_t i = base + lane;
+            const uint64_t value = i < N ? in[i] : 0;
+            bool done = i >= N;
+
+            // Each round takes the smallest value that is left, counts the
+            // work-items that have it, and adds them with one atomic.
+            while (sycl::any_of_group(sg, !done)) {
+              const uint64_t leader = sycl::reduce_over_group(
+                  sg, done ? UINT64_MAX : value, sycl::minimum<uint64_t>());
+              const bool match = !done && value == leader;
+              const uint32_t count = sycl::reduce_over_group(
+                  sg, match ? 1u : 0u, sycl::plus<uint32_t>());
+              const uint32_t first = sycl::reduce_over_group(
+                  sg, match ? lane : UINT32_MAX, sycl::minimum<uint32_t>());
+              if (lane == first) {
+                sycl::atomic_ref<uint32_t, sycl::memory_order::relaxed,
+                                 sycl::memory_scope::device,
+                                 sycl::access::address_space::global_space>
+                    bin(hist[leader]);
+                bin.fetch_add(count);
+              }
+              done = done || match;
+            }
+          }
+        });
+      }
+    });
+  }
+
+  return std::vector<uint64_t>(counts.begin(), counts.end());
+}
+
+std::vector<uint64_t> direct_histogram(std::vector<uint64_t> &input) {
+  sycl::queue q = oneapi::dpl::execution::dpcpp_default.queue();
+
+  // num_bins is maximum value + 1
+  const size_t num_bins = *std::max_element(input.begin(), input.end()) + 1;
+  std::vector<uint64_t> bins = direct_histogram_bins(q, input, num_bins);
+
+  std::cout << "Direct Histogram:\n";
+  print_dense_histogram(bins);
+  return bins;
+}
+
+// Compares the direct histogram with the sort-based dense and sparse
+// histograms, on n random values, for bin counts from 16 to 1M.
+int benchmark(size_t n) {
+  sycl::queue q = oneapi::dpl::execution::dpcpp_default.queue();
+  std::cout << "Running on "
+            << q.get_device().get_info<sycl::info::device::name>() << "\n";
+  std::cout << "Input: " << n << " values, best of 3 runs (ms)\n";
+  std::cout << std::setw(10) << "Bins" << std::setw(12) << "Sort dense"
+            << std::setw(12) << "Sort sparse" << std::setw(12) << "Direct"
+            << std::setw(10) << "Method" << std::setw(10) << "Speedup"
+            << "\n";
+
+  std::mt19937_64 gen(0);
+  int errors = 0;
+  for (size_t num_bins = 16; num_bins <= (1 << 20); num_bins *= 16) {
+    std::uniform_int_distribution<uint64_t> dist(0, num_bins - 1);
+    std::vector<uint64_t> input(n);
+    for (auto &v : input) v = dist(gen);
+
+    // The first run of each includes the kernel compilation, so it is not
+    // timed. The sort-based versions sort their input in place, so each run
+    // gets a fresh copy.
+    double dense_ms = 0, sparse_ms = 0, direct_ms = 0;
+    std::vector<uint64_t> dense, direct, values, counts;
+    DirectMethod method;
+    for (int run = 0; run < 4; run++) {
+      std::vector<uint64_t> data = input;
+      dpc_common::TimeInterval dense_time;
+      dense = sort_dense_histogram(data);
+      double t = dense_time.Elapsed() * 1000;
+      if (run == 1 || (run > 1 && t < dense_ms)) dense_ms = t;
+
+      data = input;
+      dpc_common::TimeInterval sparse_time;
+      sort_sparse_histogram(data, values, counts);
+      t = sparse_time.Elapsed() * 1000;
+      if (run == 1 || (run > 1 && t < sparse_ms)) sparse_ms = t;
+
+      dpc_common::TimeInterval direct_time;
+      direct = direct_histogram_bins(q, input, num_bins, &method);
+      t = direct_time.Elapsed() * 1000;
+      if (run == 1 || (run > 1 && t < direct_ms)) direct_ms = t;
+    }
+
+    // The dense histogram stops at the largest value of the input
+    dense.resize(num_bins, 0);
+    if (dense != direct) {
+      std::cout << "Direct histogram differs from the dense histogram for "
+                << num_bins << " bins\n";
+      errors++;
+    }
+
+    std::cout << std::setw(10) << num_bins << std::fixed
+              << std::setprecision(2) << std::setw(12) << dense_ms
+              << std::setw(12) << sparse_ms << std::setw(12) << direct_ms
+              << std::setw(10)
+              << (method == DirectMethod::Local ? "local" : "sub-group")
+              << std::setw(9) << dense_ms / direct_ms << "x\n";
+  }
+  return errors == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    const size_t n = argc > 2 ? std::stoull(argv[2]) : (1 << 24);
+    return benchmark(n);
+  }
+
   const int N = 1000;
-  std::vector<uint64_t> input, dense, sparse;
+  std::vector<uint64_t> input, dense, sparse, direct;
   srand((unsigned)time(0));
   // initialize the input array with randomly generated values between 0 and 9
   for (int i = 0; i < N; i++) input.push_back(rand() % 9);
@@ -122,8 +357,14 @@ int main(void) {
   for (int i = 0; i < N; i++) std::cout << input[i] << " ";
   std::cout << "\n";
   dense = input;
-  dense_histogram(dense);
+  std::vector<uint64_t> dense_bins = dense_histogram(dense);
   sparse = input;
   sparse_histogram(sparse);
+  direct = input;
+  std::vector<uint64_t> direct_bins = direct_histogram(direct);
+  if (direct_bins != dense_bins) {
+    std::cout << "Direct histogram differs from the dense histogram\n";
+    return 1;
+  }
   return 0;
 }
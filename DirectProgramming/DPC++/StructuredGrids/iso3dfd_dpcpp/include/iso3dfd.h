@@ -39,7 +39,7 @@ void PrintTargetInfo(sycl::queue &q, unsigned int dim_x, unsigned int dim_y);
 void Usage(const std::string &program_name);
 
 void PrintStats(double time, size_t n1, size_t n2, size_t n3,
-                unsigned int num_iterations);
+                unsigned int num_iterations, double reference_time = 0);
 
 bool WithinEpsilon(float *output, float *reference, const size_t dim_x,
                     const size_t dim_y, const size_t dim_z,
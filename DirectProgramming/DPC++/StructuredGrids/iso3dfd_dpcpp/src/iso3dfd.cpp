@@ -72,6 +72,42 @@ void Initialize(float* ptr_prev, float* ptr_next, float* ptr_vel, size_t n1,
   }
 }
 
+/*
+ * Host-Code
+ * Updates the points [bx, ixEnd) x [by, iyEnd) x [bz, izEnd) of the wavefield
+ * by a single iteration of iso3dfd kernel
+ */
+static inline void Iso3dfdBlock(float* ptr_next_base, float* ptr_prev_base,
+                                float* ptr_vel_base, float* coeff,
+                                const size_t n1, const size_t n2,
+                                const size_t bx, const size_t ixEnd,
+                                const size_t by, const size_t iyEnd,
+                                const size_t bz, const size_t izEnd) {
+  size_t dimn1n2 = n1 * n2;
+  for (size_t iz = bz; iz < izEnd; iz++) {  // start of inner iterations
+    for (size_t iy = by; iy < iyEnd; iy++) {
+      float* ptr_next = ptr_next_base + iz * dimn1n2 + iy * n1 + bx;
+      float* ptr_prev = ptr_prev_base + iz * dimn1n2 + iy * n1 + bx;
+      float* ptr_vel = ptr_vel_base + iz * dimn1n2 + iy * n1 + bx;
+#pragma omp simd
+      for (size_t ix = 0; ix < ixEnd - bx; ix++) {
+        float value = 0.0;
+        value += ptr_prev[ix] * coeff[0];
+#pragma unroll(kHalfLength)
+        for (unsigned int ir = 1; ir <= kHalfLength; ir++) {
+          value += coeff[ir] *
+                   ((ptr_prev[ix + ir] + ptr_prev[ix - ir]) +
+                    (ptr_prev[ix + ir * n1] + ptr_prev[ix - ir * n1]) +
+                    (ptr_prev[ix + ir * dimn1n2] +
+                     ptr_prev[ix - ir * dimn1n2]));
+        }
+        ptr_next[ix] =
+            2.0f * ptr_prev[ix] - ptr_next[ix] + value * ptr_vel[ix];
+      }
+    }
+  }  // end of inner iterations
+}
+
 /*
  * Host-Code
  * OpenMP implementation for single iteration of iso3dfd kernel.
@@ -84,7 +120,6 @@ void Iso3dfdIteration(float* ptr_next_base, float* ptr_prev_base,
                       float* ptr_vel_base, float* coeff, const size_t n1,
                       const size_t n2, const size_t n3, const size_t n1_block,
                       const size_t n2_block, const size_t n3_block) {
-  size_t dimn1n2 = n1 * n2;
   size_t n3End = n3 - kHalfLength;
   size_t n2End = n2 - kHalfLength;
   size_t n1End = n1 - kHalfLength;
@@ -95,31 +130,11 @@ void Iso3dfdIteration(float* ptr_next_base, float* ptr_prev_base,
        bz += n3_block) {  // start of cache blocking
     for (size_t by = kHalfLength; by < n2End; by += n2_block) {
       for (size_t bx = kHalfLength; bx < n1End; bx += n1_block) {
-        int izEnd = std::min(bz + n3_block, n3End);
-        int iyEnd = std::min(by + n2_block, n2End);
-        int ixEnd = std::min(n1_block, n1End - bx);
-        for (size_t iz = bz; iz < izEnd; iz++) {  // start of inner iterations
-          for (size_t iy = by; iy < iyEnd; iy++) {
-            float* ptr_next = ptr_next_base + iz * dimn1n2 + iy * n1 + bx;
-            float* ptr_prev = ptr_prev_base + iz * dimn1n2 + iy * n1 + bx;
-            float* ptr_vel = ptr_vel_base + iz * dimn1n2 + iy * n1 + bx;
-#pragma omp simd
-            for (size_t ix = 0; ix < ixEnd; ix++) {
-              float value = 0.0;
-              value += ptr_prev[ix] * coeff[0];
-#pragma unroll(kHalfLength)
-              for (unsigned int ir = 1; ir <= kHalfLength; ir++) {
-                value += coeff[ir] *
-                         ((ptr_prev[ix + ir] + ptr_prev[ix - ir]) +
-                          (ptr_prev[ix + ir * n1] + ptr_prev[ix - ir * n1]) +
-                          (ptr_prev[ix + ir * dimn1n2] +
-                           ptr_prev[ix - ir * dimn1n2]));
-              }
-              ptr_next[ix] =
-                  2.0f * ptr_prev[ix] - ptr_next[ix] + value * ptr_vel[ix];
-            }
-          }
-        }  // end of inner iterations
+        size_t izEnd = std::min(bz + n3_block, n3End);
+        size_t iyEnd = std::min(by + n2_block, n2End);
+        size_t ixEnd = std::min(bx + n1_block, n1End);
+        Iso3dfdBlock(ptr_next_base, ptr_prev_base, ptr_vel_base, coeff, n1,
+                     n2, bx, ixEnd, by, iyEnd, bz, izEnd);
       }
     }
   }  // end of cache blocking
@@ -148,6 +163,82 @@ void Iso3dfd(float* ptr_next, float* ptr_prev, float* ptr_vel, float* coeff,
   }  // time loop
 }
 
+/*
+ * Host-Code
+ * Bytes of the three arrays that one wavefront of Iso3dfdTemporal reads
+ * and writes, from the first plane that its first time step reads to the
+ * last plane that its last time step reads
+ */
+size_t TemporalWorkingSet(const size_t n1, const size_t n2,
+                          const unsigned int num_fused) {
+  size_t planes = (num_fused - 1) * (kHalfLength + 1) + 2 * kHalfLength + 1;
+  return 3 * planes * n1 * n2 * sizeof(float);
+}
+
+/*
+ * Host-Code
+ * Driver function for ISO3DFD OpenMP code with temporal blocking
+ * Advances the wavefields num_fused time steps per sweep over the grid with a
+ * wavefront along the Z dimension: time step k of the sweep updates the XY
+ * plane kHalfLength + 1 planes behind the plane of time step k - 1. By then,
+ * the planes that it reads are up to date, and no other time step of the
+ * sweep still reads the plane that it overwrites, so all the time steps of a
+ * wavefront update their planes at once, in place. The planes between the
+ * first and last time steps stay in cache, so the grid is read from memory
+ * once per num_fused time steps. The results are the same as Iso3dfd's, in
+ * the same buffers.
+ *
+ * That only holds while the planes of a wavefront fit in the last level
+ * cache: (num_fused - 1) * (kHalfLength + 1) + 2 * kHalfLength + 1 XY planes
+ * of n1 * n2 floats in each of the three arrays (see TemporalWorkingSet). For
+ * a 256x256 plane and 4 time steps that is about 37 MB. With a larger plane
+ * or more time steps the planes are evicted before the last time step reads
+ * them, and every time step goes through memory again.
+ */
+void Iso3dfdTemporal(float* ptr_next, float* ptr_prev, float* ptr_vel,
+                     float* coeff, const size_t n1, const size_t n2,
+                     const size_t n3, const unsigned int nreps,
+                     const size_t n1_block, const size_t n2_block,
+                     const unsigned int num_fused) {
+  // Distance in planes between two consecutive time steps of the wavefront
+  const size_t lag = kHalfLength + 1;
+  size_t n3End = n3 - kHalfLength;
+  size_t n2End = n2 - kHalfLength;
+  size_t n1End = n1 - kHalfLength;
+
+  for (unsigned int it = 0; it < nreps; it += num_fused) {
+    unsigned int num_steps = std::min(num_fused, nreps - it);
+    // The time steps alternate between writing ptr_next and ptr_prev, as in
+    // Iso3dfd
+    float* ptr_out[2] = {ptr_next, ptr_prev};
+
+#pragma omp parallel default(shared)
+    for (size_t wavefront = kHalfLength;
+         wavefront < n3End + (num_steps - 1) * lag;
+         wavefront++) {  // start of wavefront
+#pragma omp for schedule(static) collapse(3)
+      for (unsigned int step = 0; step < num_steps; step++) {
+        for (size_t by = kHalfLength; by < n2End; by += n2_block) {
+          for (size_t bx = kHalfLength; bx < n1End; bx += n1_block) {
+            // The plane of this time step, if it is in the grid
+            if (wavefront < kHalfLength + step * lag) continue;
+            size_t iz = wavefront - step * lag;
+            if (iz >= n3End) continue;
+
+            size_t iyEnd = std::min(by + n2_block, n2End);
+            size_t ixEnd = std::min(bx + n1_block, n1End);
+            Iso3dfdBlock(ptr_out[step % 2], ptr_out[1 - step % 2], ptr_vel,
+                         coeff, n1, n2, bx, ixEnd, by, iyEnd, iz, iz + 1);
+          }
+        }
+      }
+    }  // end of wavefront
+
+    // Swap previous & next after an odd number of time steps
+    if (num_steps % 2) std::swap(ptr_next, ptr_prev);
+  }  // time loop
+}
+
 /*
  * Host-Code
  * Main function to drive the sample application
@@ -169,6 +260,8 @@ int main(int argc, char* argv[]) {
   size_t n1, n2, n3;
   size_t n1_block, n2_block, n3_block;
   unsigned int num_iterations;
+  // Number of time steps per sweep over the grid in the OpenMP variant
+  unsigned int num_fused = 1;
 
   // Read Input Parameters
   try {
@@ -201,6 +294,17 @@ int main(int argc, char* argv[]) {
       is_gpu = true;
     } else if (arg_value == "cpu") {
       is_gpu = false;
+    } else if (arg_value.compare(0, 5, "fuse=") == 0) {
+      int fuse = 0;
+      try {
+        fuse = std::stoi(arg_value.substr(5));
+      } catch (...) {
+      }
+      if (fuse < 1) {
+        Usage(argv[0]);
+        return 1;
+      }
+      num_fused = fuse;
     } else {
       Usage(argv[0]);
       return 1;
@@ -256,7 +360,39 @@ int main(int argc, char* argv[]) {
             n1_block, n2_block, n3_block);
 
     // End timer
-    PrintStats(t_ser.Elapsed() * 1e3, n1, n2, n3, num_iterations);
+    double time_ser = t_ser.Elapsed() * 1e3;
+    PrintStats(time_ser, n1, n2, n3, num_iterations);
+
+    // Run the temporally blocked version from the same initial conditions,
+    // and compare it with the version above
+    if (num_fused > 1) {
+      std::cout << " ***** Running temporal blocking variant with "
+                << num_fused << " time steps per sweep *****\n";
+      std::cout << "Wavefront working set: "
+                << TemporalWorkingSet(n1, n2, num_fused) / (1024 * 1024)
+                << " MB, which has to fit in the last level cache\n";
+      float* result = (num_iterations % 2) ? next_base : prev_base;
+      float* reference = new float[nsize];
+      memcpy(reference, result, nsize * sizeof(float));
+
+      Initialize(prev_base, next_base, vel_base, n1, n2, n3);
+
+      dpc_common::TimeInterval t_tb;
+      Iso3dfdTemporal(next_base, prev_base, vel_base, coeff, n1, n2, n3,
+                      num_iterations, n1_block, n2_block, num_fused);
+      PrintStats(t_tb.Elapsed() * 1e3, n1, n2, n3, num_iterations, time_ser);
+
+      if (WithinEpsilon(result, reference, n1, n2, n3, kHalfLength, 0, 0.1f)) {
+        std::cout << "Final wavefields with and without temporal blocking "
+                  << "are not equivalent: Fail\n";
+        error = true;
+      } else {
+        std::cout << "Final wavefields with and without temporal blocking "
+                  << "are equivalent: Success\n";
+      }
+      std::cout << "--------------------------------------\n";
+      delete[] reference;
+    }
   }
 
   // Check if running both OpenMP/Serial and DPC++ version
@@ -86,7 +86,8 @@ void Usage(const std::string& programName) {
   std::cout << " Incorrect parameters \n";
   std::cout << " Usage: ";
   std::cout << programName
-            << " n1 n2 n3 b1 b2 b3 Iterations [omp|sycl] [gpu|cpu] \n\n";
+            << " n1 n2 n3 b1 b2 b3 Iterations [omp|sycl] [gpu|cpu] [fuse=T]"
+            << " \n\n";
   std::cout << " n1 n2 n3      : Grid sizes for the stencil \n";
   std::cout << " b1 b2 b3      : cache block sizes for cpu openmp version.\n";
   std::cout << " Iterations    : No. of timesteps. \n";
@@ -94,7 +95,11 @@ void Usage(const std::string& programName) {
             << " Default is to use both for validation \n";
   std::cout
       << " [gpu|cpu]     : Optional: Device to run the SYCL version"
-      << " Default is to use the GPU if available, if not fallback to CPU \n\n";
+      << " Default is to use the GPU if available, if not fallback to CPU \n";
+  std::cout
+      << " [fuse=T]      : Optional: Also run the OpenMP version with temporal"
+      << " blocking of T time steps per sweep over the grid, and compare it"
+      << " with the version without. Default is 1 (no temporal blocking) \n\n";
 }
 
 /*
@@ -102,7 +107,7 @@ void Usage(const std::string& programName) {
  * Utility function to print stats
  */
 void PrintStats(double time, size_t n1, size_t n2, size_t n3,
-                unsigned int nIterations) {
+                unsigned int nIterations, double reference_time) {
   float throughput_mpoints = 0.0f, mflops = 0.0f, normalized_time = 0.0f;
   double mbytes = 0.0f;
 
@@ -118,6 +123,12 @@ void PrintStats(double time, size_t n1, size_t n2, size_t n3,
   std::cout << "throughput   : " << throughput_mpoints << " Mpts/s\n";
   std::cout << "flops        : " << mflops / 1e3f << " GFlops\n";
   std::cout << "bytes        : " << mbytes / 1e3f << " GBytes/s\n";
+  // The throughput counts each grid point once per time step, so the
+  // speedup is the ratio of the throughputs
+  if (reference_time > 0) {
+    std::cout << "speedup      : " << reference_time / time << "x over "
+              << throughput_mpoints * time / reference_time << " Mpts/s\n";
+  }
   std::cout << "\n--------------------------------------\n";
   std::cout << "\n--------------------------------------\n";
 }
@@ -0,0 +1,596 @@
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <string_view>
+#include <thread>
+
+#include "cpu_queries.hpp"
+
+using namespace std::chrono;
+
+namespace {
+
+unsigned int cpu_threads = 0;
+
+//
+// Runs 'fn(state, begin, end)' over the morsels of the row range [0, rows)
+// on CpuThreads() threads. Each thread accumulates into its own 'State',
+// and the states of all threads are returned to be merged by the caller.
+//
+template <typename State, typename Fn>
+std::vector<State> ForEachMorsel(size_t rows, Fn fn) {
+  const size_t morsels = (rows + kCpuMorselRows - 1) / kCpuMorselRows;
+  const unsigned int threads =
+      std::max<size_t>(1, std::min<size_t>(CpuThreads(), morsels));
+
+  // keep the states of different threads on different cache lines
+  struct alignas(64) PaddedState {
+    State state{};
+  };
+  std::vector<PaddedState> states(threads);
+
+  std::atomic<size_t> next_morsel(0);
+  auto worker = [&](unsigned int t) {
+    size_t m;
+    while ((m = next_morsel.fetch_add(1, std::memory_order_relaxed)) <
+           morsels) {
+      size_t begin = m * kCpuMorselRows;
+      size_t end = std::min(rows, begin + kCpuMorselRows);
+      fn(states[t].state, begin, end);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned int t = 1; t < threads; t++) {
+    pool.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& th : pool) {
+    th.join();
+  }
+
+  std::vector<State> result;
+  result.reserve(threads);
+  for (auto& s : states) {
+    result.push_back(s.state);
+  }
+  return result;
+}
+
+//
+// Runs 'fn(begin, end)' over the morsels of [0, rows), for loops that write
+// to disjoint parts of a shared output and need no per-thread state
+//
+template <typename Fn>
+void ParallelFor(size_t rows, Fn fn) {
+  struct Empty {};
+  ForEachMorsel<Empty>(
+      rows, [&](Empty&, size_t begin, size_t end) { fn(begin, end); });
+}
+
+//
+// Maps an ORDERKEY to its row in the ORDERS table. ORDERKEYs are unique but
+// not dense, so the index is sized by the largest ORDERKEY (the ORDERS table
+// is sorted by ORDERKEY).
+//
+constexpr unsigned int kNoRow = std::numeric_limits<unsigned int>::max();
+
+std::vector<unsigned int> BuildOrdersIndex(const OrdersTable& o) {
+  const DBIdentifier max_key = (o.rows == 0) ? 0 : o.orderkey[o.rows - 1];
+  std::vector<unsigned int> index(max_key + 1, kNoRow);
+  const DBIdentifier* orderkey = o.orderkey.data();
+  unsigned int* index_ptr = index.data();
+  ParallelFor(o.rows, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      index_ptr[orderkey[i]] = (unsigned int)i;
+    }
+  });
+  return index;
+}
+
+// the row of the order with key 'orderkey', or kNoRow if there is none
+inline unsigned int FindOrder(const std::vector<unsigned int>& index,
+                              DBIdentifier orderkey) {
+  return (orderkey < index.size()) ? index[orderkey] : kNoRow;
+}
+
+// the row of a query 3 result
+struct OrderRevenue {
+  DBIdentifier orderkey;
+  DBDecimal revenue;
+  DBDate orderdate;
+  int shippriority;
+};
+
+// the output order of query 3 (see ValidateQ3)
+bool OrderedBefore(const OrderRevenue& a, const OrderRevenue& b) {
+  if (a.revenue != b.revenue) return a.revenue > b.revenue;
+  if (a.orderdate != b.orderdate) return a.orderdate < b.orderdate;
+  return a.orderkey < b.orderkey;
+}
+
+}  // namespace
+
+void SetCpuThreads(unsigned int threads) { cpu_threads = threads; }
+
+unsigned int CpuThreads() {
+  if (cpu_threads == 0) {
+    return std::max(1u, std::thread::hardware_concurrency());
+  }
+  return cpu_threads;
+}
+
+bool CpuQuery1(Database& dbinfo, DBDate low_date,
+               std::array<DBDecimal, kQuery1OutSize>& sum_qty,
+               std::array<DBDecimal, kQuery1OutSize>& sum_base_price,
+               std::array<DBDecimal, kQuery1OutSize>& sum_disc_price,
+               std::array<DBDecimal, kQuery1OutSize>& sum_charge,
+               std::array<DBDecimal, kQuery1OutSize>& avg_qty,
+               std::array<DBDecimal, kQuery1OutSize>& avg_price,
+               std::array<DBDecimal, kQuery1OutSize>& avg_discount,
+               std::array<DBDecimal, kQuery1OutSize>& count, double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+
+  struct State {
+    std::array<DBDecimal, kQuery1OutSize> qty, base_price, disc_price, charge,
+        discount, count;
+  };
+
+  auto states = ForEachMorsel<State>(
+      l.rows, [&](State& s, size_t begin, size_t end) {
+        // compute the output index of each row of the morsel first, so that
+        // the filter and the index computation vectorize
+        unsigned char out_idx[kCpuMorselRows];
+        for (size_t i = begin; i < end; i++) {
+          const char rf = l.returnflag[i];
+          const char ls = l.linestatus[i];
+          const unsigned char rf_idx = (rf == 'R') ? 0 : (rf == 'A') ? 1 : 2;
+          const unsigned char ls_idx = (ls == 'O') ? 0 : 1;
+          const bool valid = l.shipdate[i] <= low_date;
+
+          // invalid rows go to a dummy output index
+          out_idx[i - begin] =
+              valid ? (ls_idx * kReturnFlagSize + rf_idx) : kQuery1OutSize;
+        }
+
+        DBDecimal qty[kQuery1OutSize + 1] = {0};
+        DBDecimal base_price[kQuery1OutSize + 1] = {0};
+        DBDecimal disc_price[kQuery1OutSize + 1] = {0};
+        DBDecimal charge[kQuery1OutSize + 1] = {0};
+        DBDecimal discount[kQuery1OutSize + 1] = {0};
+        DBDecimal cnt[kQuery1OutSize + 1] = {0};
+        for (size_t i = begin; i < end; i++) {
+          const unsigned char idx = out_idx[i - begin];
+          const DBDecimal disc_price_tmp =
+              l.extendedprice[i] * (100 - l.discount[i]);
+          qty[idx] += l.quantity[i];
+          base_price[idx] += l.extendedprice[i];
+          disc_price[idx] += disc_price_tmp;
+          charge[idx] += disc_price_tmp * (100 + l.tax[i]);
+          discount[idx] += l.discount[i];
+          cnt[idx] += 1;
+        }
+
+        for (int i = 0; i < kQuery1OutSize; i++) {
+          s.qty[i] += qty[i];
+          s.base_price[i] += base_price[i];
+          s.disc_price[i] += disc_price[i];
+          s.charge[i] += charge[i];
+          s.discount[i] += discount[i];
+          s.count[i] += cnt[i];
+        }
+      });
+
+  // merge the thread local results and compute the averages
+  for (int i = 0; i < kQuery1OutSize; i++) {
+    DBDecimal discount = 0;
+    sum_qty[i] = sum_base_price[i] = sum_disc_price[i] = sum_charge[i] = 0;
+    count[i] = 0;
+    for (auto& s : states) {
+      sum_qty[i] += s.qty[i];
+      sum_base_price[i] += s.base_price[i];
+      sum_disc_price[i] += s.disc_price[i];
+      sum_charge[i] += s.charge[i];
+      discount += s.discount[i];
+      count[i] += s.count[i];
+    }
+    avg_qty[i] = (count[i] == 0) ? 0 : (sum_qty[i] / count[i]);
+    avg_price[i] = (count[i] == 0) ? 0 : (sum_base_price[i] / count[i]);
+    avg_discount[i] = (count[i] == 0) ? 0 : (discount / count[i]);
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery3(Database& dbinfo, int mktsegment, DBDate date,
+               std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+               std::array<DBDecimal, kQuery3OutSize>& revenue,
+               std::array<DBDate, kQuery3OutSize>& orderdate,
+               std::array<int, kQuery3OutSize>& shippriority,
+               double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+  const OrdersTable& o = dbinfo.o;
+  const CustomerTable& c = dbinfo.c;
+
+  // whether each order qualifies: placed before 'date' by a customer of the
+  // market segment. CUSTKEYs are dense, [1, c.rows].
+  std::vector<unsigned char> order_valid(o.rows);
+  ParallelFor(o.rows, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const DBIdentifier custkey = o.custkey[i];
+      order_valid[i] = (o.orderdate[i] < date) && custkey >= 1 &&
+                       custkey <= c.rows &&
+                       (c.mktsegment[custkey - 1] == mktsegment);
+    }
+  });
+
+  std::vector<unsigned int> orders_index = BuildOrdersIndex(o);
+
+  // the LINEITEM table is sorted by ORDERKEY, so the rows of an order are
+  // consecutive and each morsel emits one revenue per run of rows. An order
+  // that straddles two morsels is emitted twice and combined below.
+  auto states = ForEachMorsel<std::vector<OrderRevenue>>(
+      l.rows, [&](std::vector<OrderRevenue>& runs, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          const unsigned int o_row = FindOrder(orders_index, l.orderkey[i]);
+          if (l.shipdate[i] > date && o_row != kNoRow && order_valid[o_row]) {
+            const DBDecimal row_revenue =
+                l.extendedprice[i] * (100 - l.discount[i]);
+            if (!runs.empty() && runs.back().orderkey == l.orderkey[i]) {
+              runs.back().revenue += row_revenue;
+            } else {
+              runs.push_back({l.orderkey[i], row_revenue, o.orderdate[o_row],
+                              o.shippriority[o_row]});
+            }
+          }
+        }
+      });
+
+  // combine the runs of all threads by ORDERKEY
+  std::vector<OrderRevenue> groups;
+  for (auto& runs : states) {
+    groups.insert(groups.end(), runs.begin(), runs.end());
+  }
+  std::sort(groups.begin(), groups.end(),
+            [](const OrderRevenue& a, const OrderRevenue& b) {
+              return a.orderkey < b.orderkey;
+            });
+  size_t num_groups = 0;
+  for (size_t i = 0; i < groups.size(); i++) {
+    if (num_groups > 0 &&
+        groups[num_groups - 1].orderkey == groups[i].orderkey) {
+      groups[num_groups - 1].revenue += groups[i].revenue;
+    } else {
+      groups[num_groups++] = groups[i];
+    }
+  }
+  groups.resize(num_groups);
+
+  // the top rows
+  const size_t top = std::min<size_t>(kQuery3OutSize, groups.size());
+  std::partial_sort(groups.begin(), groups.begin() + top, groups.end(),
+                    OrderedBefore);
+
+  for (size_t i = 0; i < kQuery3OutSize; i++) {
+    bool valid = i < top;
+    orderkey[i] = valid ? groups[i].orderkey : 0;
+    revenue[i] = valid ? groups[i].revenue : 0;
+    orderdate[i] = valid ? groups[i].orderdate : 0;
+    shippriority[i] = valid ? groups[i].shippriority : 0;
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery6(Database& dbinfo, DBDate low_date, DBDate high_date,
+               DBDecimal discount, DBDecimal quantity, DBDecimal& revenue,
+               double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+  const DBDate* shipdate = l.shipdate.data();
+  const DBDecimal* disc = l.discount.data();
+  const DBDecimal* qty = l.quantity.data();
+  const DBDecimal* extendedprice = l.extendedprice.data();
+
+  // the query selects discounts within 0.01 (1 cent) of 'discount'
+  const DBDecimal low_discount = discount - 1;
+  const DBDecimal high_discount = discount + 1;
+
+  auto states = ForEachMorsel<DBDecimal>(
+      l.rows, [&](DBDecimal& sum, size_t begin, size_t end) {
+        DBDecimal local = 0;
+        for (size_t i = begin; i < end; i++) {
+          const bool valid = (shipdate[i] >= low_date) &
+                             (shipdate[i] < high_date) &
+                             (disc[i] >= low_discount) &
+                             (disc[i] <= high_discount) & (qty[i] < quantity);
+          local += valid ? extendedprice[i] * disc[i] : 0;
+        }
+        sum += local;
+      });
+
+  revenue = 0;
+  for (auto sum : states) {
+    revenue += sum;
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery9(Database& dbinfo, std::string colour,
+               std::array<DBDecimal, 25 * 2020>& sum_profit, double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+  const OrdersTable& o = dbinfo.o;
+  const PartsTable& p = dbinfo.p;
+  const SupplierTable& s = dbinfo.s;
+  const PartSupplierTable& ps = dbinfo.ps;
+
+  // the kernel only computes the profits of the years 1992-1998
+  constexpr int kFirstYear = 1992;
+  constexpr int kYears = 7;
+
+  // whether each part's name contains 'colour'. PARTKEYs are dense,
+  // [1, p.rows].
+  std::vector<unsigned char> part_matches(p.rows + 1, 0);
+  ParallelFor(p.rows, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const char* name = &p.name[i * 55];
+      std::string_view name_str(name, strnlen(name, 55));
+      part_matches[i + 1] = name_str.find(colour) != std::string_view::npos;
+    }
+  });
+
+  // the first PARTSUPPLIER row of each part, the table is sorted by PARTKEY
+  std::vector<unsigned int> ps_begin(p.rows + 2);
+  ParallelFor(p.rows + 2, [&](size_t begin, size_t end) {
+    for (size_t k = begin; k < end; k++) {
+      ps_begin[k] = std::lower_bound(ps.partkey.begin(),
+                                     ps.partkey.begin() + ps.rows, k) -
+                    ps.partkey.begin();
+    }
+  });
+
+  std::vector<unsigned int> orders_index = BuildOrdersIndex(o);
+
+  using Profits = std::array<DBDecimal, kYears * kNationTableSize>;
+  auto states = ForEachMorsel<Profits>(
+      l.rows, [&](Profits& profit, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          const DBIdentifier partkey = l.partkey[i];
+          if (partkey > p.rows || !part_matches[partkey]) continue;
+
+          // the supply cost of this part from this supplier
+          const DBIdentifier suppkey = l.suppkey[i];
+          DBDecimal supplycost = 0;
+          bool found = false;
+          for (unsigned int j = ps_begin[partkey]; j < ps_begin[partkey + 1];
+               j++) {
+            if (ps.suppkey[j] == suppkey) {
+              supplycost = ps.supplycost[j];
+              found = true;
+            }
+          }
+
+          const unsigned int o_row = FindOrder(orders_index, l.orderkey[i]);
+          if (!found || o_row == kNoRow || suppkey < 1 || suppkey > s.rows) {
+            continue;
+          }
+
+          const int year = (o.orderdate[o_row] >> 9) & 0x07FFFFF;
+          const unsigned char nation = s.nationkey[suppkey - 1];
+          if (year < kFirstYear || year >= kFirstYear + kYears) continue;
+
+          // see the Compute kernel of Q9 for why quantity is scaled by 100
+          const DBDecimal amount =
+              (l.extendedprice[i] * (100 - l.discount[i])) -
+              (supplycost * l.quantity[i] * 100);
+          profit[(year - kFirstYear) * kNationTableSize + nation] += amount;
+        }
+      });
+
+  sum_profit.fill(0);
+  for (auto& profit : states) {
+    for (int y = 0; y < kYears; y++) {
+      for (int n = 0; n < kNationTableSize; n++) {
+        sum_profit[(kFirstYear + y) * 25 + n] +=
+            profit[y * kNationTableSize + n];
+      }
+    }
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery11(Database& dbinfo, std::string& nation,
+                std::vector<DBIdentifier>& partkeys,
+                std::vector<DBDecimal>& values, double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  if (dbinfo.n.name_key_map.find(nation) == dbinfo.n.name_key_map.end()) {
+    std::cerr << "ERROR: unknown nation '" << nation << "'\n";
+    return false;
+  }
+  const unsigned char nationkey = dbinfo.n.name_key_map[nation];
+
+  const PartsTable& p = dbinfo.p;
+  const SupplierTable& s = dbinfo.s;
+  const PartSupplierTable& ps = dbinfo.ps;
+
+  // whether each supplier is in the nation. SUPPKEYs are dense, [1, s.rows].
+  std::vector<unsigned char> supplier_in_nation(s.rows + 1, 0);
+  for (size_t i = 0; i < s.rows; i++) {
+    supplier_in_nation[i + 1] = (s.nationkey[i] == nationkey);
+  }
+
+  // the PARTSUPPLIER table is sorted by PARTKEY, so the morsels are taken
+  // over the parts and each part's value is written by exactly one thread
+  std::vector<DBDecimal> part_values(p.rows);
+  ParallelFor(p.rows, [&](size_t begin, size_t end) {
+    size_t j = std::lower_bound(ps.partkey.begin(),
+                                ps.partkey.begin() + ps.rows, begin + 1) -
+               ps.partkey.begin();
+    for (size_t i = begin; i < end; i++) {
+      const DBIdentifier partkey = i + 1;
+      DBDecimal value = 0;
+      for (; j < ps.rows && ps.partkey[j] == partkey; j++) {
+        const DBIdentifier suppkey = ps.suppkey[j];
+        const bool valid = suppkey <= s.rows && supplier_in_nation[suppkey];
+        value += valid ? ps.supplycost[j] * (DBDecimal)(ps.availqty[j]) : 0;
+      }
+      part_values[i] = value;
+    }
+  });
+
+  // sort the parts by value, descending
+  std::vector<DBIdentifier> order(p.rows);
+  for (size_t i = 0; i < p.rows; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [&](DBIdentifier a, DBIdentifier b) {
+              if (part_values[a] != part_values[b]) {
+                return part_values[a] > part_values[b];
+              }
+              return a < b;
+            });
+
+  partkeys.resize(p.rows);
+  values.resize(p.rows);
+  for (size_t i = 0; i < p.rows; i++) {
+    partkeys[i] = order[i] + 1;
+    values[i] = part_values[order[i]];
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery12(Database& dbinfo, DBDate low_date, DBDate high_date,
+                int shipmode1, int shipmode2,
+                std::array<DBDecimal, 2>& high_line_count,
+                std::array<DBDecimal, 2>& low_line_count, double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+  const OrdersTable& o = dbinfo.o;
+
+  std::vector<unsigned int> orders_index = BuildOrdersIndex(o);
+
+  // {high shipmode1, high shipmode2, low shipmode1, low shipmode2}
+  using Counts = std::array<DBDecimal, 4>;
+  auto states = ForEachMorsel<Counts>(
+      l.rows, [&](Counts& counts, size_t begin, size_t end) {
+        DBDecimal high1 = 0, high2 = 0, low1 = 0, low2 = 0;
+        for (size_t i = begin; i < end; i++) {
+          const bool is_shipmode1 = (l.shipmode[i] == shipmode1);
+          const bool is_shipmode2 = (l.shipmode[i] == shipmode2);
+          const bool valid = (is_shipmode1 | is_shipmode2) &
+                             (l.commitdate[i] < l.receiptdate[i]) &
+                             (l.shipdate[i] < l.commitdate[i]) &
+                             (l.receiptdate[i] >= low_date) &
+                             (l.receiptdate[i] < high_date);
+          if (!valid) continue;
+
+          const unsigned int o_row = FindOrder(orders_index, l.orderkey[i]);
+          if (o_row == kNoRow) continue;
+
+          const int priority = o.orderpriority[o_row];
+          const bool urgent_or_high = (priority == 1 || priority == 2);
+          high1 += (is_shipmode1 && urgent_or_high) ? 1 : 0;
+          low1 += (is_shipmode1 && !urgent_or_high) ? 1 : 0;
+          high2 += (is_shipmode2 && urgent_or_high) ? 1 : 0;
+          low2 += (is_shipmode2 && !urgent_or_high) ? 1 : 0;
+        }
+        counts[0] += high1;
+        counts[1] += high2;
+        counts[2] += low1;
+        counts[3] += low2;
+      });
+
+  high_line_count = {0, 0};
+  low_line_count = {0, 0};
+  for (auto& counts : states) {
+    high_line_count[0] += counts[0];
+    high_line_count[1] += counts[1];
+    low_line_count[0] += counts[2];
+    low_line_count[1] += counts[3];
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
+
+bool CpuQuery14(Database& dbinfo, DBDate low_date, DBDate high_date,
+                DBDecimal& promo_revenue, DBDecimal& total_revenue,
+                double& latency) {
+  high_resolution_clock::time_point start = high_resolution_clock::now();
+
+  const LineItemTable& l = dbinfo.l;
+  const PartsTable& p = dbinfo.p;
+
+  // whether each part's type starts with 'PROMO'. PARTKEYs are dense,
+  // [1, p.rows].
+  std::vector<unsigned char> is_promo(p.rows + 1, 0);
+  ParallelFor(p.rows, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      is_promo[i + 1] = (strncmp(&p.type[i * 25], "PROMO", 5) == 0);
+    }
+  });
+
+  // {promo revenue, total revenue}
+  using Revenues = std::array<DBDecimal, 2>;
+  auto states = ForEachMorsel<Revenues>(
+      l.rows, [&](Revenues& sums, size_t begin, size_t end) {
+        DBDecimal promo = 0, total = 0;
+        for (size_t i = begin; i < end; i++) {
+          const DBIdentifier partkey = l.partkey[i];
+          const bool valid = (l.shipdate[i] >= low_date) &
+                             (l.shipdate[i] < high_date) & (partkey <= p.rows);
+          const DBDecimal revenue =
+              valid ? l.extendedprice[i] * (100 - l.discount[i]) : 0;
+          total += revenue;
+          promo += (valid && is_promo[partkey]) ? revenue : 0;
+        }
+        sums[0] += promo;
+        sums[1] += total;
+      });
+
+  promo_revenue = 0;
+  total_revenue = 0;
+  for (auto& sums : states) {
+    promo_revenue += sums[0];
+    total_revenue += sums[1];
+  }
+
+  duration<double, std::milli> diff = high_resolution_clock::now() - start;
+  latency = diff.count();
+
+  return true;
+}
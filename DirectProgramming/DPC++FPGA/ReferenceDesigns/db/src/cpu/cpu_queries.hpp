@@ -0,0 +1,70 @@
+#ifndef __CPU_QUERIES_HPP__
+#define __CPU_QUERIES_HPP__
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "../dbdata.hpp"
+
+//
+// A multithreaded host implementation of the queries over the same columnar
+// tables that the kernels read. It is the CPU baseline that the kernel
+// timings are compared against (see the '--cpu' flag in db.cpp).
+//
+// The tables are split into morsels of kCpuMorselRows rows that the threads
+// claim dynamically, so that a slow morsel does not stall a whole thread's
+// share of the table. Each morsel is processed with branch-free loops over
+// the columns into thread local accumulators, which the compiler can
+// vectorize, and the accumulators are merged once all morsels are done.
+//
+// The functions take the same arguments and produce the same outputs as the
+// SubmitQuery* functions. 'latency' is the wall clock time of the query in
+// ms, including building any lookup tables the query needs.
+//
+constexpr size_t kCpuMorselRows = 1 << 14;
+
+// the number of threads used by the CPU queries, defaults to the number of
+// hardware threads
+void SetCpuThreads(unsigned int threads);
+unsigned int CpuThreads();
+
+bool CpuQuery1(Database& dbinfo, DBDate low_date,
+               std::array<DBDecimal, kQuery1OutSize>& sum_qty,
+               std::array<DBDecimal, kQuery1OutSize>& sum_base_price,
+               std::array<DBDecimal, kQuery1OutSize>& sum_disc_price,
+               std::array<DBDecimal, kQuery1OutSize>& sum_charge,
+               std::array<DBDecimal, kQuery1OutSize>& avg_qty,
+               std::array<DBDecimal, kQuery1OutSize>& avg_price,
+               std::array<DBDecimal, kQuery1OutSize>& avg_discount,
+               std::array<DBDecimal, kQuery1OutSize>& count, double& latency);
+
+bool CpuQuery3(Database& dbinfo, int mktsegment, DBDate date,
+               std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+               std::array<DBDecimal, kQuery3OutSize>& revenue,
+               std::array<DBDate, kQuery3OutSize>& orderdate,
+               std::array<int, kQuery3OutSize>& shippriority,
+               double& latency);
+
+bool CpuQuery6(Database& dbinfo, DBDate low_date, DBDate high_date,
+               DBDecimal discount, DBDecimal quantity, DBDecimal& revenue,
+               double& latency);
+
+bool CpuQuery9(Database& dbinfo, std::string colour,
+               std::array<DBDecimal, 25 * 2020>& sum_profit, double& latency);
+
+bool CpuQuery11(Database& dbinfo, std::string& nation,
+                std::vector<DBIdentifier>& partkeys,
+                std::vector<DBDecimal>& values, double& latency);
+
+bool CpuQuery12(Database& dbinfo, DBDate low_date, DBDate high_date,
+                int shipmode1, int shipmode2,
+                std::array<DBDecimal, 2>& high_line_count,
+                std::array<DBDecimal, 2>& low_line_count, double& latency);
+
+bool CpuQuery14(Database& dbinfo, DBDate low_date, DBDate high_date,
+                DBDecimal& promo_revenue, DBDecimal& total_revenue,
+                double& latency);
+
+#endif /* __CPU_QUERIES_HPP__ */
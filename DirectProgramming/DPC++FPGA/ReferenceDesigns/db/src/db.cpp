@@ -21,6 +21,7 @@
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <set>
 #include <sstream>
@@ -31,6 +32,7 @@
 #include "db_utils/Date.hpp"
 #include "db_utils/LikeRegex.hpp"
 #include "dbdata.hpp"
+#include "cpu/cpu_queries.hpp"
 
 // dpc_common.hpp can be found in the dev-utilities include folder.
 // e.g., $ONEAPI_ROOT/dev-utilities/include/dpc_common.hpp
@@ -42,23 +44,45 @@ using namespace sycl;
 #if (QUERY == 1)
 #include "query1/query1_kernel.hpp"
 bool DoQuery1(queue& q, Database& dbinfo, std::string& db_root_dir,
-              std::string& args, bool test, bool print, double& kernel_latency,
-              double& total_latency);
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency);
+#elif (QUERY == 3)
+#include "query3/query3_kernel.hpp"
+bool DoQuery3(queue& q, Database& dbinfo, std::string& db_root_dir,
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency);
+#elif (QUERY == 6)
+#include "query6/query6_kernel.hpp"
+bool DoQuery6(queue& q, Database& dbinfo, std::string& db_root_dir,
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency);
 #elif (QUERY == 9)
 #include "query9/query9_kernel.hpp"
 bool DoQuery9(queue& q, Database& dbinfo, std::string& db_root_dir,
-              std::string& args, bool test, bool print, double& kernel_latency,
-              double& total_latency);
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency);
 #elif (QUERY == 11)
 #include "query11/query11_kernel.hpp"
 bool DoQuery11(queue& q, Database& dbinfo, std::string& db_root_dir,
-               std::string& args, bool test, bool print, double& kernel_latency,
-               double& total_latency);
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency);
 #elif (QUERY == 12)
 #include "query12/query12_kernel.hpp"
 bool DoQuery12(queue& q, Database& dbinfo, std::string& db_root_dir,
-               std::string& args, bool test, bool print, double& kernel_latency,
-               double& total_latency);
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency);
+#elif (QUERY == 14)
+#include "query14/query14_kernel.hpp"
+bool DoQuery14(queue& q, Database& dbinfo, std::string& db_root_dir,
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency);
 #endif
 
 //
@@ -77,6 +101,14 @@ void Help() {
                "and uses default input from TPCH documents\n";
   std::cout << "\t--print   print the query results to stdout\n";
   std::cout << "\t--runs    how many iterations of the query to run\n";
+  std::cout << "\t--cpu     also run the query with the multithreaded CPU "
+               "implementation and report its time\n";
+  std::cout << "\t--cpu-threads    the number of threads for --cpu "
+               "(default: all hardware threads)\n";
+  std::cout << "\t--no-snapshot    always parse the '.tbl' files instead of "
+               "loading (or writing) the binary snapshot in <dbroot>/snapshot\n";
+  std::cout << "\t--no-zonemaps    send every row to the kernels instead of "
+               "only the blocks that the zone maps select\n";
   std::cout << "\t--help    print this help message\n";
   std::cout << "\n";
 
@@ -88,6 +120,20 @@ void Help() {
             << "--args=1998-12-01,90\n";
   std::cout << "\n";
 
+  std::cout << "./db --dbroot=/path/to/database/files "
+            << "[--test] [--args=<SEGMENT,DATE>]\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files --test\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files "
+            << "--args=BUILDING,1995-03-15\n";
+  std::cout << "\n";
+
+  std::cout << "./db --dbroot=/path/to/database/files "
+            << "[--test] [--args=<DATE,DISCOUNT,QUANTITY>]\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files --test\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files "
+            << "--args=1994-01-01,0.06,24\n";
+  std::cout << "\n";
+
   std::cout << "./db --dbroot=/path/to/database/files "
             << "[--test] [--args=<COLOUR>]\n";
   std::cout << "\t ./db --dbroot=/path/to/database/files --test\n";
@@ -107,6 +153,13 @@ void Help() {
   std::cout << "\t ./db --dbroot=/path/to/database/files "
             << "--args=MAIL,SHIP,1994-01-10\n";
   std::cout << "\n";
+
+  std::cout << "./db --dbroot=/path/to/database/files "
+            << "[--test] [--args=<DATE>]\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files --test\n";
+  std::cout << "\t ./db --dbroot=/path/to/database/files "
+            << "--args=1995-09-01\n";
+  std::cout << "\n";
 }
 
 //
@@ -116,6 +169,17 @@ bool StrStartsWith(std::string& str, std::string prefix) {
   return str.find(prefix) == 0;
 }
 
+//
+// print how many rows of the LINEITEM table the zone map of a column selects
+// for the range [low, high], i.e. how many rows are sent to the kernels
+//
+void PrintZoneSelection(Database& dbinfo, const ZoneMap& zone,
+                        unsigned int low, unsigned int high) {
+  size_t rows = RowCount(dbinfo.ZoneSelect(zone, low, high, dbinfo.l.rows));
+  std::cout << "Zone maps select " << rows << " of " << dbinfo.l.rows
+            << " LINEITEM rows\n";
+}
+
 //
 // main
 //
@@ -132,6 +196,9 @@ int main(int argc, char* argv[]) {
   unsigned int runs = 1;
 #endif
   bool print_result = false;
+  bool use_snapshot = true;
+  bool use_zone_maps = true;
+  bool run_cpu = false;
   bool need_help = false;
 
   // parse the command line arguments
@@ -153,6 +220,14 @@ int main(int argc, char* argv[]) {
         test_query = true;
       } else if (StrStartsWith(arg, "--print")) {
         print_result = true;
+      } else if (StrStartsWith(arg, "--no-snapshot")) {
+        use_snapshot = false;
+      } else if (StrStartsWith(arg, "--no-zonemaps")) {
+        use_zone_maps = false;
+      } else if (StrStartsWith(arg, "--cpu-threads=")) {
+        SetCpuThreads(std::max(1, atoi(str_after_equals.c_str())));
+      } else if (StrStartsWith(arg, "--cpu")) {
+        run_cpu = true;
       } else if (StrStartsWith(arg, "--runs")) {
 #ifndef FPGA_EMULATOR
         // for hardware, ensure at least two iterations to ensure we can run
@@ -175,9 +250,10 @@ int main(int argc, char* argv[]) {
   }
 
   // make sure the query is supported
-  if (!(query == 1 || query == 9 || query == 11 || query == 12)) {
+  if (!(query == 1 || query == 3 || query == 6 || query == 9 || query == 11 ||
+        query == 12 || query == 14)) {
     std::cerr << "ERROR: unsupported query (" << query << "). "
-              << "Only queries 1, 9, 11 and 12 are supported\n";
+              << "Only queries 1, 3, 6, 9, 11, 12 and 14 are supported\n";
     return 1;
   }
 
@@ -204,15 +280,18 @@ int main(int argc, char* argv[]) {
     queue q(selector, dpc_common::exception_handler, props);
 
     // parse the database files located in the 'db_root_dir' directory
-    bool success = dbinfo.Parse(db_root_dir);
+    bool success = dbinfo.Parse(db_root_dir, use_snapshot);
     if (!success) {
       std::cerr << "ERROR: couldn't read the DB files\n";
       return 1;
     }
+    dbinfo.use_zone_maps = use_zone_maps;
 
-    std::cout << "Database SF = " << kSF << "\n";
+    std::cout << "Database SF = " << dbinfo.SF() << " (design SF = "
+              << kDesignSF << ")\n";
 
-    // make sure the parsed database files match the set scale factor
+    // make sure the parsed database tables are consistent with their
+    // scale factor
     if (!dbinfo.ValidateSF()) {
       std::cerr << "ERROR: could not validate the "
                 << "scale factor of the parsed database files\n";
@@ -222,6 +301,7 @@ int main(int argc, char* argv[]) {
     // track timing information for each run
     std::vector<double> total_latency(runs);
     std::vector<double> kernel_latency(runs);
+    std::vector<double> cpu_latency(runs);
 
     // run 'runs' iterations of the query
     for (unsigned int run = 0; run < runs && success; run++) {
@@ -229,29 +309,57 @@ int main(int argc, char* argv[]) {
       if (query == 1) {
 #if (QUERY == 1)
         success = DoQuery1(q, dbinfo, db_root_dir, args,
-                           test_query, print_result,
-                           kernel_latency[run], total_latency[run]);
+                           test_query, print_result, run_cpu,
+                           kernel_latency[run], total_latency[run],
+                           cpu_latency[run]);
+#endif
+      } else if (query == 3) {
+        // query3
+#if (QUERY == 3)
+        success = DoQuery3(q, dbinfo, db_root_dir, args,
+                           test_query, print_result, run_cpu,
+                           kernel_latency[run], total_latency[run],
+                           cpu_latency[run]);
+#endif
+      } else if (query == 6) {
+        // query6
+#if (QUERY == 6)
+        success = DoQuery6(q, dbinfo, db_root_dir, args,
+                           test_query, print_result, run_cpu,
+                           kernel_latency[run], total_latency[run],
+                           cpu_latency[run]);
 #endif
       } else if (query == 9) {
         // query9
 #if (QUERY == 9)
         success = DoQuery9(q, dbinfo, db_root_dir, args,
-                           test_query, print_result,
-                           kernel_latency[run], total_latency[run]);
+                           test_query, print_result, run_cpu,
+                           kernel_latency[run], total_latency[run],
+                           cpu_latency[run]);
 #endif
       } else if (query == 11) {
         // query11
 #if (QUERY == 11)
         success = DoQuery11(q, dbinfo, db_root_dir, args,
-                            test_query, print_result,
-                            kernel_latency[run], total_latency[run]);
+                            test_query, print_result, run_cpu,
+                            kernel_latency[run], total_latency[run],
+                            cpu_latency[run]);
 #endif
       } else if (query == 12) {
         // query12
 #if (QUERY == 12)
         success = DoQuery12(q, dbinfo, db_root_dir, args,
-                            test_query, print_result,
-                            kernel_latency[run], total_latency[run]);
+                            test_query, print_result, run_cpu,
+                            kernel_latency[run], total_latency[run],
+                            cpu_latency[run]);
+#endif
+      } else if (query == 14) {
+        // query14
+#if (QUERY == 14)
+        success = DoQuery14(q, dbinfo, db_root_dir, args,
+                            test_query, print_result, run_cpu,
+                            kernel_latency[run], total_latency[run],
+                            cpu_latency[run]);
 #endif
       } else {
         std::cerr << "ERROR: unsupported query (" << query << ")\n";
@@ -277,8 +385,34 @@ int main(int argc, char* argv[]) {
       std::cout << "Kernel time: " << kernel_latency_avg << " ms\n";
       std::cout << "Throughput: " << ((1 / kernel_latency_avg) * 1e3)
                 << " queries/s\n";
+#if (QUERY == 6)
+      // Q6 is a single scan of the LINEITEM table, so its throughput is
+      // bounded by the memory bandwidth. This is the effective bandwidth over
+      // the whole table, which includes the blocks skipped by the zone maps.
+      std::cout << "Scan bandwidth: "
+                << ((double)dbinfo.l.rows * kQuery6BytesPerRow * 1e-6) /
+                       (kernel_latency_avg * 1e-3)
+                << " MB/s\n";
+#endif
 #endif
 
+      if (run_cpu) {
+        // exclude the 'warmup' iteration, if there is one
+        const unsigned int first_run = (runs > 1) ? 1 : 0;
+        double cpu_latency_avg =
+            std::accumulate(cpu_latency.begin() + first_run,
+                            cpu_latency.end(), 0.0) /
+            (double)(runs - first_run);
+
+        std::cout << "CPU time: " << cpu_latency_avg << " ms ("
+                  << CpuThreads() << " threads)\n";
+#ifndef FPGA_EMULATOR
+        std::cout << "Speedup over CPU: "
+                  << (cpu_latency_avg / total_latency_avg) << "x (processing), "
+                  << (cpu_latency_avg / kernel_latency_avg) << "x (kernel)\n";
+#endif
+      }
+
       std::cout << "PASSED\n";
     } else {
       std::cout << "FAILED\n";
@@ -303,8 +437,9 @@ int main(int argc, char* argv[]) {
 
 #if (QUERY == 1)
 bool DoQuery1(queue& q, Database& dbinfo, std::string& db_root_dir,
-              std::string& args, bool test, bool print, double& kernel_latency,
-              double& total_latency) {
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency) {
   // NOTE: this is fixed based on the TPCH docs
   Date date = Date("1998-12-01");
   unsigned int DELTA = 90;
@@ -333,6 +468,7 @@ bool DoQuery1(queue& q, Database& dbinfo, std::string& db_root_dir,
 
   std::cout << "Running Q1 within " << DELTA << " days of " << date.year << "-"
             << date.month << "-" << date.day << std::endl;
+  PrintZoneSelection(dbinfo, dbinfo.l.shipdate_zone, 0, low_date_compact);
 
   // the query output data
   std::array<DBDecimal, kQuery1OutSize> sum_qty = {0}, sum_base_price = {0},
@@ -361,14 +497,209 @@ bool DoQuery1(queue& q, Database& dbinfo, std::string& db_root_dir,
     }
   }
 
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    std::array<DBDecimal, kQuery1OutSize> cpu_sum_qty, cpu_sum_base_price,
+        cpu_sum_disc_price, cpu_sum_charge, cpu_avg_qty, cpu_avg_price,
+        cpu_avg_discount, cpu_count;
+
+    success = CpuQuery1(dbinfo, low_date_compact, cpu_sum_qty,
+                        cpu_sum_base_price, cpu_sum_disc_price, cpu_sum_charge,
+                        cpu_avg_qty, cpu_avg_price, cpu_avg_discount,
+                        cpu_count, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ1(db_root_dir, cpu_sum_qty, cpu_sum_base_price,
+                                  cpu_sum_disc_price, cpu_sum_charge,
+                                  cpu_avg_qty, cpu_avg_price, cpu_avg_discount,
+                                  cpu_count);
+    }
+  }
+
+  return success;
+}
+#endif
+
+#if (QUERY == 3)
+bool DoQuery3(queue& q, Database& dbinfo, std::string& db_root_dir,
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency) {
+  // the default market segment and date, based on the TPCH documents
+  std::string segment = "BUILDING";
+  Date date = Date("1995-03-15");
+
+  // parse the query arguments
+  if (!test && !args.empty()) {
+    std::stringstream ss(args);
+    std::string tmp;
+
+    std::getline(ss, segment, ',');
+
+    if (ss.good()) {
+      std::getline(ss, tmp, ',');
+      date = Date(tmp);
+    }
+  } else {
+    if (!args.empty()) {
+      std::cout << "Testing query 3, therefore ignoring the '--args' flag\n";
+    }
+  }
+
+  // convert the market segment to uppercase characters (convention)
+  transform(segment.begin(), segment.end(), segment.begin(), ::toupper);
+
+  std::cout << "Running Q3 for market segment " << segment << " on "
+            << date.year << "-" << date.month << "-" << date.day << std::endl;
+  PrintZoneSelection(dbinfo, dbinfo.l.shipdate_zone, date.ToCompact() + 1,
+                     std::numeric_limits<DBDate>::max());
+
+  // the output of the query
+  std::array<DBIdentifier, kQuery3OutSize> orderkey;
+  std::array<DBDecimal, kQuery3OutSize> revenue;
+  std::array<DBDate, kQuery3OutSize> orderdate;
+  std::array<int, kQuery3OutSize> shippriority;
+
+  // perform the query
+  bool success = SubmitQuery3(q, dbinfo, MktsegmentStrToInt(segment),
+                              date.ToCompact(), orderkey, revenue, orderdate,
+                              shippriority, kernel_latency, total_latency);
+
+  if (success) {
+    // validate the results of the query, if requested
+    if (test) {
+      success = dbinfo.ValidateQ3(MktsegmentStrToInt(segment),
+                                  date.ToCompact(), orderkey, revenue,
+                                  orderdate, shippriority);
+    }
+
+    // print the results of the query, if requested
+    if (print) {
+      dbinfo.PrintQ3(orderkey, revenue, orderdate, shippriority);
+    }
+  }
+
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    std::array<DBIdentifier, kQuery3OutSize> cpu_orderkey;
+    std::array<DBDecimal, kQuery3OutSize> cpu_revenue;
+    std::array<DBDate, kQuery3OutSize> cpu_orderdate;
+    std::array<int, kQuery3OutSize> cpu_shippriority;
+
+    success = CpuQuery3(dbinfo, MktsegmentStrToInt(segment), date.ToCompact(),
+                        cpu_orderkey, cpu_revenue, cpu_orderdate,
+                        cpu_shippriority, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ3(MktsegmentStrToInt(segment),
+                                  date.ToCompact(), cpu_orderkey, cpu_revenue,
+                                  cpu_orderdate, cpu_shippriority);
+    }
+  }
+
+  return success;
+}
+#endif
+
+#if (QUERY == 6)
+bool DoQuery6(queue& q, Database& dbinfo, std::string& db_root_dir,
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency) {
+  // the default date, discount and quantity, based on the TPCH documents
+  Date date = Date("1994-01-01");
+  double discount = 0.06;
+  unsigned int quantity = 24;
+
+  // parse the query arguments
+  if (!test && !args.empty()) {
+    std::stringstream ss(args);
+    std::string tmp;
+
+    std::getline(ss, tmp, ',');
+    date = Date(tmp);
+
+    if (ss.good()) {
+      std::getline(ss, tmp, ',');
+      discount = atof(tmp.c_str());
+    }
+
+    if (ss.good()) {
+      std::getline(ss, tmp, ',');
+      quantity = atoi(tmp.c_str());
+    }
+  } else {
+    if (!args.empty()) {
+      std::cout << "Testing query 6, therefore ignoring the '--args' flag\n";
+    }
+  }
+
+  // check the arguments, date must be January 1 of some year
+  if (date.month != 1 || date.day != 1) {
+    std::cerr << "ERROR: Date must be first of January "
+              << "in the given year (e.g. 1994-01-01)\n";
+    return false;
+  }
+
+  // compute the interval for the query
+  Date low_date = date;
+  Date high_date = Date(low_date.year + 1, low_date.month, low_date.day);
+
+  // the DISCOUNT column is stored in hundredths
+  DBDecimal discount_int = (DBDecimal)(discount * 100.0 + 0.5);
+
+  std::cout << "Running Q6 between years " << low_date.year << " and "
+            << high_date.year << " for DISCOUNT " << discount
+            << " and QUANTITY " << quantity << std::endl;
+  PrintZoneSelection(dbinfo, dbinfo.l.shipdate_zone, low_date.ToCompact(),
+                     high_date.ToCompact() - 1);
+
+  // the output of the query
+  DBDecimal revenue;
+
+  // perform the query
+  bool success = SubmitQuery6(q, dbinfo, low_date.ToCompact(),
+                              high_date.ToCompact(), discount_int, quantity,
+                              revenue, kernel_latency, total_latency);
+
+  if (success) {
+    // validate the results of the query, if requested
+    if (test) {
+      success = dbinfo.ValidateQ6(low_date.ToCompact(), high_date.ToCompact(),
+                                  discount_int, quantity, revenue);
+    }
+
+    // print the results of the query, if requested
+    if (print) {
+      dbinfo.PrintQ6(revenue);
+    }
+  }
+
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    DBDecimal cpu_revenue;
+
+    success = CpuQuery6(dbinfo, low_date.ToCompact(), high_date.ToCompact(),
+                        discount_int, quantity, cpu_revenue, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ6(low_date.ToCompact(), high_date.ToCompact(),
+                                  discount_int, quantity, cpu_revenue);
+    }
+  }
+
   return success;
 }
 #endif
 
 #if (QUERY == 9)
 bool DoQuery9(queue& q, Database& dbinfo, std::string& db_root_dir,
-              std::string& args, bool test, bool print, double& kernel_latency,
-              double& total_latency) {
+              std::string& args, bool test, bool print, bool cpu,
+              double& kernel_latency, double& total_latency,
+              double& cpu_latency) {
   // the default colour regex based on the TPCH documents
   std::string colour = "GREEN";
 
@@ -406,14 +737,27 @@ bool DoQuery9(queue& q, Database& dbinfo, std::string& db_root_dir,
     }
   }
 
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    std::array<DBDecimal, 25 * 2020> cpu_sum_profit;
+
+    success = CpuQuery9(dbinfo, colour, cpu_sum_profit, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ9(db_root_dir, cpu_sum_profit);
+    }
+  }
+
   return success;
 }
 #endif
 
 #if (QUERY == 11)
 bool DoQuery11(queue& q, Database& dbinfo, std::string& db_root_dir,
-               std::string& args, bool test, bool print, double& kernel_latency,
-               double& total_latency) {
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency) {
   // the default nation, based on the TPCH documents
   std::string nation = "GERMANY";
 
@@ -435,8 +779,8 @@ bool DoQuery11(queue& q, Database& dbinfo, std::string& db_root_dir,
             << std::endl;
 
   // the query output
-  std::vector<DBIdentifier> partkeys(kPartTableSize);
-  std::vector<DBDecimal> partkey_values(kPartTableSize);
+  std::vector<DBIdentifier> partkeys(dbinfo.p.rows);
+  std::vector<DBDecimal> partkey_values(dbinfo.p.rows);
 
   // perform the query
   bool success = SubmitQuery11(q, dbinfo, nation, partkeys, partkey_values,
@@ -454,14 +798,30 @@ bool DoQuery11(queue& q, Database& dbinfo, std::string& db_root_dir,
     }
   }
 
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    std::vector<DBIdentifier> cpu_partkeys;
+    std::vector<DBDecimal> cpu_partkey_values;
+
+    success = CpuQuery11(dbinfo, nation, cpu_partkeys, cpu_partkey_values,
+                         cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success =
+          dbinfo.ValidateQ11(db_root_dir, cpu_partkeys, cpu_partkey_values);
+    }
+  }
+
   return success;
 }
 #endif
 
 #if (QUERY == 12)
 bool DoQuery12(queue& q, Database& dbinfo, std::string& db_root_dir,
-               std::string& args, bool test, bool print, double& kernel_latency,
-               double& total_latency) {
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency) {
   // the default query date and shipmodes, based on the TPCH documents
   Date date = Date("1994-01-01");
   std::string shipmode1 = "MAIL", shipmode2 = "SHIP";
@@ -501,6 +861,8 @@ bool DoQuery12(queue& q, Database& dbinfo, std::string& db_root_dir,
   std::cout << "Running Q12 between years " << low_date.year << " and "
             << high_date.year << " for SHIPMODES " << shipmode1 << " and "
             << shipmode2 << std::endl;;
+  PrintZoneSelection(dbinfo, dbinfo.l.receiptdate_zone, low_date.ToCompact(),
+                     high_date.ToCompact() - 1);
 
   // the output of the query
   std::array<DBDecimal, 2> high_line_count, low_line_count;
@@ -524,6 +886,100 @@ bool DoQuery12(queue& q, Database& dbinfo, std::string& db_root_dir,
     }
   }
 
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    std::array<DBDecimal, 2> cpu_high_line_count, cpu_low_line_count;
+
+    success = CpuQuery12(dbinfo, low_date.ToCompact(), high_date.ToCompact(),
+                         ShipmodeStrToInt(shipmode1),
+                         ShipmodeStrToInt(shipmode2), cpu_high_line_count,
+                         cpu_low_line_count, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ12(db_root_dir, cpu_high_line_count,
+                                   cpu_low_line_count);
+    }
+  }
+
+  return success;
+}
+#endif
+
+#if (QUERY == 14)
+bool DoQuery14(queue& q, Database& dbinfo, std::string& db_root_dir,
+               std::string& args, bool test, bool print, bool cpu,
+               double& kernel_latency, double& total_latency,
+               double& cpu_latency) {
+  // the default query date, based on the TPCH documents
+  Date date = Date("1995-09-01");
+
+  // parse the query arguments
+  if (!test && !args.empty()) {
+    std::stringstream ss(args);
+    std::string tmp;
+
+    std::getline(ss, tmp, ',');
+    date = Date(tmp);
+  } else {
+    if (!args.empty()) {
+      std::cout << "Testing query 14, therefore ignoring the '--args' flag\n";
+    }
+  }
+
+  // check the arguments, date must be the first of some month
+  if (date.day != 1) {
+    std::cerr << "ERROR: Date must be the first of a month "
+              << "(e.g. 1995-09-01)\n";
+    return false;
+  }
+
+  // compute the one month interval for the query
+  Date low_date = date;
+  Date high_date = (low_date.month == 12)
+                       ? Date(low_date.year + 1, 1, 1)
+                       : Date(low_date.year, low_date.month + 1, 1);
+
+  std::cout << "Running Q14 for the month of " << low_date.year << "-"
+            << low_date.month << std::endl;
+  PrintZoneSelection(dbinfo, dbinfo.l.shipdate_zone, low_date.ToCompact(),
+                     high_date.ToCompact() - 1);
+
+  // the output of the query
+  DBDecimal promo_revenue, total_revenue;
+
+  // perform the query
+  bool success = SubmitQuery14(q, dbinfo, low_date.ToCompact(),
+                               high_date.ToCompact(), promo_revenue,
+                               total_revenue, kernel_latency, total_latency);
+
+  if (success) {
+    // validate the results of the query, if requested
+    if (test) {
+      success = dbinfo.ValidateQ14(low_date.ToCompact(), high_date.ToCompact(),
+                                   promo_revenue, total_revenue);
+    }
+
+    // print the results of the query, if requested
+    if (print) {
+      dbinfo.PrintQ14(promo_revenue, total_revenue);
+    }
+  }
+
+  // run the query with the CPU implementation, if requested
+  if (success && cpu) {
+    DBDecimal cpu_promo_revenue, cpu_total_revenue;
+
+    success = CpuQuery14(dbinfo, low_date.ToCompact(), high_date.ToCompact(),
+                         cpu_promo_revenue, cpu_total_revenue, cpu_latency);
+
+    if (success && test) {
+      std::cout << "Validating the CPU results\n";
+      success = dbinfo.ValidateQ14(low_date.ToCompact(), high_date.ToCompact(),
+                                   cpu_promo_revenue, cpu_total_revenue);
+    }
+  }
+
   return success;
 }
 #endif
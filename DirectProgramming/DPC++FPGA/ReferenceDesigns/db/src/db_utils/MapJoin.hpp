@@ -15,9 +15,15 @@
 //
 // MapJoin implementation
 //
+// 'map_data' and 'map_valid' are indexed by the primary key of the T2Data
+// minus 'map_key_offset', so that a map smaller than the key space can hold
+// one range of keys. The producer of T2Pipe must mark rows whose key falls
+// outside of that range as invalid.
+//
 template<typename MapType, typename T2Pipe, typename T2Data, int t2_win_size,
          typename JoinPipe, typename JoinType>
-void MapJoin(MapType map_data[], bool map_valid[]) {
+void MapJoin(MapType map_data[], bool map_valid[],
+             unsigned int map_key_offset = 0) {
   //////////////////////////////////////////////////////////////////////////////
   // static asserts
   static_assert(t2_win_size > 0,
@@ -55,7 +61,7 @@ void MapJoin(MapType map_data[], bool map_valid[]) {
       UnrolledLoop<0, t2_win_size>([&](auto j) {
         const bool t2_win_valid = in_data.data.template get<j>().valid;
         const unsigned int t2_key =
-            in_data.data.template get<j>().PrimaryKey();
+            in_data.data.template get<j>().PrimaryKey() - map_key_offset;
 
         if (t2_win_valid && map_valid[t2_key]) {
           // NOTE: order below important if Join() overrides valid
@@ -8,8 +8,22 @@
 #include <sstream>
 #include <string>
 #include <stdio.h>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string_view>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "dbdata.hpp"
 #include "db_utils/Date.hpp"
 
@@ -38,38 +52,47 @@ std::vector<std::string> SplitRowStr(const std::string& row) {
 //
 // appends 'n' characters of a string to a vector
 //
-void AppendStringToCharVec(std::vector<char>& v, const std::string& str,
+void AppendStringToCharVec(std::vector<char>& v, std::string_view str,
                            const unsigned int n) {
   // append the 'n' characters, padding with null terminators ('\0')
-  const size_t str_n = str.size();
-  for (size_t i = 0; i < n; i++) {
-    v.push_back(i < str_n ? str[i] : '\0');
-  }
+  const size_t start = v.size();
+  v.resize(start + n, '\0');
+  std::memcpy(v.data() + start, str.data(), std::min<size_t>(str.size(), n));
 }
 
 //
 // convert a money string (i.e. '1209.12' dollars) to
 // the internal 'cents' representation (i.e. '120912' cents)
 //
-DBDecimal MoneyFloatToCents(const std::string& money_float_str) {
-  // parse money string
-  std::istringstream ss(money_float_str);
-  std::string dollars_str, cents_str;
-
-  std::getline(ss, dollars_str, '.');
-  std::getline(ss, cents_str, '.');
-  
-  DBDecimal dollars = atoi(dollars_str.c_str());
-  DBDecimal cents = atoi(cents_str.c_str());
+DBDecimal MoneyFloatToCents(std::string_view money_float_str, bool& ok) {
+  const char* p = money_float_str.data();
+  const char* end = p + money_float_str.size();
+
+  bool negative = (p < end && *p == '-');
+  if (negative) p++;
+
+  DBDecimal dollars = 0;
+  auto [ptr, ec] = std::from_chars(p, end, dollars);
+  ok &= (ec == std::errc());
+  p = ptr;
+
+  // up to two digits of cents
+  DBDecimal cents = 0;
+  if (p < end && *p == '.') p++;
+  for (int i = 0; i < 2; i++) {
+    cents *= 10;
+    if (p < end && std::isdigit((unsigned char)*p)) cents += *p++ - '0';
+  }
 
   // convert to fixed point format (i.e. in cents)
-  return dollars * 100 + cents;
+  DBDecimal value = dollars * 100 + cents;
+  return negative ? -value : value;
 }
 
 //
 // convert a SHIPMODE string to the internal representation (integer)
 //
-int ShipmodeStrToInt(std::string& shipmode_str) {
+int ShipmodeStrToInt(std::string_view shipmode_str) {
   if (shipmode_str == "REG AIR") {
     return 0;
   } else if (shipmode_str == "AIR") {
@@ -91,6 +114,27 @@ int ShipmodeStrToInt(std::string& shipmode_str) {
   }
 }
 
+//
+// convert a MKTSEGMENT string to the internal representation (integer)
+//
+int MktsegmentStrToInt(std::string_view mktsegment_str) {
+  if (mktsegment_str == "AUTOMOBILE") {
+    return 0;
+  } else if (mktsegment_str == "BUILDING") {
+    return 1;
+  } else if (mktsegment_str == "FURNITURE") {
+    return 2;
+  } else if (mktsegment_str == "HOUSEHOLD") {
+    return 3;
+  } else if (mktsegment_str == "MACHINERY") {
+    return 4;
+  } else {
+    std::cerr << "WARNING: Found unknown MKTSEGMENT '" << mktsegment_str
+              << " defaulting to AUTOMOBILE\n";
+    return 0;
+  }
+}
+
 //
 // check if two decimal values are within an epsilon of each other
 //
@@ -124,11 +168,379 @@ void trim(std::string& s) {
   rtrim(s);
 }
 
+//
+// trim leading and trailing whitespace of a string_view
+//
+std::string_view TrimView(std::string_view s) {
+  while (!s.empty() && std::isspace((unsigned char)s.front())) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace((unsigned char)s.back())) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+//
+// a read-only view of a whole file: memory mapped on POSIX systems and
+// read into memory otherwise
+//
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+#if defined(__unix__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      size_ = st.st_size;
+      if (size_ == 0) {
+        valid_ = true;
+      } else {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+          madvise(map, size_, MADV_SEQUENTIAL);
+          map_ = map;
+          data_ = static_cast<const char*>(map);
+          valid_ = true;
+        }
+      }
+    }
+    close(fd);
+#else
+    std::ifstream ifs(path, std::ios::binary | std::ios::ate);
+    if (!ifs.is_open()) return;
+
+    buf_.resize(ifs.tellg());
+    ifs.seekg(0);
+    ifs.read(buf_.data(), buf_.size());
+    data_ = buf_.data();
+    size_ = buf_.size();
+    valid_ = ifs.good();
+#endif
+  }
+
+  ~MappedFile() {
+#if defined(__unix__)
+    if (map_ != nullptr) munmap(map_, size_);
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool valid() const { return valid_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool valid_ = false;
+#if defined(__unix__)
+  void* map_ = nullptr;
+#else
+  std::vector<char> buf_;
+#endif
+};
+
+//
+// the columns of each table as (name, member) pairs, for code that does the
+// same thing to every column (concatenating parsed segments, snapshots)
+//
+template <typename Table, typename T>
+struct Column {
+  const char* name;
+  std::vector<T> Table::*member;
+};
+
+template <typename Table, typename T>
+constexpr Column<Table, T> MakeColumn(const char* name,
+                                      std::vector<T> Table::*member) {
+  return {name, member};
+}
+
+auto TableColumns(const LineItemTable*) {
+  using Tbl = LineItemTable;
+  return std::make_tuple(MakeColumn("orderkey", &Tbl::orderkey),
+                         MakeColumn("partkey", &Tbl::partkey),
+                         MakeColumn("suppkey", &Tbl::suppkey),
+                         MakeColumn("linenumber", &Tbl::linenumber),
+                         MakeColumn("quantity", &Tbl::quantity),
+                         MakeColumn("extendedprice", &Tbl::extendedprice),
+                         MakeColumn("discount", &Tbl::discount),
+                         MakeColumn("tax", &Tbl::tax),
+                         MakeColumn("returnflag", &Tbl::returnflag),
+                         MakeColumn("linestatus", &Tbl::linestatus),
+                         MakeColumn("shipdate", &Tbl::shipdate),
+                         MakeColumn("commitdate", &Tbl::commitdate),
+                         MakeColumn("receiptdate", &Tbl::receiptdate),
+                         MakeColumn("shipinstruct", &Tbl::shipinstruct),
+                         MakeColumn("shipmode", &Tbl::shipmode),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const OrdersTable*) {
+  using Tbl = OrdersTable;
+  return std::make_tuple(MakeColumn("orderkey", &Tbl::orderkey),
+                         MakeColumn("custkey", &Tbl::custkey),
+                         MakeColumn("orderstatus", &Tbl::orderstatus),
+                         MakeColumn("totalprice", &Tbl::totalprice),
+                         MakeColumn("orderdate", &Tbl::orderdate),
+                         MakeColumn("orderpriority", &Tbl::orderpriority),
+                         MakeColumn("clerk", &Tbl::clerk),
+                         MakeColumn("shippriority", &Tbl::shippriority),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const PartsTable*) {
+  using Tbl = PartsTable;
+  return std::make_tuple(MakeColumn("partkey", &Tbl::partkey),
+                         MakeColumn("name", &Tbl::name),
+                         MakeColumn("mfgr", &Tbl::mfgr),
+                         MakeColumn("brand", &Tbl::brand),
+                         MakeColumn("type", &Tbl::type),
+                         MakeColumn("size", &Tbl::size),
+                         MakeColumn("container", &Tbl::container),
+                         MakeColumn("retailprice", &Tbl::retailprice),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const SupplierTable*) {
+  using Tbl = SupplierTable;
+  return std::make_tuple(MakeColumn("suppkey", &Tbl::suppkey),
+                         MakeColumn("name", &Tbl::name),
+                         MakeColumn("address", &Tbl::address),
+                         MakeColumn("nationkey", &Tbl::nationkey),
+                         MakeColumn("phone", &Tbl::phone),
+                         MakeColumn("acctbal", &Tbl::acctbal),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const PartSupplierTable*) {
+  using Tbl = PartSupplierTable;
+  return std::make_tuple(MakeColumn("partkey", &Tbl::partkey),
+                         MakeColumn("suppkey", &Tbl::suppkey),
+                         MakeColumn("availqty", &Tbl::availqty),
+                         MakeColumn("supplycost", &Tbl::supplycost),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const CustomerTable*) {
+  using Tbl = CustomerTable;
+  return std::make_tuple(MakeColumn("custkey", &Tbl::custkey),
+                         MakeColumn("name", &Tbl::name),
+                         MakeColumn("address", &Tbl::address),
+                         MakeColumn("nationkey", &Tbl::nationkey),
+                         MakeColumn("phone", &Tbl::phone),
+                         MakeColumn("acctbal", &Tbl::acctbal),
+                         MakeColumn("mktsegment", &Tbl::mktsegment),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+auto TableColumns(const NationTable*) {
+  using Tbl = NationTable;
+  return std::make_tuple(MakeColumn("nationkey", &Tbl::nationkey),
+                         MakeColumn("name", &Tbl::name),
+                         MakeColumn("regionkey", &Tbl::regionkey),
+                         MakeColumn("comment", &Tbl::comment));
+}
+
+//
+// calls 'f(name, column)' for every column of a table
+//
+template <typename Table, typename F>
+void ForEachColumn(Table& tbl, F&& f) {
+  std::apply([&](auto... col) { (f(col.name, tbl.*(col.member)), ...); },
+             TableColumns(&tbl));
+}
+
+//
+// scans the '|' separated fields of one row of a '.tbl' file in place,
+// without copying or allocating. A missing or malformed field clears ok().
+//
+class RowScanner {
+ public:
+  RowScanner(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+  bool ok() const { return ok_; }
+
+  // the next field, up to the next separator or the end of the row
+  std::string_view Next() {
+    if (p_ >= end_) {
+      ok_ = false;
+      return {};
+    }
+    const char* sep =
+        static_cast<const char*>(std::memchr(p_, '|', end_ - p_));
+    if (sep == nullptr) sep = end_;
+    std::string_view field(p_, sep - p_);
+    p_ = (sep == end_) ? end_ : sep + 1;
+    return field;
+  }
+
+  template <typename T>
+  T NextInt() {
+    std::string_view f = Next();
+    long long value = 0;
+    auto [ptr, ec] = std::from_chars(f.data(), f.data() + f.size(), value);
+    ok_ &= (ec == std::errc());
+    return (T)value;
+  }
+
+  DBDecimal NextMoney() { return MoneyFloatToCents(Next(), ok_); }
+
+  // a 'YYYY-MM-DD' date, in the compact representation
+  DBDate NextDate() {
+    std::string_view f = Next();
+    int y = 0, m = 0, d = 0;
+    ok_ &= (f.size() == 10 &&
+            std::from_chars(f.data(), f.data() + 4, y).ec == std::errc() &&
+            std::from_chars(f.data() + 5, f.data() + 7, m).ec == std::errc() &&
+            std::from_chars(f.data() + 8, f.data() + 10, d).ec == std::errc());
+    return Date(y, m, d).ToCompact();
+  }
+
+  char NextChar() {
+    std::string_view f = Next();
+    ok_ &= !f.empty();
+    return f.empty() ? '\0' : f[0];
+  }
+
+  // appends the next field to a column of 'n' character strings
+  void NextString(std::vector<char>& col, const unsigned int n) {
+    AppendStringToCharVec(col, Next(), n);
+  }
+
+ private:
+  const char* p_;
+  const char* end_;
+  bool ok_ = true;
+};
+
+//
+// parses the rows of the '.tbl' file 'f' into 'tbl' using all host cores.
+//
+// The file is split into line-aligned chunks, one per thread. Each thread
+// appends its rows to its own segment of the columns with 'parse_row', and
+// the segments are concatenated in file order at the end, so the result is
+// the same as parsing the file row by row.
+//
+template <typename Table, typename RowParser>
+bool ParseTableParallel(const std::string& f, const std::string& name,
+                        Table& tbl, RowParser parse_row) {
+  MappedFile file(f);
+  if (!file.valid()) {
+    std::cout << "Failed to parse " << name << " table\n";
+    return false;
+  }
+
+  // below this chunk size, starting a thread costs more than it saves
+  constexpr size_t kMinChunkBytes = 1 << 20;
+  size_t num_chunks =
+      std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                       std::max<size_t>(1, file.size() / kMinChunkBytes));
+
+  // split the file evenly, then move each split to the start of a line
+  const char* begin = file.data();
+  const char* end = begin + file.size();
+  std::vector<const char*> bounds(num_chunks + 1, end);
+  bounds[0] = begin;
+  for (size_t c = 1; c < num_chunks; c++) {
+    const char* p =
+        std::max(begin + c * (file.size() / num_chunks), bounds[c - 1]);
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    bounds[c] = nl ? nl + 1 : end;
+  }
+
+  std::vector<Table> segments(num_chunks);
+  std::vector<char> chunk_ok(num_chunks, true);
+
+  auto parse_chunk = [&](size_t c) {
+    Table& seg = segments[c];
+    seg.rows = 0;
+    const char* p = bounds[c];
+    const char* chunk_end = bounds[c + 1];
+    while (p < chunk_end && chunk_ok[c]) {
+      const char* nl =
+          static_cast<const char*>(std::memchr(p, '\n', chunk_end - p));
+      const char* line_end = nl ? nl : chunk_end;
+      const char* row_end = line_end;
+      if (row_end > p && row_end[-1] == '\r') row_end--;
+
+      if (row_end > p) {
+        RowScanner scanner(p, row_end);
+        parse_row(scanner, seg);
+        chunk_ok[c] = scanner.ok();
+        seg.rows++;
+      }
+      p = line_end + 1;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t c = 1; c < num_chunks; c++) {
+    threads.emplace_back(parse_chunk, c);
+  }
+  parse_chunk(0);
+  for (auto& t : threads) t.join();
+
+  for (size_t c = 0; c < num_chunks; c++) {
+    if (!chunk_ok[c]) {
+      std::cout << "Failed to parse " << name << " table (malformed row)\n";
+      return false;
+    }
+  }
+
+  // concatenate the segments, freeing each one as it is copied
+  tbl.rows = 0;
+  for (auto& seg : segments) {
+    tbl.rows += seg.rows;
+  }
+  std::apply(
+      [&](auto... column) {
+        auto concatenate = [&](auto member) {
+          auto& dst = tbl.*member;
+          size_t count = dst.size();
+          for (auto& seg : segments) count += (seg.*member).size();
+          dst.reserve(count);
+          for (auto& seg : segments) {
+            dst.insert(dst.end(), (seg.*member).begin(), (seg.*member).end());
+            (seg.*member).clear();
+            (seg.*member).shrink_to_fit();
+          }
+        };
+        (concatenate(column.member), ...);
+      },
+      TableColumns(&tbl));
+
+  return true;
+}
+
+//
+// builds the NATION name/key maps from the parsed nationkey and name columns
+//
+void BuildNationMaps(NationTable& tbl) {
+  for (size_t i = 0; i < tbl.rows; i++) {
+    const char* name = tbl.name.data() + i * 25;
+    std::string nationname(name, strnlen(name, 25));
+    tbl.name_key_map[nationname] = tbl.nationkey[i];
+    tbl.key_name_map[tbl.nationkey[i]] = nationname;
+  }
+}
+
 //
 // the main parsing function
 // parses '*.tbl' files location in directory 'db_root_dir'
 //
-bool Database::Parse(std::string db_root_dir) {
+bool Database::Parse(std::string db_root_dir, bool use_snapshot) {
+  // the snapshot makes parsing a one-time cost
+  if (use_snapshot && LoadSnapshot(db_root_dir)) {
+    BuildZoneMaps();
+    return true;
+  }
+
   std::cout << "Parsing database files in: " << db_root_dir << std::endl;
 
   bool success = true;
@@ -139,54 +551,116 @@ bool Database::Parse(std::string db_root_dir) {
   success &= ParsePartsTable(db_root_dir + kSeparator + "part.tbl", p);
   success &= ParseSupplierTable(db_root_dir + kSeparator + "supplier.tbl", s);
   success &= ParsePartSupplierTable(db_root_dir + kSeparator + "partsupp.tbl", ps);
+  success &= ParseCustomerTable(db_root_dir + kSeparator + "customer.tbl", c);
   success &= ParseNationTable(db_root_dir + kSeparator + "nation.tbl", n);
 
+  // failing to write the snapshot only costs the next run a re-parse
+  if (success && use_snapshot && !SaveSnapshot(db_root_dir)) {
+    std::cerr << "WARNING: could not write the database snapshot\n";
+  }
+
+  if (success) {
+    BuildZoneMaps();
+  }
+
   return success;
 }
 
 //
-// parse the LINEITEM table
+// build the zone maps of the columns that the queries filter on
 //
-bool Database::ParseLineItemTable(std::string f, LineItemTable& tbl) {
-  std::cout << "Parsing LINEITEM table from: " << f << "\n";
+void Database::BuildZoneMaps() {
+  l.orderkey_zone.Build(l.orderkey, l.rows);
+  l.shipdate_zone.Build(l.shipdate, l.rows);
+  l.receiptdate_zone.Build(l.receiptdate, l.rows);
+  o.orderdate_zone.Build(o.orderdate, o.rows);
+}
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
+RowRanges Database::ZoneSelect(const ZoneMap& zone, unsigned int low,
+                               unsigned int high, size_t rows) const {
+  if (!use_zone_maps) {
+    return RowRanges{{0, rows}};
+  }
+  return zone.Select(low, high, rows);
+}
 
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse LINEITEM table\n";
-    return false;
+void ZoneMap::Build(const std::vector<unsigned int>& column, size_t rows) {
+  const size_t blocks = (rows + kZoneMapBlockRows - 1) / kZoneMapBlockRows;
+  min.resize(blocks);
+  max.resize(blocks);
+
+  for (size_t b = 0; b < blocks; b++) {
+    const size_t begin = b * kZoneMapBlockRows;
+    const size_t end = std::min(rows, begin + kZoneMapBlockRows);
+    unsigned int block_min = column[begin], block_max = column[begin];
+    for (size_t i = begin + 1; i < end; i++) {
+      block_min = std::min(block_min, column[i]);
+      block_max = std::max(block_max, column[i]);
+    }
+    min[b] = block_min;
+    max[b] = block_max;
   }
+}
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 16);
+RowRanges ZoneMap::Select(unsigned int low, unsigned int high,
+                          size_t rows) const {
+  RowRanges ranges;
+  for (size_t b = 0; b < min.size(); b++) {
+    if (max[b] < low || min[b] > high) {
+      continue;
+    }
+
+    const size_t begin = b * kZoneMapBlockRows;
+    const size_t end = std::min(rows, begin + kZoneMapBlockRows);
+    if (!ranges.empty() && ranges.back().second == begin) {
+      ranges.back().second = end;
+    } else {
+      ranges.push_back({begin, end});
+    }
+  }
+  return ranges;
+}
+
+size_t RowCount(const RowRanges& ranges) {
+  size_t count = 0;
+  for (auto& r : ranges) {
+    count += r.second - r.first;
+  }
+  return count;
+}
+
+//
+// parse the LINEITEM table
+//
+bool Database::ParseLineItemTable(std::string f, LineItemTable& tbl) {
+  std::cout << "Parsing LINEITEM table from: " << f << "\n";
 
-    tbl.orderkey.push_back(std::stoll(column_data[0]));
-    tbl.partkey.push_back(std::stoll(column_data[1]));
-    tbl.suppkey.push_back(std::stoll(column_data[2]));
-    tbl.linenumber.push_back(std::stoll(column_data[3]));
-    tbl.quantity.push_back(std::stoll(column_data[4]));
+  bool success = ParseTableParallel(
+      f, "LINEITEM", tbl, [](RowScanner& s, LineItemTable& t) {
+        t.orderkey.push_back(s.NextInt<DBIdentifier>());
+        t.partkey.push_back(s.NextInt<DBIdentifier>());
+        t.suppkey.push_back(s.NextInt<DBIdentifier>());
+        t.linenumber.push_back(s.NextInt<DBInt>());
+        t.quantity.push_back(s.NextInt<DBDecimal>());
 
-    tbl.extendedprice.push_back(MoneyFloatToCents(column_data[5]));
-    tbl.discount.push_back(MoneyFloatToCents(column_data[6]));
-    tbl.tax.push_back(MoneyFloatToCents(column_data[7]));
+        t.extendedprice.push_back(s.NextMoney());
+        t.discount.push_back(s.NextMoney());
+        t.tax.push_back(s.NextMoney());
 
-    tbl.returnflag.push_back(column_data[8].at(0));
-    tbl.linestatus.push_back(column_data[9].at(0));
+        t.returnflag.push_back(s.NextChar());
+        t.linestatus.push_back(s.NextChar());
 
-    tbl.shipdate.push_back(Date(column_data[10]).ToCompact());
-    tbl.commitdate.push_back(Date(column_data[11]).ToCompact());
-    tbl.receiptdate.push_back(Date(column_data[12]).ToCompact());
+        t.shipdate.push_back(s.NextDate());
+        t.commitdate.push_back(s.NextDate());
+        t.receiptdate.push_back(s.NextDate());
 
-    AppendStringToCharVec(tbl.shipinstruct, column_data[13], 25);
-    tbl.shipmode.push_back(ShipmodeStrToInt(column_data[14]));
-    AppendStringToCharVec(tbl.comment, column_data[15], 44);
+        s.NextString(t.shipinstruct, 25);
+        t.shipmode.push_back(ShipmodeStrToInt(s.Next()));
+        s.NextString(t.comment, 44);
+      });
 
-    tbl.rows++;
+  if (!success) {
+    return false;
   }
 
   for (size_t i = 0; i < kPaddingRows; i++) {
@@ -221,35 +695,23 @@ bool Database::ParseLineItemTable(std::string f, LineItemTable& tbl) {
 bool Database::ParseOrdersTable(std::string f, OrdersTable& tbl) {
   std::cout << "Parsing ORDERS table from: " << f << "\n";
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
-
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse ORDERS table\n";
+  bool success = ParseTableParallel(
+      f, "ORDERS", tbl, [](RowScanner& s, OrdersTable& t) {
+        t.orderkey.push_back(s.NextInt<DBIdentifier>());
+        t.custkey.push_back(s.NextInt<DBIdentifier>());
+        t.orderstatus.push_back(s.NextChar());
+        t.totalprice.push_back(s.NextMoney());
+        t.orderdate.push_back(s.NextDate());
+        t.orderpriority.push_back((int)(s.NextChar() - '0'));
+        s.NextString(t.clerk, 15);
+        t.shippriority.push_back(s.NextInt<int>());
+        s.NextString(t.comment, 80);
+      });
+
+  if (!success) {
     return false;
   }
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 9);
-
-    // store date for this row
-    tbl.orderkey.push_back(std::stoll(column_data[0]));
-    tbl.custkey.push_back(std::stoll(column_data[1]));
-    tbl.orderstatus.push_back(column_data[2][0]);
-    tbl.totalprice.push_back(MoneyFloatToCents(column_data[3]));
-    tbl.orderdate.push_back(Date(column_data[4]).ToCompact());
-    tbl.orderpriority.push_back((int)(column_data[5][0] - '0'));
-    AppendStringToCharVec(tbl.clerk, column_data[6], 15);
-    tbl.shippriority.push_back(std::stoi(column_data[7]));
-    AppendStringToCharVec(tbl.comment, column_data[8], 80);
-
-    tbl.rows++;
-  }
-
   for (size_t i = 0; i < kPaddingRows; i++) {
     tbl.orderkey.push_back(0);
     tbl.custkey.push_back(0);
@@ -260,7 +722,6 @@ bool Database::ParseOrdersTable(std::string f, OrdersTable& tbl) {
     tbl.shippriority.push_back(0);
   }
 
-
   std::cout << "Finished parsing ORDERS table with " << tbl.rows << " rows\n";
 
   return true;
@@ -272,39 +733,28 @@ bool Database::ParseOrdersTable(std::string f, OrdersTable& tbl) {
 bool Database::ParsePartsTable(std::string f, PartsTable& tbl) {
   std::cout << "Parsing PARTS table from: " << f << "\n";
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
-
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse PARTS table\n";
+  bool success = ParseTableParallel(
+      f, "PARTS", tbl, [](RowScanner& s, PartsTable& t) {
+        t.partkey.push_back(s.NextInt<DBIdentifier>());
+
+        // formatting part name: all uppercase
+        s.NextString(t.name, 55);
+        std::transform(t.name.end() - 55, t.name.end(), t.name.end() - 55,
+                       ::toupper);
+
+        s.NextString(t.mfgr, 25);
+        s.NextString(t.brand, 10);
+        s.NextString(t.type, 25);
+        t.size.push_back(s.NextInt<int>());
+        s.NextString(t.container, 10);
+        t.retailprice.push_back(s.NextMoney());
+        s.NextString(t.comment, 23);
+      });
+
+  if (!success) {
     return false;
   }
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 9);
-
-    tbl.partkey.push_back(std::stoll(column_data[0]));
-
-    // formatting part name: no spaces, all uppercase
-    transform(column_data[1].begin(), column_data[1].end(),
-              column_data[1].begin(), ::toupper);
-    AppendStringToCharVec(tbl.name, column_data[1], 55);
-
-    AppendStringToCharVec(tbl.mfgr, column_data[2], 25);
-    AppendStringToCharVec(tbl.brand, column_data[3], 10);
-    AppendStringToCharVec(tbl.type, column_data[4], 25);
-    tbl.size.push_back(std::stoi(column_data[5]));
-    AppendStringToCharVec(tbl.container, column_data[6], 10);
-    tbl.retailprice.push_back(MoneyFloatToCents(column_data[7]));
-    AppendStringToCharVec(tbl.comment, column_data[8], 23);
-
-    tbl.rows++;
-  }
-
   for (size_t i = 0; i < kPaddingRows; i++) {
     tbl.partkey.push_back(0);
     AppendStringToCharVec(tbl.name, "INVALID", 55);
@@ -321,32 +771,21 @@ bool Database::ParsePartsTable(std::string f, PartsTable& tbl) {
 bool Database::ParseSupplierTable(std::string f, SupplierTable& tbl) {
   std::cout << "Parsing SUPPLIER table from: " << f << "\n";
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
-
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse SUPPLIER table\n";
+  bool success = ParseTableParallel(
+      f, "SUPPLIER", tbl, [](RowScanner& s, SupplierTable& t) {
+        t.suppkey.push_back(s.NextInt<DBIdentifier>());
+        s.NextString(t.name, 25);
+        s.NextString(t.address, 40);
+        t.nationkey.push_back(s.NextInt<unsigned char>());
+        s.NextString(t.phone, 15);
+        t.acctbal.push_back(s.NextMoney());
+        s.NextString(t.comment, 101);
+      });
+
+  if (!success) {
     return false;
   }
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 7);
-
-    tbl.suppkey.push_back(std::stoll(column_data[0]));
-    AppendStringToCharVec(tbl.name, column_data[1], 25);
-    AppendStringToCharVec(tbl.address, column_data[2], 40);
-    tbl.nationkey.push_back((unsigned char)(std::stoul(column_data[3])));
-    AppendStringToCharVec(tbl.phone, column_data[4], 15);
-    tbl.acctbal.push_back(MoneyFloatToCents(column_data[5]));
-    AppendStringToCharVec(tbl.comment, column_data[6], 101);
-
-    tbl.rows++;
-  }
-
   for (size_t i = 0; i < kPaddingRows; i++) {
     tbl.suppkey.push_back(0);
     AppendStringToCharVec(tbl.name, "INVALID", 25);
@@ -365,28 +804,23 @@ bool Database::ParseSupplierTable(std::string f, SupplierTable& tbl) {
 bool Database::ParsePartSupplierTable(std::string f, PartSupplierTable& tbl) {
   std::cout << "Parsing PARTSUPPLIER table from: " << f << "\n";
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
+  bool success = ParseTableParallel(
+      f, "PARTSUPPLIER", tbl, [](RowScanner& s, PartSupplierTable& t) {
+        t.partkey.push_back(s.NextInt<DBIdentifier>());
+        t.suppkey.push_back(s.NextInt<DBIdentifier>());
+        t.availqty.push_back(s.NextInt<int>());
+        t.supplycost.push_back(s.NextMoney());
+        s.NextString(t.comment, 199);
+      });
 
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse PARTSUPPLIER table\n";
+  if (!success) {
     return false;
   }
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 5);
-
-    tbl.partkey.push_back(std::stoll(column_data[0]));
-    tbl.suppkey.push_back(std::stoll(column_data[1]));
-    tbl.availqty.push_back(std::stoi(column_data[2]));
-    tbl.supplycost.push_back(MoneyFloatToCents(column_data[3]));
-    AppendStringToCharVec(tbl.comment, column_data[4], 199);
-
-    tbl.rows++;
+  // Queries 9 and 11 find the rows of a range of PARTKEYs with a binary search
+  if (!std::is_sorted(tbl.partkey.begin(), tbl.partkey.end())) {
+    std::cerr << "ERROR: PARTSUPPLIER table is not sorted by PARTKEY\n";
+    return false;
   }
 
   for (size_t i = 0; i < kPaddingRows; i++) {
@@ -402,87 +836,361 @@ bool Database::ParsePartSupplierTable(std::string f, PartSupplierTable& tbl) {
   return true;
 }
 
+//
+// parse the CUSTOMER table
+//
+bool Database::ParseCustomerTable(std::string f, CustomerTable& tbl) {
+  std::cout << "Parsing CUSTOMER table from: " << f << "\n";
+
+  bool success = ParseTableParallel(
+      f, "CUSTOMER", tbl, [](RowScanner& s, CustomerTable& t) {
+        t.custkey.push_back(s.NextInt<DBIdentifier>());
+        s.NextString(t.name, 25);
+        s.NextString(t.address, 40);
+        t.nationkey.push_back(s.NextInt<unsigned char>());
+        s.NextString(t.phone, 15);
+        t.acctbal.push_back(s.NextMoney());
+        t.mktsegment.push_back(MktsegmentStrToInt(s.Next()));
+        s.NextString(t.comment, 117);
+      });
+
+  if (!success) {
+    return false;
+  }
+
+  for (size_t i = 0; i < kPaddingRows; i++) {
+    tbl.custkey.push_back(0);
+    tbl.nationkey.push_back(0);
+    tbl.acctbal.push_back(0);
+    tbl.mktsegment.push_back(0);
+  }
+
+  std::cout << "Finished parsing CUSTOMER table with " << tbl.rows << " rows\n";
+
+  return true;
+}
+
 //
 // parse the NATION table
 //
 bool Database::ParseNationTable(std::string f, NationTable& tbl) {
   std::cout << "Parsing NATION table from: " << f << "\n";
 
-  // populate data row by row (as presented in the file)
-  std::ifstream ifs(f);
-  std::string line;
-  tbl.rows = 0;
+  bool success = ParseTableParallel(
+      f, "NATION", tbl, [](RowScanner& s, NationTable& t) {
+        t.nationkey.push_back(s.NextInt<DBIdentifier>());
 
-  if (!ifs.is_open()) {
-    std::cout << "Failed to parse NATION table\n";
+        // convention: trimmed and all upper case
+        AppendStringToCharVec(t.name, TrimView(s.Next()), 25);
+        std::transform(t.name.end() - 25, t.name.end(), t.name.end() - 25,
+                       ::toupper);
+
+        t.regionkey.push_back(s.NextInt<DBIdentifier>());
+        s.NextString(t.comment, 152);
+      });
+
+  if (!success) {
     return false;
   }
 
-  while (std::getline(ifs, line)) {
-    // split row into column strings by separator ('|')
-    std::vector<std::string> column_data = SplitRowStr(line);
-    assert(column_data.size() == 4);
+  BuildNationMaps(tbl);
 
-    DBIdentifier nationkey = std::stoll(column_data[0]);
-    std::string nationname = column_data[1];
+  std::cout << "Finished parsing NATION table with " << tbl.rows << " rows\n";
 
-    tbl.nationkey.push_back(nationkey);
+  return true;
+}
 
-    // convention: all upper case
-    trim(nationname);
-    transform(nationname.begin(), nationname.end(), nationname.begin(),
-              ::toupper);
-    AppendStringToCharVec(tbl.name, nationname, 25);
+////////////////////////////////////////////////////////////////////////////////
+// Binary columnar snapshot
+//
+// Parsing the '*.tbl' text files dominates the runtime at larger scale
+// factors, so after the first successful parse each column is written to its
+// own binary file in '<db_root_dir>/snapshot/' (e.g. 'lineitem.shipdate.col').
+// Later runs map these files and copy them straight into the column vectors,
+// which turns the load into a handful of bulk memory copies.
+//
+// Each column file has a 64 byte header followed by the raw column elements
+// (including the kPaddingRows padding), so the data is cache line aligned in
+// the mapping. A snapshot is only used if every column has the expected
+// version and element size, and was made from a '.tbl' file with the same
+// size, modification time and hash of its first and last blocks as the one
+// currently in 'db_root_dir' (if any), so a regenerated table of the same size
+// is parsed again. Delete the 'snapshot' directory (or pass --no-snapshot to
+// db) to force a re-parse.
+////////////////////////////////////////////////////////////////////////////////
+struct ColumnFileHeader {
+  char magic[8];          // kColumnFileMagic
+  uint32_t version;       // kColumnFileVersion
+  uint32_t elem_size;     // sizeof one column element
+  uint64_t rows;          // rows in the table, excluding the padding rows
+  uint64_t count;         // elements stored in the file
+  uint64_t source_bytes;  // size of the '.tbl' file the column came from
+  uint64_t source_mtime;  // its modification time
+  uint64_t source_hash;   // hash of its first and last kSourceHashBlock bytes
+  char reserved[8];
+};
+static_assert(sizeof(ColumnFileHeader) == 64);
+
+constexpr char kColumnFileMagic[8] = {'T', 'P', 'C', 'H', 'C', 'O', 'L', '\0'};
+constexpr uint32_t kColumnFileVersion = 2;
+constexpr size_t kSourceHashBlock = 4096;
 
-    tbl.regionkey.push_back(std::stoll(column_data[2]));
-    AppendStringToCharVec(tbl.comment, column_data[3], 152);
+//
+// identifies the contents of a '.tbl' file without reading all of it
+//
+struct SourceStamp {
+  int64_t bytes = -1;  // -1 if the file doesn't exist
+  uint64_t mtime = 0;
+  uint64_t hash = 0;
+};
 
-    // add entry into map
-    tbl.name_key_map[nationname] = nationkey;
-    tbl.key_name_map[nationkey] = nationname;
+//
+// returns the stamp of the file at 'path'. The hash is the 64-bit FNV-1a of
+// its first and last kSourceHashBlock bytes.
+//
+SourceStamp StampSourceFile(const std::string& path) {
+  SourceStamp stamp;
+  std::error_code ec;
+  auto size = std::filesystem::file_size(path, ec);
+  if (ec) return stamp;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) return stamp;
+
+  std::ifstream ifs(path, std::ios::binary);
+  if (!ifs.is_open()) return stamp;
+  std::vector<char> buf(std::min<uint64_t>(size, kSourceHashBlock));
+  ifs.read(buf.data(), buf.size());
+  if (size > kSourceHashBlock) {
+    size_t tail = std::min<uint64_t>(size - kSourceHashBlock, kSourceHashBlock);
+    buf.resize(buf.size() + tail);
+    ifs.seekg(size - tail);
+    ifs.read(buf.data() + kSourceHashBlock, tail);
+  }
+  if (!ifs.good()) return stamp;
 
-    tbl.rows++;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : buf) {
+    hash = (hash ^ (unsigned char)c) * 0x100000001b3ULL;
   }
 
-  std::cout << "Finished parsing NATION table with " << tbl.rows << " rows\n";
+  stamp.bytes = size;
+  stamp.mtime = mtime.time_since_epoch().count();
+  stamp.hash = hash;
+  return stamp;
+}
 
+//
+// writes one column to 'path'
+//
+template <typename T>
+bool WriteColumnFile(const std::string& path, const std::vector<T>& col,
+                     size_t rows, const SourceStamp& source) {
+  ColumnFileHeader h{};
+  std::memcpy(h.magic, kColumnFileMagic, sizeof(h.magic));
+  h.version = kColumnFileVersion;
+  h.elem_size = sizeof(T);
+  h.rows = rows;
+  h.count = col.size();
+  h.source_bytes = source.bytes;
+  h.source_mtime = source.mtime;
+  h.source_hash = source.hash;
+
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+  ofs.write(reinterpret_cast<const char*>(col.data()), col.size() * sizeof(T));
+  return ofs.good();
+}
+
+//
+// reads one column from 'path' into 'col'. Returns false if the file is
+// missing or doesn't match the expected element size or source file stamp
+// (a 'source.bytes' < 0 skips the source check, e.g. if the '.tbl' was
+// deleted).
+//
+template <typename T>
+bool ReadColumnFile(const std::string& path, std::vector<T>& col, size_t& rows,
+                    const SourceStamp& source) {
+  MappedFile file(path);
+  if (!file.valid() || file.size() < sizeof(ColumnFileHeader)) return false;
+
+  ColumnFileHeader h;
+  std::memcpy(&h, file.data(), sizeof(h));
+  bool valid_header =
+      std::memcmp(h.magic, kColumnFileMagic, sizeof(h.magic)) == 0 &&
+      h.version == kColumnFileVersion && h.elem_size == sizeof(T) &&
+      (source.bytes < 0 || (h.source_bytes == (uint64_t)source.bytes &&
+                             h.source_mtime == source.mtime &&
+                             h.source_hash == source.hash)) &&
+      file.size() == sizeof(h) + h.count * sizeof(T);
+  if (!valid_header) return false;
+
+  const T* data = reinterpret_cast<const T*>(file.data() + sizeof(h));
+  col.assign(data, data + h.count);
+  rows = h.rows;
   return true;
 }
 
+//
+// loads every column of table 'name' from the snapshot directory
+//
+template <typename Table>
+bool LoadTableSnapshot(const std::string& db_root_dir, const std::string& name,
+                       Table& tbl) {
+  std::string dir = db_root_dir + kSeparator + "snapshot" + kSeparator;
+  SourceStamp source =
+      StampSourceFile(db_root_dir + kSeparator + name + ".tbl");
+
+  bool ok = true;
+  bool first = true;
+  ForEachColumn(tbl, [&](const char* col_name, auto& col) {
+    size_t rows = 0;
+    if (ok) {
+      ok = ReadColumnFile(dir + name + "." + col_name + ".col", col, rows,
+                          source);
+      // every column of a table must agree on the number of rows
+      ok &= first || rows == tbl.rows;
+      tbl.rows = rows;
+      first = false;
+    }
+  });
+  return ok;
+}
+
+//
+// writes every column of table 'name' to the snapshot directory
+//
+template <typename Table>
+bool SaveTableSnapshot(const std::string& db_root_dir, const std::string& name,
+                       Table& tbl) {
+  std::string dir = db_root_dir + kSeparator + "snapshot" + kSeparator;
+  SourceStamp source =
+      StampSourceFile(db_root_dir + kSeparator + name + ".tbl");
+
+  bool ok = true;
+  ForEachColumn(tbl, [&](const char* col_name, auto& col) {
+    ok = ok && WriteColumnFile(dir + name + "." + col_name + ".col", col,
+                               tbl.rows, source);
+  });
+  return ok;
+}
+
+//
+// loads all of the tables from the binary snapshot in 'db_root_dir/snapshot'.
+// Returns false, leaving the tables empty, if any column is missing or stale.
+//
+bool Database::LoadSnapshot(std::string db_root_dir) {
+  bool success = true;
+  success = success && LoadTableSnapshot(db_root_dir, "lineitem", l);
+  success = success && LoadTableSnapshot(db_root_dir, "orders", o);
+  success = success && LoadTableSnapshot(db_root_dir, "part", p);
+  success = success && LoadTableSnapshot(db_root_dir, "supplier", s);
+  success = success && LoadTableSnapshot(db_root_dir, "partsupp", ps);
+  success = success && LoadTableSnapshot(db_root_dir, "customer", c);
+  success = success && LoadTableSnapshot(db_root_dir, "nation", n);
+
+  if (!success) {
+    l = LineItemTable();
+    o = OrdersTable();
+    p = PartsTable();
+    s = SupplierTable();
+    ps = PartSupplierTable();
+    c = CustomerTable();
+    n = NationTable();
+    return false;
+  }
+
+  BuildNationMaps(n);
+
+  std::cout << "Loaded database snapshot from: " << db_root_dir << kSeparator
+            << "snapshot (" << l.rows << " LINEITEM rows)\n";
+
+  return true;
+}
+
+//
+// writes all of the tables to a binary snapshot in 'db_root_dir/snapshot'
+//
+bool Database::SaveSnapshot(std::string db_root_dir) {
+  std::error_code ec;
+  std::filesystem::create_directories(db_root_dir + kSeparator + "snapshot",
+                                      ec);
+  if (ec) return false;
+
+  bool success = true;
+  success = success && SaveTableSnapshot(db_root_dir, "lineitem", l);
+  success = success && SaveTableSnapshot(db_root_dir, "orders", o);
+  success = success && SaveTableSnapshot(db_root_dir, "part", p);
+  success = success && SaveTableSnapshot(db_root_dir, "supplier", s);
+  success = success && SaveTableSnapshot(db_root_dir, "partsupp", ps);
+  success = success && SaveTableSnapshot(db_root_dir, "customer", c);
+  success = success && SaveTableSnapshot(db_root_dir, "nation", n);
+
+  if (success) {
+    std::cout << "Wrote database snapshot to: " << db_root_dir << kSeparator
+              << "snapshot\n";
+  }
+
+  return success;
+}
+
+//
+// the scale factor of the parsed database, derived from the SUPPLIER table
+// (which has exactly SF * 10000 rows)
+//
+double Database::SF() const {
+  return (double)(s.rows) / kSupplierRowsPerSF;
+}
+
 //
 // Checks the size of each parsed table against the expected size based
-// on the selected scale factor
+// on the scale factor of the parsed database
 //
 bool Database::ValidateSF() {
   bool ret = true;
+  const double sf = SF();
+
+  auto expected_rows = [&](int rows_per_sf) {
+    return (size_t)std::llround(sf * rows_per_sf);
+  };
 
-  if (l.rows != kLineItemTableSize) {
+  if (s.rows == 0) {
+    std::cerr << "Supplier table is empty\n";
+    ret = false;
+  }
+
+  // every order has between 1 and 7 line items
+  if (l.rows < o.rows || l.rows > 7 * o.rows) {
     std::cerr << "LineItem table size has " << l.rows << " rows"
-              << " when it should have " << kLineItemTableSize << "\n";
+              << " when it should have between " << o.rows << " and "
+              << 7 * o.rows << "\n";
     ret = false;
   }
 
-  if (o.rows != kOrdersTableSize) {
+  if (o.rows != expected_rows(kOrdersRowsPerSF)) {
     std::cerr << "Orders table size has " << o.rows << " rows"
-              << " when it should have " << kOrdersTableSize << "\n";
+              << " when it should have " << expected_rows(kOrdersRowsPerSF)
+              << "\n";
     ret = false;
   }
 
-  if (p.rows != kPartTableSize) {
+  if (p.rows != expected_rows(kPartRowsPerSF)) {
     std::cerr << "Parts table size has " << p.rows << " rows"
-              << " when it should have " << kPartTableSize << "\n";
+              << " when it should have " << expected_rows(kPartRowsPerSF)
+              << "\n";
     ret = false;
   }
 
-  if (s.rows != kSupplierTableSize) {
-    std::cerr << "Supplier table size has " << s.rows << " rows"
-              << " when it should have " << kSupplierTableSize << "\n";
+  if (ps.rows != expected_rows(kPartSupplierRowsPerSF)) {
+    std::cerr << "PartSupplier table size has " << ps.rows << " rows"
+              << " when it should have "
+              << expected_rows(kPartSupplierRowsPerSF) << "\n";
     ret = false;
   }
 
-  if (ps.rows != kPartSupplierTableSize) {
-    std::cerr << "PartSupplier table size has " << ps.rows << " rows"
-              << " when it should have " << kPartSupplierTableSize << "\n";
+  if (c.rows != expected_rows(kCustomerRowsPerSF)) {
+    std::cerr << "Customer table size has " << c.rows << " rows"
+              << " when it should have " << expected_rows(kCustomerRowsPerSF)
+              << "\n";
     ret = false;
   }
 
@@ -625,6 +1333,120 @@ bool Database::ValidateQ1(std::string db_root_dir,
   return valid;
 }
 
+//
+// validate the results of Query 3
+//
+// There are no reference answers for Queries 3, 6 and 14 in the 'answers'
+// directory, so the expected results are computed on the host from the
+// parsed tables. This also lets them be tested at any scale factor.
+//
+bool Database::ValidateQ3(int mktsegment, DBDate date,
+                          std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+                          std::array<DBDecimal, kQuery3OutSize>& revenue,
+                          std::array<DBDate, kQuery3OutSize>& orderdate,
+                          std::array<int, kQuery3OutSize>& shippriority) {
+  std::cout << "Validating query 3 test results" << std::endl;
+
+  // the customers in the market segment, indexed by CUSTKEY
+  std::vector<bool> in_segment;
+  for (size_t i = 0; i < c.rows; i++) {
+    if (c.custkey[i] >= in_segment.size()) {
+      in_segment.resize(c.custkey[i] + 1, false);
+    }
+    in_segment[c.custkey[i]] = (c.mktsegment[i] == mktsegment);
+  }
+
+  // the orders placed by those customers before 'date'
+  struct Row {
+    DBIdentifier orderkey;
+    DBDecimal revenue;
+    DBDate orderdate;
+    int shippriority;
+  };
+  std::vector<Row> rows;
+  std::unordered_map<DBIdentifier, size_t> row_idx;
+  for (size_t i = 0; i < o.rows; i++) {
+    DBIdentifier custkey = o.custkey[i];
+    if (o.orderdate[i] < date && custkey < in_segment.size() &&
+        in_segment[custkey]) {
+      row_idx[o.orderkey[i]] = rows.size();
+      rows.push_back({o.orderkey[i], 0, o.orderdate[i], o.shippriority[i]});
+    }
+  }
+
+  // the revenue of each order from the items shipped after 'date'
+  for (size_t i = 0; i < l.rows; i++) {
+    auto it = row_idx.find(l.orderkey[i]);
+    if (l.shipdate[i] > date && it != row_idx.end()) {
+      rows[it->second].revenue += l.extendedprice[i] * (100 - l.discount[i]);
+    }
+  }
+
+  // only orders with at least one such item are in the result
+  rows.erase(std::remove_if(rows.begin(), rows.end(),
+                            [](const Row& r) { return r.revenue == 0; }),
+             rows.end());
+
+  // order by revenue (descending), then order date and key (ascending)
+  std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) {
+    if (a.revenue != b.revenue) return a.revenue > b.revenue;
+    if (a.orderdate != b.orderdate) return a.orderdate < b.orderdate;
+    return a.orderkey < b.orderkey;
+  });
+
+  bool valid = true;
+
+  for (size_t i = 0; i < kQuery3OutSize; i++) {
+    // unused output slots have an orderkey of 0
+    DBIdentifier orderkey_gold = (i < rows.size()) ? rows[i].orderkey : 0;
+
+    if (orderkey_gold != orderkey[i]) {
+      std::cerr << "ERROR: orderkey at index " << i << " does not match "
+                << "(Expected=" << orderkey_gold << ", Result=" << orderkey[i]
+                << ")\n";
+      valid = false;
+    } else if (i < rows.size() && (rows[i].revenue != revenue[i] ||
+                                   rows[i].orderdate != orderdate[i] ||
+                                   rows[i].shippriority != shippriority[i])) {
+      std::cerr << "ERROR: result for orderkey " << orderkey_gold
+                << " does not match (Expected revenue="
+                << (double)(rows[i].revenue) / (100.0 * 100.0)
+                << ", Result revenue=" << (double)(revenue[i]) / (100.0 * 100.0)
+                << ")\n";
+      valid = false;
+    }
+  }
+
+  return valid;
+}
+
+//
+// validate the results of Query 6
+//
+bool Database::ValidateQ6(DBDate low_date, DBDate high_date,
+                          DBDecimal discount, DBDecimal quantity,
+                          DBDecimal revenue) {
+  std::cout << "Validating query 6 test results" << std::endl;
+
+  DBDecimal revenue_gold = 0;
+  for (size_t i = 0; i < l.rows; i++) {
+    if (l.shipdate[i] >= low_date && l.shipdate[i] < high_date &&
+        l.discount[i] >= discount - 1 && l.discount[i] <= discount + 1 &&
+        l.quantity[i] < quantity) {
+      revenue_gold += l.extendedprice[i] * l.discount[i];
+    }
+  }
+
+  if (revenue_gold != revenue) {
+    std::cerr << "ERROR: revenue (Expected="
+              << (double)(revenue_gold) / (100.0 * 100.0)
+              << ", Result=" << (double)(revenue) / (100.0 * 100.0) << ")\n";
+    return false;
+  }
+
+  return true;
+}
+
 //
 // validate the results of Query 9
 //
@@ -706,7 +1528,7 @@ bool Database::ValidateQ11(std::string db_root_dir,
     // split row into column strings by separator ('|')
     std::vector<std::string> column_data = SplitRowStr(line);
     assert(column_data.size() == 2);
-    assert(i < kPartTableSize);
+    assert(i < partkeys.size());
 
     DBIdentifier partkey_gold = std::stoll(column_data[0]);
     double value_gold = std::stod(column_data[1]);
@@ -801,6 +1623,53 @@ bool Database::ValidateQ12(std::string db_root_dir,
   return valid;
 }
 
+//
+// validate the results of Query 14
+//
+bool Database::ValidateQ14(DBDate low_date, DBDate high_date,
+                           DBDecimal promo_revenue, DBDecimal total_revenue) {
+  std::cout << "Validating query 14 test results" << std::endl;
+
+  // the parts whose type starts with 'PROMO', indexed by PARTKEY
+  std::vector<bool> is_promo;
+  for (size_t i = 0; i < p.rows; i++) {
+    if (p.partkey[i] >= is_promo.size()) {
+      is_promo.resize(p.partkey[i] + 1, false);
+    }
+    is_promo[p.partkey[i]] = std::strncmp(&p.type[i * 25], "PROMO", 5) == 0;
+  }
+
+  DBDecimal promo_revenue_gold = 0, total_revenue_gold = 0;
+  for (size_t i = 0; i < l.rows; i++) {
+    DBIdentifier partkey = l.partkey[i];
+    if (l.shipdate[i] >= low_date && l.shipdate[i] < high_date &&
+        partkey < is_promo.size()) {
+      DBDecimal revenue = l.extendedprice[i] * (100 - l.discount[i]);
+      total_revenue_gold += revenue;
+      promo_revenue_gold += is_promo[partkey] ? revenue : 0;
+    }
+  }
+
+  bool valid = true;
+
+  if (promo_revenue_gold != promo_revenue) {
+    std::cerr << "ERROR: promo revenue (Expected="
+              << (double)(promo_revenue_gold) / (100.0 * 100.0)
+              << ", Result=" << (double)(promo_revenue) / (100.0 * 100.0)
+              << ")\n";
+    valid = false;
+  }
+  if (total_revenue_gold != total_revenue) {
+    std::cerr << "ERROR: total revenue (Expected="
+              << (double)(total_revenue_gold) / (100.0 * 100.0)
+              << ", Result=" << (double)(total_revenue) / (100.0 * 100.0)
+              << ")\n";
+    valid = false;
+  }
+
+  return valid;
+}
+
 //
 // print the results of Query 1
 //
@@ -835,6 +1704,45 @@ void Database::PrintQ1(std::array<DBDecimal, 3 * 2>& sum_qty,
   }
 }
 
+//
+// print the results of Query 3
+//
+void Database::PrintQ3(std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+                       std::array<DBDecimal, kQuery3OutSize>& revenue,
+                       std::array<DBDate, kQuery3OutSize>& orderdate,
+                       std::array<int, kQuery3OutSize>& shippriority) {
+  // print the header
+  std::cout << "l_orderkey|revenue|o_orderdate|o_shippriority\n";
+
+  // print the results, skipping the unused output slots (orderkey of 0)
+  std::cout << std::fixed << std::setprecision(4) << std::setfill('0');
+  for (int i = 0; i < kQuery3OutSize; i++) {
+    if (orderkey[i] == 0) continue;
+
+    Date date(0, 0, 0);
+    date.FromCompact(orderdate[i]);
+
+    std::cout << orderkey[i] << "|"
+              << (double)(revenue[i]) / (100.0 * 100.0) << "|"
+              << std::setw(4) << date.year << "-" << std::setw(2) << date.month
+              << "-" << std::setw(2) << date.day << "|" << shippriority[i]
+              << "\n";
+  }
+  std::cout << std::setfill(' ');
+}
+
+//
+// print the results of Query 6
+//
+void Database::PrintQ6(DBDecimal revenue) {
+  // print the header
+  std::cout << "revenue\n";
+
+  // print the result
+  std::cout << std::fixed << std::setprecision(4);
+  std::cout << (double)(revenue) / (100.0 * 100.0) << "\n";
+}
+
 //
 // print the results of Query 9
 //
@@ -917,3 +1825,18 @@ void Database::PrintQ12(std::string& SM1, std::string& SM2,
   std::cout << SM2 << "|" << high_line_count[1] << "|" << low_line_count[1]
             << "\n";
 }
+
+//
+// print the results of Query 14
+//
+void Database::PrintQ14(DBDecimal promo_revenue, DBDecimal total_revenue) {
+  // print the header
+  std::cout << "promo_revenue\n";
+
+  // print the result
+  double promo_percent =
+      (total_revenue == 0)
+          ? 0.0
+          : 100.0 * (double)(promo_revenue) / (double)(total_revenue);
+  std::cout << std::fixed << std::setprecision(2) << promo_percent << "\n";
+}
@@ -4,8 +4,10 @@
 
 #include <array>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 // database types
@@ -15,19 +17,23 @@ using DBInt = unsigned int;
 using DBDecimal = long long;
 using DBDate = unsigned int;
 
-// Set the scale factor
+// The design scale factor
 //
-// The default (and only option) scale factor for
-// emulation is 0.01; a scale factor of 1 for emulation
-// takes far too long.
+// The database files can have any scale factor (SF); the table sizes are
+// taken from the parsed data at runtime. However, the on-chip data structures
+// of the query kernels (e.g. the MapJoin maps and the sorters) are sized at
+// compile time for the design scale factor below. Queries over a database
+// larger than the design scale factor process it in multiple passes.
 //
-// The default scale factor for hardware is 1. However,
+// The default (and only option) design scale factor for emulation is 0.01.
+//
+// The default design scale factor for hardware is 1. However,
 // the SF_SMALL flag allows the hardware design to be compiled
-// with a scale factor of 0.01
+// with a design scale factor of 0.01
 #if defined(FPGA_EMULATOR) || defined(SF_SMALL)
-constexpr float kSF = 0.01f;
+constexpr float kDesignSF = 0.01f;
 #else
-constexpr float kSF = 1.0f;
+constexpr float kDesignSF = 1.0f;
 #endif
 
 // add some padding rows to the end of each table.
@@ -36,28 +42,22 @@ constexpr float kSF = 1.0f;
 // 16 was chosen because it is the largest access granularity
 constexpr size_t kPaddingRows = 16;
 
-// ensure the selected scale factor is supported
-static_assert((kSF == 0.01f || kSF == 1.0f), "Unsupported Scale Factor (kSF)");
-
-// table sizes based on the Scale Factor (kSF)
-constexpr int kPartTableSize = kSF * 200000;
-constexpr int kPartSupplierTableSize = kSF * 800000;
-constexpr int kOrdersTableSize = kSF * 1500000;
-constexpr int kSupplierTableSize = kSF * 10000;
-constexpr int kCustomerTableSize = kSF * 150000;
-
-// LINEITEM table is not a strict multiple of kSF
-constexpr int LineItemTableSizeFnc() {
-  if (kSF == 0.01f) {
-    return 60175;
-  } else if (kSF == 1.0f) {
-    return 6001215;
-  } else {
-    return 0;  // error, should be caught by kSF static_assert
-  }
-}
+// table sizes per unit of scale factor, based on the TPCH docs.
+// The LINEITEM table is not a strict multiple of the SF, about 6M rows per SF.
+constexpr int kPartRowsPerSF = 200000;
+constexpr int kPartSupplierRowsPerSF = 800000;
+constexpr int kOrdersRowsPerSF = 1500000;
+constexpr int kSupplierRowsPerSF = 10000;
+constexpr int kCustomerRowsPerSF = 150000;
+constexpr int kLineItemRowsPerSF = 6001215;
+
+// the number of PART and SUPPLIER keys that the kernels hold on-chip in one
+// pass, and the number of LINEITEM rows one pass is expected to touch
+constexpr int kPartCapacity = kDesignSF * kPartRowsPerSF;
+constexpr int kSupplierCapacity = kDesignSF * kSupplierRowsPerSF;
+constexpr int kLineItemCapacity = kDesignSF * kLineItemRowsPerSF;
+constexpr int kCustomerCapacity = kDesignSF * kCustomerRowsPerSF;
 
-constexpr int kLineItemTableSize = LineItemTableSizeFnc();
 constexpr int kNationTableSize = 25;
 constexpr int kRegionTableSize = 5;
 
@@ -65,9 +65,57 @@ constexpr int kLineStatusSize = 2;
 constexpr int kReturnFlagSize = 3;
 constexpr int kQuery1OutSize = kReturnFlagSize * kLineStatusSize;
 
+// Query 3 returns the 10 orders with the highest revenue
+constexpr int kQuery3OutSize = 10;
+
+// Zone maps split a table into blocks of kZoneMapBlockRows rows and keep the
+// min and max value of a column in each block. A query with a range predicate
+// on the column only has to send the blocks whose [min, max] overlaps the
+// range to the kernels. This pays off when the table is clustered by the
+// column (e.g. LINEITEM loaded in date order), and costs nothing otherwise.
+constexpr size_t kZoneMapBlockRows = 4096;
+
+// a list of [begin, end) row ranges of a table
+using RowRanges = std::vector<std::pair<size_t, size_t>>;
+
+struct ZoneMap {
+  std::vector<unsigned int> min;
+  std::vector<unsigned int> max;
+
+  void Build(const std::vector<unsigned int>& column, size_t rows);
+
+  // the rows of the blocks that may hold values in [low, high], with
+  // adjacent blocks merged into one range
+  RowRanges Select(unsigned int low, unsigned int high, size_t rows) const;
+};
+
+// the number of rows in 'ranges'
+size_t RowCount(const RowRanges& ranges);
+
+// the rows of 'column' in 'ranges' followed by kPaddingRows padding rows.
+// If 'ranges' is the whole table, 'column' itself is returned without a copy,
+// otherwise the rows are gathered into 'storage'.
+template <typename T>
+std::vector<T>& SelectRows(std::vector<T>& column, const RowRanges& ranges,
+                           size_t rows, std::vector<T>& storage) {
+  if (ranges.size() == 1 && ranges[0].first == 0 && ranges[0].second == rows) {
+    return column;
+  }
+
+  storage.clear();
+  storage.reserve(RowCount(ranges) + kPaddingRows);
+  for (auto& r : ranges) {
+    storage.insert(storage.end(), column.begin() + r.first,
+                   column.begin() + r.second);
+  }
+  storage.resize(storage.size() + kPaddingRows);
+  return storage;
+}
+
 // helpers
 DBDate DateFromString(std::string& date_str);
-int ShipmodeStrToInt(std::string& shipmode_str);
+int ShipmodeStrToInt(std::string_view shipmode_str);
+int MktsegmentStrToInt(std::string_view mktsegment_str);
 
 // LINEITEM table
 struct LineItemTable {
@@ -89,6 +137,11 @@ struct LineItemTable {
   std::vector<char> comment;
 
   size_t rows;
+
+  // zone maps, built after the table is loaded
+  ZoneMap orderkey_zone;
+  ZoneMap shipdate_zone;
+  ZoneMap receiptdate_zone;
 };
 
 // ORDERS table
@@ -104,6 +157,9 @@ struct OrdersTable {
   std::vector<char> comment;
 
   size_t rows;
+
+  // zone maps, built after the table is loaded
+  ZoneMap orderdate_zone;
 };
 
 // PARTS table
@@ -145,6 +201,20 @@ struct PartSupplierTable {
   size_t rows;
 };
 
+// CUSTOMER table
+struct CustomerTable {
+  std::vector<DBIdentifier> custkey;
+  std::vector<char> name;
+  std::vector<char> address;
+  std::vector<unsigned char> nationkey;
+  std::vector<char> phone;
+  std::vector<DBDecimal> acctbal;
+  std::vector<int> mktsegment;
+  std::vector<char> comment;
+
+  size_t rows;
+};
+
 // NATION table
 struct NationTable {
   std::vector<DBIdentifier> nationkey;
@@ -164,9 +234,23 @@ struct Database {
   PartsTable p;
   SupplierTable s;
   PartSupplierTable ps;
+  CustomerTable c;
   NationTable n;
 
-  bool Parse(std::string db_root_dir);
+  // whether the queries use the zone maps to skip blocks of rows
+  bool use_zone_maps = true;
+
+  // parses the '*.tbl' files in 'db_root_dir', or loads the binary columnar
+  // snapshot of them (see dbdata.cpp) if one exists and 'use_snapshot' is set
+  bool Parse(std::string db_root_dir, bool use_snapshot = true);
+
+  // the rows of a table that may hold values of a column in [low, high],
+  // based on the column's zone map. All rows if 'use_zone_maps' is not set.
+  RowRanges ZoneSelect(const ZoneMap& zone, unsigned int low,
+                       unsigned int high, size_t rows) const;
+
+  // the scale factor of the parsed database
+  double SF() const;
 
   // validation functions
   bool ValidateSF();
@@ -181,6 +265,15 @@ struct Database {
                   std::array<DBDecimal, 3 * 2>& avg_discount,
                   std::array<DBDecimal, 3 * 2>& count);
 
+  bool ValidateQ3(int mktsegment, DBDate date,
+                  std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+                  std::array<DBDecimal, kQuery3OutSize>& revenue,
+                  std::array<DBDate, kQuery3OutSize>& orderdate,
+                  std::array<int, kQuery3OutSize>& shippriority);
+
+  bool ValidateQ6(DBDate low_date, DBDate high_date, DBDecimal discount,
+                  DBDecimal quantity, DBDecimal revenue);
+
   bool ValidateQ9(std::string db_root_dir,
                   std::array<DBDecimal, 25 * 2020>& sum_profit);
 
@@ -191,6 +284,9 @@ struct Database {
                    std::array<DBDecimal, 2> high_line_count,
                    std::array<DBDecimal, 2> low_line_count);
 
+  bool ValidateQ14(DBDate low_date, DBDate high_date,
+                   DBDecimal promo_revenue, DBDecimal total_revenue);
+
   // print functions
   void PrintQ1(std::array<DBDecimal, 3 * 2>& sum_qty,
                std::array<DBDecimal, 3 * 2>& sum_base_price,
@@ -201,6 +297,13 @@ struct Database {
                std::array<DBDecimal, 3 * 2>& avg_discount,
                std::array<DBDecimal, 3 * 2>& count);
 
+  void PrintQ3(std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+               std::array<DBDecimal, kQuery3OutSize>& revenue,
+               std::array<DBDate, kQuery3OutSize>& orderdate,
+               std::array<int, kQuery3OutSize>& shippriority);
+
+  void PrintQ6(DBDecimal revenue);
+
   void PrintQ9(std::array<DBDecimal, 25 * 2020>& sum_profit);
 
   void PrintQ11(std::vector<DBIdentifier>& partkeys,
@@ -210,13 +313,20 @@ struct Database {
                 std::array<DBDecimal, 2> high_line_count,
                 std::array<DBDecimal, 2> low_line_count);
 
+  void PrintQ14(DBDecimal promo_revenue, DBDecimal total_revenue);
+
  private:
   bool ParseLineItemTable(std::string f, LineItemTable& tbl);
   bool ParseOrdersTable(std::string f, OrdersTable& tbl);
   bool ParsePartsTable(std::string f, PartsTable& tbl);
   bool ParseSupplierTable(std::string f, SupplierTable& tbl);
   bool ParsePartSupplierTable(std::string f, PartSupplierTable& tbl);
+  bool ParseCustomerTable(std::string f, CustomerTable& tbl);
   bool ParseNationTable(std::string f, NationTable& tbl);
+
+  bool LoadSnapshot(std::string db_root_dir);
+  void BuildZoneMaps();
+  bool SaveSnapshot(std::string db_root_dir);
 };
 
 #endif /* __DBDATA_HPP__ */
@@ -24,14 +24,31 @@ bool SubmitQuery1(queue& q, Database& dbinfo, DBDate low_date,
                   std::array<DBDecimal, kQuery1OutSize>& avg_discount,
                   std::array<DBDecimal, kQuery1OutSize>& count,
                   double& kernel_latency, double& total_latency) {
+  // start timer
+  high_resolution_clock::time_point host_start = high_resolution_clock::now();
+
+  // only send the blocks of the LINEITEM table that can have rows shipped
+  // on or before 'low_date'
+  LineItemTable& l = dbinfo.l;
+  RowRanges ranges = dbinfo.ZoneSelect(l.shipdate_zone, 0, low_date, l.rows);
+
+  // storage for the selected rows
+  std::vector<DBDecimal> quantity_rows, extendedprice_rows, discount_rows,
+      tax_rows;
+  std::vector<char> returnflag_rows, linestatus_rows;
+  std::vector<DBDate> shipdate_rows;
+
   // create space for input buffers
-  buffer quantity_buf(dbinfo.l.quantity);
-  buffer extendedprice_buf(dbinfo.l.extendedprice);
-  buffer discount_buf(dbinfo.l.discount);
-  buffer tax_buf(dbinfo.l.tax);
-  buffer returnflag_buf(dbinfo.l.returnflag);
-  buffer linestatus_buf(dbinfo.l.linestatus);
-  buffer shipdate_buf(dbinfo.l.shipdate);
+  buffer quantity_buf(SelectRows(l.quantity, ranges, l.rows, quantity_rows));
+  buffer extendedprice_buf(
+      SelectRows(l.extendedprice, ranges, l.rows, extendedprice_rows));
+  buffer discount_buf(SelectRows(l.discount, ranges, l.rows, discount_rows));
+  buffer tax_buf(SelectRows(l.tax, ranges, l.rows, tax_rows));
+  buffer returnflag_buf(
+      SelectRows(l.returnflag, ranges, l.rows, returnflag_rows));
+  buffer linestatus_buf(
+      SelectRows(l.linestatus, ranges, l.rows, linestatus_rows));
+  buffer shipdate_buf(SelectRows(l.shipdate, ranges, l.rows, shipdate_rows));
 
   // setup the output buffers
   buffer sum_qty_buf(sum_qty);
@@ -43,12 +60,9 @@ bool SubmitQuery1(queue& q, Database& dbinfo, DBDate low_date,
   buffer avg_discount_buf(avg_discount);
   buffer count_buf(count);
 
-  const int rows = dbinfo.l.rows; 
+  const int rows = RowCount(ranges);
   const size_t iters = (rows + kElementsPerCycle - 1) / kElementsPerCycle;
 
-  // start timer
-  high_resolution_clock::time_point host_start = high_resolution_clock::now();
-
   /////////////////////////////////////////////////////////////////////////////
   //// Query1 Kernel
   auto event = q.submit([&](handler& h) {
@@ -1,6 +1,8 @@
 #include <stdio.h>
 
+#include <algorithm>
 #include <type_traits>
+#include <utility>
 
 #include "query11_kernel.hpp"
 #include "pipe_types.hpp"
@@ -25,11 +27,11 @@ class ConsumeSort;
 ///////////////////////////////////////////////////////////////////////////////
 // sort configuration
 using SortType = OutputData;
-constexpr int kNumSortStages = CeilLog2(kPartTableSize);
+constexpr int kNumSortStages = CeilLog2(kPartCapacity);
 constexpr int kSortSize = Pow2(kNumSortStages);
 
-static_assert(kPartTableSize <= kSortSize,
-              "Must be able to sort all part keys");
+static_assert(kPartCapacity <= kSortSize,
+              "Must be able to sort all part keys of one pass");
 
 // comparator for the sorter to sort in descending order
 struct GreaterThan {
@@ -43,6 +45,14 @@ using SortInPipe = pipe<class SortInputPipe, SortType>;
 using SortOutPipe = pipe<class SortOutputPipe, SortType>;
 ///////////////////////////////////////////////////////////////////////////////
 
+//
+// Q11 is computed in passes over ranges of at most kPartCapacity PARTKEYs
+// (outer) and kSupplierCapacity SUPPKEYs (inner), so that the per-part
+// accumulator and the SUPPLIER map fit on-chip for any scale factor.
+// The partial sums of a range of parts are carried across its SUPPLIER passes
+// in global memory. Only the last SUPPLIER pass of each range of parts sorts
+// them, and its sorted output is merged on the host.
+//
 bool SubmitQuery11(queue& q, Database& dbinfo, std::string& nation,
                     std::vector<DBIdentifier>& partkeys,
                     std::vector<DBDecimal>& values,
@@ -51,9 +61,13 @@ bool SubmitQuery11(queue& q, Database& dbinfo, std::string& nation,
   assert(dbinfo.n.name_key_map.find(nation) != dbinfo.n.name_key_map.end());
   unsigned char nationkey = dbinfo.n.name_key_map[nation];
 
+  const size_t p_rows = dbinfo.p.rows;
+  const size_t s_rows = dbinfo.s.rows;
+  const size_t ps_rows = dbinfo.ps.rows;
+
   // ensure correctly sized output buffers
-  partkeys.resize(kPartTableSize);
-  values.resize(kPartTableSize);
+  partkeys.resize(p_rows);
+  values.resize(p_rows);
 
   // create space for the input buffers
   // SUPPLIER
@@ -65,212 +79,306 @@ bool SubmitQuery11(queue& q, Database& dbinfo, std::string& nation,
   buffer ps_availqty_buf(dbinfo.ps.availqty);
   buffer ps_supplycost_buf(dbinfo.ps.supplycost);
 
-  // setup the output buffers
-  buffer partkeys_buf(partkeys);
-  buffer values_buf(values);
+  // the partial sums of the current range of parts, carried across the
+  // SUPPLIER passes
+  buffer<DBDecimal> partial_values_buf{range<1>(kPartCapacity)};
 
-  // number of producing iterations depends on the number of elements per cycle
-  const size_t ps_rows = dbinfo.ps.rows;
-  const size_t ps_iters = (ps_rows + kJoinWinSize - 1) / kJoinWinSize;
+  // the sorted output of one range of parts
+  std::vector<DBIdentifier> pass_partkeys(kPartCapacity);
+  std::vector<DBDecimal> pass_values(kPartCapacity);
+
+  // the (partkey, value) pairs of the ranges finished so far, sorted by value
+  std::vector<std::pair<DBIdentifier, DBDecimal>> result, merged;
+  result.reserve(p_rows);
+  merged.reserve(p_rows);
+
+  kernel_latency = 0;
 
   // start timer
   high_resolution_clock::time_point host_start = high_resolution_clock::now();
 
-  ///////////////////////////////////////////////////////////////////////////
-  //// ProducePartSupplier Kernel
-  auto produce_ps_event = q.submit([&](handler& h) {
-    // PARTSUPPLIER table accessors
-    accessor ps_partkey_accessor(ps_partkey_buf, h, read_only);
-    accessor ps_suppkey_accessor(ps_suppkey_buf, h, read_only);
-    accessor ps_availqty_accessor(ps_availqty_buf, h, read_only);
-    accessor ps_supplycost_accessor(ps_supplycost_buf, h, read_only);
-
-    // kernel to produce the PARTSUPPLIER table
-    h.single_task<ProducePartSupplier>([=]() [[intel::kernel_args_restrict]] {
-      [[intel::initiation_interval(1)]]
-      for (size_t i = 0; i < ps_iters; i++) {
-        // bulk read of data from global memory
-        NTuple<kJoinWinSize, PartSupplierRow> data;
-
-        UnrolledLoop<0, kJoinWinSize>([&](auto j) {
-          size_t idx = i * kJoinWinSize + j;
-          bool in_range = idx < ps_rows;
-
-          DBIdentifier partkey = ps_partkey_accessor[idx];
-          DBIdentifier suppkey = ps_suppkey_accessor[idx];
-          int availqty = ps_availqty_accessor[idx];
-          DBDecimal supplycost = ps_supplycost_accessor[idx];
-
-          data.get<j>() =
-              PartSupplierRow(in_range, partkey, suppkey, availqty, supplycost);
+  for (size_t p_base = 0; p_base < p_rows; p_base += kPartCapacity) {
+    // PARTKEYs in this pass are in the range [p_base + 1, p_base + p_count]
+    const size_t p_count = std::min<size_t>(kPartCapacity, p_rows - p_base);
+
+    // the PARTSUPPLIER table is sorted by PARTKEY, so only the rows of this
+    // range of parts need to be produced
+    const DBIdentifier* ps_partkey = dbinfo.ps.partkey.data();
+    const size_t ps_begin =
+        std::lower_bound(ps_partkey, ps_partkey + ps_rows, p_base + 1) -
+        ps_partkey;
+    const size_t ps_end =
+        std::lower_bound(ps_partkey, ps_partkey + ps_rows,
+                         p_base + p_count + 1) - ps_partkey;
+
+    // number of producing iterations depends on the number of elements per
+    // cycle
+    const size_t ps_iters =
+        (ps_end - ps_begin + kJoinWinSize - 1) / kJoinWinSize;
+
+    for (size_t s_base = 0; s_base < s_rows; s_base += kSupplierCapacity) {
+      // SUPPKEYs in this pass are in the range [s_base + 1, s_base + s_count]
+      const size_t s_count =
+          std::min<size_t>(kSupplierCapacity, s_rows - s_base);
+      const bool first_s_pass = (s_base == 0);
+      const bool last_s_pass = (s_base + kSupplierCapacity >= s_rows);
+
+      // setup the output buffers
+      buffer partkeys_buf(pass_partkeys);
+      buffer values_buf(pass_values);
+
+      /////////////////////////////////////////////////////////////////////////
+      //// ProducePartSupplier Kernel
+      auto produce_ps_event = q.submit([&](handler& h) {
+        // PARTSUPPLIER table accessors
+        accessor ps_partkey_accessor(ps_partkey_buf, h, read_only);
+        accessor ps_suppkey_accessor(ps_suppkey_buf, h, read_only);
+        accessor ps_availqty_accessor(ps_availqty_buf, h, read_only);
+        accessor ps_supplycost_accessor(ps_supplycost_buf, h, read_only);
+
+        // kernel to produce the PARTSUPPLIER table
+        h.single_task<ProducePartSupplier>(
+            [=]() [[intel::kernel_args_restrict]] {
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < ps_iters; i++) {
+            // bulk read of data from global memory
+            NTuple<kJoinWinSize, PartSupplierRow> data;
+
+            UnrolledLoop<0, kJoinWinSize>([&](auto j) {
+              size_t idx = ps_begin + i * kJoinWinSize + j;
+
+              DBIdentifier partkey = ps_partkey_accessor[idx];
+              DBIdentifier suppkey = ps_suppkey_accessor[idx];
+              int availqty = ps_availqty_accessor[idx];
+              DBDecimal supplycost = ps_supplycost_accessor[idx];
+
+              // only rows whose SUPPKEY is in this pass are valid
+              bool in_range = idx < ps_end && suppkey > s_base &&
+                              suppkey <= s_base + s_count;
+
+              data.get<j>() = PartSupplierRow(in_range, partkey, suppkey,
+                                              availqty, supplycost);
+            });
+
+            // write to pipe
+            ProducePartSupplierPipe::write(
+                PartSupplierRowPipeData(false, true, data));
+          }
+
+          // tell the downstream kernel we are done producing data
+          ProducePartSupplierPipe::write(PartSupplierRowPipeData(true, false));
         });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// JoinPartSupplierParts Kernel
+      auto join_event = q.submit([&](handler& h) {
+        // SUPPLIER table accessors
+        accessor s_nationkey_accessor(s_nationkey_buf, h, read_only);
+
+        h.single_task<JoinPartSupplierParts>(
+            [=]() [[intel::kernel_args_restrict]] {
+          // initialize the array map
+          // +1 is to account for fact that SUPPKEY is [1,kSupplierCapacity]
+          // relative to s_base
+          unsigned char nation_key_map_data[kSupplierCapacity + 1];
+          bool nation_key_map_valid[kSupplierCapacity + 1];
+          for (int i = 0; i < kSupplierCapacity + 1; i++) {
+            nation_key_map_valid[i] = false;
+          }
 
-        // write to pipe
-        ProducePartSupplierPipe::write(
-            PartSupplierRowPipeData(false, true, data));
-      }
+          // populate MapJoiner map
+          // why a map? keys may not be sequential
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < s_count; i++) {
+            // NOTE: based on TPCH docs, SUPPKEY is guaranteed to be unique
+            // in the range [1:SF*10000]
+            DBIdentifier s_suppkey = i + 1;
+            unsigned char s_nationkey = s_nationkey_accessor[s_base + i];
+            
+            nation_key_map_data[s_suppkey] = s_nationkey;
+            nation_key_map_valid[s_suppkey] = true;
+          }
 
-      // tell the downstream kernel we are done producing data
-      ProducePartSupplierPipe::write(PartSupplierRowPipeData(true, false));
-    });
-  });
-  ///////////////////////////////////////////////////////////////////////////
-
-  ///////////////////////////////////////////////////////////////////////////
-  //// JoinPartSupplierParts Kernel
-  auto join_event = q.submit([&](handler& h) {
-    // SUPPLIER table accessors
-    size_t s_rows = dbinfo.s.rows;
-    accessor s_nationkey_accessor(s_nationkey_buf, h, read_only);
-
-    h.single_task<JoinPartSupplierParts>([=]() [[intel::kernel_args_restrict]] {
-      // initialize the array map
-      // +1 is to account for fact that SUPPKEY is [1,kSF*10000]
-      unsigned char nation_key_map_data[kSupplierTableSize + 1];
-      bool nation_key_map_valid[kSupplierTableSize + 1];
-      for (int i = 0; i < kSupplierTableSize + 1; i++) {
-        nation_key_map_valid[i] = false;
-      }
+          // MAPJOIN PARTSUPPLIER and SUPPLIER tables by suppkey
+          MapJoin<unsigned char, ProducePartSupplierPipe, PartSupplierRow,
+                  kJoinWinSize, PartSupplierPartsPipe,
+                  SupplierPartSupplierJoined>(nation_key_map_data,
+                                              nation_key_map_valid,
+                                              (unsigned int)s_base);
+          
+          // tell downstream we are done
+          PartSupplierPartsPipe::write(
+              SupplierPartSupplierJoinedPipeData(true,false));
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// Compute Kernel
+      auto compute_event = q.submit([&](handler& h) {
+        // the partial sums of the previous SUPPLIER passes
+        accessor partial_values_accessor(partial_values_buf, h, read_write);
+
+        h.single_task<Compute>([=]() [[intel::kernel_args_restrict]] {
+          constexpr int kAccumCacheSize = 15;
+          fpga_tools::OnchipMemoryWithCache<DBDecimal, kPartCapacity, 
+                                            kAccumCacheSize> partkey_values;
+
+          // initialize accumulator
+          if (first_s_pass) {
+            partkey_values.init(0);
+          } else {
+            for (size_t i = 0; i < kPartCapacity; i++) {
+              partkey_values.write(i, partial_values_accessor[i]);
+            }
+          }
 
-      // populate MapJoiner map
-      // why a map? keys may not be sequential
-      [[intel::initiation_interval(1)]]
-      for (size_t i = 0; i < s_rows; i++) {
-        // NOTE: based on TPCH docs, SUPPKEY is guaranteed to be unique
-        // in the range [1:kSF*10000]
-        DBIdentifier s_suppkey = i + 1;
-        unsigned char s_nationkey = s_nationkey_accessor[i];
-        
-        nation_key_map_data[s_suppkey] = s_nationkey;
-        nation_key_map_valid[s_suppkey] = true;
-      }
+          bool done = false;
+
+          [[intel::initiation_interval(1)]]
+          while (!done) {
+            bool valid_pipe_read;
+            SupplierPartSupplierJoinedPipeData pipe_data = 
+                PartSupplierPartsPipe::read(valid_pipe_read);
+
+            done = pipe_data.done && valid_pipe_read;
+
+            if (valid_pipe_read && !done) {
+              UnrolledLoop<0, kJoinWinSize>([&](auto j) {
+                SupplierPartSupplierJoined data =
+                    pipe_data.data.template get<j>();
+
+                if (data.valid && data.nationkey == nationkey) {
+                  // partkeys start at p_base + 1
+                  DBIdentifier index = data.partkey - 1 - p_base;
+                  DBDecimal val = data.supplycost * (DBDecimal)(data.availqty);
+                  auto curr_val = partkey_values.read(index);
+                  partkey_values.write(index, curr_val + val);
+                }
+              });
+            }
+          }
 
-      // MAPJOIN PARTSUPPLIER and SUPPLIER tables by suppkey
-      MapJoin<unsigned char, ProducePartSupplierPipe, PartSupplierRow,
-              kJoinWinSize, PartSupplierPartsPipe,
-              SupplierPartSupplierJoined>(nation_key_map_data,
-                                          nation_key_map_valid);
-      
-      // tell downstream we are done
-      PartSupplierPartsPipe::write(
-          SupplierPartSupplierJoinedPipeData(true,false));
-    });
-  });
-  ///////////////////////////////////////////////////////////////////////////
-
-  ///////////////////////////////////////////////////////////////////////////
-  //// Compute Kernel
-  auto compute_event = q.single_task<Compute>([=] {
-    constexpr int kAccumCacheSize = 15;
-    fpga_tools::OnchipMemoryWithCache<DBDecimal, kPartTableSize, 
-                                      kAccumCacheSize> partkey_values;
-
-    // initialize accumulator
-    partkey_values.init(0);
-
-    bool done = false;
-
-    [[intel::initiation_interval(1)]]
-    while (!done) {
-      bool valid_pipe_read;
-      SupplierPartSupplierJoinedPipeData pipe_data = 
-          PartSupplierPartsPipe::read(valid_pipe_read);
-
-      done = pipe_data.done && valid_pipe_read;
-
-      if (valid_pipe_read && !done) {
-        UnrolledLoop<0, kJoinWinSize>([&](auto j) {
-          SupplierPartSupplierJoined data = pipe_data.data.template get<j>();
-
-          if (data.valid && data.nationkey == nationkey) {
-            // partkeys start at 1
-            DBIdentifier index = data.partkey - 1;
-            DBDecimal val = data.supplycost * (DBDecimal)(data.availqty);
-            auto curr_val = partkey_values.read(index);
-            partkey_values.write(index, curr_val + val);
+          // carry the partial sums to the next SUPPLIER pass
+          if (!last_s_pass) {
+            for (size_t i = 0; i < kPartCapacity; i++) {
+              partial_values_accessor[i] = partkey_values.read(i);
+            }
+            return;
           }
+
+          // the sums are final, so sort the {partkey, partvalue} pairs
+          // based on partvalue. we will send in kSortSize - p_count dummy
+          // values with a minimum value so that they are last (sorting from
+          // highest to lowest)
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < kSortSize; i++) {
+            bool in_pass = i < p_count;
+            size_t key = in_pass ? (p_base + i + 1) : 0;
+            auto val = in_pass ? partkey_values.read(i)
+                               : std::numeric_limits<DBDecimal>::min();
+            SortInPipe::write(OutputData(key, val));
+          }
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      // the sorter only runs on the last SUPPLIER pass, when the partial sums
+      // of this range of parts are final
+      event last_event = compute_event;
+      if (last_s_pass) {
+        ///////////////////////////////////////////////////////////////////////
+        //// ConsumeSort kernel
+        auto consume_sort_event = q.submit([&](handler& h) {
+          // output buffer accessors
+          accessor partkeys_accessor(partkeys_buf, h, write_only, no_init);
+          accessor values_accessor(values_buf, h, write_only, no_init);
+
+          h.single_task<ConsumeSort>([=]() [[intel::kernel_args_restrict]] {
+            int i = 0;
+            bool i_in_range = 0 < kSortSize;
+            bool i_next_in_range = 1 < kSortSize;
+            bool i_in_parttable_range = 0 < kPartCapacity;
+            bool i_next_in_parttable_range = 1 < kPartCapacity;
+
+            // grab all kSortSize elements from the sorter
+            [[intel::initiation_interval(1)]]
+            while (i_in_range) {
+              bool pipe_read_valid;
+              OutputData D = SortOutPipe::read(pipe_read_valid);
+
+              if (pipe_read_valid) {
+                if (i_in_parttable_range) {
+                  partkeys_accessor[i] = D.partkey;
+                  values_accessor[i] = D.partvalue;
+                }
+
+                i_in_range = i_next_in_range;
+                i_next_in_range = i < kSortSize - 2;
+                i_in_parttable_range = i_next_in_parttable_range;
+                i_next_in_parttable_range = i < kPartCapacity - 2;
+                i++;
+              }
+            }
+          });
+        });
+        ///////////////////////////////////////////////////////////////////////
+
+        ///////////////////////////////////////////////////////////////////////
+        //// FifoSort Kernel
+        auto sort_event = q.single_task<FifoSort>([=] {
+          ihc::sort<SortType, kSortSize, SortInPipe, SortOutPipe>(
+              GreaterThan());
         });
+        ///////////////////////////////////////////////////////////////////////
+
+        sort_event.wait();
+        consume_sort_event.wait();
+        last_event = consume_sort_event;
       }
+
+      // wait for kernels to finish
+      produce_ps_event.wait();
+      join_event.wait();
+      compute_event.wait();
+
+      // gather profiling info
+      auto start_time =
+          produce_ps_event
+              .get_profiling_info<info::event_profiling::command_start>();
+      auto end_time =
+          last_event.get_profiling_info<info::event_profiling::command_end>();
+
+      // accumulate the kernel execution time in ms
+      kernel_latency += (end_time - start_time) * 1e-6;
     }
 
-    // sort the {partkey, partvalue} pairs based on partvalue.
-    // we will send in kSortSize - kPartTableSize dummy values with a
-    // minimum value so that they are last (sorting from highest to lowest)
-    [[intel::initiation_interval(1)]]
-    for (size_t i = 0; i < kSortSize; i++) {
-      size_t key = (i < kPartTableSize) ? (i + 1) : 0;
-      auto val = (i < kPartTableSize) ? partkey_values.read(i)
-                                      : std::numeric_limits<DBDecimal>::min();
-      SortInPipe::write(OutputData(key, val));
+    // the output buffers were copied back when they went out of scope. The
+    // real parts of this range are the first p_count sorted outputs, since
+    // the dummy values sort last. Merge them into the result by value.
+    merged.clear();
+    auto greater_value = [](const auto& a, const auto& b) {
+      return a.second > b.second;
+    };
+    std::vector<std::pair<DBIdentifier, DBDecimal>> pass_result(p_count);
+    for (size_t i = 0; i < p_count; i++) {
+      pass_result[i] = {pass_partkeys[i], pass_values[i]};
     }
-  });
-  ///////////////////////////////////////////////////////////////////////////
-
-  ///////////////////////////////////////////////////////////////////////////
-  //// ConsumeSort kernel
-  auto consume_sort_event = q.submit([&](handler& h) {
-    // output buffer accessors
-    accessor partkeys_accessor(partkeys_buf, h, write_only, no_init);
-    accessor values_accessor(values_buf, h, write_only, no_init);
-
-    h.single_task<ConsumeSort>([=]() [[intel::kernel_args_restrict]] {
-      int i = 0;
-      bool i_in_range = 0 < kSortSize;
-      bool i_next_in_range = 1 < kSortSize;
-      bool i_in_parttable_range = 0 < kPartTableSize;
-      bool i_next_in_parttable_range = 1 < kPartTableSize;
-
-      // grab all kSortSize elements from the sorter
-      [[intel::initiation_interval(1)]]
-      while (i_in_range) {
-        bool pipe_read_valid;
-        OutputData D = SortOutPipe::read(pipe_read_valid);
-
-        if (pipe_read_valid) {
-          if (i_in_parttable_range) {
-            partkeys_accessor[i] = D.partkey;
-            values_accessor[i] = D.partvalue;
-          }
+    std::merge(result.begin(), result.end(), pass_result.begin(),
+               pass_result.end(), std::back_inserter(merged), greater_value);
+    std::swap(result, merged);
+  }
 
-          i_in_range = i_next_in_range;
-          i_next_in_range = i < kSortSize - 2;
-          i_in_parttable_range = i_next_in_parttable_range;
-          i_next_in_parttable_range = i < kPartTableSize - 2;
-          i++;
-        }
-      }
-    });
-  });
-  ///////////////////////////////////////////////////////////////////////////
-
-  ///////////////////////////////////////////////////////////////////////////
-  //// FifoSort Kernel
-  auto sort_event = q.single_task<FifoSort>([=] {
-    ihc::sort<SortType, kSortSize, SortInPipe, SortOutPipe>(GreaterThan());
-  });
-  ///////////////////////////////////////////////////////////////////////////
-
-  // wait for kernels to finish
-  produce_ps_event.wait();
-  join_event.wait();
-  compute_event.wait();
-  sort_event.wait();
-  consume_sort_event.wait();
+  for (size_t i = 0; i < p_rows; i++) {
+    partkeys[i] = result[i].first;
+    values[i] = result[i].second;
+  }
 
   high_resolution_clock::time_point host_end = high_resolution_clock::now();
   duration<double, std::milli> diff = host_end - host_start;
 
-  // gather profiling info
-  auto start_time =
-      consume_sort_event
-          .get_profiling_info<info::event_profiling::command_start>();
-  auto end_time = consume_sort_event
-          .get_profiling_info<info::event_profiling::command_end>();
-
-  // calculating the kernel execution time in ms
-  auto kernel_execution_time = (end_time - start_time) * 1e-6;
-
-  kernel_latency = kernel_execution_time;
   total_latency = diff.count();
 
   return true;
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <limits>
 #include <stdio.h>
@@ -22,37 +23,78 @@ bool SubmitQuery12(queue& q, Database& dbinfo, DBDate low_date,
                     std::array<DBDecimal, 2>& high_line_count,
                     std::array<DBDecimal, 2>& low_line_count,
                     double& kernel_latency, double& total_latency) {
+  // start timer
+  high_resolution_clock::time_point host_start = high_resolution_clock::now();
+
+  // only send the blocks of the LINEITEM table that can have rows received
+  // in [low_date, high_date)
+  LineItemTable& l = dbinfo.l;
+  OrdersTable& o = dbinfo.o;
+  RowRanges l_ranges =
+      dbinfo.ZoneSelect(l.receiptdate_zone, low_date, high_date - 1, l.rows);
+
+  // only send the ORDERS rows whose ORDERKEY is in the range of ORDERKEYs of
+  // the selected LINEITEM blocks. The ORDERS table is sorted by ORDERKEY, so
+  // these rows are a single range.
+  DBIdentifier min_orderkey = std::numeric_limits<DBIdentifier>::max();
+  DBIdentifier max_orderkey = 0;
+  for (auto& r : l_ranges) {
+    const size_t first_block = r.first / kZoneMapBlockRows;
+    const size_t last_block = (r.second - 1) / kZoneMapBlockRows;
+    for (size_t b = first_block; b <= last_block; b++) {
+      min_orderkey = std::min(min_orderkey, l.orderkey_zone.min[b]);
+      max_orderkey = std::max(max_orderkey, l.orderkey_zone.max[b]);
+    }
+  }
+
+  RowRanges o_ranges{{0, o.rows}};
+  if (dbinfo.use_zone_maps) {
+    auto o_begin = o.orderkey.begin();
+    auto o_end = o.orderkey.begin() + o.rows;
+    size_t first = std::lower_bound(o_begin, o_end, min_orderkey) - o_begin;
+    size_t last = std::upper_bound(o_begin, o_end, max_orderkey) - o_begin;
+    o_ranges = RowRanges{{first, std::max(first, last)}};
+  }
+
+  // storage for the selected rows
+  std::vector<DBIdentifier> l_orderkey_rows, o_orderkey_rows;
+  std::vector<int> l_shipmode_rows, o_orderpriority_rows;
+  std::vector<DBDate> l_commitdate_rows, l_shipdate_rows, l_receiptdate_rows;
+
   // create space for the input buffers
   // LINEITEM table
-  buffer l_orderkey_buf(dbinfo.l.orderkey);
-  buffer l_shipmode_buf(dbinfo.l.shipmode);
-  buffer l_commitdate_buf(dbinfo.l.commitdate);
-  buffer l_shipdate_buf(dbinfo.l.shipdate);
-  buffer l_receiptdate_buf(dbinfo.l.receiptdate);
+  buffer l_orderkey_buf(
+      SelectRows(l.orderkey, l_ranges, l.rows, l_orderkey_rows));
+  buffer l_shipmode_buf(
+      SelectRows(l.shipmode, l_ranges, l.rows, l_shipmode_rows));
+  buffer l_commitdate_buf(
+      SelectRows(l.commitdate, l_ranges, l.rows, l_commitdate_rows));
+  buffer l_shipdate_buf(
+      SelectRows(l.shipdate, l_ranges, l.rows, l_shipdate_rows));
+  buffer l_receiptdate_buf(
+      SelectRows(l.receiptdate, l_ranges, l.rows, l_receiptdate_rows));
 
   // ORDERS table
-  buffer o_orderkey_buf(dbinfo.o.orderkey);
-  buffer o_orderpriority_buf(dbinfo.o.orderpriority);
+  buffer o_orderkey_buf(
+      SelectRows(o.orderkey, o_ranges, o.rows, o_orderkey_rows));
+  buffer o_orderpriority_buf(
+      SelectRows(o.orderpriority, o_ranges, o.rows, o_orderpriority_rows));
 
   // setup the output buffers
   buffer high_line_count_buf(high_line_count);
   buffer low_line_count_buf(low_line_count);
 
   // number of producing iterations depends on the number of elements per cycle
-  const size_t l_rows = dbinfo.l.rows;
+  const size_t l_rows = RowCount(l_ranges);
   const size_t l_iters =
       (l_rows + kLineItemJoinWindowSize - 1) / kLineItemJoinWindowSize;
-  const size_t o_rows = dbinfo.o.rows;
+  const size_t o_rows = RowCount(o_ranges);
   const size_t o_iters =
       (o_rows + kOrderJoinWindowSize - 1) / kOrderJoinWindowSize;
 
-  // start timer
-  high_resolution_clock::time_point host_start = high_resolution_clock::now();
-
   /////////////////////////////////////////////////////////////////////////////
   //// LineItemProducer Kernel: produce the LINEITEM table
   auto produce_lineitem_event = q.submit([&](handler& h) {
-    size_t l_rows = dbinfo.l.rows;
     accessor l_orderkey_accessor(l_orderkey_buf, h, read_only);
     accessor l_shipmode_accessor(l_shipmode_buf, h, read_only);
     accessor l_commitdate_accessor(l_commitdate_buf, h, read_only);
@@ -94,7 +136,6 @@ bool SubmitQuery12(queue& q, Database& dbinfo, DBDate low_date,
   /////////////////////////////////////////////////////////////////////////////
   //// OrdersProducer Kernel: produce the ORDERS table
   auto produce_orders_event = q.submit([&](handler& h) {
-    size_t o_rows = dbinfo.o.rows;
     accessor o_orderkey_accessor(o_orderkey_buf, h, read_only);
     accessor o_orderpriority_accessor(o_orderpriority_buf, h, read_only);
 
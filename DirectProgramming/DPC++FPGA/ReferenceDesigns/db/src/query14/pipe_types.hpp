@@ -0,0 +1,77 @@
+#ifndef __PIPE_TYPES_H__
+#define __PIPE_TYPES_H__
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "../db_utils/StreamingData.hpp"
+#include "../dbdata.hpp"
+
+using namespace sycl;
+
+//
+// A single row of the LINEITEM table
+// with a subset of the columns (needed for this query)
+//
+class LineItemRow {
+ public:
+  LineItemRow() : valid(false), partkey(0), extendedprice(0), discount(0) {}
+  LineItemRow(bool v_valid, DBIdentifier v_partkey, DBDecimal v_extendedprice,
+              DBDecimal v_discount)
+      : valid(v_valid),
+        partkey(v_partkey),
+        extendedprice(v_extendedprice),
+        discount(v_discount) {}
+
+  // NOTE: this is not true, but is key to be used by MapJoin
+  DBIdentifier PrimaryKey() const { return partkey; }
+
+  bool valid;
+  DBIdentifier partkey;
+  DBDecimal extendedprice;
+  DBDecimal discount;
+};
+
+//
+// A row of the join LINEITEM and PARTS table
+//
+class LineItemPartJoined {
+ public:
+  LineItemPartJoined()
+      : valid(false), is_promo(false), extendedprice(0), discount(0) {}
+  LineItemPartJoined(bool v_valid, bool v_is_promo, DBDecimal v_extendedprice,
+                     DBDecimal v_discount)
+      : valid(v_valid),
+        is_promo(v_is_promo),
+        extendedprice(v_extendedprice),
+        discount(v_discount) {}
+
+  void Join(const bool part_is_promo, const LineItemRow& l_row) {
+    is_promo = part_is_promo;
+    extendedprice = l_row.extendedprice;
+    discount = l_row.discount;
+  }
+
+  bool valid;
+  bool is_promo;
+  DBDecimal extendedprice;
+  DBDecimal discount;
+};
+
+// JOIN window size
+constexpr int kLineItemJoinWinSize = 4;
+
+// pipe data types
+using LineItemRowPipeData = StreamingData<LineItemRow, kLineItemJoinWinSize>;
+using LineItemPartJoinedPipeData =
+    StreamingData<LineItemPartJoined, kLineItemJoinWinSize>;
+
+// the pipes
+using LineItemProducerPipe =
+  pipe<class LineItemProducerPipeClass, LineItemRowPipeData>;
+
+using LineItemPartJoinedPipe =
+  pipe<class LineItemPartJoinedPipeClass, LineItemPartJoinedPipeData>;
+
+#endif /* __PIPE_TYPES_H__ */
@@ -0,0 +1,254 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include "query14_kernel.hpp"
+#include "pipe_types.hpp"
+
+#include "../db_utils/LikeRegex.hpp"
+#include "../db_utils/MapJoin.hpp"
+#include "../db_utils/Tuple.hpp"
+#include "../db_utils/Unroller.hpp"
+
+using namespace std::chrono;
+
+// kernel class names
+class ProduceLineItem;
+class JoinParts;
+class Compute;
+
+//
+// Q14 joins the LINEITEM table with the PARTS table on PARTKEY with a MapJoin.
+// The map holds whether the type of each part starts with 'PROMO'. Like Q9
+// and Q11, the map is sized for the design scale factor, so the query runs
+// one pass over the LINEITEM table per range of kPartCapacity PARTKEYs and
+// the revenues of the passes are summed on the host.
+//
+bool SubmitQuery14(queue& q, Database& dbinfo,
+                   DBDate low_date, DBDate high_date,
+                   DBDecimal& promo_revenue, DBDecimal& total_revenue,
+                   double& kernel_latency, double& total_latency) {
+  // the regex word for the 'LIKE PROMO%' condition on the part type
+  const std::array<char, 5> promo_word = {'P', 'R', 'O', 'M', 'O'};
+
+  // start timer
+  high_resolution_clock::time_point host_start = high_resolution_clock::now();
+
+  // only send the blocks of the LINEITEM table that can have rows shipped
+  // in [low_date, high_date)
+  LineItemTable& l = dbinfo.l;
+  RowRanges ranges =
+      dbinfo.ZoneSelect(l.shipdate_zone, low_date, high_date - 1, l.rows);
+
+  // storage for the selected rows
+  std::vector<DBIdentifier> partkey_rows;
+  std::vector<DBDecimal> extendedprice_rows, discount_rows;
+  std::vector<DBDate> shipdate_rows;
+
+  // create space for the input buffers
+  // PARTS
+  buffer p_type_buf(dbinfo.p.type);
+
+  // LINEITEM
+  buffer l_partkey_buf(SelectRows(l.partkey, ranges, l.rows, partkey_rows));
+  buffer l_extendedprice_buf(
+      SelectRows(l.extendedprice, ranges, l.rows, extendedprice_rows));
+  buffer l_discount_buf(SelectRows(l.discount, ranges, l.rows, discount_rows));
+  buffer l_shipdate_buf(SelectRows(l.shipdate, ranges, l.rows, shipdate_rows));
+
+  // number of producing iterations depends on the number of elements per cycle
+  const size_t l_rows = RowCount(ranges);
+  const size_t l_iters =
+      (l_rows + kLineItemJoinWinSize - 1) / kLineItemJoinWinSize;
+  const size_t p_rows = dbinfo.p.rows;
+
+  // the revenues of all passes are summed
+  promo_revenue = 0;
+  total_revenue = 0;
+  kernel_latency = 0;
+
+  for (size_t p_base = 0; p_base < p_rows; p_base += kPartCapacity) {
+    // PARTKEYs in this pass are in the range [p_base + 1, p_base + p_count]
+    const size_t p_count = std::min<size_t>(kPartCapacity, p_rows - p_base);
+
+    // the output of this pass: {promo revenue, total revenue}
+    std::array<DBDecimal, 2> pass_revenue;
+
+    {
+      // setup the output buffer
+      buffer pass_revenue_buf(pass_revenue);
+
+      /////////////////////////////////////////////////////////////////////////
+      //// ProduceLineItem Kernel: produce the LINEITEM table
+      auto produce_lineitem_event = q.submit([&](handler& h) {
+        // LINEITEM table accessors
+        accessor l_partkey_accessor(l_partkey_buf, h, read_only);
+        accessor l_extendedprice_accessor(l_extendedprice_buf, h, read_only);
+        accessor l_discount_accessor(l_discount_buf, h, read_only);
+        accessor l_shipdate_accessor(l_shipdate_buf, h, read_only);
+
+        h.single_task<ProduceLineItem>([=]() [[intel::kernel_args_restrict]] {
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < l_iters; i++) {
+            // bulk read of data from global memory
+            NTuple<kLineItemJoinWinSize, LineItemRow> data;
+
+            UnrolledLoop<0, kLineItemJoinWinSize>([&](auto j) {
+              size_t idx = i * kLineItemJoinWinSize + j;
+              bool in_range = idx < l_rows;
+
+              DBIdentifier partkey = l_partkey_accessor[idx];
+              DBDecimal extendedprice = l_extendedprice_accessor[idx];
+              DBDecimal discount = l_discount_accessor[idx];
+              DBDate shipdate = l_shipdate_accessor[idx];
+
+              // only rows shipped in the query interval whose PARTKEY is
+              // in this pass are valid
+              bool valid = in_range && shipdate >= low_date &&
+                           shipdate < high_date && partkey > p_base &&
+                           partkey <= p_base + p_count;
+
+              data.get<j>() =
+                  LineItemRow(valid, partkey, extendedprice, discount);
+            });
+
+            // write to pipe
+            LineItemProducerPipe::write(LineItemRowPipeData(false, true, data));
+          }
+
+          // tell the downstream kernel we are done producing data
+          LineItemProducerPipe::write(LineItemRowPipeData(true, false));
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// JoinParts Kernel: MapJoin the LINEITEM and PARTS tables
+      auto join_event = q.submit([&](handler& h) {
+        // PARTS table accessors
+        accessor p_type_accessor(p_type_buf, h, read_only);
+
+        h.single_task<JoinParts>([=]() [[intel::kernel_args_restrict]] {
+          // initialize the array map
+          // +1 is to account for fact that PARTKEY is [1,kPartCapacity]
+          // relative to p_base
+          bool is_promo_map_data[kPartCapacity + 1];
+          bool is_promo_map_valid[kPartCapacity + 1];
+          for (int i = 0; i < kPartCapacity + 1; i++) {
+            is_promo_map_valid[i] = false;
+          }
+
+          // initialize the regex word
+          LikeRegex<5, 25> regex;
+          UnrolledLoop<0, 5>([&](auto k) { regex.word[k] = promo_word[k]; });
+
+          // populate MapJoiner map
+          // NOTE: based on TPCH docs, PARTKEY is guaranteed to be unique
+          // in the range [1:SF*200000]
+          [[intel::initiation_interval(1), intel::ivdep]]
+          for (size_t i = 0; i < p_count; i++) {
+            DBIdentifier p_partkey = i + 1;
+
+            // read in the part type and check if it matches 'PROMO%'
+            UnrolledLoop<0, 25>([&](auto k) {
+              regex.str[k] = p_type_accessor[(p_base + i) * 25 + k];
+            });
+            regex.Match();
+
+            is_promo_map_data[p_partkey] = regex.AtStart();
+            is_promo_map_valid[p_partkey] = true;
+          }
+
+          // MAPJOIN LINEITEM and PARTS tables by partkey
+          MapJoin<bool, LineItemProducerPipe, LineItemRow,
+                  kLineItemJoinWinSize, LineItemPartJoinedPipe,
+                  LineItemPartJoined>(is_promo_map_data, is_promo_map_valid,
+                                      (unsigned int)p_base);
+
+          // tell downstream we are done
+          LineItemPartJoinedPipe::write(
+              LineItemPartJoinedPipeData(true, false));
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// Compute Kernel
+      auto compute_event = q.submit([&](handler& h) {
+        // output write accessor
+        accessor pass_revenue_accessor(pass_revenue_buf, h, write_only,
+                                       no_init);
+
+        h.single_task<Compute>([=]() [[intel::kernel_args_restrict]] {
+          // local accumulators
+          DBDecimal promo_revenue_local = 0, total_revenue_local = 0;
+          bool done;
+
+          [[intel::initiation_interval(1)]]
+          do {
+            // get joined row from pipe
+            LineItemPartJoinedPipeData joined_data =
+                LineItemPartJoinedPipe::read();
+
+            // upstream kernel tells this kernel when it is done
+            done = joined_data.done;
+
+            if (!done && joined_data.valid) {
+              DBDecimal promo_revenue_local_tmp[kLineItemJoinWinSize];
+              DBDecimal total_revenue_local_tmp[kLineItemJoinWinSize];
+
+              UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+                const LineItemPartJoined& row = joined_data.data.get<i>();
+                const DBDecimal revenue =
+                    row.extendedprice * (100 - row.discount);
+
+                total_revenue_local_tmp[i] = row.valid ? revenue : 0;
+                promo_revenue_local_tmp[i] =
+                    (row.valid && row.is_promo) ? revenue : 0;
+              });
+
+              // this creates an adder reduction tree from *_local_tmp to
+              // *_local
+              UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+                promo_revenue_local += promo_revenue_local_tmp[i];
+                total_revenue_local += total_revenue_local_tmp[i];
+              });
+            }
+          } while (!done);
+
+          // write back the local data to global memory
+          pass_revenue_accessor[0] = promo_revenue_local;
+          pass_revenue_accessor[1] = total_revenue_local;
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      // wait for the kernels to finish
+      produce_lineitem_event.wait();
+      join_event.wait();
+      compute_event.wait();
+
+      // gather profiling info
+      auto start_time = compute_event
+          .get_profiling_info<info::event_profiling::command_start>();
+      auto end_time = compute_event
+          .get_profiling_info<info::event_profiling::command_end>();
+
+      // accumulate the kernel execution time in ms
+      kernel_latency += (end_time - start_time) * 1e-6;
+    }
+
+    // the output buffer was copied back when it went out of scope
+    promo_revenue += pass_revenue[0];
+    total_revenue += pass_revenue[1];
+  }
+
+  high_resolution_clock::time_point host_end = high_resolution_clock::now();
+  duration<double, std::milli> diff = host_end - host_start;
+
+  total_latency = diff.count();
+
+  return true;
+}
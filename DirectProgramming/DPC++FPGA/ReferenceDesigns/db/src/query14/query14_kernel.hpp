@@ -0,0 +1,17 @@
+#ifndef __QUERY14_KERNEL_HPP__
+#define __QUERY14_KERNEL_HPP__
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "../dbdata.hpp"
+
+using namespace sycl;
+
+bool SubmitQuery14(queue& q, Database& dbinfo,
+                   DBDate low_date, DBDate high_date,
+                   DBDecimal& promo_revenue, DBDecimal& total_revenue,
+                   double& kernel_latency, double& total_latency);
+
+#endif  //__QUERY14_KERNEL_HPP__
@@ -0,0 +1,188 @@
+#ifndef __PIPE_TYPES_H__
+#define __PIPE_TYPES_H__
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "../db_utils/StreamingData.hpp"
+#include "../dbdata.hpp"
+
+using namespace sycl;
+
+//
+// A single row of the ORDERS table
+// with a subset of the columns (needed for this query)
+//
+class OrdersRow {
+ public:
+  OrdersRow()
+      : valid(false), orderkey(0), custkey(0), orderdate(0), shippriority(0) {}
+  OrdersRow(bool v_valid, DBIdentifier v_orderkey, DBIdentifier v_custkey,
+            DBDate v_orderdate, int v_shippriority)
+      : valid(v_valid),
+        orderkey(v_orderkey),
+        custkey(v_custkey),
+        orderdate(v_orderdate),
+        shippriority(v_shippriority) {}
+
+  DBIdentifier PrimaryKey() const { return orderkey; }
+
+  bool valid;
+  DBIdentifier orderkey;
+  DBIdentifier custkey;
+  DBDate orderdate;
+  int shippriority;
+};
+
+//
+// A single row of the LINEITEM table
+// with a subset of the columns (needed for this query)
+//
+class LineItemRow {
+ public:
+  LineItemRow() : valid(false), orderkey(0), extendedprice(0), discount(0) {}
+  LineItemRow(bool v_valid, DBIdentifier v_orderkey, DBDecimal v_extendedprice,
+              DBDecimal v_discount)
+      : valid(v_valid),
+        orderkey(v_orderkey),
+        extendedprice(v_extendedprice),
+        discount(v_discount) {}
+
+  DBIdentifier PrimaryKey() const { return orderkey; }
+
+  bool valid;
+  DBIdentifier orderkey;
+  DBDecimal extendedprice;
+  DBDecimal discount;
+};
+
+//
+// A row of the join ORDERS and LINEITEM table
+//
+class OrdersLineItemJoined {
+ public:
+  OrdersLineItemJoined()
+      : valid(false),
+        orderkey(0),
+        custkey(0),
+        orderdate(0),
+        shippriority(0),
+        extendedprice(0),
+        discount(0) {}
+
+  // NOTE: this is not true, but is key to be used by MapJoin
+  DBIdentifier PrimaryKey() const { return custkey; }
+
+  void Join(const OrdersRow& o_row, const LineItemRow& l_row) {
+    orderkey = o_row.orderkey;
+    custkey = o_row.custkey;
+    orderdate = o_row.orderdate;
+    shippriority = o_row.shippriority;
+    extendedprice = l_row.extendedprice;
+    discount = l_row.discount;
+  }
+
+  bool valid;
+  DBIdentifier orderkey;
+  DBIdentifier custkey;
+  DBDate orderdate;
+  int shippriority;
+  DBDecimal extendedprice;
+  DBDecimal discount;
+};
+
+//
+// A row of the join CUSTOMER, ORDERS and LINEITEM table
+//
+class CustomerOrdersLineItemJoined {
+ public:
+  CustomerOrdersLineItemJoined()
+      : valid(false),
+        mktsegment(0),
+        orderkey(0),
+        orderdate(0),
+        shippriority(0),
+        extendedprice(0),
+        discount(0) {}
+
+  void Join(const unsigned char c_mktsegment,
+            const OrdersLineItemJoined& ol_row) {
+    mktsegment = c_mktsegment;
+    orderkey = ol_row.orderkey;
+    orderdate = ol_row.orderdate;
+    shippriority = ol_row.shippriority;
+    extendedprice = ol_row.extendedprice;
+    discount = ol_row.discount;
+  }
+
+  bool valid;
+  unsigned char mktsegment;
+  DBIdentifier orderkey;
+  DBDate orderdate;
+  int shippriority;
+  DBDecimal extendedprice;
+  DBDecimal discount;
+};
+
+//
+// The revenue of one order: a row of the output of Q3
+//
+class OrderRevenue {
+ public:
+  OrderRevenue()
+      : valid(false), orderkey(0), revenue(0), orderdate(0), shippriority(0) {}
+  OrderRevenue(bool v_valid, DBIdentifier v_orderkey, DBDecimal v_revenue,
+               DBDate v_orderdate, int v_shippriority)
+      : valid(v_valid),
+        orderkey(v_orderkey),
+        revenue(v_revenue),
+        orderdate(v_orderdate),
+        shippriority(v_shippriority) {}
+
+  // the output order of Q3: by revenue (descending), then by order date.
+  // Ties are broken by orderkey, so the result is deterministic.
+  bool OrderedBefore(const OrderRevenue& other) const {
+    if (revenue != other.revenue) return revenue > other.revenue;
+    if (orderdate != other.orderdate) return orderdate < other.orderdate;
+    return orderkey < other.orderkey;
+  }
+
+  bool valid;
+  DBIdentifier orderkey;
+  DBDecimal revenue;
+  DBDate orderdate;
+  int shippriority;
+};
+
+// JOIN window sizes
+constexpr int kOrdersJoinWinSize = 1;
+constexpr int kLineItemJoinWinSize = 2;
+
+// pipe data types
+using OrdersRowPipeData = StreamingData<OrdersRow, kOrdersJoinWinSize>;
+using LineItemRowPipeData = StreamingData<LineItemRow, kLineItemJoinWinSize>;
+using OrdersLineItemJoinedPipeData =
+    StreamingData<OrdersLineItemJoined, kLineItemJoinWinSize>;
+using CustomerOrdersLineItemJoinedPipeData =
+    StreamingData<CustomerOrdersLineItemJoined, kLineItemJoinWinSize>;
+// the orders whose revenue is final: at most one per lane of the window
+using OrderRevenuePipeData = StreamingData<OrderRevenue, kLineItemJoinWinSize>;
+
+// the pipes
+using OrdersProducerPipe =
+  pipe<class OrdersProducerPipeClass, OrdersRowPipeData>;
+
+using LineItemProducerPipe =
+  pipe<class LineItemProducerPipeClass, LineItemRowPipeData>;
+
+using OrdersLineItemJoinedPipe =
+  pipe<class OrdersLineItemJoinedPipeClass, OrdersLineItemJoinedPipeData>;
+
+using CustomerJoinedPipe =
+  pipe<class CustomerJoinedPipeClass, CustomerOrdersLineItemJoinedPipeData>;
+
+using OrderRevenuePipe =
+  pipe<class OrderRevenuePipeClass, OrderRevenuePipeData>;
+
+#endif /* __PIPE_TYPES_H__ */
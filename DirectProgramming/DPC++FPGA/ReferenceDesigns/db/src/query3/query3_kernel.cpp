@@ -0,0 +1,491 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+
+#include "query3_kernel.hpp"
+#include "pipe_types.hpp"
+
+#include "../db_utils/MapJoin.hpp"
+#include "../db_utils/MergeJoin.hpp"
+#include "../db_utils/Tuple.hpp"
+#include "../db_utils/Unroller.hpp"
+
+using namespace std::chrono;
+
+// kernel class names
+class ProduceOrders;
+class ProduceLineItem;
+class JoinOrdersLineItem;
+class JoinCustomer;
+class Compute;
+class SelectTopK;
+
+//
+// Keeps the 'k' best rows seen so far, in order, in registers. Each Insert
+// compares the new row against all 'k' rows in parallel and shifts the rows
+// after its position down by one, so a loop that makes one Insert per
+// iteration can insert a row every cycle. Several Inserts in one iteration
+// would form a chain of dependent compares and shifts instead.
+//
+template <int k>
+class TopK {
+ public:
+  void Init() {
+    #pragma unroll
+    for (int i = 0; i < k; i++) {
+      valid[i] = false;
+    }
+  }
+
+  void Insert(const OrderRevenue& row) {
+    // whether 'row' goes before the current i'th row
+    bool before[k];
+    #pragma unroll
+    for (int i = 0; i < k; i++) {
+      before[i] = !valid[i] || row.OrderedBefore(data[i]);
+    }
+
+    // 'before' is false for the rows that stay, then true for the rest.
+    // Iterate backwards so that data[i - 1] is still the old value.
+    #pragma unroll
+    for (int i = k - 1; i >= 0; i--) {
+      if (before[i]) {
+        bool shift = (i > 0) && before[i - 1];
+        data[i] = shift ? data[i - 1] : row;
+        valid[i] = shift ? valid[i - 1] : true;
+      }
+    }
+  }
+
+  OrderRevenue data[k];
+  bool valid[k];
+};
+
+//
+// Q3 merge joins the ORDERS and LINEITEM tables on ORDERKEY (both are sorted
+// by it), then MapJoins the result with the CUSTOMER table on CUSTKEY. The
+// LINEITEM rows of an order arrive consecutively, so the revenue of each order
+// is summed as the rows stream by. A window of rows can finish several orders,
+// so the finished orders go to a second kernel, which inserts them one per
+// cycle into a register based top-k of the 10 best orders.
+//
+// The CUSTOMER map is sized for the design scale factor, so the query runs
+// one pass per range of kCustomerCapacity CUSTKEYs. Every order belongs to
+// exactly one customer, so the passes find disjoint sets of orders and their
+// top 10 lists are merged on the host.
+//
+bool SubmitQuery3(queue& q, Database& dbinfo, int mktsegment, DBDate date,
+                  std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+                  std::array<DBDecimal, kQuery3OutSize>& revenue,
+                  std::array<DBDate, kQuery3OutSize>& orderdate,
+                  std::array<int, kQuery3OutSize>& shippriority,
+                  double& kernel_latency, double& total_latency) {
+  // start timer
+  high_resolution_clock::time_point host_start = high_resolution_clock::now();
+
+  // only send the blocks of the ORDERS table that can have orders placed
+  // before 'date', and the blocks of the LINEITEM table that can have rows
+  // shipped after 'date'. Both selections keep the rows sorted by ORDERKEY,
+  // which is all that the MergeJoin needs.
+  OrdersTable& o = dbinfo.o;
+  LineItemTable& l = dbinfo.l;
+  RowRanges o_ranges = dbinfo.ZoneSelect(o.orderdate_zone, 0, date - 1, o.rows);
+  RowRanges l_ranges = dbinfo.ZoneSelect(
+      l.shipdate_zone, date + 1, std::numeric_limits<DBDate>::max(), l.rows);
+
+  // storage for the selected rows
+  std::vector<DBIdentifier> o_orderkey_rows, o_custkey_rows, l_orderkey_rows;
+  std::vector<DBDate> o_orderdate_rows, l_shipdate_rows;
+  std::vector<int> o_shippriority_rows;
+  std::vector<DBDecimal> l_extendedprice_rows, l_discount_rows;
+
+  // create space for the input buffers
+  // CUSTOMER
+  buffer c_mktsegment_buf(dbinfo.c.mktsegment);
+
+  // ORDERS
+  buffer o_orderkey_buf(
+      SelectRows(o.orderkey, o_ranges, o.rows, o_orderkey_rows));
+  buffer o_custkey_buf(SelectRows(o.custkey, o_ranges, o.rows, o_custkey_rows));
+  buffer o_orderdate_buf(
+      SelectRows(o.orderdate, o_ranges, o.rows, o_orderdate_rows));
+  buffer o_shippriority_buf(
+      SelectRows(o.shippriority, o_ranges, o.rows, o_shippriority_rows));
+
+  // LINEITEM
+  buffer l_orderkey_buf(
+      SelectRows(l.orderkey, l_ranges, l.rows, l_orderkey_rows));
+  buffer l_extendedprice_buf(
+      SelectRows(l.extendedprice, l_ranges, l.rows, l_extendedprice_rows));
+  buffer l_discount_buf(
+      SelectRows(l.discount, l_ranges, l.rows, l_discount_rows));
+  buffer l_shipdate_buf(
+      SelectRows(l.shipdate, l_ranges, l.rows, l_shipdate_rows));
+
+  // number of producing iterations depends on the number of elements per cycle
+  const size_t l_rows = RowCount(l_ranges);
+  const size_t l_iters =
+      (l_rows + kLineItemJoinWinSize - 1) / kLineItemJoinWinSize;
+  const size_t o_rows = RowCount(o_ranges);
+  const size_t o_iters =
+      (o_rows + kOrdersJoinWinSize - 1) / kOrdersJoinWinSize;
+  const size_t c_rows = dbinfo.c.rows;
+
+  // the top rows of all passes
+  std::vector<OrderRevenue> result;
+
+  kernel_latency = 0;
+
+  for (size_t c_base = 0; c_base < c_rows; c_base += kCustomerCapacity) {
+    // CUSTKEYs in this pass are in the range [c_base + 1, c_base + c_count]
+    const size_t c_count = std::min<size_t>(kCustomerCapacity, c_rows - c_base);
+
+    // the output of this pass
+    std::array<DBIdentifier, kQuery3OutSize> pass_orderkey;
+    std::array<DBDecimal, kQuery3OutSize> pass_revenue;
+    std::array<DBDate, kQuery3OutSize> pass_orderdate;
+    std::array<int, kQuery3OutSize> pass_shippriority;
+
+    {
+      // setup the output buffers
+      buffer pass_orderkey_buf(pass_orderkey);
+      buffer pass_revenue_buf(pass_revenue);
+      buffer pass_orderdate_buf(pass_orderdate);
+      buffer pass_shippriority_buf(pass_shippriority);
+
+      /////////////////////////////////////////////////////////////////////////
+      //// ProduceOrders Kernel: produce the ORDERS table
+      auto produce_orders_event = q.submit([&](handler& h) {
+        // ORDERS table accessors
+        accessor o_orderkey_accessor(o_orderkey_buf, h, read_only);
+        accessor o_custkey_accessor(o_custkey_buf, h, read_only);
+        accessor o_orderdate_accessor(o_orderdate_buf, h, read_only);
+        accessor o_shippriority_accessor(o_shippriority_buf, h, read_only);
+
+        h.single_task<ProduceOrders>([=]() [[intel::kernel_args_restrict]] {
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < o_iters + 1; i++) {
+            bool done = (i == o_iters);
+            bool valid = (i != o_iters);
+
+            // bulk read of data from global memory
+            NTuple<kOrdersJoinWinSize, OrdersRow> data;
+
+            UnrolledLoop<0, kOrdersJoinWinSize>([&](auto j) {
+              size_t idx = (i * kOrdersJoinWinSize + j);
+              bool in_range = idx < o_rows;
+
+              DBIdentifier key_tmp = o_orderkey_accessor[idx];
+              DBIdentifier custkey = o_custkey_accessor[idx];
+              DBDate orderdate = o_orderdate_accessor[idx];
+              int shippriority = o_shippriority_accessor[idx];
+
+              DBIdentifier key =
+                  in_range ? key_tmp : std::numeric_limits<DBIdentifier>::max();
+
+              // only orders placed before 'date' by a customer in this pass
+              // are valid
+              bool row_valid = in_range && orderdate < date &&
+                               custkey > c_base && custkey <= c_base + c_count;
+
+              data.get<j>() =
+                  OrdersRow(row_valid, key, custkey, orderdate, shippriority);
+            });
+
+            // write to pipe
+            OrdersProducerPipe::write(OrdersRowPipeData(done, valid, data));
+          }
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// ProduceLineItem Kernel: produce the LINEITEM table
+      auto produce_lineitem_event = q.submit([&](handler& h) {
+        // LINEITEM table accessors
+        accessor l_orderkey_accessor(l_orderkey_buf, h, read_only);
+        accessor l_extendedprice_accessor(l_extendedprice_buf, h, read_only);
+        accessor l_discount_accessor(l_discount_buf, h, read_only);
+        accessor l_shipdate_accessor(l_shipdate_buf, h, read_only);
+
+        h.single_task<ProduceLineItem>([=]() [[intel::kernel_args_restrict]] {
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < l_iters + 1; i++) {
+            bool done = (i == l_iters);
+            bool valid = (i != l_iters);
+
+            // bulk read of data from global memory
+            NTuple<kLineItemJoinWinSize, LineItemRow> data;
+
+            UnrolledLoop<0, kLineItemJoinWinSize>([&](auto j) {
+              size_t idx = (i * kLineItemJoinWinSize + j);
+              bool in_range = idx < l_rows;
+
+              DBIdentifier key_tmp = l_orderkey_accessor[idx];
+              DBDecimal extendedprice = l_extendedprice_accessor[idx];
+              DBDecimal discount = l_discount_accessor[idx];
+              DBDate shipdate = l_shipdate_accessor[idx];
+
+              DBIdentifier key =
+                  in_range ? key_tmp : std::numeric_limits<DBIdentifier>::max();
+
+              // only items shipped after 'date' are valid
+              bool row_valid = in_range && shipdate > date;
+
+              data.get<j>() =
+                  LineItemRow(row_valid, key, extendedprice, discount);
+            });
+
+            // write to pipe
+            LineItemProducerPipe::write(LineItemRowPipeData(done, valid, data));
+          }
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// JoinOrdersLineItem Kernel: MergeJoin the ORDERS and LINEITEM tables
+      auto join_orders_lineitem_event = q.submit([&](handler& h) {
+        h.single_task<JoinOrdersLineItem>([=]() [[intel::kernel_args_restrict]] {
+          MergeJoin<OrdersProducerPipe, OrdersRow, kOrdersJoinWinSize,
+                    LineItemProducerPipe, LineItemRow, kLineItemJoinWinSize,
+                    OrdersLineItemJoinedPipe, OrdersLineItemJoined>();
+
+          // join is done, tell downstream
+          OrdersLineItemJoinedPipe::write(
+              OrdersLineItemJoinedPipeData(true, false));
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// JoinCustomer Kernel: MapJoin the CUSTOMER table with the result
+      auto join_customer_event = q.submit([&](handler& h) {
+        // CUSTOMER table accessors
+        accessor c_mktsegment_accessor(c_mktsegment_buf, h, read_only);
+
+        h.single_task<JoinCustomer>([=]() [[intel::kernel_args_restrict]] {
+          // initialize the array map
+          // +1 is to account for fact that CUSTKEY is [1,kCustomerCapacity]
+          // relative to c_base
+          unsigned char mktsegment_map_data[kCustomerCapacity + 1];
+          bool mktsegment_map_valid[kCustomerCapacity + 1];
+          for (int i = 0; i < kCustomerCapacity + 1; i++) {
+            mktsegment_map_valid[i] = false;
+          }
+
+          // populate MapJoiner map
+          // NOTE: based on TPCH docs, CUSTKEY is guaranteed to be unique
+          // in the range [1:SF*150000]
+          [[intel::initiation_interval(1)]]
+          for (size_t i = 0; i < c_count; i++) {
+            DBIdentifier c_custkey = i + 1;
+            unsigned char c_mktsegment = c_mktsegment_accessor[c_base + i];
+
+            mktsegment_map_data[c_custkey] = c_mktsegment;
+            mktsegment_map_valid[c_custkey] = true;
+          }
+
+          // MAPJOIN the ORDERS/LINEITEM join and CUSTOMER tables by custkey
+          MapJoin<unsigned char, OrdersLineItemJoinedPipe, OrdersLineItemJoined,
+                  kLineItemJoinWinSize, CustomerJoinedPipe,
+                  CustomerOrdersLineItemJoined>(mktsegment_map_data,
+                                                mktsegment_map_valid,
+                                                (unsigned int)c_base);
+
+          // tell downstream we are done
+          CustomerJoinedPipe::write(
+              CustomerOrdersLineItemJoinedPipeData(true, false));
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// Compute Kernel: sum the revenue of each order
+      auto compute_event = q.submit([&](handler& h) {
+        h.single_task<Compute>([=]() [[intel::kernel_args_restrict]] {
+          // the order whose LINEITEM rows are currently streaming by
+          OrderRevenue group;
+          bool done;
+
+          [[intel::initiation_interval(1)]]
+          do {
+            // get joined row from pipe
+            CustomerOrdersLineItemJoinedPipeData joined_data =
+                CustomerJoinedPipe::read();
+
+            // upstream kernel tells this kernel when it is done
+            done = joined_data.done;
+
+            // the orders finished by this window, in the lane of the row
+            // that finished them
+            NTuple<kLineItemJoinWinSize, OrderRevenue> finished;
+            bool any_finished = false;
+
+            if (!done && joined_data.valid) {
+              // the rows are sorted by ORDERKEY, so an order's revenue is
+              // final once a row with a different ORDERKEY arrives
+              UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+                const CustomerOrdersLineItemJoined& row =
+                    joined_data.data.get<i>();
+                finished.get<i>().valid = false;
+
+                if (row.valid && row.mktsegment == mktsegment) {
+                  DBDecimal row_revenue =
+                      row.extendedprice * (100 - row.discount);
+
+                  if (group.valid && row.orderkey == group.orderkey) {
+                    group.revenue += row_revenue;
+                  } else {
+                    if (group.valid) {
+                      finished.get<i>() = group;
+                      any_finished = true;
+                    }
+                    group.orderkey = row.orderkey;
+                    group.revenue = row_revenue;
+                    group.orderdate = row.orderdate;
+                    group.shippriority = row.shippriority;
+                    group.valid = true;
+                  }
+                }
+              });
+            }
+
+            // the last order is final once upstream is done
+            if (done && group.valid) {
+              finished.get<0>() = group;
+              any_finished = true;
+            }
+
+            if (any_finished || done) {
+              OrderRevenuePipe::write(
+                  OrderRevenuePipeData(done, any_finished, finished));
+            }
+          } while (!done);
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      /////////////////////////////////////////////////////////////////////////
+      //// SelectTopK Kernel: keep the 10 best orders
+      auto select_top_k_event = q.submit([&](handler& h) {
+        // output write accessors
+        accessor orderkey_accessor(pass_orderkey_buf, h, write_only, no_init);
+        accessor revenue_accessor(pass_revenue_buf, h, write_only, no_init);
+        accessor orderdate_accessor(pass_orderdate_buf, h, write_only,
+                                    no_init);
+        accessor shippriority_accessor(pass_shippriority_buf, h, write_only,
+                                       no_init);
+
+        h.single_task<SelectTopK>([=]() [[intel::kernel_args_restrict]] {
+          TopK<kQuery3OutSize> top;
+          top.Init();
+
+          // the finished orders of the last window read, and which of them
+          // still have to be inserted
+          NTuple<kLineItemJoinWinSize, OrderRevenue> orders;
+          bool pending[kLineItemJoinWinSize];
+          UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+            pending[i] = false;
+          });
+          bool upstream_done = false;
+          bool any_pending = false;
+
+          // read a window only once all its orders are inserted, and insert
+          // one order per iteration
+          [[intel::initiation_interval(1)]]
+          do {
+            if (!any_pending) {
+              OrderRevenuePipeData in = OrderRevenuePipe::read();
+              upstream_done = in.done;
+              UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+                orders.get<i>() = in.data.get<i>();
+                pending[i] = in.valid && orders.get<i>().valid;
+              });
+            }
+
+            // pick the first pending order
+            OrderRevenue next;
+            bool found = false;
+            UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+              if (!found && pending[i]) {
+                next = orders.get<i>();
+                pending[i] = false;
+                found = true;
+              }
+            });
+
+            if (found) {
+              top.Insert(next);
+            }
+
+            any_pending = false;
+            UnrolledLoop<0, kLineItemJoinWinSize>([&](auto i) {
+              any_pending |= pending[i];
+            });
+          } while (!upstream_done || any_pending);
+
+          // write back the local data to global memory.
+          // Unused output slots get an orderkey of 0 (ORDERKEYs start at 1)
+          for (size_t i = 0; i < kQuery3OutSize; i++) {
+            orderkey_accessor[i] = top.valid[i] ? top.data[i].orderkey : 0;
+            revenue_accessor[i] = top.valid[i] ? top.data[i].revenue : 0;
+            orderdate_accessor[i] = top.data[i].orderdate;
+            shippriority_accessor[i] = top.data[i].shippriority;
+          }
+        });
+      });
+      /////////////////////////////////////////////////////////////////////////
+
+      // wait for the kernels to finish
+      produce_orders_event.wait();
+      produce_lineitem_event.wait();
+      join_orders_lineitem_event.wait();
+      join_customer_event.wait();
+      compute_event.wait();
+      select_top_k_event.wait();
+
+      // gather profiling info
+      auto start_time = compute_event
+          .get_profiling_info<info::event_profiling::command_start>();
+      auto end_time = select_top_k_event
+          .get_profiling_info<info::event_profiling::command_end>();
+
+      // accumulate the kernel execution time in ms
+      kernel_latency += (end_time - start_time) * 1e-6;
+    }
+
+    // the output buffers were copied back when they went out of scope
+    for (size_t i = 0; i < kQuery3OutSize; i++) {
+      if (pass_orderkey[i] != 0) {
+        result.push_back(OrderRevenue(true, pass_orderkey[i], pass_revenue[i],
+                                      pass_orderdate[i],
+                                      pass_shippriority[i]));
+      }
+    }
+  }
+
+  // merge the top rows of the passes
+  std::sort(result.begin(), result.end(),
+            [](const OrderRevenue& a, const OrderRevenue& b) {
+              return a.OrderedBefore(b);
+            });
+
+  for (size_t i = 0; i < kQuery3OutSize; i++) {
+    bool valid = i < result.size();
+    orderkey[i] = valid ? result[i].orderkey : 0;
+    revenue[i] = valid ? result[i].revenue : 0;
+    orderdate[i] = valid ? result[i].orderdate : 0;
+    shippriority[i] = valid ? result[i].shippriority : 0;
+  }
+
+  high_resolution_clock::time_point host_end = high_resolution_clock::now();
+  duration<double, std::milli> diff = host_end - host_start;
+
+  total_latency = diff.count();
+
+  return true;
+}
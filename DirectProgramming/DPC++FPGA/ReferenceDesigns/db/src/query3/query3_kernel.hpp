@@ -0,0 +1,19 @@
+#ifndef __QUERY3_KERNEL_HPP__
+#define __QUERY3_KERNEL_HPP__
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "../dbdata.hpp"
+
+using namespace sycl;
+
+bool SubmitQuery3(queue& q, Database& dbinfo, int mktsegment, DBDate date,
+                  std::array<DBIdentifier, kQuery3OutSize>& orderkey,
+                  std::array<DBDecimal, kQuery3OutSize>& revenue,
+                  std::array<DBDate, kQuery3OutSize>& orderdate,
+                  std::array<int, kQuery3OutSize>& shippriority,
+                  double& kernel_latency, double& total_latency);
+
+#endif  //__QUERY3_KERNEL_HPP__
@@ -0,0 +1,133 @@
+#include <stdio.h>
+
+#include "query6_kernel.hpp"
+
+#include "../db_utils/Unroller.hpp"
+
+using namespace std::chrono;
+
+// how many elements to compute per cycle.
+// NOTE: this must not be larger than kPaddingRows, since the last iteration
+// reads past the end of the table into the padding rows
+constexpr int kElementsPerCycle = 16;
+static_assert(kElementsPerCycle <= kPaddingRows,
+              "Cannot read more elements per cycle than there are padding rows");
+
+// the kernel name
+class Query6;
+
+//
+// Q6 is a single scan over 4 columns of the LINEITEM table with a filter and
+// one sum, so it has no joins and its kernel time is bound by the global
+// memory bandwidth. It is the roofline for the other LINEITEM queries.
+//
+bool SubmitQuery6(queue& q, Database& dbinfo, DBDate low_date,
+                  DBDate high_date, DBDecimal discount, DBDecimal quantity,
+                  DBDecimal& revenue, double& kernel_latency,
+                  double& total_latency) {
+  // start timer
+  high_resolution_clock::time_point host_start = high_resolution_clock::now();
+
+  // only send the blocks of the LINEITEM table that can have rows shipped
+  // in [low_date, high_date)
+  LineItemTable& l = dbinfo.l;
+  RowRanges ranges =
+      dbinfo.ZoneSelect(l.shipdate_zone, low_date, high_date - 1, l.rows);
+
+  // storage for the selected rows
+  std::vector<DBDate> shipdate_rows;
+  std::vector<DBDecimal> discount_rows, quantity_rows, extendedprice_rows;
+
+  // create space for input buffers
+  buffer shipdate_buf(SelectRows(l.shipdate, ranges, l.rows, shipdate_rows));
+  buffer discount_buf(SelectRows(l.discount, ranges, l.rows, discount_rows));
+  buffer quantity_buf(SelectRows(l.quantity, ranges, l.rows, quantity_rows));
+  buffer extendedprice_buf(
+      SelectRows(l.extendedprice, ranges, l.rows, extendedprice_rows));
+
+  // the query selects discounts within 0.01 (1 cent) of 'discount'
+  const DBDecimal low_discount = discount - 1;
+  const DBDecimal high_discount = discount + 1;
+
+  const size_t rows = RowCount(ranges);
+  const size_t iters = (rows + kElementsPerCycle - 1) / kElementsPerCycle;
+
+  {
+    // setup the output buffer
+    buffer<DBDecimal, 1> revenue_buf(&revenue, range<1>(1));
+
+    ///////////////////////////////////////////////////////////////////////////
+    //// Query6 Kernel
+    auto event = q.submit([&](handler& h) {
+      // read accessors
+      accessor shipdate_accessor(shipdate_buf, h, read_only);
+      accessor discount_accessor(discount_buf, h, read_only);
+      accessor quantity_accessor(quantity_buf, h, read_only);
+      accessor extendedprice_accessor(extendedprice_buf, h, read_only);
+
+      // write accessor
+      accessor revenue_accessor(revenue_buf, h, write_only, no_init);
+
+      h.single_task<Query6>([=]() [[intel::kernel_args_restrict]] {
+        DBDecimal revenue_local = 0;
+
+        // stream each row in the DB (kElementsPerCycle rows at a time)
+        [[intel::initiation_interval(1)]]
+        for (size_t r = 0; r < iters; r++) {
+          DBDecimal revenue_tmp[kElementsPerCycle];
+
+          // multiple elements per cycle
+          UnrolledLoop<0, kElementsPerCycle>([&](auto p) {
+            // is data in range of the table
+            // (data size may not be divisible by kElementsPerCycle)
+            size_t idx = r * kElementsPerCycle + p;
+            bool in_range = idx < rows;
+
+            DBDate shipdate = shipdate_accessor[idx];
+            DBDecimal disc = discount_accessor[idx];
+            DBDecimal qty = quantity_accessor[idx];
+            DBDecimal extendedprice = extendedprice_accessor[idx];
+
+            // determine if the row is valid
+            bool row_valid = in_range && (shipdate >= low_date) &&
+                             (shipdate < high_date) &&
+                             (disc >= low_discount) &&
+                             (disc <= high_discount) && (qty < quantity);
+
+            revenue_tmp[p] = row_valid ? (extendedprice * disc) : 0;
+          });
+
+          // this creates an adder reduction tree from revenue_tmp to
+          // revenue_local
+          UnrolledLoop<0, kElementsPerCycle>([&](auto p) {
+            revenue_local += revenue_tmp[p];
+          });
+        }
+
+        // write back the local data to global memory
+        revenue_accessor[0] = revenue_local;
+      });
+    });
+    ///////////////////////////////////////////////////////////////////////////
+
+    // wait for kernel to finish
+    event.wait();
+
+    // gather profiling info
+    auto kernel_start_time =
+        event.get_profiling_info<info::event_profiling::command_start>();
+    auto kernel_end_time =
+        event.get_profiling_info<info::event_profiling::command_end>();
+
+    // calculating the kernel execution time in ms
+    kernel_latency = (kernel_end_time - kernel_start_time) * 1e-6;
+  }
+
+  // the output buffer was copied back to 'revenue' when it went out of scope
+  high_resolution_clock::time_point host_end = high_resolution_clock::now();
+  duration<double, std::milli> diff = host_end - host_start;
+
+  total_latency = diff.count();
+
+  return true;
+}
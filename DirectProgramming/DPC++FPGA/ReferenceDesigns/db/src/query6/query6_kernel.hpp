@@ -0,0 +1,22 @@
+#ifndef __QUERY6_KERNEL_HPP__
+#define __QUERY6_KERNEL_HPP__
+#pragma once
+
+#include <CL/sycl.hpp>
+#include <sycl/ext/intel/fpga_extensions.hpp>
+
+#include "../dbdata.hpp"
+
+using namespace sycl;
+
+// the number of bytes of each LINEITEM row that Q6 reads
+// (SHIPDATE, DISCOUNT, QUANTITY and EXTENDEDPRICE)
+constexpr size_t kQuery6BytesPerRow =
+    sizeof(DBDate) + 3 * sizeof(DBDecimal);
+
+bool SubmitQuery6(queue& q, Database& dbinfo, DBDate low_date,
+                  DBDate high_date, DBDecimal discount, DBDecimal quantity,
+                  DBDecimal& revenue, double& kernel_latency,
+                  double& total_latency);
+
+#endif  //__QUERY6_KERNEL_HPP__
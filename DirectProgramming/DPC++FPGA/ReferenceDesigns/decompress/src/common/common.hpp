@@ -2,15 +2,30 @@
 #define __COMMON_HPP__
 
 #include <CL/sycl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include <sycl/ext/intel/ac_types/ac_int.hpp>
 #include <sycl/ext/intel/fpga_extensions.hpp>
 
 #include "common_metaprogramming.hpp"
 #include "constexpr_math.hpp"  // included from ../../../../include
 #include "memory_utils.hpp"    // included from ../../../../include
+#include "unrolled_loop.hpp"   // included from ../../../../include
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 // we only use unsigned ac_ints in this design, so this alias lets us not write
 // the 'false' template argument every where
@@ -212,8 +227,8 @@ class select_by_string : public sycl::default_selector {
 // Reads 'filename' and returns an array of chars (the bytes of the file)
 //
 std::vector<unsigned char> ReadInputFile(const std::string& filename) {
-  // open file stream
-  std::ifstream fin(filename, std::ios::binary);
+  // open file stream, positioned at the end so we can get the file size
+  std::ifstream fin(filename, std::ios::binary | std::ios::ate);
 
   // make sure it opened
   if (!fin.good() || !fin.is_open()) {
@@ -221,11 +236,13 @@ std::vector<unsigned char> ReadInputFile(const std::string& filename) {
     std::terminate();
   }
 
-  // read in bytes
-  std::vector<unsigned char> result;
-  char tmp;
-  while (fin.get(tmp)) {
-    result.push_back(tmp);
+  // read in all of the bytes with a single call
+  std::vector<unsigned char> result(static_cast<size_t>(fin.tellg()));
+  fin.seekg(0, std::ios::beg);
+  fin.read(reinterpret_cast<char*>(result.data()), result.size());
+  if (!fin) {
+    std::cerr << "ERROR: failed to read " << filename << "\n";
+    std::terminate();
   }
   fin.close();
 
@@ -238,7 +255,7 @@ std::vector<unsigned char> ReadInputFile(const std::string& filename) {
 void WriteOutputFile(const std::string& filename,
                      std::vector<unsigned char>& data) {
   // open file stream
-  std::ofstream fout(filename.c_str());
+  std::ofstream fout(filename, std::ios::binary);
 
   // make sure it opened
   if (!fout.good() || !fout.is_open()) {
@@ -246,19 +263,182 @@ void WriteOutputFile(const std::string& filename,
     std::terminate();
   }
 
-  // write out bytes
-  for (auto& c : data) {
-    fout << c;
-  }
+  // write out all of the bytes with a single call
+  fout.write(reinterpret_cast<const char*>(data.data()), data.size());
   fout.close();
 }
 
+//
+// A read-only view of an input file's bytes. On POSIX systems the file is
+// memory-mapped, so the bytes are paged in straight from the page cache when
+// they are copied to the device, without an intermediate host buffer. On other
+// systems it falls back to reading the whole file with ReadInputFile.
+//
+class MappedInputFile {
+ public:
+  MappedInputFile(const std::string& filename) {
+#if defined(__unix__)
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cerr << "ERROR: could not open " << filename << " for reading\n";
+      std::terminate();
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+      void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p == MAP_FAILED) {
+        std::cerr << "ERROR: could not memory-map " << filename << "\n";
+        std::terminate();
+      }
+      // the file is consumed front to back, so ask for aggressive read-ahead
+      madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const unsigned char*>(p);
+    }
+    close(fd);
+#else
+    bytes_ = ReadInputFile(filename);
+    data_ = bytes_.data();
+    size_ = bytes_.size();
+#endif
+  }
+
+  ~MappedInputFile() {
+#if defined(__unix__)
+    if (data_ != nullptr) {
+      munmap(const_cast<unsigned char*>(data_), size_);
+    }
+#endif
+  }
+
+  MappedInputFile(const MappedInputFile&) = delete;
+  MappedInputFile& operator=(const MappedInputFile&) = delete;
+
+  const unsigned char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const unsigned char* data_ = nullptr;
+  size_t size_ = 0;
+#if !defined(__unix__)
+  std::vector<unsigned char> bytes_;
+#endif
+};
+
+//
+// Receives the decompressed output, in order, one chunk at a time
+//
+using OutputChunkWriter = std::function<void(const unsigned char*, size_t)>;
+
+// the size of the chunks the output is passed to an OutputChunkWriter in
+constexpr size_t kOutputChunkBytes = 16 * 1024 * 1024;
+
+//
+// Runs 'count' independent pieces of work on 'num_engines' replicas of a
+// decompression engine. Each engine is driven by its own host thread, which
+// calls 'run_piece(piece, engine)' for the next piece as soon as the engine
+// is done with the previous one. 'engine' is a std::integral_constant, so it
+// can select the kernels and pipes of the replica.
+//
+// 'run_piece' leaves the output of the piece in 'out_bytes', ending at
+// 'out_ends[piece]' (the pieces' outputs are contiguous and in order), and
+// returns false if the piece failed and its output is not final. If 'writer'
+// is set, the calling thread passes the output to it in order, in chunks of
+// up to kOutputChunkBytes, as soon as all the pieces it spans are done. This
+// way, writing the output overlaps with decompressing the rest. The output
+// is only passed on up to the first piece that failed.
+//
+// Returns the number of output bytes passed to 'writer'.
+//
+template <unsigned num_engines, typename F>
+size_t RunOnEngines(size_t count, F&& run_piece, const unsigned char* out_bytes,
+                    const std::vector<size_t>& out_ends,
+                    const OutputChunkWriter& writer) {
+  // the state of each piece: 0 while running, then kPieceFinal or kPieceFailed
+  constexpr char kPieceFinal = 1, kPieceFailed = 2;
+  std::atomic<size_t> next(0);
+  std::vector<char> done(count, 0);
+  std::mutex mutex;
+  std::condition_variable piece_done;
+
+  std::vector<std::thread> threads;
+  fpga_tools::UnrolledLoop<num_engines>([&](auto e) {
+    if (e < count) {
+      threads.emplace_back([&, e] {
+        for (size_t p = next++; p < count; p = next++) {
+          bool piece_ok = run_piece(p, e);
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            done[p] = piece_ok ? kPieceFinal : kPieceFailed;
+          }
+          piece_done.notify_one();
+        }
+      });
+    }
+  });
+
+  // wait for the pieces in order, and pass their output to 'writer' once a
+  // whole chunk (or the end of the output) is ready
+  size_t ready = 0;
+  size_t written = 0;
+  bool failed = false;
+  while (ready < count && !failed) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      piece_done.wait(lock, [&] { return done[ready] != 0; });
+      while (ready < count && done[ready] == kPieceFinal) ready++;
+      failed = (ready < count && done[ready] == kPieceFailed);
+    }
+
+    size_t end = (writer && ready > 0) ? out_ends[ready - 1] : 0;
+    while (written < end &&
+           (end - written >= kOutputChunkBytes || ready == count)) {
+      size_t chunk = std::min(kOutputChunkBytes, end - written);
+      writer(out_bytes + written, chunk);
+      written += chunk;
+    }
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+  return written;
+}
+
+//
+// Calls 'f(i)' for every 'i' in [0, count) on up to 'num_threads' host threads.
+// Indices are handed out one at a time, so work items of different sizes are
+// balanced across the threads.
+//
+template <typename F>
+void HostParallelFor(size_t count, unsigned num_threads, F&& f) {
+  num_threads = (unsigned)std::max<size_t>(1, std::min<size_t>(num_threads,
+                                                                count));
+  std::atomic<size_t> next(0);
+  auto worker = [&] {
+    for (size_t i = next++; i < count; i = next++) {
+      f(i);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < num_threads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
 //
 // A base class for a decmompressor
 // This class is purely virtual, i.e. another class must inherit from it and
 // override the 'DecompressBytes' function. This is done in
 // ../gzip/gzip_decompress.hpp and ../src/snappy/snappy_decompressor.hpp for the
-// GZIP and SNAPPY decompressors, respectively.
+// GZIP and SNAPPY decompressors, respectively. The host-only versions, which
+// decompress on the CPU, are in ../gzip/gzip_cpu_decompressor.hpp and
+// ../snappy/snappy_cpu_decompressor.hpp.
 //
 class DecompressorBase {
  public:
@@ -268,13 +448,44 @@ class DecompressorBase {
   // See ../gzip/gzip_decompressor.hpp and ../snappy/snappy_decompressor.hpp
   // for the GZIP and SNAPPY versions of these, respectively
   //
+  // Arguments:
+  //    q: the SYCL queue
+  //    in_bytes: the compressed input bytes
+  //    in_count: the number of compressed input bytes
+  //    runs: the number of times to decompress the input
+  //    print_stats: whether to print the execution time and throughput
+  //      statistics to stdout
+  //    writer: if set, receives the decompressed output of the last run in
+  //      chunks (see RunOnEngines above)
+  //
   virtual std::optional<std::vector<unsigned char>> DecompressBytes(
-      sycl::queue&, std::vector<unsigned char>&, int, bool) = 0;
+      sycl::queue&, const unsigned char*, size_t, int, bool,
+      const OutputChunkWriter&) = 0;
+
+  //
+  // Decompresses the bytes in 'in_bytes', without streaming the output.
+  //
+  std::optional<std::vector<unsigned char>> DecompressBytes(
+      sycl::queue& q, std::vector<unsigned char>& in_bytes, int runs,
+      bool print_stats) {
+    return DecompressBytes(q, in_bytes.data(), in_bytes.size(), runs,
+                           print_stats, nullptr);
+  }
 
   //
   // Reads the bytes in 'in_filename', decompresses them, and writes the
   // output to 'out_filename' (if write_output == true). This function uses
   // the DecompressBytes virtual function above to do the actual decompression.
+  // The input file is memory-mapped and the output is written to disk in
+  // large chunks, in order, as soon as the GZIP members or Snappy chunks it
+  // spans are done. If decompression or writing fails, the partially written
+  // output file is removed.
+  //
+  // Note that this does not bound the memory use: the whole output is still
+  // held in host memory (DecompressBytes returns it), and the Consumer kernel
+  // writes each piece to device memory, so a piece only reaches the host once
+  // its engine is done with it. A single-member GZIP file or raw Snappy stream
+  // is therefore written only after it is fully decompressed.
   //
   // Arguments:
   //    q: the SYCL queue
@@ -292,21 +503,47 @@ class DecompressorBase {
     std::cout << "Decompressing '" << in_filename << "' " << runs
               << ((runs == 1) ? " time" : " times") << std::endl;
 
-    auto in_bytes = ReadInputFile(in_filename);
-    auto result = DecompressBytes(q, in_bytes, runs, print_stats);
+    MappedInputFile in_file(in_filename);
 
-    if (result != std::nullopt) {
-      if (write_output) {
-        std::cout << std::endl;
-        std::cout << "Writing output data to '" << out_filename << "'"
-                  << std::endl;
-        std::cout << std::endl;
-        WriteOutputFile(out_filename, result.value());
+    std::FILE* fout = nullptr;
+    OutputChunkWriter writer;
+    bool write_failed = false;
+    if (write_output) {
+      if ((fout = std::fopen(out_filename.c_str(), "wb")) == nullptr) {
+        std::cerr << "ERROR: could not open " << out_filename
+                  << " for writing\n";
+        return false;
       }
-      return true;
-    } else {
-      return false;
+      std::cout << std::endl;
+      std::cout << "Writing output data to '" << out_filename << "'"
+                << std::endl;
+      std::cout << std::endl;
+      // the decompression cannot be stopped from the writer, so after a
+      // failed write the remaining chunks are dropped and the file is removed
+      // below
+      writer = [fout, &out_filename, &write_failed](const unsigned char* data,
+                                                    size_t n) {
+        if (!write_failed && std::fwrite(data, 1, n, fout) != n) {
+          std::cerr << "ERROR: failed to write " << out_filename << "\n";
+          write_failed = true;
+        }
+      };
     }
+
+    auto result = DecompressBytes(q, in_file.data(), in_file.size(), runs,
+                                  print_stats, writer);
+
+    if (fout != nullptr) {
+      if (std::fclose(fout) != 0 && !write_failed) {
+        std::cerr << "ERROR: failed to write " << out_filename << "\n";
+        write_failed = true;
+      }
+      if (result == std::nullopt || write_failed) {
+        std::remove(out_filename.c_str());
+      }
+    }
+
+    return result != std::nullopt && !write_failed;
   }
 };
 
@@ -361,31 +598,49 @@ sycl::event SubmitProducer(sycl::queue& q, unsigned in_count_padded,
 //
 //  Arguments:
 //    q: the SYCL queue
-//    out_count_padded: the total number of bytes to read from input pipe and
-//      write to out_ptr. In this design, we pad the size to be a multiple of
-//      literals_per_cycle.
+//    out_count_padded: the maximum number of bytes to write to out_ptr. In
+//      this design, we pad the size to be a multiple of literals_per_cycle.
 //    out_ptr: a pointer to the output data
+//    produced_count_ptr: if not null, receives the number of bytes the engine
+//      produced
+//
+// The kernel reads from the pipe until the engine signals that it is done. On
+// invalid input, the engine can produce more or fewer bytes than expected, so
+// at most 'out_count_padded' bytes are written, and the host checks the
+// number of bytes produced.
 //
 template <typename Id, typename OutPipe, unsigned literals_per_cycle>
 sycl::event SubmitConsumer(sycl::queue& q, unsigned out_count_padded,
-                           unsigned char* out_ptr) {
+                           unsigned char* out_ptr,
+                           unsigned* produced_count_ptr = nullptr) {
   assert(out_count_padded % literals_per_cycle == 0);
   auto iteration_count = out_count_padded / literals_per_cycle;
   return q.single_task<Id>([=] {
-    // Use the PipeToMemory utility to read 'literals_per_cycle'
-    // elements at once from 'OutPipe' and write them to 'out_ptr'.
-    // For details about the 'false' template parameter, see the SubmitProducer
-    // function above.
     sycl::device_ptr<unsigned char> out(out_ptr);
-    fpga_tools::PipeToMemory<OutPipe, literals_per_cycle, false>(
-        out, iteration_count);
 
-    // read the last 'done' signal
+    // read 'literals_per_cycle' elements at once from 'OutPipe' and write
+    // them to 'out_ptr', until the 'done' signal
+    unsigned produced_count = 0;
+    unsigned i = 0;
     bool done = false;
     while (!done) {
-      bool valid;
-      auto d = OutPipe::read(valid);
-      done = d.flag && valid;
+      auto d = OutPipe::read();
+      done = d.flag;
+      if (!done) {
+        if (i < iteration_count) {
+#pragma unroll
+          for (int j = 0; j < literals_per_cycle; j++) {
+            out[i * literals_per_cycle + j] = d[j];
+          }
+        }
+        produced_count += d.data.valid_count;
+        i++;
+      }
+    }
+
+    if (produced_count_ptr != nullptr) {
+      sycl::device_ptr<unsigned> produced(produced_count_ptr);
+      *produced = produced_count;
     }
   });
 }
@@ -0,0 +1,492 @@
+#ifndef __GZIP_CPU_DECOMPRESSOR_HPP__
+#define __GZIP_CPU_DECOMPRESSOR_HPP__
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "../common/common.hpp"
+#include "crc32_utils.hpp"  // included from ../../../../include
+#include "gzip_member_index.hpp"
+
+namespace gzip_cpu_detail {
+
+//
+// Reads the DEFLATE bit stream, least significant bit first
+//
+class BitReader {
+ public:
+  BitReader(const unsigned char* in, size_t in_count)
+      : in_(in), end_(in + in_count) {}
+
+  // returns the next 'n' bits (n <= 32) without consuming them
+  unsigned Peek(int n) {
+    Refill();
+    return (unsigned)(buf_ & ((1ull << n) - 1));
+  }
+
+  // consumes 'n' bits that are already in the bit buffer
+  void Skip(int n) {
+    if (n > count_) {
+      error_ = true;
+      n = count_;
+    }
+    buf_ >>= n;
+    count_ -= n;
+  }
+
+  // reads and consumes the next 'n' bits (n <= 32)
+  unsigned Bits(int n) {
+    unsigned val = Peek(n);
+    Skip(n);
+    return val;
+  }
+
+  // drops the bits up to the next byte boundary, and returns any whole bytes
+  // in the bit buffer to the byte stream
+  void AlignToByte() {
+    Skip(count_ % 8);
+    in_ -= count_ / 8;
+    buf_ = 0;
+    count_ = 0;
+  }
+
+  const unsigned char* BytePtr() const { return in_; }
+  size_t BytesLeft() const { return end_ - in_; }
+  void AdvanceBytes(size_t n) { in_ += n; }
+  bool Error() const { return error_; }
+
+ private:
+  void Refill() {
+    while (count_ <= 56 && in_ < end_) {
+      buf_ |= (unsigned long long)(*in_++) << count_;
+      count_ += 8;
+    }
+  }
+
+  const unsigned char* in_;
+  const unsigned char* end_;
+  unsigned long long buf_ = 0;
+  int count_ = 0;
+  bool error_ = false;
+};
+
+//
+// A canonical Huffman decoding table. Codes of up to kFastBits bits are
+// decoded with a single table lookup; longer codes fall back to walking the
+// per-length code counts.
+//
+class HuffmanTable {
+ public:
+  static constexpr int kMaxBits = 15;
+  static constexpr int kFastBits = 10;
+
+  // builds the table from the code length of each of the 'n' symbols.
+  // Returns false if the code lengths are over-subscribed.
+  bool Build(const unsigned char* lengths, int n) {
+    count_.fill(0);
+    fast_.fill(0);
+    for (int s = 0; s < n; s++) count_[lengths[s]]++;
+    count_[0] = 0;
+
+    int left = 1;
+    for (int len = 1; len <= kMaxBits; len++) {
+      left = (left << 1) - count_[len];
+      if (left < 0) return false;
+    }
+
+    std::array<unsigned short, kMaxBits + 2> offs;
+    offs[1] = 0;
+    for (int len = 1; len <= kMaxBits; len++) {
+      offs[len + 1] = offs[len] + count_[len];
+    }
+
+    // assign codes in canonical order and fill the fast table with the
+    // bit-reversed codes (the stream holds Huffman codes MSB first)
+    std::array<unsigned, kMaxBits + 1> next_code;
+    next_code[1] = 0;
+    for (int len = 2; len <= kMaxBits; len++) {
+      next_code[len] = (next_code[len - 1] + count_[len - 1]) << 1;
+    }
+
+    for (int s = 0; s < n; s++) {
+      int len = lengths[s];
+      if (len == 0) continue;
+      symbol_[offs[len]++] = s;
+      unsigned c = next_code[len]++;
+      if (len <= kFastBits) {
+        unsigned rev = 0;
+        for (int b = 0; b < len; b++) rev |= ((c >> b) & 1) << (len - 1 - b);
+        for (unsigned f = rev; f < (1u << kFastBits); f += 1u << len) {
+          fast_[f] = (len << 9) | s;
+        }
+      }
+    }
+    return true;
+  }
+
+  // decodes one symbol, or returns -1 on an invalid code
+  int Decode(BitReader& br) const {
+    unsigned entry = fast_[br.Peek(kFastBits)];
+    if (entry != 0) {
+      br.Skip(entry >> 9);
+      return entry & 0x1FF;
+    }
+
+    // slow path: walk the code one bit at a time
+    unsigned bits = br.Peek(kMaxBits);
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= kMaxBits; len++) {
+      code |= (bits >> (len - 1)) & 1;
+      int count = count_[len];
+      if (code - count < first) {
+        br.Skip(len);
+        return symbol_[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+    }
+    return -1;
+  }
+
+ private:
+  std::array<unsigned short, kMaxBits + 1> count_;
+  std::array<unsigned short, 288> symbol_;
+  std::array<unsigned short, 1 << kFastBits> fast_;
+};
+
+// base values and extra bits for the length (257-285) and distance codes
+constexpr unsigned short kLengthBase[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr unsigned char kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                            1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                            4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr unsigned short kDistBase[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,
+    65,  97,  129, 193, 257, 385,  513,  769,  1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577};
+constexpr unsigned char kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                          4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                          9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+//
+// Decodes the literals and {length, distance} pairs of one compressed block
+//
+inline bool InflateCodes(BitReader& br, const HuffmanTable& lit,
+                         const HuffmanTable& dist, unsigned char* out,
+                         size_t out_count, size_t& pos) {
+  while (true) {
+    int sym = lit.Decode(br);
+    if (sym < 0) return false;
+    if (sym < 256) {
+      if (pos >= out_count) return false;
+      out[pos++] = sym;
+    } else if (sym == 256) {
+      return true;
+    } else {
+      sym -= 257;
+      if (sym >= 29) return false;
+      size_t len = kLengthBase[sym] + br.Bits(kLengthExtra[sym]);
+      int dsym = dist.Decode(br);
+      if (dsym < 0 || dsym >= 30) return false;
+      size_t d = kDistBase[dsym] + br.Bits(kDistExtra[dsym]);
+      if (d > pos || len > out_count - pos) return false;
+
+      unsigned char* dst = out + pos;
+      const unsigned char* src = dst - d;
+      if (d >= len) {
+        std::memcpy(dst, src, len);
+      } else {
+        for (size_t i = 0; i < len; i++) dst[i] = src[i];
+      }
+      pos += len;
+    }
+  }
+}
+
+//
+// Decompresses the raw DEFLATE stream in 'in' into 'out', which must hold
+// exactly 'out_count' bytes. Returns the number of input bytes consumed, or
+// std::nullopt if the stream is invalid or its output size differs.
+//
+inline std::optional<size_t> Inflate(const unsigned char* in, size_t in_count,
+                                     unsigned char* out, size_t out_count) {
+  static const auto fixed_tables = [] {
+    std::array<HuffmanTable, 2> t;
+    unsigned char lengths[288];
+    for (int s = 0; s < 144; s++) lengths[s] = 8;
+    for (int s = 144; s < 256; s++) lengths[s] = 9;
+    for (int s = 256; s < 280; s++) lengths[s] = 7;
+    for (int s = 280; s < 288; s++) lengths[s] = 8;
+    t[0].Build(lengths, 288);
+    for (int s = 0; s < 30; s++) lengths[s] = 5;
+    t[1].Build(lengths, 30);
+    return t;
+  }();
+
+  BitReader br(in, in_count);
+  HuffmanTable lit, dist;
+  size_t pos = 0;
+  bool last = false;
+
+  while (!last) {
+    last = br.Bits(1);
+    unsigned type = br.Bits(2);
+
+    if (type == 0) {
+      // stored block
+      br.AlignToByte();
+      if (br.BytesLeft() < 4) return std::nullopt;
+      const unsigned char* p = br.BytePtr();
+      unsigned len = p[0] | (p[1] << 8);
+      unsigned nlen = p[2] | (p[3] << 8);
+      if ((len ^ 0xFFFF) != nlen || br.BytesLeft() - 4 < len ||
+          len > out_count - pos) {
+        return std::nullopt;
+      }
+      std::memcpy(out + pos, p + 4, len);
+      pos += len;
+      br.AdvanceBytes(4 + len);
+    } else if (type == 1) {
+      if (!InflateCodes(br, fixed_tables[0], fixed_tables[1], out, out_count,
+                        pos)) {
+        return std::nullopt;
+      }
+    } else if (type == 2) {
+      // read the code length code lengths, then the literal/length and
+      // distance code lengths
+      static constexpr unsigned char kOrder[19] = {
+          16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+      unsigned hlit = br.Bits(5) + 257;
+      unsigned hdist = br.Bits(5) + 1;
+      unsigned hclen = br.Bits(4) + 4;
+      if (hlit > 286 || hdist > 30) return std::nullopt;
+
+      unsigned char lengths[286 + 30] = {};
+      for (unsigned i = 0; i < hclen; i++) lengths[kOrder[i]] = br.Bits(3);
+      HuffmanTable cl;
+      if (!cl.Build(lengths, 19)) return std::nullopt;
+
+      std::memset(lengths, 0, sizeof(lengths));
+      unsigned i = 0;
+      while (i < hlit + hdist) {
+        int sym = cl.Decode(br);
+        if (sym < 0) return std::nullopt;
+        if (sym < 16) {
+          lengths[i++] = sym;
+          continue;
+        }
+        unsigned char val = 0;
+        unsigned rep;
+        if (sym == 16) {
+          if (i == 0) return std::nullopt;
+          val = lengths[i - 1];
+          rep = 3 + br.Bits(2);
+        } else if (sym == 17) {
+          rep = 3 + br.Bits(3);
+        } else {
+          rep = 11 + br.Bits(7);
+        }
+        if (i + rep > hlit + hdist) return std::nullopt;
+        while (rep--) lengths[i++] = val;
+      }
+      if (lengths[256] == 0) return std::nullopt;
+      if (!lit.Build(lengths, hlit) || !dist.Build(lengths + hlit, hdist)) {
+        return std::nullopt;
+      }
+      if (!InflateCodes(br, lit, dist, out, out_count, pos)) {
+        return std::nullopt;
+      }
+    } else {
+      return std::nullopt;
+    }
+
+    if (br.Error()) return std::nullopt;
+  }
+
+  if (pos != out_count) return std::nullopt;
+  br.AlignToByte();
+  return (size_t)(br.BytePtr() - in);
+}
+
+//
+// Returns the size of the header of the GZIP member in 'in', or std::nullopt
+// if it is not a valid header
+//
+inline std::optional<size_t> GzipHeaderSize(const unsigned char* in,
+                                            size_t in_count) {
+  constexpr unsigned char kFlagHCRC = 0x02, kFlagExtra = 0x04,
+                          kFlagName = 0x08, kFlagComment = 0x10;
+  if (in_count < kGzipMinMemberSize || !IsGzipMemberHeader(in)) {
+    return std::nullopt;
+  }
+
+  unsigned char flags = in[3];
+  size_t pos = 10;
+  size_t footer = in_count - 8;
+  if (flags & kFlagExtra) {
+    if (pos + 2 > footer) return std::nullopt;
+    pos += 2 + ReadLE16(in + pos);
+  }
+  if (flags & kFlagName) {
+    while (pos < footer && in[pos] != 0) pos++;
+    pos++;
+  }
+  if (flags & kFlagComment) {
+    while (pos < footer && in[pos] != 0) pos++;
+    pos++;
+  }
+  if (flags & kFlagHCRC) pos += 2;
+  if (pos > footer) return std::nullopt;
+  return pos;
+}
+
+//
+// Decompresses one GZIP member into 'out' (which holds the member's ISIZE
+// bytes) and checks the footer CRC-32. Returns false on any error.
+//
+inline bool DecompressGzipMember(const unsigned char* in, size_t in_count,
+                                 unsigned char* out, size_t out_count) {
+  auto pos = GzipHeaderSize(in, in_count);
+  if (!pos) return false;
+  size_t footer = in_count - 8;
+
+  auto consumed = Inflate(in + *pos, footer - *pos, out, out_count);
+  if (!consumed) return false;
+
+  return fpga_tools::Crc32(0, out, out_count) == ReadLE32(in + footer);
+}
+
+}  // namespace gzip_cpu_detail
+
+//
+// A GZIP decompressor that runs on the host CPU. See ../common/common.hpp for
+// more information.
+//
+// The members of a multi-member file are decompressed in parallel on up to
+// 'num_threads' host threads. The SYCL queue is not used, so this decompressor
+// works without an accelerator and can run at the same time as the FPGA
+// decompressor.
+//
+class GzipCpuDecompressor : public DecompressorBase {
+ public:
+  using DecompressorBase::DecompressBytes;
+
+  GzipCpuDecompressor(unsigned num_threads = std::thread::hardware_concurrency())
+      : num_threads_(std::max(num_threads, 1u)) {}
+
+  std::optional<std::vector<unsigned char>> DecompressBytes(
+      sycl::queue &, const unsigned char *in_bytes, size_t in_bytes_count,
+      int runs, bool print_stats, const OutputChunkWriter &writer) {
+    size_t in_count = in_bytes_count;
+
+    // find the member boundaries and where each member's output goes
+    auto members = IndexGzipMembers(in_bytes, in_count);
+    if (members.empty()) {
+      return {};
+    }
+    size_t member_count = members.size();
+    size_t out_count = members.back().out_offset + members.back().out_count;
+    std::vector<unsigned char> out_bytes(out_count);
+
+    // track timing information in ms
+    std::vector<double> time_ms(runs);
+
+    bool passed = true;
+
+    // run multiple times to increase the accuracy of the timing
+    for (int i = 0; i < runs; i++) {
+      std::vector<char> member_ok(member_count);
+
+      auto s = std::chrono::high_resolution_clock::now();
+      size_t first = 0;
+      while (first < member_count) {
+        HostParallelFor(member_count - first, num_threads_, [&](size_t k) {
+          const auto &member = members[first + k];
+          member_ok[first + k] = gzip_cpu_detail::DecompressGzipMember(
+              in_bytes + member.in_offset, member.in_count,
+              out_bytes.data() + member.out_offset, member.out_count);
+        });
+
+        // a member that fails may have been cut short by a false header
+        // match of the scan. In that case, merge it with the next piece and
+        // decompress again from there, since the output offsets after it
+        // have changed.
+        size_t m = first;
+        while (m < member_count && member_ok[m]) m++;
+        if (m == member_count ||
+            !MergeGzipMemberWithNext(in_bytes, members, m)) {
+          break;
+        }
+        member_count = members.size();
+        out_count = members.back().out_offset + members.back().out_count;
+        out_bytes.resize(out_count);
+        member_ok.resize(member_count);
+        first = m;
+      }
+      auto e = std::chrono::high_resolution_clock::now();
+
+      // duration in milliseconds
+      time_ms[i] = std::chrono::duration<double, std::milli>(e - s).count();
+
+      for (size_t m = 0; m < member_count; m++) {
+        if (!member_ok[m]) {
+          std::cerr << "ERROR: failed to decompress GZIP member " << m
+                    << " (invalid data or CRC mismatch)\n";
+          passed = false;
+        }
+      }
+
+      // stream the output of the last run to 'writer'
+      if (passed && i == runs - 1 && writer) {
+        for (size_t off = 0; off < out_count; off += kOutputChunkBytes) {
+          writer(out_bytes.data() + off,
+                 std::min(kOutputChunkBytes, out_count - off));
+        }
+      }
+    }
+
+    // print the performance results
+    if (passed && print_stats) {
+      double avg_time_ms;
+      if (runs > 1) {
+        avg_time_ms = std::accumulate(time_ms.begin() + 1, time_ms.end(), 0.0) /
+                      (runs - 1);
+      } else {
+        avg_time_ms = time_ms[0];
+      }
+
+      double compression_ratio = (double)(out_count) / (double)(in_count);
+
+      // the number of output megabytes
+      double out_mb = out_count * sizeof(unsigned char) * 1e-6;
+
+      std::cout << "GZIP members: " << member_count << " ("
+                << std::min((size_t)num_threads_, member_count)
+                << " CPU threads)\n";
+      std::cout << "Execution time: " << avg_time_ms << " ms\n";
+      std::cout << "Output Throughput: " << (out_mb / (avg_time_ms * 1e-3))
+                << " MB/s\n";
+      std::cout << "Compression Ratio: " << compression_ratio << ":1"
+                << "\n";
+    }
+
+    if (passed) {
+      return out_bytes;
+    } else {
+      return {};
+    }
+  }
+
+ private:
+  unsigned num_threads_;
+};
+
+#endif /* __GZIP_CPU_DECOMPRESSOR_HPP__ */
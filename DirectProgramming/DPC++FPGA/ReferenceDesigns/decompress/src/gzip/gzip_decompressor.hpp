@@ -2,27 +2,39 @@
 #define __GZIP_DECOMPRESSOR_HPP__
 
 #include <CL/sycl.hpp>
+#include <array>
 #include <chrono>
+#include <cstring>
 #include <sycl/ext/intel/ac_types/ac_int.hpp>
 #include <sycl/ext/intel/fpga_extensions.hpp>
 
 #include "../common/byte_stacker.hpp"
 #include "../common/common.hpp"
 #include "../common/lz77_decoder.hpp"
-#include "../common/simple_crc32.hpp"
 #include "constexpr_math.hpp"  // included from ../../../../include
+#include "crc32_utils.hpp"     // included from ../../../../include
+#include "gzip_member_index.hpp"
 #include "gzip_metadata_reader.hpp"
 #include "huffman_decoder.hpp"
 #include "metaprogramming_utils.hpp"  // included from ../../../../include
+#include "unrolled_loop.hpp"          // included from ../../../../include
 
-// declare the kernel and pipe names globally to reduce name mangling
+// declare the kernel and pipe names globally to reduce name mangling.
+// They are templated on the engine index so that the engine can be replicated.
+template <unsigned engine>
 class GzipMetadataReaderKernelID;
+template <unsigned engine>
 class HuffmanDecoderKernelID;
+template <unsigned engine>
 class LZ77DecoderKernelID;
+template <unsigned engine>
 class ByteStackerKernelID;
 
+template <unsigned engine>
 class GzipMetadataToHuffmanPipeID;
+template <unsigned engine>
 class HuffmanToLZ77PipeID;
+template <unsigned engine>
 class LZ77ToByteStackerPipeID;
 
 // the depth of the pipe between the Huffman decoder and the LZ77 decoder.
@@ -41,6 +53,7 @@ constexpr int kHuffmanToLZ77PipeDepth = 64;
 //    literals_per_cycle: the maximum number of literals written to the output
 //      stream every cycle. This sets how many literals can be read from the
 //      LZ77 history buffer at once.
+//    engine: the index of this instance of the decompression engine
 //
 //  Arguments:
 //    q: the SYCL queue
@@ -49,7 +62,8 @@ constexpr int kHuffmanToLZ77PipeDepth = 64;
 //    crc_out: an output buffer for the CRC in the GZIP footer
 //    count_out: an output buffer for the uncompressed size in the GZIP footer
 //
-template <typename InPipe, typename OutPipe, unsigned literals_per_cycle>
+template <typename InPipe, typename OutPipe, unsigned literals_per_cycle,
+          unsigned engine = 0>
 std::vector<sycl::event> SubmitGzipDecompressKernels(
     sycl::queue &q, int in_count, GzipHeaderData *hdr_data_out, int *crc_out,
     int *count_out) {
@@ -63,98 +77,151 @@ std::vector<sycl::event> SubmitGzipDecompressKernels(
 
   // the inter-kernel pipes for the GZIP decompression engine
   using GzipMetadataToHuffmanPipe =
-      sycl::ext::intel::pipe<GzipMetadataToHuffmanPipeID,
+      sycl::ext::intel::pipe<GzipMetadataToHuffmanPipeID<engine>,
                              FlagBundle<ByteSet<1>>>;
   using HuffmanToLZ77Pipe =
-      sycl::ext::intel::pipe<HuffmanToLZ77PipeID, FlagBundle<GzipLZ77InputData>,
+      sycl::ext::intel::pipe<HuffmanToLZ77PipeID<engine>,
+                             FlagBundle<GzipLZ77InputData>,
                              kHuffmanToLZ77PipeDepth>;
 
   // submit the GZIP decompression kernels
   auto header_event =
-      SubmitGzipMetadataReader<GzipMetadataReaderKernelID, InPipe,
+      SubmitGzipMetadataReader<GzipMetadataReaderKernelID<engine>, InPipe,
                                GzipMetadataToHuffmanPipe>(
           q, in_count, hdr_data_out, crc_out, count_out);
   auto huffman_event =
-      SubmitHuffmanDecoder<HuffmanDecoderKernelID, GzipMetadataToHuffmanPipe,
-                           HuffmanToLZ77Pipe>(q);
+      SubmitHuffmanDecoder<HuffmanDecoderKernelID<engine>,
+                           GzipMetadataToHuffmanPipe, HuffmanToLZ77Pipe>(q);
 
   // the design only needs a ByteStacker kernel when literals_per_cycle > 1
   if constexpr (literals_per_cycle > 1) {
     using LZ77ToByteStackerPipe =
-        sycl::ext::intel::pipe<LZ77ToByteStackerPipeID,
+        sycl::ext::intel::pipe<LZ77ToByteStackerPipeID<engine>,
                                FlagBundle<BytePack<literals_per_cycle>>>;
 
     auto lz77_event =
-        SubmitLZ77Decoder<LZ77DecoderKernelID, HuffmanToLZ77Pipe,
+        SubmitLZ77Decoder<LZ77DecoderKernelID<engine>, HuffmanToLZ77Pipe,
                           LZ77ToByteStackerPipe, literals_per_cycle,
                           kGzipMaxLZ77Distance, kGzipMaxLZ77Length>(q);
     auto byte_stacker_event =
-        SubmitByteStacker<ByteStackerKernelID, LZ77ToByteStackerPipe, OutPipe,
-                          literals_per_cycle>(q);
+        SubmitByteStacker<ByteStackerKernelID<engine>, LZ77ToByteStackerPipe,
+                          OutPipe, literals_per_cycle>(q);
 
     return {header_event, huffman_event, lz77_event, byte_stacker_event};
   } else {
     auto lz77_event =
-        SubmitLZ77Decoder<LZ77DecoderKernelID, HuffmanToLZ77Pipe, OutPipe,
-                          literals_per_cycle, kGzipMaxLZ77Distance,
+        SubmitLZ77Decoder<LZ77DecoderKernelID<engine>, HuffmanToLZ77Pipe,
+                          OutPipe, literals_per_cycle, kGzipMaxLZ77Distance,
                           kGzipMaxLZ77Length>(q);
     return {header_event, huffman_event, lz77_event};
   }
 }
 
 // declare kernel and pipe names at the global scope to reduce name mangling
+template <unsigned engine>
 class ProducerId;
+template <unsigned engine>
 class ConsumerId;
+template <unsigned engine>
 class InPipeId;
+template <unsigned engine>
 class OutPipeId;
 
-// the input and output pipe
-using InPipe = sycl::ext::intel::pipe<InPipeId, ByteSet<1>>;
-using OutPipe =
-    sycl::ext::intel::pipe<OutPipeId, FlagBundle<BytePack<kLiteralsPerCycle>>>;
+// the input and output pipe of each engine
+template <unsigned engine>
+using InPipe = sycl::ext::intel::pipe<InPipeId<engine>, ByteSet<1>>;
+template <unsigned engine>
+using OutPipe = sycl::ext::intel::pipe<OutPipeId<engine>,
+                                       FlagBundle<BytePack<kLiteralsPerCycle>>>;
 
 //
 // The GZIP decompressor. See ../common/common.hpp for more information.
 //
-template <unsigned literals_per_cycle>
+// The input may hold several concatenated GZIP members (e.g. BGZF files or the
+// output of the streaming mode of the GZIP compression reference design). The
+// members are indexed on the host (see gzip_member_index.hpp) and decompressed
+// by 'num_engines' replicas of the decompression engine, each of which takes
+// the next member as soon as it is done with the previous one (see
+// RunOnEngines in ../common/common.hpp). Each member's output is written to
+// its place in the output buffer, so the output is in the original order.
+//
+// A member whose end was found by scanning may have been cut short by bytes
+// that only look like the next member's header. The engine then fails on it:
+// it stops at the end of the input and produces the wrong number of bytes (or
+// the wrong CRC). Such a member is merged with the piece after it, and only
+// the merged members are decompressed again.
+//
+template <unsigned literals_per_cycle, unsigned num_engines>
 class GzipDecompressor : public DecompressorBase {
+  static_assert(num_engines > 0);
+
  public:
+  using DecompressorBase::DecompressBytes;
+
   std::optional<std::vector<unsigned char>> DecompressBytes(
-      sycl::queue &q, std::vector<unsigned char> &in_bytes, int runs,
-      bool print_stats) {
-    int in_count = in_bytes.size();
+      sycl::queue &q, const unsigned char *in_bytes, size_t in_bytes_count,
+      int runs, bool print_stats, const OutputChunkWriter &writer) {
+    size_t in_count = in_bytes_count;
+
+    // find the member boundaries and where each member's output goes
+    auto members = IndexGzipMembers(in_bytes, in_count);
+    if (members.empty()) {
+      return {};
+    }
 
-    // read the expected output size from the last 4 bytes of the file
-    std::vector<unsigned char> last_4_bytes(in_bytes.end() - 4, in_bytes.end());
-    unsigned out_count = *(reinterpret_cast<unsigned *>(last_4_bytes.data()));
+    size_t member_count = members.size();
+    size_t out_count = members.back().out_offset + members.back().out_count;
     std::vector<unsigned char> out_bytes(out_count);
 
-    // round up the output count to the nearest multiple of literals_per_cycle,
-    // which allows us to not predicate the last writes to the output buffer
-    // from the device.
-    int out_count_padded =
-        fpga_tools::RoundUpToMultiple(out_count, literals_per_cycle);
+    // On the device, each member's output is rounded up to the nearest
+    // multiple of literals_per_cycle, which allows us to not predicate the
+    // last writes to the output buffer from the device. This also keeps the
+    // padded writes of concurrently running engines from overlapping.
+    // Merging two members also merges their space on the device, which holds
+    // the output of the merged member, since it has the second one's footer.
+    std::vector<size_t> dev_out_offset(member_count);
+    std::vector<size_t> dev_out_size(member_count);
+    size_t out_count_padded = 0;
+    for (size_t m = 0; m < member_count; m++) {
+      dev_out_offset[m] = out_count_padded;
+      dev_out_size[m] = fpga_tools::RoundUpToMultiple(
+          (size_t)members[m].out_count, (size_t)literals_per_cycle);
+      out_count_padded += dev_out_size[m];
+    }
+
+    // the GZIP header data of each engine. This is parsed by the
+    // GZIPMetadataReader kernel
+    std::array<GzipHeaderData, num_engines> hdr_data_h;
 
-    // the GZIP header data. This is parsed by the GZIPMetadataReader kernel
-    GzipHeaderData hdr_data_h;
+    // the GZIP footer data of each engine. This is parsed by the
+    // GZIPMetadataReader kernel.
+    std::array<unsigned int, num_engines> crc_h, count_h;
 
-    // the GZIP footer data. This is parsed by the GZIPMetadataReader kernel.
-    unsigned int crc_h, count_h;
+    // the number of bytes each engine produced, counted by the consumer kernel
+    std::array<unsigned, num_engines> produced_h;
 
     // track timing information in ms
-    std::vector<double> time_ms(runs);
+    std::vector<double> time_ms(runs, 0.0);
 
     // input and output data pointers on the device using USM device allocations
     unsigned char *in, *out;
 
-    // the GZIP header data (see gzip_header_data.hpp)
+    // the GZIP header data (see gzip_header_data.hpp), one per engine
     GzipHeaderData *hdr_data;
 
     // the GZIP footer data, where 'count' is the expected number of bytes
-    // in the uncompressed file
+    // in the uncompressed file, one per engine
     int *crc, *count;
 
-    bool passed = true;
+    // the number of bytes produced, one per engine
+    unsigned *produced;
+
+    // the engines validate their members on separate host threads, which
+    // share the host cores to compute the CRCs
+    std::atomic<bool> passed(true);
+    std::mutex error_mutex;
+    const unsigned crc_threads =
+        std::max(1u, std::thread::hardware_concurrency() / num_engines);
 
     try {
       // allocate memory on the device
@@ -167,91 +234,209 @@ class GzipDecompressor : public DecompressorBase {
         std::cerr << "ERROR: could not allocate space for 'out'\n";
         std::terminate();
       }
-      if ((hdr_data = sycl::malloc_device<GzipHeaderData>(1, q)) == nullptr) {
+      if ((hdr_data = sycl::malloc_device<GzipHeaderData>(num_engines, q)) ==
+          nullptr) {
         std::cerr << "ERROR: could not allocate space for 'hdr_data'\n";
         std::terminate();
       }
-      if ((crc = sycl::malloc_device<int>(1, q)) == nullptr) {
+      if ((crc = sycl::malloc_device<int>(num_engines, q)) == nullptr) {
         std::cerr << "ERROR: could not allocate space for 'crc'\n";
         std::terminate();
       }
-      if ((count = sycl::malloc_device<int>(1, q)) == nullptr) {
+      if ((count = sycl::malloc_device<int>(num_engines, q)) == nullptr) {
         std::cerr << "ERROR: could not allocate space for 'count'\n";
         std::terminate();
       }
+      if ((produced = sycl::malloc_device<unsigned>(num_engines, q)) ==
+          nullptr) {
+        std::cerr << "ERROR: could not allocate space for 'produced'\n";
+        std::terminate();
+      }
 
       // copy the input data to the device memory and wait for the copy to
       // finish
-      q.memcpy(in, in_bytes.data(), in_count * sizeof(unsigned char)).wait();
+      q.memcpy(in, in_bytes, in_count * sizeof(unsigned char)).wait();
 
       // run the design multiple times to increase the accuracy of the timing
       for (int i = 0; i < runs; i++) {
         std::cout << "Launching kernels for run " << i << std::endl;
 
-        auto producer_event =
-            SubmitProducer<ProducerId, InPipe, 1>(q, in_count, in);
-        auto consumer_event =
-            SubmitConsumer<ConsumerId, OutPipe, literals_per_cycle>(
-                q, out_count_padded, out);
-
-        auto gzip_decompress_events =
-            SubmitGzipDecompressKernels<InPipe, OutPipe, literals_per_cycle>(
-                q, in_count, hdr_data, crc, count);
-
+        // the end of the last kernel on each engine
+        std::array<std::chrono::high_resolution_clock::time_point, num_engines>
+            engine_end;
         auto s = std::chrono::high_resolution_clock::now();
-        producer_event.wait();
-        consumer_event.wait();
-        auto e = std::chrono::high_resolution_clock::now();
-
-        // wait for the decompression kernels to finish
-        for (auto &e : gzip_decompress_events) {
-          e.wait();
+        engine_end.fill(s);
+
+        // whether each member passed the checks below
+        std::vector<char> member_ok(member_count, 0);
+
+        // decompress the members on the engines, each engine taking the next
+        // member as soon as it is done with the previous one. Returns whether
+        // the member passed. The errors of a member whose end was found by
+        // scanning are not reported, since it is merged and decompressed again
+        // (see below).
+        auto decompress_member = [&](size_t m_idx, auto e) {
+          const auto &m = members[m_idx];
+          bool report = m.exact;
+          bool member_passed = true;
+
+          auto producer_event = SubmitProducer<ProducerId<e>, InPipe<e>, 1>(
+              q, m.in_count, in + m.in_offset);
+          auto consumer_event =
+              SubmitConsumer<ConsumerId<e>, OutPipe<e>, literals_per_cycle>(
+                  q, dev_out_size[m_idx], out + dev_out_offset[m_idx],
+                  produced + e);
+          auto gzip_decompress_events =
+              SubmitGzipDecompressKernels<InPipe<e>, OutPipe<e>,
+                                          literals_per_cycle, e>(
+                  q, m.in_count, hdr_data + e, crc + e, count + e);
+
+          producer_event.wait();
+          consumer_event.wait();
+          for (auto &event : gzip_decompress_events) {
+            event.wait();
+          }
+          engine_end[e] = std::chrono::high_resolution_clock::now();
+
+          // Copy the header and footer data back from the device
+          q.memcpy(&hdr_data_h[e], hdr_data + e, sizeof(GzipHeaderData))
+              .wait();
+          q.memcpy(&crc_h[e], crc + e, sizeof(int)).wait();
+          q.memcpy(&count_h[e], count + e, sizeof(int)).wait();
+          q.memcpy(&produced_h[e], produced + e, sizeof(unsigned)).wait();
+
+          // validating the output
+          // check the magic header we read
+          if (hdr_data_h[e].MagicNumber() != 0x1f8b) {
+            if (report) {
+              std::lock_guard<std::mutex> lock(error_mutex);
+              auto save_flags = std::cerr.flags();
+              std::cerr << "ERROR: Incorrect magic header value of 0x"
+                        << std::hex << std::setw(4) << std::setfill('0')
+                        << hdr_data_h[e].MagicNumber()
+                        << " (should be 0x1f8b) in member " << std::dec
+                        << m_idx << "\n";
+              std::cerr.flags(save_flags);
+            }
+            member_passed = false;
+          }
+
+          // check the number of bytes we read and produced
+          if (count_h[e] != m.out_count || produced_h[e] != m.out_count) {
+            if (report) {
+              std::lock_guard<std::mutex> lock(error_mutex);
+              std::cerr << "ERROR: Out counts do not match in member " << m_idx
+                        << ": " << count_h[e] << ", " << produced_h[e]
+                        << " != " << m.out_count
+                        << " (count_h, produced_h != out_count)\n";
+            }
+            member_passed = false;
+          }
+
+          if (member_passed) {
+            // Copy the output back from the device
+            q.memcpy(out_bytes.data() + m.out_offset,
+                     out + dev_out_offset[m_idx],
+                     m.out_count * sizeof(unsigned char))
+                .wait();
+
+            // compute the CRC of the output data, using this engine's share
+            // of the host cores
+            auto crc32_out = fpga_tools::Crc32Parallel(
+                0, out_bytes.data() + m.out_offset, m.out_count, crc_threads);
+
+            // check that the computed CRC matches the expectation (crc_h is
+            // the CRC-32 that is in the GZIP footer).
+            if (crc32_out != crc_h[e]) {
+              if (report) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                auto save_flags = std::cerr.flags();
+                std::cerr << std::hex << std::setw(4) << std::setfill('0');
+                std::cerr << "ERROR: output data CRC does not match the "
+                          << "expected CRC 0x" << crc32_out << " != 0x"
+                          << crc_h[e] << " (result != expected) in member "
+                          << std::dec << m_idx << "\n";
+                std::cerr.flags(save_flags);
+              }
+              member_passed = false;
+            }
+          }
+
+          member_ok[m_idx] = member_passed;
+          return member_passed;
+        };
+
+        // the output of the last run is streamed to 'writer' while the
+        // engines are running, up to the first member that fails
+        const OutputChunkWriter &run_writer =
+            (i == runs - 1) ? writer : OutputChunkWriter();
+        std::vector<size_t> out_ends(member_count);
+        for (size_t m = 0; m < member_count; m++) {
+          out_ends[m] = members[m].out_offset + members[m].out_count;
         }
+        size_t written =
+            RunOnEngines<num_engines>(member_count, decompress_member,
+                                      out_bytes.data(), out_ends, run_writer);
+
+        // Merge every member that failed with the piece after it, move the
+        // output of the members that passed to its new place, and decompress
+        // the merged members again, until they all pass. A member that can
+        // not be merged (i.e. its end was not found by scanning) is an error.
+        // A failed member right after another one may just be the rest of
+        // it, so it is left to be merged into it.
+        while (passed) {
+          std::vector<size_t> cur_out_offset(member_count);
+          for (size_t m = 0; m < member_count; m++) {
+            cur_out_offset[m] = members[m].out_offset;
+          }
+
+          std::vector<size_t> merged;
+          for (size_t m = 0; m < members.size(); m++) {
+            if (member_ok[m] || (m > 0 && !member_ok[m - 1])) continue;
+            if (!MergeGzipMemberWithNext(in_bytes, members, m)) {
+              passed = false;
+              break;
+            }
+            member_ok.erase(member_ok.begin() + m + 1);
+            cur_out_offset.erase(cur_out_offset.begin() + m + 1);
+            dev_out_size[m] += dev_out_size[m + 1];
+            dev_out_size.erase(dev_out_size.begin() + m + 1);
+            dev_out_offset.erase(dev_out_offset.begin() + m + 1);
+            merged.push_back(m);
+          }
+          if (merged.empty() || !passed) break;
+
+          // a merged member has the output size of the last piece in it, so
+          // the output only moves towards the front
+          member_count = members.size();
+          out_count = members.back().out_offset + members.back().out_count;
+          for (size_t m = 0; m < member_count; m++) {
+            if (member_ok[m] && cur_out_offset[m] != members[m].out_offset) {
+              std::memmove(out_bytes.data() + members[m].out_offset,
+                           out_bytes.data() + cur_out_offset[m],
+                           members[m].out_count);
+            }
+          }
+
+          RunOnEngines<num_engines>(
+              merged.size(),
+              [&](size_t k, auto e) { return decompress_member(merged[k], e); },
+              out_bytes.data(), {}, OutputChunkWriter());
+        }
+        out_bytes.resize(out_count);
 
-        std::cout << "All kernels have finished for run " << i << std::endl;
+        // pass the rest of the output of the members that were merged
+        for (size_t off = written; passed && run_writer && off < out_count;
+             off += kOutputChunkBytes) {
+          run_writer(out_bytes.data() + off,
+                     std::min(kOutputChunkBytes, out_count - off));
+        }
 
         // duration in milliseconds
+        auto e = *std::max_element(engine_end.begin(), engine_end.end());
         time_ms[i] = std::chrono::duration<double, std::milli>(e - s).count();
 
-        // Copy the output back from the device
-        q.memcpy(out_bytes.data(), out, out_count * sizeof(unsigned char))
-            .wait();
-        q.memcpy(&hdr_data_h, hdr_data, sizeof(GzipHeaderData)).wait();
-        q.memcpy(&crc_h, crc, sizeof(int)).wait();
-        q.memcpy(&count_h, count, sizeof(int)).wait();
-
-        // validating the output
-        // check the magic header we read
-        if (hdr_data_h.MagicNumber() != 0x1f8b) {
-          auto save_flags = std::cerr.flags();
-          std::cerr << "ERROR: Incorrect magic header value of 0x" << std::hex
-                    << std::setw(4) << std::setfill('0')
-                    << hdr_data_h.MagicNumber() << " (should be 0x1f8b)\n";
-          std::cerr.flags(save_flags);
-          passed = false;
-        }
-
-        // check the number of bytes we read
-        if (count_h != out_count) {
-          std::cerr << "ERROR: Out counts do not match: " << count_h
-                    << " != " << out_count << "(count_h != out_count)\n";
-          passed = false;
-        }
-
-        // compute the CRC of the output data
-        auto crc32_out = SimpleCRC32(0, out_bytes.data(), out_count);
-
-        // check that the computed CRC matches the expectation (crc_h is the
-        // CRC-32 that is in the GZIP footer).
-        if (crc32_out != crc_h) {
-          auto save_flags = std::cout.flags();
-          std::cerr << std::hex << std::setw(4) << std::setfill('0');
-          std::cerr << "ERROR: output data CRC does not match the expected CRC "
-                    << "0x" << crc32_out << " != 0x" << crc_h
-                    << " (result != expected)\n";
-          std::cout.flags(save_flags);
-          passed = false;
-        }
+        std::cout << "All kernels have finished for run " << i << std::endl;
       }
     } catch (sycl::exception const &e) {
       std::cout << "Caught a synchronous SYCL exception: " << e.what() << "\n";
@@ -264,6 +449,7 @@ class GzipDecompressor : public DecompressorBase {
     sycl::free(hdr_data, q);
     sycl::free(crc, q);
     sycl::free(count, q);
+    sycl::free(produced, q);
 
     // print the performance results
     if (passed && print_stats) {
@@ -277,11 +463,13 @@ class GzipDecompressor : public DecompressorBase {
         avg_time_ms = time_ms[0];
       }
 
-      double compression_ratio = (double)(count_h) / (double)(in_count);
+      double compression_ratio = (double)(out_count) / (double)(in_count);
 
       // the number of input and output megabytes, respectively
-      size_t out_mb = count_h * sizeof(unsigned char) * 1e-6;
+      size_t out_mb = out_count * sizeof(unsigned char) * 1e-6;
 
+      std::cout << "GZIP members: " << member_count << " (" << num_engines
+                << ((num_engines == 1) ? " engine" : " engines") << ")\n";
       std::cout << "Execution time: " << avg_time_ms << " ms\n";
       std::cout << "Output Throughput: " << (out_mb / (avg_time_ms * 1e-3))
                 << " MB/s\n";
@@ -297,4 +485,4 @@ class GzipDecompressor : public DecompressorBase {
   }
 };
 
-#endif /* __GZIP_DECOMPRESSOR_HPP__ */
\ No newline at end of file
+#endif /* __GZIP_DECOMPRESSOR_HPP__ */
\ No newline at end of file
@@ -0,0 +1,169 @@
+#ifndef __GZIP_MEMBER_INDEX_HPP__
+#define __GZIP_MEMBER_INDEX_HPP__
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//
+// The location of one GZIP member in a (possibly multi-member) GZIP file and
+// where its decompressed bytes go in the output
+//
+struct GzipMember {
+  size_t in_offset;   // offset of the member's first byte in the input
+  size_t in_count;    // number of bytes in the member (header to footer)
+  size_t out_offset;  // offset of the member's output in the output file
+  unsigned out_count; // number of decompressed bytes (the footer's ISIZE)
+  bool exact;         // the member's end is known (BGZF or end of input),
+                      // rather than found by scanning
+};
+
+// the smallest possible member: 10 byte header, an empty fixed Huffman block
+// (2 bytes) and the 8 byte footer
+constexpr size_t kGzipMinMemberSize = 18;
+
+// DEFLATE cannot expand data by more than this factor, so a footer claiming a
+// larger output for its member cannot belong to a real member boundary
+constexpr size_t kDeflateMaxRatio = 1032;
+
+//
+// Reads a little-endian 16 or 32 bit value
+//
+inline unsigned ReadLE16(const unsigned char* p) {
+  return (unsigned)p[0] | ((unsigned)p[1] << 8);
+}
+inline unsigned ReadLE32(const unsigned char* p) {
+  return ReadLE16(p) | (ReadLE16(p + 2) << 16);
+}
+
+//
+// Returns whether the bytes at 'p' look like the start of a GZIP member
+// header: the magic number, the DEFLATE compression method, no reserved flag
+// bits set and a valid extra flags (XFL) and OS field.
+//
+inline bool IsGzipMemberHeader(const unsigned char* p) {
+  unsigned char flags = p[3], xfl = p[8], os = p[9];
+  return p[0] == 0x1F && p[1] == 0x8B && p[2] == 0x08 && (flags & 0xE0) == 0 &&
+         (xfl == 0 || xfl == 2 || xfl == 4) && (os <= 13 || os == 255);
+}
+
+//
+// If the member header at 'p' carries a BGZF 'BC' extra subfield (as written by
+// bgzip), returns the total member size it records. Otherwise, returns 0.
+//
+inline size_t BgzfMemberSize(const unsigned char* p, size_t remaining) {
+  constexpr unsigned char kFlagExtra = 0x04;
+  if (!(p[3] & kFlagExtra) || remaining < 12) return 0;
+
+  size_t xlen = ReadLE16(p + 10);
+  if (remaining < 12 + xlen) return 0;
+
+  // walk the extra subfields looking for SI1='B', SI2='C', SLEN=2
+  const unsigned char* sub = p + 12;
+  const unsigned char* end = sub + xlen;
+  while (sub + 4 <= end) {
+    size_t slen = ReadLE16(sub + 2);
+    if (sub[0] == 'B' && sub[1] == 'C' && slen == 2 && sub + 6 <= end) {
+      return ReadLE16(sub + 4) + 1;  // BSIZE is the member size minus 1
+    }
+    sub += 4 + slen;
+  }
+  return 0;
+}
+
+//
+// Splits the GZIP file in 'in_bytes' into its members so that they can be
+// decompressed independently.
+//
+// Member boundaries are exact for BGZF files, which record each member's size
+// in the header. For other multi-member files (e.g. concatenated gzip or pigz
+// output), the next member is found by scanning for a byte sequence that is a
+// plausible member header and is preceded by a plausible footer. Such a byte
+// sequence can also occur inside compressed data, so these members are not
+// 'exact': a member that turns out to be cut short by a false match must be
+// merged with the pieces after it (see MergeGzipMemberWithNext below).
+//
+// Returns an empty vector if 'in_bytes' is not a GZIP file.
+//
+std::vector<GzipMember> IndexGzipMembers(const unsigned char* in_bytes,
+                                         size_t in_count) {
+  std::vector<GzipMember> members;
+  size_t pos = 0;
+  size_t out_offset = 0;
+
+  while (pos < in_count) {
+    size_t remaining = in_count - pos;
+    if (remaining < kGzipMinMemberSize ||
+        !IsGzipMemberHeader(in_bytes + pos)) {
+      std::cerr << "ERROR: no GZIP member header at byte " << pos << "\n";
+      return {};
+    }
+
+    size_t member_size = BgzfMemberSize(in_bytes + pos, remaining);
+    bool exact = true;
+    if (member_size == 0 || member_size > remaining) {
+      // scan for the next plausible member header
+      member_size = remaining;
+      const unsigned char* p = in_bytes + pos + kGzipMinMemberSize;
+      const unsigned char* last = in_bytes + in_count - kGzipMinMemberSize;
+      while (p <= last) {
+        p = static_cast<const unsigned char*>(
+            std::memchr(p, 0x1F, last - p + 1));
+        if (p == nullptr) break;
+        size_t candidate_size = p - (in_bytes + pos);
+        size_t footer_isize = ReadLE32(p - 4);
+        if (IsGzipMemberHeader(p) &&
+            footer_isize <= candidate_size * kDeflateMaxRatio) {
+          member_size = candidate_size;
+          exact = false;
+          break;
+        }
+        p++;
+      }
+    }
+
+    GzipMember m;
+    m.in_offset = pos;
+    m.in_count = member_size;
+    m.out_offset = out_offset;
+    m.out_count = ReadLE32(in_bytes + pos + member_size - 4);
+    m.exact = exact;
+    members.push_back(m);
+
+    pos += member_size;
+    out_offset += m.out_count;
+  }
+
+  return members;
+}
+
+//
+// Merges member 'm' with the member after it, for when the boundary between
+// them was a false header match. The merged member's output size is read from
+// the footer at its new end, and the output offsets of the members after it
+// are updated.
+//
+// Returns false, and leaves 'members' unchanged, if the end of member 'm' is
+// exact.
+//
+bool MergeGzipMemberWithNext(const unsigned char* in_bytes,
+                             std::vector<GzipMember>& members, size_t m) {
+  if (members[m].exact || m + 1 >= members.size()) {
+    return false;
+  }
+
+  GzipMember& member = members[m];
+  member.in_count += members[m + 1].in_count;
+  member.exact = members[m + 1].exact;
+  member.out_count =
+      ReadLE32(in_bytes + member.in_offset + member.in_count - 4);
+  members.erase(members.begin() + m + 1);
+
+  for (size_t i = m + 1; i < members.size(); i++) {
+    members[i].out_offset =
+        members[i - 1].out_offset + members[i - 1].out_count;
+  }
+  return true;
+}
+
+#endif /* __GZIP_MEMBER_INDEX_HPP__ */
@@ -92,8 +92,10 @@ void GzipMetadataReader(int in_count, GzipHeaderData& hdr_data, int& crc,
   // not critical (low trip count). However, the compiler doesn't know that
   // and tries to optimize for throughput (~Fmax/II). However, we don't want
   // this loop to be our Fmax bottleneck, so increase the II.
+  // The loop also stops at the end of the input, in case the header of an
+  // invalid member claims more bytes than there are.
   [[intel::initiation_interval(4)]]  // NO-FORMAT: Attribute
-  while (state != GzipHeaderState::SteadyState) {
+  while (state != GzipHeaderState::SteadyState && i_in_range) {
     auto pipe_data = InPipe::read();
     curr_byte = pipe_data[0];
 
@@ -172,7 +174,7 @@ void GzipMetadataReader(int in_count, GzipHeaderData& hdr_data, int& crc,
         break;
       }
       case GzipHeaderState::Filename: {
-        header_filename[state_counter] = curr_byte;
+        if (state_counter < 256) header_filename[state_counter] = curr_byte;
         if (curr_byte == '\0') {
           if (header_flags & 0x02) {
             state = GzipHeaderState::CRC;
@@ -225,8 +227,14 @@ void GzipMetadataReader(int in_count, GzipHeaderData& hdr_data, int& crc,
 
   // the last 8 bytes of the stream are the CRC and size (in bytes) of the file
   // this data will be sent back to the host to help validate the output
-  unsigned char crc_bytes[4];
-  unsigned char size_bytes[4];
+  unsigned char crc_bytes[4] = {0, 0, 0, 0};
+  unsigned char size_bytes[4] = {0, 0, 0, 0};
+
+  // if the header took up all of the input, send a single byte with the flag
+  // set, so that the decompressor sees the end of the stream and fails
+  if (!i_in_range) {
+    OutPipe::write(OutPipeBundleT(ByteSet<1>(), true));
+  }
 
   // finished reading the header, so now stream the bytes into the decompressor.
   // keep track of the last 8 bytes, which are the crc and output size.
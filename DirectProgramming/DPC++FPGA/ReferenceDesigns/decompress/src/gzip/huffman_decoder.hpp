@@ -33,6 +33,11 @@ static_assert(kBitBufferBits > 8);
 static_assert(kBitBufferBits > kBitBufferMaxReadBits);
 static_assert(kBitBufferBits > kBitBufferMaxShiftBits);
 
+// The 8 byte GZIP footer follows the last DEFLATE block. The decoder relies on
+// the footer not fitting in the bit buffer: if the last byte of the member is
+// read before the last block is done, the member was cut short.
+static_assert(kBitBufferBits < 64);
+
 // the ByteBitStream alias
 using BitStreamT = ByteBitStream<kBitBufferBits, kBitBufferMaxReadBits,
                                  kBitBufferMaxShiftBits>;
@@ -46,10 +51,12 @@ constexpr int kDeflateStaticTotalCodes =
 // forward declare the helper functions that are defined at the end of the file
 namespace huffman_decoder_detail {
 template <typename InPipe>
-std::pair<bool, ac_uint<2>> ParseLastBlockAndBlockType(BitStreamT& bit_stream);
+std::pair<bool, ac_uint<2>> ParseLastBlockAndBlockType(BitStreamT& bit_stream,
+                                                       bool& done_reading);
 
 template <typename InPipe>
-void ParseFirstTable(BitStreamT& bit_stream, ac_uint<9>& numlitlencodes,
+void ParseFirstTable(BitStreamT& bit_stream, bool& done_reading,
+                     ac_uint<9>& numlitlencodes,
                      ac_uint<6>& numdistcodes, ac_uint<5>& numcodelencodes,
                      ac_uint<8> codelencode_map_first_code[8],
                      ac_uint<8> codelencode_map_last_code[8],
@@ -57,15 +64,15 @@ void ParseFirstTable(BitStreamT& bit_stream, ac_uint<9>& numlitlencodes,
                      ac_uint<5> codelencode_map[19]);
 
 template <typename InPipe>
-void ParseSecondTable(
-    BitStreamT& bit_stream, bool is_static_huffman_block,
+bool ParseSecondTable(
+    BitStreamT& bit_stream, bool& done_reading, bool is_static_huffman_block,
     ac_uint<9> numlitlencodes, ac_uint<6> numdistcodes,
     ac_uint<5> numcodelencodes, ac_uint<8> codelencode_map_first_code[8],
     ac_uint<8> codelencode_map_last_code[8],
     ac_uint<5> codelencode_map_base_idx[8], ac_uint<5> codelencode_map[19],
-    ac_uint<15> lit_map_first_code[15], ac_uint<15> lit_map_last_code[15],
+    ac_uint<15> lit_map_first_code[15], ac_uint<16> lit_map_last_code[15],
     ac_uint<9> lit_map_base_idx[15], ac_uint<9> lit_map[286],
-    ac_uint<15> dist_map_first_code[15], ac_uint<15> dist_map_last_code[15],
+    ac_uint<15> dist_map_first_code[15], ac_uint<16> dist_map_last_code[15],
     ac_uint<5> dist_map_base_idx[15], ac_uint<5> dist_map[32]);
 
 }  // namespace huffman_decoder_detail
@@ -77,6 +84,11 @@ void ParseSecondTable(
 // For dynamically compressed blocks, the huffman tables are also built from the
 // input byte stream.
 //
+// On invalid input, or input that ends before the last block does (e.g. a
+// GZIP member that was cut short), the decoder stops early and sends the done
+// signal downstream, so the engine finishes and the host sees that the output
+// size or CRC does not match, rather than the engine stalling.
+//
 //  Template parameters:
 //    InPipe: a SYCL pipe that streams in compressed data, 1 byte at a time
 //    OutPipe: a SYCL pipe that streams out either literals or
@@ -99,6 +111,7 @@ void HuffmanDecoder() {
   BitStreamT bit_stream;
   bool last_block = false;
   bool done_reading = false;
+  bool stream_error = false;
 
   // Processing consecutive DEFLATE blocks
   // Loop pipelining is disabled here because to reduce the amount of memory
@@ -107,16 +120,18 @@ void HuffmanDecoder() {
   // pipelining here does not have a significant affect on the throughput
   // of the design.
   [[intel::disable_loop_pipelining]]  // NO-FORMAT: Attribute
-  while (!last_block) {
+  while (!last_block && !stream_error) {
     ////////////////////////////////////////////////////////////////////////////
     // BEGIN: parse the first three bits of the block
     auto [last_block_tmp, block_type] =
-        huffman_decoder_detail::ParseLastBlockAndBlockType<InPipe>(bit_stream);
+        huffman_decoder_detail::ParseLastBlockAndBlockType<InPipe>(
+            bit_stream, done_reading);
 
     last_block = last_block_tmp;
     bool is_uncompressed_block = (block_type == 0);
     bool is_static_huffman_block = (block_type == 1);
     bool is_dynamic_huffman_block = (block_type == 2);
+    stream_error = (block_type == 3);  // reserved block type
     // END: parsing the first three bits
     ////////////////////////////////////////////////////////////////////////////
 
@@ -136,7 +151,8 @@ void HuffmanDecoder() {
 
     if (is_dynamic_huffman_block) {
       huffman_decoder_detail::ParseFirstTable<InPipe>(
-          bit_stream, numlitlencodes, numdistcodes, numcodelencodes,
+          bit_stream, done_reading, numlitlencodes, numdistcodes,
+          numcodelencodes,
           codelencode_map_first_code, codelencode_map_last_code,
           codelencode_map_base_idx, codelencode_map);
     }
@@ -157,18 +173,18 @@ void HuffmanDecoder() {
     // used to decode the actual payload data in optimized form. They are read
     // from the ParseSecondTable helper function.
     [[intel::fpga_register]] ac_uint<15> lit_map_first_code[15];
-    [[intel::fpga_register]] ac_uint<15> lit_map_last_code[15];
+    [[intel::fpga_register]] ac_uint<16> lit_map_last_code[15];
     [[intel::fpga_register]] ac_uint<9> lit_map_base_idx[15];
     [[intel::fpga_register]] ac_uint<9> lit_map[286];
     [[intel::fpga_register]] ac_uint<15> dist_map_first_code[15];
-    [[intel::fpga_register]] ac_uint<15> dist_map_last_code[15];
+    [[intel::fpga_register]] ac_uint<16> dist_map_last_code[15];
     [[intel::fpga_register]] ac_uint<5> dist_map_base_idx[15];
     [[intel::fpga_register]] ac_uint<5> dist_map[32];
 
     if (is_static_huffman_block || is_dynamic_huffman_block) {
-      huffman_decoder_detail::ParseSecondTable<InPipe>(
-          bit_stream, is_static_huffman_block, numlitlencodes, numdistcodes,
-          numcodelencodes, codelencode_map_first_code,
+      stream_error = !huffman_decoder_detail::ParseSecondTable<InPipe>(
+          bit_stream, done_reading, is_static_huffman_block, numlitlencodes,
+          numdistcodes, numcodelencodes, codelencode_map_first_code,
           codelencode_map_last_code, codelencode_map_base_idx, codelencode_map,
 
           lit_map_first_code, lit_map_last_code, lit_map_base_idx, lit_map,
@@ -219,7 +235,7 @@ void HuffmanDecoder() {
 #ifdef HUFFMAN_MAIN_LOOP_II
     [[intel::initiation_interval(HUFFMAN_II)]]  // NO-FORMAT: Attribute
 #endif
-    while (!block_done) {
+    while (!block_done && !done_reading && !stream_error) {
       // read in new data if the ByteBitStream has space for it
       if (bit_stream.HasSpaceForByte()) {
         bool read_valid;
@@ -359,6 +375,10 @@ void HuffmanDecoder() {
         ac_uint<9> lit_idx = lit_base_idx + lit_offset;
         ac_uint<9> dist_idx = dist_base_idx + dist_offset;
 
+        // if no code matches, the data is invalid
+        stream_error = reading_distance ? (dist_codelen_valid_bitmap == 0)
+                                        : (lit_codelen_valid_bitmap == 0);
+
         // lookup the literal (literal or length) and distance using base_idx
         // and offset
         lit_symbol = lit_map[lit_idx];
@@ -440,7 +460,11 @@ void HuffmanDecoder() {
         out_ready = false;
       }
     }  // while (!block_done)
-  }    // while (!last_block)
+
+    // the end of the member was read before the end of the block, so the
+    // member was cut short (see the static_assert on kBitBufferBits)
+    stream_error = stream_error || done_reading;
+  }  // while (!last_block)
   // END: decoding the bit stream (main computation loop)
   ////////////////////////////////////////////////////////////////////////////
 
@@ -480,9 +504,11 @@ namespace huffman_decoder_detail {
 //        3: reserved
 //
 template <typename InPipe>
-std::pair<bool, ac_uint<2>> ParseLastBlockAndBlockType(BitStreamT& bit_stream) {
+std::pair<bool, ac_uint<2>> ParseLastBlockAndBlockType(BitStreamT& bit_stream,
+                                                       bool& done_reading) {
   // read in the first byte and add it to the byte bit stream
   auto first_pipe_data = InPipe::read();
+  done_reading = first_pipe_data.flag;
   bit_stream.NewByte(first_pipe_data.data[0]);
 
   // read the first three bits
@@ -500,10 +526,10 @@ std::pair<bool, ac_uint<2>> ParseLastBlockAndBlockType(BitStreamT& bit_stream) {
 
 //
 // Parses the first Huffman table and creates the optimized Huffman table
-// structure
+// structure. Stops early if the input ends ('done_reading').
 //
 template <typename InPipe>
-void ParseFirstTable(BitStreamT& bit_stream,
+void ParseFirstTable(BitStreamT& bit_stream, bool& done_reading,
 
                      // outputs
                      ac_uint<9>& numlitlencodes, ac_uint<6>& numdistcodes,
@@ -532,7 +558,7 @@ void ParseFirstTable(BitStreamT& bit_stream,
   // and tries to optimize for throughput (~Fmax/II). We don't want
   // this loop to be our Fmax bottleneck, so increase the II.
   [[intel::initiation_interval(3)]]  // NO-FORMAT: Attribute
-  while (parsing) {
+  while (parsing && !done_reading) {
     // grab a byte if we have space for it
     if (bit_stream.HasSpaceForByte()) {
       bool read_valid;
@@ -540,6 +566,7 @@ void ParseFirstTable(BitStreamT& bit_stream,
 
       if (read_valid) {
         unsigned char c = pd.data[0];
+        done_reading = pd.flag;
         bit_stream.NewByte(c);
       }
     }
@@ -592,20 +619,21 @@ void ParseFirstTable(BitStreamT& bit_stream,
 
 //
 // Parses the second Huffman table and creates the optimized Huffman table
-// structure
+// structure. Returns false if the table is invalid. Stops early if the input
+// ends ('done_reading').
 //
 template <typename InPipe>
-void ParseSecondTable(
-    BitStreamT& bit_stream, bool is_static_huffman_block,
+bool ParseSecondTable(
+    BitStreamT& bit_stream, bool& done_reading, bool is_static_huffman_block,
     ac_uint<9> numlitlencodes, ac_uint<6> numdistcodes,
     ac_uint<5> numcodelencodes, ac_uint<8> codelencode_map_first_code[8],
     ac_uint<8> codelencode_map_last_code[8],
     ac_uint<5> codelencode_map_base_idx[8], ac_uint<5> codelencode_map[19],
 
     // outputs
-    ac_uint<15> lit_map_first_code[15], ac_uint<15> lit_map_last_code[15],
+    ac_uint<15> lit_map_first_code[15], ac_uint<16> lit_map_last_code[15],
     ac_uint<9> lit_map_base_idx[15], ac_uint<9> lit_map[286],
-    ac_uint<15> dist_map_first_code[15], ac_uint<15> dist_map_last_code[15],
+    ac_uint<15> dist_map_first_code[15], ac_uint<16> dist_map_last_code[15],
     ac_uint<5> dist_map_base_idx[15], ac_uint<5> dist_map[32]) {
   // length of codelens is MAX(numlitlencodes + numdistcodes)
   // = MAX((2^5 + 257) + (2^5 + 1)) = 322
@@ -617,6 +645,7 @@ void ParseSecondTable(
   ac_uint<8> runlen;  // MAX = (2^7 + 11)
   int onecount = 0, otherpositivecount = 0;
   ac_uint<4> extend_symbol;
+  bool table_error = false;
 
   // static codelens ROM (for static huffman encoding)
   constexpr auto static_codelens = [] {
@@ -651,13 +680,15 @@ void ParseSecondTable(
     // and tries to optimize for throughput (~Fmax/II). We don't want
     // this loop to be our Fmax bottleneck, so increase the II.
     [[intel::initiation_interval(3)]]  // NO-FORMAT: Attribute
-    while (codelens_idx < total_codes_second_table) {
+    while (codelens_idx < total_codes_second_table && !done_reading &&
+           !table_error) {
       // read in another byte if we have space for it
       if (bit_stream.HasSpaceForByte()) {
         bool read_valid;
         auto pd = InPipe::read(read_valid);
 
         if (read_valid) {
+          done_reading = pd.flag;
           bit_stream.NewByte(pd.data[0]);
         }
       }
@@ -724,6 +755,11 @@ void ParseSecondTable(
           // get the decoded symbol
           auto symbol = codelencode_map[base_idx + offset];
 
+          // if no code matches, or the first code length repeats the
+          // previous one, the table is invalid
+          table_error = (codelencode_valid_bitmap == 0) ||
+                        (symbol == 16 && codelens_idx == 0);
+
           // max shift amount will be 15 (8 bits for symbol, 7 for run length)
           ac_uint<4> shift_amount;
 
@@ -782,6 +818,9 @@ void ParseSecondTable(
       }
     }
 
+    // the table was cut short or is invalid
+    if (done_reading || table_error) return false;
+
     // handle the case where only one distance code is defined add a dummy
     // invalid code to make the Huffman tree complete
     if (onecount == 1 && otherpositivecount == 0) {
@@ -826,9 +865,11 @@ void ParseSecondTable(
   else
     max_codes = numdistcodes;
 
-  ac_uint<15> lit_map_next_code = 0;
+  // the code after the last 15-bit code of a complete table is 2^15, so the
+  // next and last codes need 16 bits
+  ac_uint<16> lit_map_next_code = 0;
   ac_uint<9> lit_map_counter = 0;
-  ac_uint<15> dist_map_next_code = 0;
+  ac_uint<16> dist_map_next_code = 0;
   ac_uint<5> dist_map_counter = 0;
   for (unsigned char codelen = 1; codelen <= 15; codelen++) {
     lit_map_next_code <<= 1;
@@ -867,6 +908,8 @@ void ParseSecondTable(
     lit_map_last_code[codelen - 1] = lit_map_next_code;
     dist_map_last_code[codelen - 1] = dist_map_next_code;
   }
+
+  return !table_error;
 }
 
 }  // namespace huffman_decoder_detail
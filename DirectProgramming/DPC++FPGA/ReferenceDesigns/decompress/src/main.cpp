@@ -48,23 +48,36 @@ constexpr unsigned kLiteralsPerCycle = LITERALS_PER_CYCLE;
 static_assert(kLiteralsPerCycle > 0);
 static_assert(fpga_tools::IsPow2(kLiteralsPerCycle));
 
+// the number of replicated decompression engines can be set from the command
+// line using the macro -DNUM_ENGINES=<num_engines>. Independent GZIP members
+// and Snappy frame chunks are decompressed this many at a time.
+#if not defined(NUM_ENGINES)
+#define NUM_ENGINES 1
+#endif
+constexpr unsigned kNumEngines = NUM_ENGINES;
+static_assert(kNumEngines > 0);
+
 // include files and aliases specific to GZIP and SNAPPY decompression
 #if defined(GZIP)
+#include "gzip/gzip_cpu_decompressor.hpp"
 #include "gzip/gzip_decompressor.hpp"
 #else
+#include "snappy/snappy_cpu_decompressor.hpp"
 #include "snappy/snappy_data_gen.hpp"
 #include "snappy/snappy_decompressor.hpp"
 #endif
 
 // aliases and testing functions specific to GZIP and SNAPPY decompression
 #if defined(GZIP)
-using GzipDecompressorT = GzipDecompressor<kLiteralsPerCycle>;
-bool RunGzipTest(sycl::queue& q, GzipDecompressorT decompressor,
+using GzipDecompressorT = GzipDecompressor<kLiteralsPerCycle, kNumEngines>;
+using CpuDecompressorT = GzipCpuDecompressor;
+bool RunGzipTest(sycl::queue& q, DecompressorBase& decompressor,
                  const std::string test_dir);
 std::string decompressor_name = "GZIP";
 #else
-using SnappyDecompressorT = SnappyDecompressor<kLiteralsPerCycle>;
-bool RunSnappyTest(sycl::queue& q, SnappyDecompressorT decompressor,
+using SnappyDecompressorT = SnappyDecompressor<kLiteralsPerCycle, kNumEngines>;
+using CpuDecompressorT = SnappyCpuDecompressor;
+bool RunSnappyTest(sycl::queue& q, DecompressorBase& decompressor,
                    const std::string test_dir);
 std::string decompressor_name = "SNAPPY";
 #endif
@@ -74,8 +87,11 @@ using namespace sycl;
 // Prints the usage for the executable command line args
 void PrintUsage(std::string exe_name) {
   std::cerr << "USAGE: \n"
-            << exe_name << " <input filename> <output filename> [runs]\n"
-            << exe_name << " <test directory>" << std::endl;
+            << exe_name
+            << " [--cpu] <input filename> <output filename> [runs]\n"
+            << exe_name << " [--cpu] <test directory>\n"
+            << "  --cpu: decompress on the host CPU instead of the FPGA"
+            << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -95,15 +111,26 @@ int main(int argc, char* argv[]) {
   int runs;
   bool default_test_mode = false;
 
-  if (argc == 1 || argc == 2) {
+  // the '--cpu' flag selects the CPU decompressor and may appear anywhere
+  bool use_cpu = false;
+  std::vector<std::string> args;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--cpu") {
+      use_cpu = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  if (args.size() <= 1) {
     default_test_mode = true;
-  } else if (argc > 4) {
+  } else if (args.size() > 3) {
     PrintUsage(argv[0]);
     return 1;
   }
 
   if (default_test_mode) {
-    if (argc > 1) test_dir = argv[1];
+    if (args.size() > 0) test_dir = args[0];
   } else {
     // default the number of runs based on emulation, simulation, or hardware
 #if defined(FPGA_EMULATOR)
@@ -114,18 +141,15 @@ int main(int argc, char* argv[]) {
     runs = 9;
 #endif
 
-    in_filename = argv[1];
-    out_filename = argv[2];
-    if (argc > 3) runs = atoi(argv[3]);
+    in_filename = args[0];
+    out_filename = args[1];
+    if (args.size() > 2) runs = atoi(args[2].c_str());
     if (runs < 1) {
       std::cerr << "ERROR: 'runs' must be greater than 0\n";
       std::terminate();
     }
   }
 
-  std::cout << "Using " << decompressor_name << " decompression\n";
-  std::cout << std::endl;
-
   // the device selector
 #if defined(FPGA_EMULATOR)
   sycl::ext::intel::fpga_emulator_selector selector;
@@ -137,15 +161,40 @@ int main(int argc, char* argv[]) {
   sycl::ext::intel::fpga_selector selector;
 #endif
 
-  // create the device queue
-  queue q(selector, dpc_common::exception_handler);
+  // create the device queue. If there is no FPGA device, fall back to the
+  // CPU decompressor. It never uses the queue, so any device will do.
+  std::optional<queue> fpga_q;
+  try {
+    fpga_q.emplace(selector, dpc_common::exception_handler);
+  } catch (sycl::exception const& e) {
+    std::cerr << "WARNING: could not create the FPGA queue (" << e.what()
+              << "), falling back to CPU decompression\n";
+    use_cpu = true;
+  }
+  queue q = fpga_q ? *fpga_q : queue(default_selector{});
 
-  // create the decompressor based on which decompression version we are using
+  // create the decompressor based on which decompression version and backend
+  // we are using
 #if defined(GZIP)
-  GzipDecompressorT decompressor;
+  GzipDecompressorT fpga_decompressor;
 #else
-  SnappyDecompressorT decompressor;
+  SnappyDecompressorT fpga_decompressor;
 #endif
+  CpuDecompressorT cpu_decompressor;
+  DecompressorBase& decompressor =
+      use_cpu ? static_cast<DecompressorBase&>(cpu_decompressor)
+              : fpga_decompressor;
+
+  std::cout << "Using " << decompressor_name << " decompression ";
+  if (use_cpu) {
+    std::cout << "on the CPU with "
+              << std::max(std::thread::hardware_concurrency(), 1u)
+              << " threads\n";
+  } else {
+    std::cout << "with " << kNumEngines
+              << ((kNumEngines == 1) ? " engine\n" : " engines\n");
+  }
+  std::cout << std::endl;
 
   // perform the test or single file decompression
   bool passed;
@@ -181,7 +230,7 @@ void PrintTestResults(std::string test_name, bool passed) {
 }
 
 #if defined(GZIP)
-bool RunGzipTest(sycl::queue& q, GzipDecompressorT decompressor,
+bool RunGzipTest(sycl::queue& q, DecompressorBase& decompressor,
                  const std::string test_dir) {
   // the name of the files for the default test are fixed
   std::string uncompressed_filename = test_dir + "/uncompressed.gz";
@@ -207,6 +256,33 @@ bool RunGzipTest(sycl::queue& q, GzipDecompressorT decompressor,
   PrintTestResults("Dynamically Compressed File Test", dynamic_test_pass);
   std::cout << std::endl;
 
+  // concatenate the three test files into a single multi-member GZIP file
+  // and check that it decompresses to the concatenation of their outputs
+  std::cout << ">>>>> Multi-Member File Test <<<<<" << std::endl;
+  std::vector<unsigned char> multi_member_bytes, multi_member_ref;
+  bool multi_member_test_pass = true;
+  for (auto& filename : {uncompressed_filename, static_compress_filename,
+                         dynamic_compress_filename}) {
+    auto member_bytes = ReadInputFile(filename);
+    auto member_out = decompressor.DecompressBytes(q, member_bytes, 1, false);
+    if (member_out == std::nullopt) {
+      multi_member_test_pass = false;
+      break;
+    }
+    multi_member_bytes.insert(multi_member_bytes.end(), member_bytes.begin(),
+                              member_bytes.end());
+    multi_member_ref.insert(multi_member_ref.end(), member_out->begin(),
+                            member_out->end());
+  }
+  if (multi_member_test_pass) {
+    auto multi_member_out =
+        decompressor.DecompressBytes(q, multi_member_bytes, 1, false);
+    multi_member_test_pass = (multi_member_out != std::nullopt) &&
+                             (multi_member_out.value() == multi_member_ref);
+  }
+  PrintTestResults("Multi-Member File Test", multi_member_test_pass);
+  std::cout << std::endl;
+
   std::cout << ">>>>> Throughput Test <<<<<" << std::endl;
   constexpr int kTPTestRuns = 5;
   bool tp_test_pass = decompressor.DecompressFile(q, tp_test_filename, "",
@@ -215,12 +291,12 @@ bool RunGzipTest(sycl::queue& q, GzipDecompressorT decompressor,
   std::cout << std::endl;
 
   return uncompressed_test_pass && static_test_pass && dynamic_test_pass &&
-         tp_test_pass;
+         multi_member_test_pass && tp_test_pass;
 }
 #endif
 
 #if defined(SNAPPY)
-bool RunSnappyTest(sycl::queue& q, SnappyDecompressorT decompressor,
+bool RunSnappyTest(sycl::queue& q, DecompressorBase& decompressor,
                    const std::string test_dir) {
   std::cout << ">>>>> Alice In Wonderland Test <<<<<" << std::endl;
   std::string alice_in_file = test_dir + "/alice29.txt.sz";
@@ -256,6 +332,49 @@ bool RunSnappyTest(sycl::queue& q, SnappyDecompressorT decompressor,
   PrintTestResults("Mixed Literal Strings and Copies Test", test3_pass);
   std::cout << std::endl;
 
+  // wrap raw Snappy streams as compressed chunks of a framed Snappy file,
+  // with an uncompressed chunk in between, and check that it decompresses to
+  // the concatenation of their outputs
+  std::cout << ">>>>> Framed Snappy Test <<<<<" << std::endl;
+  std::vector<unsigned char> framed_bytes = {kSnappyChunkStreamId, 6, 0, 0};
+  framed_bytes.insert(framed_bytes.end(), kSnappyStreamId,
+                      kSnappyStreamId + kSnappyStreamIdSize);
+  std::vector<unsigned char> framed_ref;
+  auto append_chunk = [&](unsigned char type,
+                          const std::vector<unsigned char>& data,
+                          const std::vector<unsigned char>& out) {
+    unsigned crc = SnappyMaskedCrc32c(out.data(), out.size());
+    size_t len = data.size() + 4;
+    framed_bytes.insert(framed_bytes.end(),
+                        {type, (unsigned char)len, (unsigned char)(len >> 8),
+                         (unsigned char)(len >> 16), (unsigned char)crc,
+                         (unsigned char)(crc >> 8), (unsigned char)(crc >> 16),
+                         (unsigned char)(crc >> 24)});
+    framed_bytes.insert(framed_bytes.end(), data.begin(), data.end());
+    framed_ref.insert(framed_ref.end(), out.begin(), out.end());
+  };
+  bool framed_test_pass = true;
+  for (auto& raw : {GenerateSnappyCompressedData(333, 3, 0, 0, 3),
+                    GenerateSnappyCompressedData(4096, 2, 64, 13, 4),
+                    GenerateSnappyCompressedData(1000, 5, 7, 3, 2)}) {
+    auto raw_bytes = raw;
+    auto raw_out = decompressor.DecompressBytes(q, raw_bytes, 1, false);
+    if (raw_out == std::nullopt) {
+      framed_test_pass = false;
+      break;
+    }
+    append_chunk(kSnappyChunkCompressed, raw_bytes, raw_out.value());
+    std::vector<unsigned char> stored(100, 'x');
+    append_chunk(kSnappyChunkUncompressed, stored, stored);
+  }
+  if (framed_test_pass) {
+    auto framed_out = decompressor.DecompressBytes(q, framed_bytes, 1, false);
+    framed_test_pass =
+        (framed_out != std::nullopt) && (framed_out.value() == framed_ref);
+  }
+  PrintTestResults("Framed Snappy Test", framed_test_pass);
+  std::cout << std::endl;
+
   std::cout << ">>>>> Throughput Test <<<<<" << std::endl;
   constexpr int kTPTestRuns = 5;
 #ifndef FPGA_EMULATOR
@@ -269,6 +388,7 @@ bool RunSnappyTest(sycl::queue& q, SnappyDecompressorT decompressor,
   PrintTestResults("Throughput Test", test_tp_pass);
   std::cout << std::endl;
 
-  return test1_pass && test2_pass && test3_pass && test_tp_pass;
+  return test1_pass && test2_pass && test3_pass && framed_test_pass &&
+         test_tp_pass;
 }
 #endif
@@ -0,0 +1,236 @@
+#ifndef __SNAPPY_CPU_DECOMPRESSOR_HPP__
+#define __SNAPPY_CPU_DECOMPRESSOR_HPP__
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "../common/common.hpp"
+#include "snappy_frame_index.hpp"
+
+namespace snappy_cpu_detail {
+
+//
+// Reads the varint preamble of a raw Snappy stream (the uncompressed length).
+// Returns the number of preamble bytes, or 0 if the preamble is invalid.
+//
+inline size_t ReadSnappyPreamble(const unsigned char* in, size_t in_count,
+                                 unsigned& out_count) {
+  out_count = 0;
+  for (size_t i = 0; i < 5 && i < in_count; i++) {
+    out_count |= (unsigned)(in[i] & 0x7F) << (7 * i);
+    if (!(in[i] & 0x80)) return i + 1;
+  }
+  return 0;
+}
+
+//
+// Decompresses the raw Snappy stream in 'in' into 'out', which must hold
+// exactly the number of bytes given by the stream's preamble. Returns false if
+// the stream is invalid.
+//
+inline bool DecompressRawSnappy(const unsigned char* in, size_t in_count,
+                                unsigned char* out, size_t out_count) {
+  unsigned preamble_count;
+  size_t i = ReadSnappyPreamble(in, in_count, preamble_count);
+  if (i == 0 || preamble_count != out_count) return false;
+
+  size_t pos = 0;
+  while (i < in_count) {
+    unsigned char tag = in[i++];
+    size_t len, offset;
+
+    switch (tag & 0x3) {
+      case 0: {
+        // literal string, with the length in the tag or in 1-4 extra bytes
+        len = tag >> 2;
+        if (len >= 60) {
+          size_t extra = len - 59;
+          if (in_count - i < extra) return false;
+          len = 0;
+          for (size_t b = 0; b < extra; b++) len |= (size_t)in[i + b] << (8 * b);
+          i += extra;
+        }
+        len += 1;
+        if (in_count - i < len || out_count - pos < len) return false;
+        std::memcpy(out + pos, in + i, len);
+        i += len;
+        pos += len;
+        continue;
+      }
+      case 1:
+        // copy with a 1 byte offset
+        if (in_count - i < 1) return false;
+        len = ((tag >> 2) & 0x7) + 4;
+        offset = ((size_t)(tag >> 5) << 8) | in[i];
+        i += 1;
+        break;
+      case 2:
+        // copy with a 2 byte offset
+        if (in_count - i < 2) return false;
+        len = (tag >> 2) + 1;
+        offset = in[i] | ((size_t)in[i + 1] << 8);
+        i += 2;
+        break;
+      default:
+        // copy with a 4 byte offset
+        if (in_count - i < 4) return false;
+        len = (tag >> 2) + 1;
+        offset = in[i] | ((size_t)in[i + 1] << 8) | ((size_t)in[i + 2] << 16) |
+                 ((size_t)in[i + 3] << 24);
+        i += 4;
+        break;
+    }
+
+    if (offset == 0 || offset > pos || out_count - pos < len) return false;
+    unsigned char* dst = out + pos;
+    const unsigned char* src = dst - offset;
+    if (offset >= len) {
+      std::memcpy(dst, src, len);
+    } else {
+      for (size_t b = 0; b < len; b++) dst[b] = src[b];
+    }
+    pos += len;
+  }
+
+  return pos == out_count;
+}
+
+}  // namespace snappy_cpu_detail
+
+//
+// A Snappy decompressor that runs on the host CPU. See ../common/common.hpp
+// for more information.
+//
+// The input is either a raw Snappy stream or a file in the Snappy framing
+// format. The chunks of a framed file are decompressed in parallel on up to
+// 'num_threads' host threads. The SYCL queue is not used, so this decompressor
+// works without an accelerator and can run at the same time as the FPGA
+// decompressor.
+//
+class SnappyCpuDecompressor : public DecompressorBase {
+ public:
+  using DecompressorBase::DecompressBytes;
+
+  SnappyCpuDecompressor(
+      unsigned num_threads = std::thread::hardware_concurrency())
+      : num_threads_(std::max(num_threads, 1u)) {}
+
+  std::optional<std::vector<unsigned char>> DecompressBytes(
+      sycl::queue&, const unsigned char* in_bytes, size_t in_bytes_count,
+      int runs, bool print_stats, const OutputChunkWriter& writer) {
+    size_t in_count = in_bytes_count;
+    bool framed = IsFramedSnappy(in_bytes, in_count);
+
+    std::vector<SnappyFrameChunk> chunks;
+    if (framed) {
+      chunks = IndexSnappyFrames(in_bytes, in_count);
+    } else {
+      // a raw Snappy stream is a single compressed chunk
+      unsigned out_count;
+      if (snappy_cpu_detail::ReadSnappyPreamble(in_bytes, in_count,
+                                                out_count) != 0) {
+        chunks.push_back({0, in_count, 0, out_count, true, 0});
+      } else {
+        std::cerr << "ERROR: invalid Snappy preamble\n";
+      }
+    }
+    if (chunks.empty()) {
+      return {};
+    }
+    size_t chunk_count = chunks.size();
+    size_t out_count = chunks.back().out_offset + chunks.back().out_count;
+    std::vector<unsigned char> out_bytes(out_count);
+
+    // track timing information in ms
+    std::vector<double> time(runs);
+
+    bool passed = true;
+
+    // run multiple times to increase the accuracy of the timing
+    for (int i = 0; i < runs; i++) {
+      std::vector<char> chunk_ok(chunk_count);
+
+      auto s = std::chrono::high_resolution_clock::now();
+      HostParallelFor(chunk_count, num_threads_, [&](size_t c) {
+        const auto& chunk = chunks[c];
+        unsigned char* out = out_bytes.data() + chunk.out_offset;
+        if (chunk.compressed) {
+          chunk_ok[c] = snappy_cpu_detail::DecompressRawSnappy(
+              in_bytes + chunk.in_offset, chunk.in_count, out,
+              chunk.out_count);
+        } else {
+          std::memcpy(out, in_bytes + chunk.in_offset, chunk.out_count);
+          chunk_ok[c] = true;
+        }
+        if (framed && chunk_ok[c]) {
+          chunk_ok[c] = SnappyMaskedCrc32c(out, chunk.out_count) ==
+                        chunk.masked_crc;
+        }
+      });
+      auto e = std::chrono::high_resolution_clock::now();
+
+      // calculate the time the decompression ran for, in milliseconds
+      time[i] = std::chrono::duration<double, std::milli>(e - s).count();
+
+      for (size_t c = 0; c < chunk_count; c++) {
+        if (!chunk_ok[c]) {
+          std::cerr << "ERROR: failed to decompress the Snappy chunk at input "
+                    << "byte " << chunks[c].in_offset
+                    << " (invalid data or CRC mismatch)\n";
+          passed = false;
+        }
+      }
+
+      // stream the output of the last run to 'writer'
+      if (passed && i == runs - 1 && writer) {
+        for (size_t off = 0; off < out_count; off += kOutputChunkBytes) {
+          writer(out_bytes.data() + off,
+                 std::min(kOutputChunkBytes, out_count - off));
+        }
+      }
+    }
+
+    // print the performance results
+    if (passed && print_stats) {
+      double avg_time_ms;
+      if (runs > 1) {
+        avg_time_ms =
+            std::accumulate(time.begin() + 1, time.end(), 0.0) / (runs - 1);
+      } else {
+        avg_time_ms = time[0];
+      }
+
+      double compression_ratio = (double)(out_count) / (double)(in_count);
+
+      // the number of output megabytes
+      double out_mb = out_count * sizeof(unsigned char) * 1e-6;
+
+      if (framed) {
+        std::cout << "Snappy chunks: " << chunk_count << " ("
+                  << std::min((size_t)num_threads_, chunk_count)
+                  << " CPU threads)\n";
+      }
+      std::cout << "Execution time: " << avg_time_ms << " ms\n";
+      std::cout << "Output Throughput: " << (out_mb / (avg_time_ms * 1e-3))
+                << " MB/s\n";
+      std::cout << "Compression Ratio: " << compression_ratio << ":1"
+                << "\n";
+    }
+
+    if (passed) {
+      return out_bytes;
+    } else {
+      return {};
+    }
+  }
+
+ private:
+  unsigned num_threads_;
+};
+
+#endif /* __SNAPPY_CPU_DECOMPRESSOR_HPP__ */
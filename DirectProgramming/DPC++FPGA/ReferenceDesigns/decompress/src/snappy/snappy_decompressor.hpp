@@ -2,7 +2,9 @@
 #define __SNAPPY_DECOMPRESSOR_HPP__
 
 #include <CL/sycl.hpp>
+#include <array>
 #include <chrono>
+#include <cstring>
 #include <optional>
 #include <sycl/ext/intel/ac_types/ac_int.hpp>
 #include <sycl/ext/intel/fpga_extensions.hpp>
@@ -12,14 +14,22 @@
 #include "../common/lz77_decoder.hpp"
 #include "constexpr_math.hpp"         // included from ../../../../include
 #include "metaprogramming_utils.hpp"  // included from ../../../../include
+#include "snappy_frame_index.hpp"
 #include "snappy_reader.hpp"
+#include "unrolled_loop.hpp"  // included from ../../../../include
 
-// declare the kernel and pipe names globally to reduce name mangling
+// declare the kernel and pipe names globally to reduce name mangling.
+// They are templated on the engine index so that the engine can be replicated.
+template <unsigned engine>
 class SnappyReaderKernelID;
+template <unsigned engine>
 class LZ77DecoderKernelID;
+template <unsigned engine>
 class ByteStackerKernelID;
 
+template <unsigned engine>
 class SnappyReaderToLZ77PipeID;
+template <unsigned engine>
 class LZ77ToByteStackerPipeID;
 
 //
@@ -35,6 +45,7 @@ class LZ77ToByteStackerPipeID;
 //      This sets how many literals can be read from the input stream at once,
 //      as well as the number that can be read at once from the history buffer
 //      in the LZ77 decoder.
+//    engine: the index of this instance of the decompression engine
 //
 //  Arguments:
 //    q: the SYCL queue
@@ -42,7 +53,8 @@ class LZ77ToByteStackerPipeID;
 //    preamble_count: an output buffer for the uncompressed size read in the
 //      Snappy preamble
 //
-template <typename InPipe, typename OutPipe, unsigned literals_per_cycle>
+template <typename InPipe, typename OutPipe, unsigned literals_per_cycle,
+          unsigned engine = 0>
 std::vector<sycl::event> SubmitSnappyDecompressKernels(
     sycl::queue& q, unsigned in_count, unsigned* preamble_count) {
   // check that the input and output pipe types are actually pipes
@@ -56,94 +68,143 @@ std::vector<sycl::event> SubmitSnappyDecompressKernels(
   // the inter-kernel pipes for the snappy decompression engine
   constexpr int SnappyReaderToLZ77PipeDepth = 16;
   using SnappyReaderToLZ77Pipe = sycl::ext::intel::pipe<
-      SnappyReaderToLZ77PipeID,
+      SnappyReaderToLZ77PipeID<engine>,
       FlagBundle<SnappyLZ77InputData<literals_per_cycle>>,
       SnappyReaderToLZ77PipeDepth>;
 
   auto snappy_reader_event =
-      SubmitSnappyReader<SnappyReaderKernelID, InPipe, SnappyReaderToLZ77Pipe,
-                         literals_per_cycle>(q, in_count, preamble_count);
+      SubmitSnappyReader<SnappyReaderKernelID<engine>, InPipe,
+                         SnappyReaderToLZ77Pipe, literals_per_cycle>(
+          q, in_count, preamble_count);
 
   // the design only needs a ByteStacker kernel when literals_per_cycle > 1
   if constexpr (literals_per_cycle > 1) {
     using LZ77ToByteStackerPipe =
-        sycl::ext::intel::pipe<LZ77ToByteStackerPipeID,
+        sycl::ext::intel::pipe<LZ77ToByteStackerPipeID<engine>,
                                FlagBundle<BytePack<literals_per_cycle>>>;
 
     auto lz77_event =
-        SubmitLZ77Decoder<LZ77DecoderKernelID, SnappyReaderToLZ77Pipe,
+        SubmitLZ77Decoder<LZ77DecoderKernelID<engine>, SnappyReaderToLZ77Pipe,
                           LZ77ToByteStackerPipe, literals_per_cycle,
                           kSnappyMaxLZ77Distance, kSnappyMaxLZ77Length>(q);
     auto byte_stacker_event =
-        SubmitByteStacker<ByteStackerKernelID, LZ77ToByteStackerPipe, OutPipe,
-                          literals_per_cycle>(q);
+        SubmitByteStacker<ByteStackerKernelID<engine>, LZ77ToByteStackerPipe,
+                          OutPipe, literals_per_cycle>(q);
 
     return {snappy_reader_event, lz77_event, byte_stacker_event};
   } else {
     auto lz77_event =
-        SubmitLZ77Decoder<LZ77DecoderKernelID, SnappyReaderToLZ77Pipe, OutPipe,
-                          literals_per_cycle, kSnappyMaxLZ77Distance,
+        SubmitLZ77Decoder<LZ77DecoderKernelID<engine>, SnappyReaderToLZ77Pipe,
+                          OutPipe, literals_per_cycle, kSnappyMaxLZ77Distance,
                           kSnappyMaxLZ77Length>(q);
     return {snappy_reader_event, lz77_event};
   }
 }
 
 // declare kernel and pipe names at the global scope to reduce name mangling
+template <unsigned engine>
 class ProducerId;
+template <unsigned engine>
 class ConsumerId;
+template <unsigned engine>
 class InPipeId;
+template <unsigned engine>
 class OutPipeId;
 
-// the input and output pipe
-using InPipe = sycl::ext::intel::pipe<InPipeId, ByteSet<kLiteralsPerCycle>>;
-using OutPipe =
-    sycl::ext::intel::pipe<OutPipeId, FlagBundle<BytePack<kLiteralsPerCycle>>>;
+// the input and output pipe of each engine
+template <unsigned engine>
+using InPipe =
+    sycl::ext::intel::pipe<InPipeId<engine>, ByteSet<kLiteralsPerCycle>>;
+template <unsigned engine>
+using OutPipe = sycl::ext::intel::pipe<OutPipeId<engine>,
+                                       FlagBundle<BytePack<kLiteralsPerCycle>>>;
 
 //
 // The SNAPPY decompressor. See ../common/common.hpp for more information.
 //
-template <unsigned literals_per_cycle>
+// The input is either a raw Snappy stream or a file in the Snappy framing
+// format. For framed files, the chunks are indexed on the host (see
+// snappy_frame_index.hpp) and the compressed chunks are decompressed by
+// 'num_engines' replicas of the decompression engine, each of which takes the
+// next chunk as soon as it is done with the previous one (see RunOnEngines in
+// ../common/common.hpp). Uncompressed chunks are copied on the host. Each
+// chunk's output is written to its place in the output buffer, so the output
+// is in the original order.
+//
+template <unsigned literals_per_cycle, unsigned num_engines>
 class SnappyDecompressor : public DecompressorBase {
+  static_assert(num_engines > 0);
+
  public:
+  using DecompressorBase::DecompressBytes;
+
   std::optional<std::vector<unsigned char>> DecompressBytes(
-      sycl::queue& q, std::vector<unsigned char>& in_bytes, int runs,
-      bool print_stats) {
-    bool passed = true;
-    unsigned in_count = in_bytes.size();
-    int in_count_padded =
-        fpga_tools::RoundUpToMultiple(in_count, kLiteralsPerCycle);
-
-    // read the expected output size from the start of the file
-    // this is used to size the output buffer
-    unsigned out_count = 0;
-    unsigned byte_idx = 0;
-    unsigned shift = 0;
-    bool keep_reading_preamble = true;
-    while (keep_reading_preamble) {
-      if (byte_idx > 4) {
-        std::cerr << "ERROR: uncompressed length should not span more than 5"
-                  << " bytes\n";
-        std::terminate();
+      sycl::queue& q, const unsigned char* in_bytes, size_t in_bytes_count,
+      int runs, bool print_stats, const OutputChunkWriter& writer) {
+    // the engines validate their chunks on separate host threads
+    std::atomic<bool> passed(true);
+    std::mutex error_mutex;
+    size_t in_count = in_bytes_count;
+    bool framed = IsFramedSnappy(in_bytes, in_count);
+
+    std::vector<SnappyFrameChunk> chunks;
+    if (framed) {
+      chunks = IndexSnappyFrames(in_bytes, in_count);
+      if (chunks.empty()) {
+        return {};
       }
-      auto b = in_bytes[byte_idx];
-      keep_reading_preamble = (b >> 7) & 0x1;
-      out_count |= (b & 0x7F) << shift;
-      shift += 7;
-      byte_idx += 1;
+    } else {
+      // a raw Snappy stream is a single compressed chunk.
+      // read the expected output size from the start of the file
+      // this is used to size the output buffer
+      unsigned out_count = 0;
+      unsigned byte_idx = 0;
+      unsigned shift = 0;
+      bool keep_reading_preamble = true;
+      while (keep_reading_preamble) {
+        if (byte_idx > 4) {
+          std::cerr << "ERROR: uncompressed length should not span more than 5"
+                    << " bytes\n";
+          std::terminate();
+        }
+        auto b = in_bytes[byte_idx];
+        keep_reading_preamble = (b >> 7) & 0x1;
+        out_count |= (b & 0x7F) << shift;
+        shift += 7;
+        byte_idx += 1;
+      }
+      chunks.push_back({0, in_count, 0, out_count, true, 0});
     }
+    size_t chunk_count = chunks.size();
+    size_t out_count = chunks.back().out_offset + chunks.back().out_count;
 
     std::vector<unsigned char> out_bytes(out_count);
 
-    // round up the output count to the nearest multiple of kLiteralsPerCycle
-    // this allows to ignore predicating the last writes to the output
-    int out_count_padded =
-        fpga_tools::RoundUpToMultiple(out_count, kLiteralsPerCycle);
+    // On the device, each compressed chunk's output is rounded up to the
+    // nearest multiple of kLiteralsPerCycle. This allows to ignore predicating
+    // the last writes to the output and keeps the padded writes of
+    // concurrently running engines from overlapping.
+    std::vector<size_t> dev_out_offset(chunk_count);
+    std::vector<size_t> out_ends(chunk_count);
+    size_t out_count_padded = 0;
+    for (size_t c = 0; c < chunk_count; c++) {
+      dev_out_offset[c] = out_count_padded;
+      out_ends[c] = chunks[c].out_offset + chunks[c].out_count;
+      if (chunks[c].compressed) {
+        out_count_padded += fpga_tools::RoundUpToMultiple(
+            (size_t)chunks[c].out_count, (size_t)kLiteralsPerCycle);
+      }
+    }
 
-    // host variables for output from device
-    unsigned preamble_count_host;
+    // the producer reads each chunk's input rounded up to a multiple of
+    // kLiteralsPerCycle, which can run past the end of the last chunk
+    size_t in_count_padded = in_count + kLiteralsPerCycle;
+
+    // host variables for output from device, one per engine
+    std::array<unsigned, num_engines> preamble_count_host;
 
     // track timing information in ms
-    std::vector<double> time(runs);
+    std::vector<double> time(runs, 0.0);
 
     // input and output data pointers on the device using USM device allocations
     unsigned char *in, *out;
@@ -156,66 +217,113 @@ class SnappyDecompressor : public DecompressorBase {
         std::cerr << "ERROR: could not allocate space for 'in'\n";
         std::terminate();
       }
-      if ((out = sycl::malloc_device<unsigned char>(out_count_padded, q)) ==
-          nullptr) {
+      if ((out = sycl::malloc_device<unsigned char>(
+               std::max(out_count_padded, (size_t)1), q)) == nullptr) {
         std::cerr << "ERROR: could not allocate space for 'out'\n";
         std::terminate();
       }
-      if ((preamble_count = sycl::malloc_device<unsigned>(1, q)) == nullptr) {
+      if ((preamble_count = sycl::malloc_device<unsigned>(num_engines, q)) ==
+          nullptr) {
         std::cerr << "ERROR: could not allocate space for 'preamble_count'\n";
         std::terminate();
       }
 
       // copy the input data to the device memory and wait for the copy to
       // finish
-      q.memcpy(in, in_bytes.data(), in_count * sizeof(unsigned char)).wait();
+      q.memcpy(in, in_bytes, in_count * sizeof(unsigned char)).wait();
 
       // run the design multiple times to increase the accuracy of the timing
       for (int i = 0; i < runs; i++) {
         std::cout << "Launching kernels for run " << i << std::endl;
 
-        // run the producer and consumer kernels
-        auto producer_event =
-            SubmitProducer<ProducerId, InPipe, literals_per_cycle>(
-                q, in_count_padded, in);
-        auto consumer_event =
-            SubmitConsumer<ConsumerId, OutPipe, literals_per_cycle>(
-                q, out_count_padded, out);
-
-        // run the decompression kernels
-        auto snappy_decompress_events =
-            SubmitSnappyDecompressKernels<InPipe, OutPipe, kLiteralsPerCycle>(
-                q, in_count, preamble_count);
-
-        // wait for the producer and consumer to finish
+        // the end of the last kernel on each engine
+        std::array<std::chrono::high_resolution_clock::time_point, num_engines>
+            engine_end;
         auto s = std::chrono::high_resolution_clock::now();
-        producer_event.wait();
-        consumer_event.wait();
-        auto e = std::chrono::high_resolution_clock::now();
-
-        // wait for the decompression kernels to finish
-        for (auto& e : snappy_decompress_events) {
-          e.wait();
-        }
-
-        std::cout << "All kernels finished for run " << i << std::endl;
+        engine_end.fill(s);
+
+        // decompress the chunks on the engines, each engine taking the next
+        // chunk as soon as it is done with the previous one. Uncompressed
+        // chunks are copied on the host. Returns whether the chunk passed.
+        auto decompress_chunk = [&](size_t c_idx, auto e) {
+          const auto& c = chunks[c_idx];
+          unsigned char* c_out = out_bytes.data() + c.out_offset;
+          bool chunk_passed = true;
+
+          if (c.compressed) {
+            unsigned c_in_count_padded = fpga_tools::RoundUpToMultiple(
+                (unsigned)c.in_count, literals_per_cycle);
+            unsigned c_out_count_padded =
+                fpga_tools::RoundUpToMultiple(c.out_count, literals_per_cycle);
+
+            // run the producer and consumer kernels
+            auto producer_event =
+                SubmitProducer<ProducerId<e>, InPipe<e>, literals_per_cycle>(
+                    q, c_in_count_padded, in + c.in_offset);
+            auto consumer_event =
+                SubmitConsumer<ConsumerId<e>, OutPipe<e>, literals_per_cycle>(
+                    q, c_out_count_padded, out + dev_out_offset[c_idx]);
+
+            // run the decompression kernels
+            auto snappy_decompress_events =
+                SubmitSnappyDecompressKernels<InPipe<e>, OutPipe<e>,
+                                              kLiteralsPerCycle, e>(
+                    q, c.in_count, preamble_count + e);
+
+            // wait for the kernels to finish
+            producer_event.wait();
+            consumer_event.wait();
+            for (auto& event : snappy_decompress_events) {
+              event.wait();
+            }
+            engine_end[e] = std::chrono::high_resolution_clock::now();
+
+            // Copy the output back from the device
+            q.memcpy(&preamble_count_host[e], preamble_count + e,
+                     sizeof(unsigned))
+                .wait();
+            q.memcpy(c_out, out + dev_out_offset[c_idx],
+                     c.out_count * sizeof(unsigned char))
+                .wait();
+
+            // validating the output
+            // check the number of bytes we read
+            if (preamble_count_host[e] != c.out_count) {
+              std::lock_guard<std::mutex> lock(error_mutex);
+              std::cerr << "ERROR: Out counts do not match: "
+                        << preamble_count_host[e] << " != " << c.out_count
+                        << " (preamble_count_host != out_count)\n";
+              chunk_passed = false;
+            }
+          } else {
+            std::memcpy(c_out, in_bytes + c.in_offset, c.out_count);
+          }
+
+          // check the CRC-32C of every chunk of a framed file
+          if (framed &&
+              SnappyMaskedCrc32c(c_out, c.out_count) != c.masked_crc) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            std::cerr << "ERROR: CRC-32C mismatch in the Snappy chunk at input "
+                      << "byte " << c.in_offset << "\n";
+            chunk_passed = false;
+          }
+
+          if (!chunk_passed) passed = false;
+          return chunk_passed;
+        };
+
+        // the output of the last run is streamed to 'writer' while the
+        // engines are running
+        RunOnEngines<num_engines>(chunk_count, decompress_chunk,
+                                  out_bytes.data(), out_ends,
+                                  (i == runs - 1) ? writer
+                                                  : OutputChunkWriter());
 
         // calculate the time the kernels ran for, in milliseconds
+        auto e = *std::max_element(engine_end.begin(), engine_end.end());
         time[i] = std::chrono::duration<double, std::milli>(e - s).count();
 
-        // Copy the output back from the device
-        q.memcpy(out_bytes.data(), out, out_count * sizeof(unsigned char))
-            .wait();
-        q.memcpy(&preamble_count_host, preamble_count, sizeof(int)).wait();
-
-        // validating the output
-        // check the number of bytes we read
-        if (preamble_count_host != out_count) {
-          std::cerr << "ERROR: Out counts do not match: " << preamble_count_host
-                    << " != " << out_count
-                    << " (preamble_count_host != out_count)\n";
-          passed = false;
-        }
+        std::cout << "All kernels finished for run " << i << std::endl;
       }
     } catch (sycl::exception const& e) {
       std::cout << "Caught a synchronous SYCL exception: " << e.what() << "\n";
@@ -239,12 +347,15 @@ class SnappyDecompressor : public DecompressorBase {
         avg_time_ms = time[0];
       }
 
-      double compression_ratio =
-          (double)(preamble_count_host) / (double)(in_count);
+      double compression_ratio = (double)(out_count) / (double)(in_count);
 
       // the number of input and output megabytes, respectively
-      size_t out_mb = preamble_count_host * sizeof(unsigned char) * 1e-6;
+      size_t out_mb = out_count * sizeof(unsigned char) * 1e-6;
 
+      if (framed) {
+        std::cout << "Snappy chunks: " << chunk_count << " (" << num_engines
+                  << ((num_engines == 1) ? " engine" : " engines") << ")\n";
+      }
       std::cout << "Execution time: " << avg_time_ms << " ms\n";
       std::cout << "Output Throughput: " << (out_mb / (avg_time_ms * 1e-3))
                 << " MB/s\n";
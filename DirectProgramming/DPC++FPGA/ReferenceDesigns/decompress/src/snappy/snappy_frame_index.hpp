@@ -0,0 +1,165 @@
+#ifndef __SNAPPY_FRAME_INDEX_HPP__
+#define __SNAPPY_FRAME_INDEX_HPP__
+
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+//
+// The location of one chunk of a framed Snappy file and where its decompressed
+// bytes go in the output. See
+// https://github.com/google/snappy/blob/main/framing_format.txt
+//
+struct SnappyFrameChunk {
+  size_t in_offset;     // offset of the chunk's data in the input
+  size_t in_count;      // number of data bytes (excluding type, length, CRC)
+  size_t out_offset;    // offset of the chunk's output in the output file
+  unsigned out_count;   // number of decompressed bytes
+  bool compressed;      // raw Snappy data (true) or stored bytes (false)
+  unsigned masked_crc;  // masked CRC-32C of the decompressed bytes
+};
+
+// chunk types in the Snappy framing format
+constexpr unsigned char kSnappyChunkCompressed = 0x00;
+constexpr unsigned char kSnappyChunkUncompressed = 0x01;
+constexpr unsigned char kSnappyChunkPadding = 0xFE;
+constexpr unsigned char kSnappyChunkStreamId = 0xFF;
+
+// the payload of the stream identifier chunk
+constexpr char kSnappyStreamId[] = "sNaPpY";
+constexpr size_t kSnappyStreamIdSize = 6;
+
+// the maximum number of decompressed bytes in one chunk
+constexpr unsigned kSnappyMaxChunkOutput = 65536;
+
+//
+// Returns whether 'in_bytes' starts with the stream identifier of the Snappy
+// framing format
+//
+inline bool IsFramedSnappy(const unsigned char* in_bytes, size_t in_count) {
+  return in_count >= 4 + kSnappyStreamIdSize &&
+         in_bytes[0] == kSnappyChunkStreamId && in_bytes[1] == 6 &&
+         in_bytes[2] == 0 && in_bytes[3] == 0 &&
+         std::memcmp(in_bytes + 4, kSnappyStreamId, kSnappyStreamIdSize) == 0;
+}
+
+//
+// Computes the masked CRC-32C (Castagnoli) checksum that the Snappy framing
+// format stores for each chunk
+//
+unsigned SnappyMaskedCrc32c(const unsigned char* buf, size_t len) {
+  static const auto table = [] {
+    std::array<unsigned, 256> t{};
+    for (unsigned i = 0; i < 256; i++) {
+      unsigned c = i;
+      for (int j = 0; j < 8; j++) {
+        c = (c & 1) ? (0x82F63B78 ^ (c >> 1)) : (c >> 1);
+      }
+      t[i] = c;
+    }
+    return t;
+  }();
+
+  unsigned crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+  }
+  crc = ~crc;
+  return ((crc >> 15) | (crc << 17)) + 0xA282EAD8;
+}
+
+//
+// Splits the framed Snappy file in 'in_bytes' into its data chunks so that
+// they can be decompressed independently. Padding and skippable chunks are
+// dropped.
+//
+// Returns an empty vector if the framing is malformed.
+//
+std::vector<SnappyFrameChunk> IndexSnappyFrames(const unsigned char* in_bytes,
+                                                size_t in_count) {
+  std::vector<SnappyFrameChunk> chunks;
+  size_t pos = 0;
+  size_t out_offset = 0;
+
+  while (pos < in_count) {
+    if (in_count - pos < 4) {
+      std::cerr << "ERROR: truncated Snappy chunk header at byte " << pos
+                << "\n";
+      return {};
+    }
+    unsigned char type = in_bytes[pos];
+    size_t len = in_bytes[pos + 1] | (in_bytes[pos + 2] << 8) |
+                 (in_bytes[pos + 3] << 16);
+    const unsigned char* body = in_bytes + pos + 4;
+    if (len > in_count - pos - 4) {
+      std::cerr << "ERROR: truncated Snappy chunk at byte " << pos << "\n";
+      return {};
+    }
+
+    if (type == kSnappyChunkCompressed || type == kSnappyChunkUncompressed) {
+      if (len < 4) {
+        std::cerr << "ERROR: Snappy chunk at byte " << pos
+                  << " is too short to hold a CRC\n";
+        return {};
+      }
+      SnappyFrameChunk c;
+      c.in_offset = pos + 8;
+      c.in_count = len - 4;
+      c.out_offset = out_offset;
+      c.compressed = (type == kSnappyChunkCompressed);
+      c.masked_crc = body[0] | (body[1] << 8) | (body[2] << 16) |
+                     ((unsigned)body[3] << 24);
+
+      if (c.compressed) {
+        // the uncompressed length is the varint preamble of the raw data
+        c.out_count = 0;
+        unsigned shift = 0;
+        size_t i = 0;
+        bool more = true;
+        while (more) {
+          if (i >= 5 || i >= c.in_count) {
+            std::cerr << "ERROR: bad Snappy preamble in chunk at byte " << pos
+                      << "\n";
+            return {};
+          }
+          unsigned char b = in_bytes[c.in_offset + i++];
+          c.out_count |= (b & 0x7F) << shift;
+          shift += 7;
+          more = b & 0x80;
+        }
+      } else {
+        c.out_count = c.in_count;
+      }
+
+      if (c.out_count > kSnappyMaxChunkOutput) {
+        std::cerr << "ERROR: Snappy chunk at byte " << pos << " decompresses "
+                  << "to more than " << kSnappyMaxChunkOutput << " bytes\n";
+        return {};
+      }
+
+      chunks.push_back(c);
+      out_offset += c.out_count;
+    } else if (type == kSnappyChunkStreamId) {
+      // concatenated framed streams repeat the stream identifier
+      if (len != kSnappyStreamIdSize ||
+          std::memcmp(body, kSnappyStreamId, kSnappyStreamIdSize) != 0) {
+        std::cerr << "ERROR: bad Snappy stream identifier at byte " << pos
+                  << "\n";
+        return {};
+      }
+    } else if (type < 0x80) {
+      std::cerr << "ERROR: unskippable reserved Snappy chunk type 0x"
+                << std::hex << (unsigned)type << std::dec << " at byte "
+                << pos << "\n";
+      return {};
+    }
+    // else: padding (0xFE) or a reserved skippable chunk (0x80-0xFD)
+
+    pos += 4 + len;
+  }
+
+  return chunks;
+}
+
+#endif /* __SNAPPY_FRAME_INDEX_HPP__ */
@@ -0,0 +1,198 @@
+#include "DynamicHuffman.hpp"
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+// Order in which the code length code lengths are sent (RFC 1951, 3.2.7).
+static const int kCLOrder[kBLCodes] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                       11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+// Computes Huffman code lengths for n symbols, limited to max_bits. Symbols
+// with a zero count get length 0. At least two symbols always get a code,
+// since inflate implementations expect a complete (or single 1-bit) code.
+static void BuildCodeLengths(const unsigned int *freq, int n, int max_bits,
+                             unsigned short *lengths) {
+  std::vector<unsigned int> f(freq, freq + n);
+  int used = 0;
+  for (int i = 0; i < n; i++) used += f[i] ? 1 : 0;
+  for (int i = 0; i < n && used < 2; i++) {
+    if (!f[i]) {
+      f[i] = 1;
+      used++;
+    }
+  }
+
+  // Plain Huffman tree construction. Nodes 0..n-1 are leaves.
+  std::vector<int> parent(2 * n, -1);
+  using Node = std::pair<unsigned long long, int>;
+  std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+  for (int i = 0; i < n; i++) {
+    if (f[i]) heap.push(Node(f[i], i));
+  }
+  int next = n;
+  while (heap.size() > 1) {
+    Node a = heap.top();
+    heap.pop();
+    Node b = heap.top();
+    heap.pop();
+    parent[a.second] = next;
+    parent[b.second] = next;
+    heap.push(Node(a.first + b.first, next++));
+  }
+
+  // Count the leaves per depth, clamping depths beyond max_bits.
+  std::vector<int> bl_count(max_bits + 1, 0);
+  for (int i = 0; i < n; i++) {
+    if (!f[i]) continue;
+    int depth = 0;
+    for (int p = parent[i]; p >= 0; p = parent[p]) depth++;
+    bl_count[std::min(depth, max_bits)]++;
+  }
+
+  // Clamping may oversubscribe the code (Kraft sum > 1). Repair it by moving
+  // leaves down from shorter lengths until the code is complete again.
+  unsigned long total = 0;
+  for (int i = 1; i <= max_bits; i++) {
+    total += (unsigned long)bl_count[i] << (max_bits - i);
+  }
+  while (total > (1UL << max_bits)) {
+    bl_count[max_bits]--;
+    for (int i = max_bits - 1; i > 0; i--) {
+      if (bl_count[i]) {
+        bl_count[i]--;
+        bl_count[i + 1] += 2;
+        break;
+      }
+    }
+    total--;
+  }
+
+  // Hand out the lengths, shortest to the most frequent symbols.
+  std::vector<int> order;
+  for (int i = 0; i < n; i++) {
+    lengths[i] = 0;
+    if (f[i]) order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](int a, int b) { return f[a] > f[b]; });
+  size_t idx = 0;
+  for (int len = 1; len <= max_bits; len++) {
+    for (int k = 0; k < bl_count[len]; k++) lengths[order[idx++]] = len;
+  }
+}
+
+// Assigns canonical codes (RFC 1951, 3.2.2) and stores them bit-reversed,
+// ready to be shifted into the LSB-first deflate bit stream.
+static void BuildCanonicalCodes(const unsigned short *lengths, int n,
+                                CtData *tree) {
+  unsigned short bl_count[kMaxHuffcodeBits + 1] = {0};
+  unsigned short next_code[kMaxHuffcodeBits + 1] = {0};
+  for (int i = 0; i < n; i++) bl_count[lengths[i]]++;
+  bl_count[0] = 0;
+
+  unsigned short code = 0;
+  for (int bits = 1; bits <= kMaxHuffcodeBits; bits++) {
+    code = (code + bl_count[bits - 1]) << 1;
+    next_code[bits] = code;
+  }
+
+  for (int i = 0; i < n; i++) {
+    unsigned short len = lengths[i];
+    unsigned short c = len ? next_code[len]++ : 0;
+    unsigned short rev = 0;
+    for (int b = 0; b < len; b++) rev |= ((c >> b) & 1) << (len - 1 - b);
+    tree[i].code = rev;
+    tree[i].len = len;
+  }
+}
+
+void BuildDynamicHuffman(const unsigned int *hist, bool last_block,
+                         CtData *trees, HuffHeaderChunk *header) {
+  unsigned short lengths[kLCodes + kDCodes];
+  unsigned int lit_freq[kLCodes];
+  std::copy(hist, hist + kLCodes, lit_freq);
+  lit_freq[kEndBlock] = 1;  // every block ends with one end-of-block symbol
+
+  BuildCodeLengths(lit_freq, kLCodes, kMaxDynLitBits, lengths);
+  BuildCodeLengths(hist + kLCodes, kDCodes, kMaxDynDistBits,
+                   lengths + kLCodes);
+  BuildCanonicalCodes(lengths, kLCodes, trees);
+  BuildCanonicalCodes(lengths + kLCodes, kDCodes, trees + kLCodes);
+
+  int hlit = kLCodes;
+  while (hlit > kLiterals + 1 && lengths[hlit - 1] == 0) hlit--;
+  int hdist = kDCodes;
+  while (hdist > 1 && lengths[kLCodes + hdist - 1] == 0) hdist--;
+
+  // Run-length encode the hlit + hdist code lengths as one sequence, using
+  // the code length alphabet: 0-15 literal lengths, 16 repeat previous 3-6
+  // times, 17 repeat zero 3-10 times, 18 repeat zero 11-138 times.
+  std::vector<unsigned short> seq(lengths, lengths + hlit);
+  seq.insert(seq.end(), lengths + kLCodes, lengths + kLCodes + hdist);
+
+  struct ClSym {
+    unsigned short sym;
+    unsigned short extra;
+  };
+  std::vector<ClSym> rle;
+  unsigned int cl_freq[kBLCodes] = {0};
+  for (size_t i = 0; i < seq.size();) {
+    unsigned short len = seq[i];
+    size_t run = 1;
+    while (i + run < seq.size() && seq[i + run] == len) run++;
+
+    size_t left = run;
+    if (len == 0) {
+      while (left >= 11) {
+        size_t r = std::min<size_t>(left, 138);
+        rle.push_back({18, (unsigned short)(r - 11)});
+        left -= r;
+      }
+      if (left >= 3) {
+        rle.push_back({17, (unsigned short)(left - 3)});
+        left = 0;
+      }
+    } else {
+      rle.push_back({len, 0});
+      left--;
+      while (left >= 3) {
+        size_t r = std::min<size_t>(left, 6);
+        rle.push_back({16, (unsigned short)(r - 3)});
+        left -= r;
+      }
+    }
+    for (; left > 0; left--) rle.push_back({len, 0});
+    i += run;
+  }
+  for (auto &r : rle) cl_freq[r.sym]++;
+
+  unsigned short cl_lengths[kBLCodes];
+  CtData cl_tree[kBLCodes];
+  BuildCodeLengths(cl_freq, kBLCodes, kMaxDynCLBits, cl_lengths);
+  BuildCanonicalCodes(cl_lengths, kBLCodes, cl_tree);
+
+  int hclen = kBLCodes;
+  while (hclen > 4 && cl_lengths[kCLOrder[hclen - 1]] == 0) hclen--;
+
+  // Emit the header as bit chunks.
+  int nchunks = 0;
+  auto put = [&](unsigned short bits, unsigned short len) {
+    header[nchunks].bits = bits;
+    header[nchunks].len = len;
+    nchunks++;
+  };
+
+  put((2 << 1) | (last_block ? 1 : 0), 3);  // BFINAL, BTYPE=10
+  put(hlit - 257, 5);
+  put(hdist - 1, 5);
+  put(hclen - 4, 4);
+  for (int i = 0; i < hclen; i++) put(cl_lengths[kCLOrder[i]], 3);
+  for (auto &r : rle) {
+    unsigned short extra_len = r.sym == 16 ? 2 : (r.sym == 17 ? 3 : 7);
+    if (r.sym < 16) extra_len = 0;
+    put(cl_tree[r.sym].code | (r.extra << cl_tree[r.sym].len),
+        cl_tree[r.sym].len + extra_len);
+  }
+  while (nchunks < kMaxHeaderChunks) put(0, 0);
+}
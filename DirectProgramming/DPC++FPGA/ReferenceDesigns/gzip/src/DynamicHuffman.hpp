@@ -0,0 +1,21 @@
+#ifndef __DYNAMICHUFFMAN_H__
+#define __DYNAMICHUFFMAN_H__
+#pragma once
+
+#include <stddef.h>
+
+#include "kernels.hpp"
+
+// Builds the code tables and the block header for one dynamic Huffman
+// (BTYPE=2) deflate block from the symbol histograms gathered by the LZ
+// kernel. Code lengths are limited to kMaxDynLitBits/kMaxDynDistBits so that
+// every symbol fits the Huffman kernel's 32-bit code slot.
+void BuildDynamicHuffman(
+    const unsigned int *hist,  // kDynHistSize symbol counts, literal/length
+                               // symbols first, then distance symbols
+    bool last_block,           // sets BFINAL in the block header
+    CtData *trees,             // out: kLCodes literal/length codes followed by
+                               // kDCodes distance codes, bit-reversed
+    HuffHeaderChunk *header);  // out: kMaxHeaderChunks header bit chunks
+
+#endif  //__DYNAMICHUFFMAN_H__
@@ -19,6 +19,9 @@ constexpr int kDeflated = 8;
 #define ORIG_NAME 0x08
 #define OS_CODE 0x03  // Unix OS_CODE
 
+// Largest payload of a single DEFLATE stored block.
+constexpr size_t kMaxStoredLen = 65535;
+
 typedef struct GzipHeader {
   unsigned char magic[2];         // 0x1f, 0x8b
   unsigned char compress_method;  // 0-7 reserved, 8=deflate -- kDeflated
@@ -49,20 +52,14 @@ inline static void PutUlong(uint8_t *pc, unsigned long l) {
   pc[3] = (l >> 24) & 0xff;
 }
 
-// returns 0 on success, otherwise failure
-int WriteBlockGzip(
-    std::string &original_filename,  // Original file name being compressed
-    std::string &out_filename,       // gzip filename
-    char *obuf,                      // pointer to compressed data block
-    size_t blen,                     // length of compressed data block
-    size_t ilen,                     // original block length
-    uint32_t buffer_crc)             // the block's crc
-{
+// Writes the gzip member header. If original_filename is non-null, it is
+// stored in the header (FNAME). Returns 0 on success, otherwise failure.
+static int WriteGzipHeader(FILE *fo, const std::string *original_filename) {
   //------------------------------------------------------------------
   // Setup the gzip output file header.
   //  max filename size is arbitrarily set to 256 bytes long
   //  Method is always DEFLATE
-  //  Original filename is always set in header
+  //  Original filename is set in header when provided
   //  timestamp is set to 0 - ignored by gunzip
   //  deflate flags set to 0
   //  OS code is 0
@@ -80,7 +77,7 @@ int WriteBlockGzip(
   pgziphdr[0] = GZIP_MAGIC[0];
   pgziphdr[1] = GZIP_MAGIC[1];
   pgziphdr[2] = kDeflated;
-  pgziphdr[3] = ORIG_NAME;
+  pgziphdr[3] = original_filename ? ORIG_NAME : 0;
 
   // Set time in header to 0, this is ignored by gunzip.
   pgziphdr[4] = 0;
@@ -96,40 +93,120 @@ int WriteBlockGzip(
 
   int ondx = 10;
 
-  const char *p = original_filename.c_str();
-  do {
-    pgziphdr[ondx++] = (*p);
-  } while (*p++);
+  if (original_filename) {
+    const char *p = original_filename->c_str();
+    do {
+      pgziphdr[ondx++] = (*p);
+    } while (*p++ && ondx < max_filename_sz);
+    pgziphdr[ondx - 1] = 0;
+  }
 
   int header_bytes = ondx;
 
+  fwrite(pgziphdr, 1, header_bytes, fo);
+  free(pgziphdr);
+
+  return ferror(fo) ? 1 : 0;
+}
+
+// Writes the gzip member trailer (CRC32 and ISIZE).
+static int WriteGzipTrailer(FILE *fo, uint32_t buffer_crc, size_t ilen) {
   unsigned char prolog[8];
 
   PutUlong(((unsigned char *)prolog), buffer_crc);
   PutUlong(((unsigned char *)&prolog[4]), ilen);
 
-  FILE *fo = fopen(out_filename.c_str(), "w+");
-  if (ferror(fo)) {
-    std::cout << "Cannot open file for output: " << out_filename << "\n";
-    free(pgziphdr);
+  fwrite(prolog, 1, 8, fo);
+  return ferror(fo) ? 1 : 0;
+}
+
+// returns 0 on success, otherwise failure
+int WriteGzipMember(
+    FILE *fo,                                // open gzip output file
+    const std::string *original_filename,    // stored in header if non-null
+    const char *obuf,                        // pointer to compressed data block
+    size_t blen,                             // length of compressed data block
+    size_t ilen,                             // original block length
+    uint32_t buffer_crc)                     // the block's crc
+{
+  if (WriteGzipHeader(fo, original_filename)) {
+    std::cout << "gzip output file write failure.\n";
     return 1;
   }
 
-  fwrite(pgziphdr, 1, header_bytes, fo);
   fwrite(obuf, 1, blen, fo);
-  fwrite(prolog, 1, 8, fo);
 
-  if (ferror(fo)) {
+  if (ferror(fo) || WriteGzipTrailer(fo, buffer_crc, ilen)) {
+    std::cout << "gzip output file write failure.\n";
+    return 1;
+  }
+  return 0;
+}
+
+// returns 0 on success, otherwise failure
+int WriteStoredGzipMember(
+    FILE *fo,                                // open gzip output file
+    const std::string *original_filename,    // stored in header if non-null
+    const char *ibuf,                        // pointer to uncompressed data
+    size_t ilen,                             // uncompressed data length
+    uint32_t buffer_crc)                     // the block's crc
+{
+  if (WriteGzipHeader(fo, original_filename)) {
     std::cout << "gzip output file write failure.\n";
-    free(pgziphdr);
+    return 1;
+  }
+
+  // Emit the data as a sequence of DEFLATE stored blocks (BTYPE=00). Each
+  // stored block holds at most 65535 bytes. An empty member still needs one
+  // final (empty) stored block.
+  size_t pos = 0;
+  do {
+    size_t len = ilen - pos;
+    if (len > kMaxStoredLen) len = kMaxStoredLen;
+    bool final_block = (pos + len) == ilen;
+
+    unsigned char hdr[5];
+    hdr[0] = final_block ? 1 : 0;  // BFINAL, BTYPE=00, pad to byte boundary
+    hdr[1] = len & 0xff;
+    hdr[2] = (len >> 8) & 0xff;
+    hdr[3] = ~len & 0xff;
+    hdr[4] = (~len >> 8) & 0xff;
+
+    fwrite(hdr, 1, sizeof(hdr), fo);
+    fwrite(ibuf + pos, 1, len, fo);
+    pos += len;
+  } while (pos < ilen);
+
+  if (ferror(fo) || WriteGzipTrailer(fo, buffer_crc, ilen)) {
+    std::cout << "gzip output file write failure.\n";
+    return 1;
+  }
+  return 0;
+}
+
+// returns 0 on success, otherwise failure
+int WriteBlockGzip(
+    std::string &original_filename,  // Original file name being compressed
+    std::string &out_filename,       // gzip filename
+    char *obuf,                      // pointer to compressed data block
+    size_t blen,                     // length of compressed data block
+    size_t ilen,                     // original block length
+    uint32_t buffer_crc)             // the block's crc
+{
+  FILE *fo = fopen(out_filename.c_str(), "w+");
+  if (!fo || ferror(fo)) {
+    std::cout << "Cannot open file for output: " << out_filename << "\n";
+    return 1;
+  }
+
+  if (WriteGzipMember(fo, &original_filename, obuf, blen, ilen, buffer_crc)) {
+    fclose(fo);
     return 1;
   }
 
   if (fclose(fo)) {
     perror("close");
-    free(pgziphdr);
     return 1;
   }
-  free(pgziphdr);
   return 0;
 }
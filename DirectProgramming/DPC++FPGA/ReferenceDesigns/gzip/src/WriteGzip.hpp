@@ -2,6 +2,9 @@
 #define __WRITEGZIP_H__
 #pragma once
 
+#include <stdint.h>
+#include <stdio.h>
+
 #include <iostream>
 #include <string>
 
@@ -14,4 +17,25 @@ int WriteBlockGzip(
     size_t ilen,                     // original block length
     uint32_t buffer_crc);            // the block's crc
 
+// Appends one complete gzip member (header, deflate data, trailer) to an
+// already open file. Concatenated members form a valid multi-member .gz file.
+// returns 0 on success, otherwise failure
+int WriteGzipMember(
+    FILE *fo,                              // open gzip output file
+    const std::string *original_filename,  // stored in header if non-null
+    const char *obuf,                      // pointer to compressed data block
+    size_t blen,                           // length of compressed data block
+    size_t ilen,                           // original block length
+    uint32_t buffer_crc);                  // the block's crc
+
+// Appends one gzip member holding ibuf uncompressed, as DEFLATE stored blocks.
+// Used for data the compression engine cannot shrink.
+// returns 0 on success, otherwise failure
+int WriteStoredGzipMember(
+    FILE *fo,                              // open gzip output file
+    const std::string *original_filename,  // stored in header if non-null
+    const char *ibuf,                      // pointer to uncompressed data
+    size_t ilen,                           // uncompressed data length
+    uint32_t buffer_crc);                  // the block's crc
+
 #endif  //__WRITEGZIP_H__
@@ -9,10 +9,14 @@ uint32_t Crc32Host(
     const char *pbuf,        // pointer to the buffer to crc
     size_t sz,               // number of bytes
     uint32_t previous_crc);  // previous CRC, allows combining. First invocation
-                             // would use 0xffffffff.
+                             // would use 0.
 uint32_t Crc32(const char *pbuf,        // pointer to the buffer to crc
                size_t sz,               // number of bytes
                uint32_t previous_crc);  // previous CRC, allows combining. First
                                         // invocation would use 0xffffffff.
 
+// Returns the CRC of A followed by B, given crc1 = CRC of A, crc2 = CRC of B
+// and len2 = length of B.
+uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
 #endif  //__CRC32_H__
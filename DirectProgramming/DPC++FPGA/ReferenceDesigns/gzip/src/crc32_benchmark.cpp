@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "crc32_utils.hpp"  // included from ../../../include
+
+//
+// Micro-benchmark for the host CRC-32 used for the GZIP footer. Reports the
+// throughput of the byte-at-a-time reference, of slicing-by-16 on one thread,
+// and of Crc32Parallel for 1, 2, 4, ... threads.
+//
+// Usage: crc32_bench [buffer size in MB] [max threads]
+//
+
+// The byte-at-a-time CRC-32 that the designs used before crc32_utils.hpp.
+uint32_t ReferenceCrc32(uint32_t init, const unsigned char *buf, size_t len) {
+  const auto &t = fpga_tools::crc32_detail::kSliceTables[0];
+  uint32_t c = ~init;
+  for (size_t i = 0; i < len; i++) {
+    c = t[(c ^ buf[i]) & 0xFF] ^ (c >> 8);
+  }
+  return ~c;
+}
+
+// Runs 'f' 'runs' times and returns the best throughput in GB/s.
+template <typename F>
+double BestGBps(F &&f, size_t bytes, int runs) {
+  double best = 0;
+  for (int r = 0; r < runs; r++) {
+    auto start = std::chrono::high_resolution_clock::now();
+    f();
+    auto end = std::chrono::high_resolution_clock::now();
+    double s = std::chrono::duration<double>(end - start).count();
+    best = std::max(best, bytes / s * 1e-9);
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  size_t size_mb = 256;
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  if (argc > 1) size_mb = std::strtoul(argv[1], nullptr, 10);
+  if (argc > 2) max_threads = std::strtoul(argv[2], nullptr, 10);
+  if (size_mb == 0 || max_threads == 0) {
+    std::cerr << "USAGE: " << argv[0] << " [buffer size in MB] [max threads]\n";
+    return 1;
+  }
+  constexpr int kRuns = 5;
+
+  size_t bytes = size_mb << 20;
+  std::vector<unsigned char> data(bytes);
+  std::mt19937 rng(1);
+  std::generate(data.begin(), data.end(), [&] { return rng() & 0xFF; });
+
+  // validate slicing-by-16, the parallel split and Crc32Combine against the
+  // reference
+  uint32_t expected = ReferenceCrc32(0, data.data(), bytes);
+  bool passed = fpga_tools::Crc32(0, data.data(), bytes) == expected;
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    passed &= fpga_tools::Crc32Parallel(0, data.data(), bytes, t) == expected;
+  }
+  size_t split = bytes / 3 + 7;
+  passed &= fpga_tools::Crc32Combine(
+                fpga_tools::Crc32(0, data.data(), split),
+                fpga_tools::Crc32(0, data.data() + split, bytes - split),
+                bytes - split) == expected;
+  if (!passed) {
+    std::cerr << "ERROR: CRC-32 results do not match the reference\n";
+    std::cout << "FAILED\n";
+    return 1;
+  }
+
+  volatile uint32_t sink = 0;
+  std::cout << "Buffer size: " << size_mb << " MB\n";
+  std::cout << "Byte-at-a-time reference: "
+            << BestGBps([&] { sink = ReferenceCrc32(0, data.data(), bytes); },
+                        bytes, kRuns)
+            << " GB/s\n";
+  std::cout << "Slicing-by-16: "
+            << BestGBps(
+                   [&] { sink = fpga_tools::Crc32(0, data.data(), bytes); },
+                   bytes, kRuns)
+            << " GB/s\n";
+  for (unsigned t = 1; t <= max_threads; t *= 2) {
+    std::cout << "Slicing-by-16, " << t << " thread(s): "
+              << BestGBps(
+                     [&] {
+                       sink = fpga_tools::Crc32Parallel(0, data.data(), bytes,
+                                                        t);
+                     },
+                     bytes, kRuns)
+              << " GB/s\n";
+  }
+
+  std::cout << "PASSED\n";
+  return 0;
+}
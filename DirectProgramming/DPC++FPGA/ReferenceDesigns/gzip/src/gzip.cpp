@@ -1,12 +1,18 @@
 #include <CL/sycl.hpp>
 #include <sycl/ext/intel/fpga_extensions.hpp>
+#include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <string>
+#include <thread>
 
 #include "CompareGzip.hpp"
 #include "WriteGzip.hpp"
 #include "crc32.hpp"
+#include "crc32_utils.hpp"  // included from ../../../include
 #include "gzipkernel.hpp"
 #include "kernels.hpp"
 
@@ -21,10 +27,18 @@ using namespace sycl;
 // Any filesize less than this results in an error.
 constexpr int minimum_filesize = kVec + 1;
 
+// The maximum block size in streaming mode. Each block is a gzip member, whose
+// ISIZE footer field holds the uncompressed size in 32 bits.
+constexpr size_t kMaxBlockSize = 0xFFFFFFFF;
+
 bool help = false;
 
 int CompressFile(queue &q, std::string &input_file, std::vector<std::string> outfilenames,
-                 int iterations, bool report);
+                 int iterations, bool report, bool dynamic_huffman);
+
+int CompressFileStreaming(queue &q, std::string &input_file,
+                          std::string &outfilename, size_t block_size,
+                          bool dynamic_huffman);
 
 void Help(void) {
   // Command line arguments.
@@ -39,6 +53,13 @@ void Help(void) {
   std::cout << "  -h,--help                                : this help text\n";
   std::cout
       << "  -o=<filename>,--output-file=<filename>   : specify output file\n";
+  std::cout
+      << "  -b=<bytes>,--block-size=<bytes>          : stream the input in\n"
+      << "                                             blocks of this size,\n"
+      << "                                             one gzip member each\n";
+  std::cout
+      << "  -d,--dynamic                             : use dynamic Huffman\n"
+      << "                                             blocks (BTYPE=2)\n";
 }
 
 bool FindGetArg(std::string &arg, const char *str, int defaultval, int *val) {
@@ -51,6 +72,25 @@ bool FindGetArg(std::string &arg, const char *str, int defaultval, int *val) {
   return false;
 }
 
+// Like FindGetArg, for an option that is a number of bytes. *valid is set to
+// false if the value is not a whole number that fits in a size_t; strtoull
+// alone would wrap "-1" to the largest value and ignore trailing characters.
+bool FindGetArgSize(std::string &arg, const char *str, size_t *val,
+                    bool *valid) {
+  std::size_t found = arg.find(str, 0, strlen(str));
+  if (found != std::string::npos) {
+    const char *sptr = &arg.c_str()[strlen(str)];
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(sptr, &end, 10);
+    *valid = isdigit((unsigned char)sptr[0]) && *end == '\0' &&
+             errno != ERANGE && value <= SIZE_MAX;
+    *val = value;
+    return true;
+  }
+  return false;
+}
+
 constexpr int kMaxStringLen = 40;
 
 bool FindGetArgString(std::string &arg, const char *str, char *str_value,
@@ -92,10 +132,19 @@ int main(int argc, char *argv[]) {
 
   char str_buffer[kMaxStringLen] = {0};
 
+  // Block size for streaming mode, which -b selects instead of the whole-file
+  // mode.
+  size_t block_size = 0;
+  bool block_size_set = false;
+  bool block_size_valid = true;
+
+  // Emit dynamic instead of static Huffman blocks.
+  bool dynamic_huffman = false;
+
   // Check the number of arguments specified
-  if (argc != 3) {
+  if (argc < 3 || argc > 5) {
     std::cerr << "Incorrect number of arguments. Correct usage: " << argv[0]
-              << " <input-file> -o=<output-file>\n";
+              << " <input-file> -o=<output-file> [-b=<block-size>] [-d]\n";
     return 1;
   }
 
@@ -108,9 +157,18 @@ int main(int argc, char *argv[]) {
       if (std::string(argv[i]) == "--help") {
         help = true;
       }
+      if (std::string(argv[i]) == "-d" ||
+          std::string(argv[i]) == "--dynamic") {
+        dynamic_huffman = true;
+      }
 
       FindGetArgString(sarg, "-o=", str_buffer, kMaxStringLen);
       FindGetArgString(sarg, "--output-file=", str_buffer, kMaxStringLen);
+      if (FindGetArgSize(sarg, "-b=", &block_size, &block_size_valid) ||
+          FindGetArgSize(sarg, "--block-size=", &block_size,
+                         &block_size_valid)) {
+        block_size_set = true;
+      }
     } else {
       infilename = std::string(argv[i]);
     }
@@ -121,6 +179,15 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  if (block_size_set &&
+      (!block_size_valid || block_size < (size_t)minimum_filesize ||
+       block_size > kMaxBlockSize)) {
+    std::cout << "Block size for streaming compression must be a number of "
+                 "bytes between "
+              << minimum_filesize << " and " << kMaxBlockSize << "\n";
+    return 1;
+  }
+
   try {
 #ifdef FPGA_EMULATOR
     ext::intel::fpga_emulator_selector device_selector;
@@ -151,19 +218,29 @@ int main(int argc, char *argv[]) {
       outfilenames[i] = outfilenames[0] + std::to_string(i+1);
     }
 
+    if (block_size_set) {
+      std::cout << "Launching streaming High-Bandwidth DMA GZIP application "
+                   "with " << kNumEngines << " engines and " << block_size
+                << " byte blocks\n";
+      if (dynamic_huffman) std::cout << "Using dynamic Huffman blocks\n";
+      return CompressFileStreaming(q, infilename, outfilenames[0],
+                                   block_size, dynamic_huffman);
+    }
+
     std::cout << "Launching High-Bandwidth DMA GZIP application with " << kNumEngines
               << " engines\n";
+    if (dynamic_huffman) std::cout << "Using dynamic Huffman blocks\n";
 
 #ifdef FPGA_EMULATOR
-    CompressFile(q, infilename, outfilenames, 1, true);
+    CompressFile(q, infilename, outfilenames, 1, true, dynamic_huffman);
 #else
     // warmup run - use this run to warmup accelerator. There are some steps in
     // the runtime that are only executed on the first kernel invocation but not
     // on subsequent invocations. So execute all that stuff here before we
     // measure performance (in the next call to CompressFile().
-    CompressFile(q, infilename, outfilenames, 1, false);
+    CompressFile(q, infilename, outfilenames, 1, false, dynamic_huffman);
     // profile performance
-    CompressFile(q, infilename, outfilenames, 200, true);
+    CompressFile(q, infilename, outfilenames, 200, true, dynamic_huffman);
 #endif
   } catch (sycl::exception const &e) {
     // Catches exceptions in the host code
@@ -182,8 +259,27 @@ int main(int argc, char *argv[]) {
   return 0;
 }
 
+// Allocates the buffers of the dynamic Huffman path for blocks of up to
+// block_size bytes. In static Huffman mode they are placeholders.
+void AllocDynamicHuffmanBuffers(struct DynamicHuffmanBuffers &dyn,
+                                size_t block_size, bool dynamic_huffman) {
+  size_t lz_records = dynamic_huffman ? block_size / kVec + 1 : 1;
+  dyn.lz_buf = new buffer<struct DistLen, 1>(lz_records);
+  dyn.hist_buf = new buffer<unsigned, 1>(kDynHistSize);
+  dyn.tree_buf = new buffer<struct CtData, 1>(kLCodes + kDCodes);
+  dyn.header_buf = new buffer<struct HuffHeaderChunk, 1>(kMaxHeaderChunks);
+}
+
+void FreeDynamicHuffmanBuffers(struct DynamicHuffmanBuffers &dyn) {
+  delete dyn.lz_buf;
+  delete dyn.hist_buf;
+  delete dyn.tree_buf;
+  delete dyn.header_buf;
+}
+
 struct KernelInfo {
   buffer<struct GzipOutInfo, 1> *gzip_out_buf;
+  struct DynamicHuffmanBuffers dyn;
   buffer<unsigned, 1> *current_crc;
   buffer<char, 1> *pobuf;
   buffer<char, 1> *pibuf;
@@ -202,7 +298,7 @@ struct KernelInfo {
 
 // returns 0 on success, otherwise a non-zero failure code.
 int CompressFile(queue &q, std::string &input_file, std::vector<std::string> outfilenames,
-                 int iterations, bool report) {
+                 int iterations, bool report, bool dynamic_huffman) {
   size_t isz;
   char *pinbuf;
 
@@ -307,6 +403,11 @@ int CompressFile(queue &q, std::string &input_file, std::vector<std::string> out
                                 : new buffer<char, 1>(input_alloc_size);
       kinfo[eng][i].pobuf =
           i >= 3 ? kinfo[eng][i - 3].pobuf : new buffer<char, 1>(outputSize);
+      if (i >= 3) {
+        kinfo[eng][i].dyn = kinfo[eng][i - 3].dyn;
+      } else {
+        AllocDynamicHuffmanBuffers(kinfo[eng][i].dyn, isz, dynamic_huffman);
+      }
       kinfo[eng][i].pobuf_decompress = (char *)malloc(kinfo[eng][i].file_size);
     }
   }
@@ -346,7 +447,8 @@ int CompressFile(queue &q, std::string &input_file, std::vector<std::string> out
       SubmitGzipTasks(q, kinfo[eng][i].file_size, kinfo[eng][i].pibuf,
                       kinfo[eng][i].pobuf, kinfo[eng][i].gzip_out_buf,
                       kinfo[eng][i].current_crc, kinfo[eng][i].last_block,
-                      e_k_crc[eng][i], e_k_lz[eng][i], e_k_huff[eng][i], eng);
+                      dynamic_huffman, &kinfo[eng][i].dyn, e_k_crc[eng][i],
+                      e_k_lz[eng][i], e_k_huff[eng][i], eng);
 
       // Transfer the output (compressed) data from device to host.
       e_output_dma[eng][i] = q.submit([&](handler &h) {
@@ -491,6 +593,7 @@ int CompressFile(queue &q, std::string &input_file, std::vector<std::string> out
         delete kinfo[eng][i].current_crc;
         delete kinfo[eng][i].pibuf;
         delete kinfo[eng][i].pobuf;
+        FreeDynamicHuffmanBuffers(kinfo[eng][i].dyn);
         if (prepin) {
           free(kinfo[eng][i].poutput_buffer, q.get_context());
         } else {
@@ -505,3 +608,252 @@ int CompressFile(queue &q, std::string &input_file, std::vector<std::string> out
   if (report) std::cout << "PASSED\n";
   return 0;
 }
+
+// Number of KernelInfo slots per engine used by the streaming mode. As in
+// CompressFile(), three disjoint sets of buffers per engine are enough to keep
+// the input DMA, the kernels and the output DMA of consecutive blocks
+// overlapped.
+constexpr int kStreamRingSize = 3;
+
+// Streaming mode: the input file is read in block_size chunks which rotate
+// through a ring of kNumEngines * kStreamRingSize KernelInfo slots. Every
+// block is compressed independently and written as its own gzip member, so
+// the output is a valid multi-member .gz file (as produced by pigz/bgzip).
+// Peak memory is bounded by the ring size times block_size, independent of the
+// input size. Reading block b from disk and writing block b - ring_slots to
+// disk overlap with the device processing the blocks in between.
+// returns 0 on success, otherwise a non-zero failure code.
+int CompressFileStreaming(queue &q, std::string &input_file,
+                          std::string &outfilename, size_t block_size,
+                          bool dynamic_huffman) {
+  bool prepin = q.get_device().has(aspect::usm_host_allocations);
+
+  // padding for the input and output buffers to deal with granularity of
+  // kernel reads and writes
+  constexpr size_t kInOutPadding = 16 * kVec;
+  constexpr int kRingSlots = kNumEngines * kStreamRingSize;
+
+  std::ifstream file(input_file,
+                     std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    std::cout << "Error: cannot read specified input file\n";
+    return 1;
+  }
+  size_t isz = file.tellg();
+  file.seekg(0, std::ios::beg);
+
+  if (isz < minimum_filesize) {
+    std::cout << "Minimum filesize for compression is " << minimum_filesize
+              << "\n";
+    return 1;
+  }
+
+  FILE *fo = fopen(outfilename.c_str(), "wb");
+  if (!fo) {
+    std::cout << "Cannot open file for output: " << outfilename << "\n";
+    return 1;
+  }
+
+  const size_t input_alloc_size = block_size + kInOutPadding;
+  const size_t output_size = (input_alloc_size < kMinBufferSize)
+                                 ? kMinBufferSize
+                                 : input_alloc_size;
+
+  // One KernelInfo per ring slot. pref_buffer is the slot's host staging
+  // buffer for the input block, which is kept until the block's gzip member
+  // has been written (for the host side CRC and the stored fallback).
+  struct KernelInfo *kinfo =
+      (struct KernelInfo *)malloc(sizeof(struct KernelInfo) * kRingSlots);
+  char *pinbuf[kRingSlots];
+  if (kinfo == NULL) {
+    std::cout << "Cannot allocate kernel info buffer.\n";
+    fclose(fo);
+    return 1;
+  }
+  for (int s = 0; s < kRingSlots; s++) {
+    if (prepin) {
+      pinbuf[s] = (char *)malloc_host(input_alloc_size, q.get_context());
+      kinfo[s].poutput_buffer =
+          (char *)malloc_host(output_size, q.get_context());
+    } else {
+      pinbuf[s] = new char[input_alloc_size];
+      kinfo[s].poutput_buffer = (char *)malloc(output_size);
+    }
+    memset(pinbuf[s], 0, input_alloc_size);
+    memset(kinfo[s].poutput_buffer, 0, output_size);
+
+    kinfo[s].pref_buffer = pinbuf[s];
+    kinfo[s].pobuf_decompress = nullptr;
+    kinfo[s].file_size = 0;
+    kinfo[s].iteration = -1;
+    kinfo[s].last_block = true;
+    kinfo[s].gzip_out_buf = new buffer<struct GzipOutInfo, 1>(kMinBufferSize);
+    kinfo[s].current_crc = new buffer<unsigned, 1>(kMinBufferSize);
+    kinfo[s].pibuf = new buffer<char, 1>(input_alloc_size);
+    kinfo[s].pobuf = new buffer<char, 1>(output_size);
+    AllocDynamicHuffmanBuffers(kinfo[s].dyn, block_size, dynamic_huffman);
+  }
+
+  event e_input_dma[kRingSlots];
+  event e_output_dma[kRingSlots];
+  event e_crc_dma[kRingSlots];
+  event e_size_dma[kRingSlots];
+  event e_k_crc[kRingSlots];
+  event e_k_lz[kRingSlots];
+  event e_k_huff[kRingSlots];
+  bool on_device[kRingSlots] = {false};
+
+  size_t compressed_sz = 0;
+  size_t stored_blocks = 0;
+  int status = 0;
+
+  // Waits for the block held in slot s (if any) and appends its gzip member
+  // to the output file. Blocks the engine could not shrink, and tail blocks
+  // too small for the engine, are written as stored members instead.
+  auto drain_slot = [&](int s) {
+    if (kinfo[s].iteration < 0) return;
+    size_t ilen = kinfo[s].file_size;
+    const std::string *name = (kinfo[s].iteration == 0) ? &input_file : nullptr;
+    bool stored = !on_device[s];
+
+    if (on_device[s]) {
+      e_output_dma[s].wait();
+      e_size_dma[s].wait();
+      e_crc_dma[s].wait();
+      // The CRC kernel covers the quantized part of the block, the host
+      // finishes the remaining bytes.
+      kinfo[s].buffer_crc[0] =
+          Crc32(kinfo[s].pref_buffer, ilen, kinfo[s].buffer_crc[0]);
+      stored = kinfo[s].out_info[0].compression_sz > ilen;
+    } else {
+      kinfo[s].buffer_crc[0] = fpga_tools::Crc32Parallel(
+          0, kinfo[s].pref_buffer, ilen, std::thread::hardware_concurrency());
+    }
+
+    if (stored) {
+      stored_blocks++;
+      compressed_sz += ilen;
+      status |= WriteStoredGzipMember(fo, name, kinfo[s].pref_buffer, ilen,
+                                      kinfo[s].buffer_crc[0]);
+    } else {
+      compressed_sz += kinfo[s].out_info[0].compression_sz;
+      status |= WriteGzipMember(fo, name, kinfo[s].poutput_buffer,
+                                kinfo[s].out_info[0].compression_sz, ilen,
+                                kinfo[s].buffer_crc[0]);
+    }
+    kinfo[s].iteration = -1;
+    on_device[s] = false;
+  };
+
+#ifndef FPGA_EMULATOR
+  dpc_common::TimeInterval perf_timer;
+#endif
+
+  /*************************************************/
+  /* Main loop where the actual execution happens  */
+  /*************************************************/
+  size_t num_blocks = (isz + block_size - 1) / block_size;
+  for (size_t b = 0; b < num_blocks && !status; b++) {
+    int s = b % kRingSlots;
+    size_t eng = s % kNumEngines;
+
+    // Retire the block that last used this slot before reusing its buffers.
+    drain_slot(s);
+
+    size_t ilen = (b + 1 == num_blocks) ? isz - b * block_size : block_size;
+    file.read(pinbuf[s], ilen);
+    if (!file) {
+      std::cout << "Error: cannot read specified input file\n";
+      status = 1;
+      break;
+    }
+    kinfo[s].file_size = ilen;
+    kinfo[s].iteration = b;
+
+    // The engine needs more than kVec bytes of input.
+    if (ilen < minimum_filesize) continue;
+
+    e_input_dma[s] = q.submit([&](handler &h) {
+      auto in_data = kinfo[s].pibuf->get_access<access::mode::discard_write>(h);
+      h.copy(kinfo[s].pref_buffer, in_data);
+    });
+
+    SubmitGzipTasks(q, ilen, kinfo[s].pibuf, kinfo[s].pobuf,
+                    kinfo[s].gzip_out_buf, kinfo[s].current_crc,
+                    kinfo[s].last_block, dynamic_huffman, &kinfo[s].dyn,
+                    e_k_crc[s], e_k_lz[s], e_k_huff[s], eng);
+
+    e_output_dma[s] = q.submit([&](handler &h) {
+      auto out_data = kinfo[s].pobuf->get_access<access::mode::read>(h);
+      h.copy(out_data, kinfo[s].poutput_buffer);
+    });
+
+    e_size_dma[s] = q.submit([&](handler &h) {
+      auto out_data = kinfo[s].gzip_out_buf->get_access<access::mode::read>(h);
+      h.copy(out_data, kinfo[s].out_info);
+    });
+
+    e_crc_dma[s] = q.submit([&](handler &h) {
+      auto out_data = kinfo[s].current_crc->get_access<access::mode::read>(h);
+      h.copy(out_data, kinfo[s].buffer_crc);
+    });
+    on_device[s] = true;
+  }
+
+  // Retire the blocks still in flight, oldest first, so members stay in order.
+  for (size_t b = num_blocks < kRingSlots ? 0 : num_blocks - kRingSlots;
+       b < num_blocks; b++) {
+    drain_slot(b % kRingSlots);
+  }
+
+#ifndef FPGA_EMULATOR
+  double diff_total = perf_timer.Elapsed();
+#endif
+  file.close();
+
+  if (fclose(fo)) {
+    perror("close");
+    status = 1;
+  }
+
+  for (int s = 0; s < kRingSlots; s++) {
+    delete kinfo[s].gzip_out_buf;
+    delete kinfo[s].current_crc;
+    delete kinfo[s].pibuf;
+    delete kinfo[s].pobuf;
+    FreeDynamicHuffmanBuffers(kinfo[s].dyn);
+    if (prepin) {
+      free(pinbuf[s], q.get_context());
+      free(kinfo[s].poutput_buffer, q.get_context());
+    } else {
+      delete[] pinbuf[s];
+      free(kinfo[s].poutput_buffer);
+    }
+  }
+  free(kinfo);
+
+  if (status) {
+    std::cout << "FAILED\n";
+    return 1;
+  }
+
+  if (CompareGzipFiles(input_file, outfilename)) {
+    std::cout << "FAILED\n";
+    return 1;
+  }
+
+  std::cout << "Blocks: " << num_blocks << " (" << stored_blocks
+            << " stored uncompressed)\n";
+  std::cout << "Peak block buffer memory: "
+            << kRingSlots * (input_alloc_size + output_size) / (1024 * 1024.0)
+            << " MB\n";
+#ifndef FPGA_EMULATOR
+  // Includes reading the input from and writing the output to disk.
+  std::cout << "Throughput (end-to-end): "
+            << isz / (double)diff_total / 1000000000.0 << " GB/s\n";
+#endif
+  std::cout << "Compression Ratio "
+            << (double)compressed_sz / (double)isz * 100 << "%\n";
+  std::cout << "PASSED\n";
+  return 0;
+}
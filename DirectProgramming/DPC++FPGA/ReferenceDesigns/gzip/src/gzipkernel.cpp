@@ -1,7 +1,9 @@
 #include <CL/sycl.hpp>
 
+#include "DynamicHuffman.hpp"
 #include "gzipkernel.hpp"
 #include "kernels.hpp"
+#include "onchip_memory_with_cache.hpp"  // DirectProgramming/DPC++FPGA/include
 
 
 using namespace sycl;
@@ -598,19 +600,113 @@ int GetHuffBits(int len, int dist, unsigned char ch) {
   return bits;
 }
 
+// Index of the most significant set bit of x, for 0 < x < 2^16.
+int MsbIndex(unsigned int x) {
+  int msb = 0;
+  Unroller<1, 16>::step([&](int b) { msb = (x >> b) ? b : msb; });
+  return msb;
+}
+
+// Maps a match length (kMinMatch..kMaxMatch) to its deflate length code
+// (the literal/length symbol is kLiterals + 1 + code) and its extra bits.
+int GetLengthCode(int len, int *extra_len, int *extra_val) {
+  int lc = len - kMinMatch;
+  *extra_len = 0;
+  *extra_val = 0;
+  if (lc == kMaxMatch - kMinMatch) return kLengthCodes - 1;
+  if (lc < 8) return lc;
+  int k = MsbIndex(lc) - 2;
+  *extra_len = k;
+  *extra_val = lc & ((1 << k) - 1);
+  return 4 * (k + 1) + ((lc >> k) & 3);
+}
+
+// Maps a match distance (1..kMaxDistance) to its deflate distance code and
+// its extra bits.
+int GetDistCode(int dist, int *extra_len, int *extra_val) {
+  int d = dist - 1;
+  *extra_len = 0;
+  *extra_val = 0;
+  if (d < 4) return d;
+  int k = MsbIndex(d) - 1;
+  *extra_len = k;
+  *extra_val = d & ((1 << k) - 1);
+  return 2 * (k + 1) + ((d >> k) & 1);
+}
+
+// Dynamic Huffman counterpart of GetHuffLen()/GetHuffBits(). Looks the
+// symbol(s) up in the code tables built on the host. A length/distance pair
+// is returned as one code, see kMaxDynLitBits.
+void GetDynHuffCode(int len, int dist, unsigned char ch, const CtData *ltree,
+                    const CtData *dtree, unsigned int *bits,
+                    unsigned short *nbits) {
+  int lx_len, lx_val, dx_len, dx_val;
+  int lcode = GetLengthCode(len > 0 ? len : kMinMatch, &lx_len, &lx_val);
+  int dcode = GetDistCode(len > 0 ? dist : 1, &dx_len, &dx_val);
+
+  CtData l = ltree[kLiterals + 1 + lcode];
+  CtData d = dtree[dcode];
+  unsigned int run_bits = l.code;
+  unsigned short run_len = l.len;
+  run_bits |= lx_val << run_len;
+  run_len += lx_len;
+  run_bits |= (unsigned int)d.code << run_len;
+  run_len += d.len;
+  run_bits |= dx_val << run_len;
+  run_len += dx_len;
+
+  switch (len) {
+    case -3:
+      *bits = ltree[kEndBlock].code;
+      *nbits = ltree[kEndBlock].len;
+      break;
+    case -1:
+      *bits = 0;
+      *nbits = 0;
+      break;
+    case 0:
+      *bits = ltree[ch].code;
+      *nbits = ltree[ch].len;
+      break;
+    default:
+      *bits = run_bits;
+      *nbits = run_len;
+      break;
+  }
+}
+
 // assembles up to kVecX2 unsigned char values based on given huffman encoding
 // writes up to kMaxHuffcodeBits * kVecX2 bits to memory
+bool HufPack(unsigned int *code_bits, unsigned short *code_len,
+             unsigned int *outdata, unsigned int *leftover,
+             unsigned short *leftover_size);
+
 bool HufEnc(char *len, short *dist, unsigned char *data, unsigned int *outdata,
             unsigned int *leftover, unsigned short *leftover_size) {
+  unsigned int code_bits[kVec];
+  unsigned short code_len[kVec];
+
+  Unroller<0, kVec>::step([&](int i) {
+    code_len[i] = IsValid(len[i], dist[i], data[i])
+                      ? GetHuffLen(len[i], dist[i], data[i])
+                      : 0;
+    // Codes can be more than 16 bits, so use uint32
+    code_bits[i] = GetHuffBits(len[i], dist[i], data[i]);
+  });
+
+  return HufPack(code_bits, code_len, outdata, leftover, leftover_size);
+}
+
+// packs kVec codes of code_len[i] bits each onto the output bit stream
+bool HufPack(unsigned int *code_bits, unsigned short *code_len,
+             unsigned int *outdata, unsigned int *leftover,
+             unsigned short *leftover_size) {
   // array that contains the bit position of each symbol
   unsigned short bitpos[kVec + 1];
   bitpos[0] = 0;
 
-  Unroller<0, kVec>::step([&](int i) {
-    bitpos[i + 1] = bitpos[i] + (IsValid(len[i], dist[i], data[i])
-                                     ? GetHuffLen(len[i], dist[i], data[i])
-                                     : 0);
-  });
+  Unroller<0, kVec>::step(
+      [&](int i) { bitpos[i + 1] = bitpos[i] + code_len[i]; });
 
   // leftover is an array that carries huffman encoded data not yet written to
   // memory adjust leftover_size with the number of bits to write this time
@@ -641,21 +737,12 @@ bool HufEnc(char *len, short *dist, unsigned char *data, unsigned int *outdata,
   });
 
   Unroller<0, kVec>::step([&](int i) {
-    // Codes can be more than 16 bits, so use uint32
-    unsigned int curr_code = GetHuffBits(len[i], dist[i], data[i]);
+    unsigned int curr_code = code_bits[i];
     unsigned char bitpos_in_short = bitpos[i] & 0x01F;
 
     unsigned long long temp = (unsigned long long)curr_code << bitpos_in_short;
-    unsigned int temp1 = (unsigned int)temp;
-    unsigned int temp2 = temp >> 32ULL;
-
-    if (IsValid(len[i], dist[i], data[i])) {
-      code[i].x = temp1;
-      code[i].y = temp2;
-    } else {
-      code[i].x = temp1;
-      code[i].y = temp2;
-    }
+    code[i].x = (unsigned int)temp;
+    code[i].y = temp >> 32ULL;
   });
 
   // Iterate over all destination locations and gather the required data
@@ -708,12 +795,15 @@ class LZReduction;
 template <int engineID>
 class StaticHuffman;
 template <int engineID>
+class DynamicHuffman;
+template <int engineID>
 void SubmitGzipTasksSingleEngine(
     queue &q,
     size_t block_size,  // size of block to compress.
     buffer<char, 1> *pibuf, buffer<char, 1> *pobuf,
     buffer<struct GzipOutInfo, 1> *gzip_out_buf,
-    buffer<unsigned, 1> *result_crc, bool last_block, event &e_crc, event &e_lz,
+    buffer<unsigned, 1> *result_crc, bool last_block, bool dynamic,
+    struct DynamicHuffmanBuffers *dyn, event &e_crc, event &e_lz,
     event &e_huff) {
   using acc_dist_channel = ext::intel::pipe<class some_pipe, struct DistLen>;
   using acc_dist_channel_last = ext::intel::pipe<class some_pipe2, struct DistLen>;
@@ -1977,8 +2067,49 @@ void SubmitGzipTasksSingleEngine(
   e_lz = q.submit([&](handler &h) {
     auto accessor_isz = block_size;
     auto acc_pibuf = pibuf->get_access<access::mode::read>(h);
+    // In dynamic Huffman mode the LZ output goes to global memory instead of
+    // the pipe, together with the symbol histograms of the whole block.
+    auto acc_lz_out = dyn->lz_buf->get_access<access::mode::discard_write>(h);
+    auto acc_hist = dyn->hist_buf->get_access<access::mode::discard_write>(h);
+    auto acc_dynamic = dynamic;
 
     h.single_task<LZReduction<engineID>>([=]() [[intel::kernel_args_restrict]] {
+      //-------------------------------------
+      //   Symbol histograms (dynamic Huffman only)
+      //-------------------------------------
+
+      // One private histogram per lane, so every lane updates its own memory.
+      // The increments are data-dependent read-modify-writes in the II=1 main
+      // loop below. Each histogram keeps its last kHistCacheDepth updates in a
+      // register cache, which covers the latency of the on-chip memory, so the
+      // increment of one iteration never waits on the store of the previous.
+      constexpr int kHistCacheDepth = 8;
+      fpga_tools::OnchipMemoryWithCache<unsigned int, kLCodes, kHistCacheDepth>
+          lit_hist[kVec];
+      fpga_tools::OnchipMemoryWithCache<unsigned int, kDCodes, kHistCacheDepth>
+          dist_hist[kVec];
+
+      if (acc_dynamic) {
+        Unroller<0, kVec>::step([&](int k) {
+          lit_hist[k].init(0);
+          dist_hist[k].init(0);
+        });
+      }
+
+      // Counts the symbols of one LZ output record.
+      auto count_symbols = [&](const struct DistLen &rec) {
+        Unroller<0, kVec>::step([&](int i) {
+          int lx_len, lx_val, dx_len, dx_val;
+          int len = rec.len[i];
+          int lsym = len > 0 ? kLiterals + 1 +
+                                   GetLengthCode(len, &lx_len, &lx_val)
+                             : rec.data[i];
+          int dsym = GetDistCode(len > 0 ? rec.dist[i] : 1, &dx_len, &dx_val);
+          if (len >= 0) lit_hist[i].write(lsym, lit_hist[i].read(lsym) + 1);
+          if (len > 0) dist_hist[i].write(dsym, dist_hist[i].read(dsym) + 1);
+        });
+      };
+
       //-------------------------------------
       //   Hash Table(s)
       //-------------------------------------
@@ -2255,7 +2386,12 @@ void SubmitGzipTasksSingleEngine(
           }
         });
 
-        acc_dist_channel::write(dist_offs_data);
+        if (acc_dynamic) {
+          acc_lz_out[inpos_minus_vec_div_16] = dist_offs_data;
+          count_symbols(dist_offs_data);
+        } else {
+          acc_dist_channel::write(dist_offs_data);
+        }
 
         // increment input position
         inpos_minus_vec_div_16++;
@@ -2278,10 +2414,128 @@ void SubmitGzipTasksSingleEngine(
         dist_offs_data.len[i] = pred ? 0 : -1;
       });
 
-      acc_dist_channel_last::write(dist_offs_data);
+      if (acc_dynamic) {
+        acc_lz_out[insize_compare] = dist_offs_data;
+        count_symbols(dist_offs_data);
+
+        // Merge the per-lane histograms.
+        for (int i = 0; i < kLCodes; i++) {
+          unsigned int sum = 0;
+          Unroller<0, kVec>::step([&](int k) { sum += lit_hist[k].read(i); });
+          acc_hist[i] = sum;
+        }
+        for (int i = 0; i < kDCodes; i++) {
+          unsigned int sum = 0;
+          Unroller<0, kVec>::step([&](int k) { sum += dist_hist[k].read(i); });
+          acc_hist[kLCodes + i] = sum;
+        }
+      } else {
+        acc_dist_channel_last::write(dist_offs_data);
+      }
     });
   });
 
+  if (dynamic) {
+    // Build the code tables and the block header on the host, as soon as the
+    // histograms are available. The runtime orders this host task between the
+    // LZ kernel and the DynamicHuffman kernel through the buffer accessors.
+    q.submit([&](handler &h) {
+      auto acc_hist = dyn->hist_buf->get_access<access::mode::read>(h);
+      auto acc_trees =
+          dyn->tree_buf->get_access<access::mode::discard_write>(h);
+      auto acc_header =
+          dyn->header_buf->get_access<access::mode::discard_write>(h);
+      h.host_task([=]() {
+        BuildDynamicHuffman(&acc_hist[0], last_block, &acc_trees[0],
+                            &acc_header[0]);
+      });
+    });
+
+    e_huff = q.submit([&](handler &h) {
+      auto accessor_isz = block_size;
+      auto acc_lz_in = dyn->lz_buf->get_access<access::mode::read>(h);
+      auto acc_trees = dyn->tree_buf->get_access<access::mode::read>(h);
+      auto acc_header = dyn->header_buf->get_access<access::mode::read>(h);
+      auto acc_gzip_out =
+          gzip_out_buf->get_access<access::mode::discard_write>(h);
+      auto accessor_output = pobuf->get_access<access::mode::discard_write>(h);
+      h.single_task<DynamicHuffman<engineID>>([=
+      ]() [[intel::kernel_args_restrict]] {
+        CtData ltree[kLCodes];
+        CtData dtree[kDCodes];
+        for (int i = 0; i < kLCodes; i++) ltree[i] = acc_trees[i];
+        for (int i = 0; i < kDCodes; i++) dtree[i] = acc_trees[kLCodes + i];
+
+        unsigned int leftover[kVec] = {0};
+        Unroller<0, kVec>::step([&](int i) { leftover[i] = 0; });
+
+        unsigned short leftover_size = 0;
+
+        unsigned int outpos_huffman = 0;
+        int odx = 0;
+
+        // Cycle layout: the block header chunks, one cycle per LZ record, the
+        // end of block marker, and a final cycle that flushes the leftover.
+        const int header_cycles = kMaxHeaderChunks / kVec;
+        const int num_records = (accessor_isz / kVec) + 1;
+        const int eob_cycle = header_cycles + num_records;
+
+        for (int c = 0; c <= eob_cycle + 1; c++) {
+          unsigned int code_bits[kVec];
+          unsigned short code_len[kVec];
+
+          if (c < header_cycles) {
+            Unroller<0, kVec>::step([&](int i) {
+              struct HuffHeaderChunk chunk = acc_header[c * kVec + i];
+              code_bits[i] = chunk.bits;
+              code_len[i] = chunk.len;
+            });
+          } else {
+            struct DistLen in;
+            Unroller<0, kVec>::step([&](int i) {
+              in.len[i] = -1;
+              in.dist[i] = -1;
+              in.data[i] = 0;
+            });
+            in.len[0] = c == eob_cycle ? -3 : -1;
+
+            if (c < eob_cycle) in = acc_lz_in[c - header_cycles];
+
+            Unroller<0, kVec>::step([&](int i) {
+              GetDynHuffCode(in.len[i], in.dist[i], in.data[i], ltree, dtree,
+                             &code_bits[i], &code_len[i]);
+            });
+          }
+
+          struct HuffmanOutput outdata;
+          outdata.write = HufPack(code_bits, code_len, outdata.data, leftover,
+                                  &leftover_size);
+
+          bool flush = c == eob_cycle + 1;
+
+          // prevent out of bounds write
+          if ((flush || outdata.write) && (odx < accessor_isz)) {
+            Unroller<0, kVec * sizeof(unsigned int)>::step([&](int i) {
+              accessor_output[odx + i] =
+                  flush ? (unsigned char)(leftover[(i >> 2) & 0xf] >>
+                                          ((i & 3) << 3))
+                        : (unsigned char)(outdata.data[(i >> 2) & 0xf] >>
+                                          ((i & 3) << 3));
+            });
+          }
+
+          outpos_huffman = outdata.write ? outpos_huffman + 1 : outpos_huffman;
+          odx += outdata.write ? (sizeof(unsigned int) << kVecPow) : 0;
+        }
+
+        acc_gzip_out[0].compression_sz =
+            (outpos_huffman * sizeof(unsigned int) * kVec) +
+            (leftover_size + 7) / 8;
+      });
+    });
+    return;
+  }
+
   e_huff = q.submit([&](handler &h) {
     auto accessor_isz = block_size;
     auto acc_gzip_out =
@@ -2352,6 +2606,7 @@ void SubmitGzipTasks(queue &q,
                      buffer<char, 1> *pibuf, buffer<char, 1> *pobuf,
                      buffer<struct GzipOutInfo, 1> *gzip_out_buf,
                      buffer<unsigned, 1> *result_crc, bool last_block,
+                     bool dynamic_huffman, struct DynamicHuffmanBuffers *dyn,
                      event &e_crc, event &e_lz, event &e_huff,
                      size_t engineID) {
   // Statically declare the engines so that the hardware is created for them.
@@ -2359,13 +2614,15 @@ void SubmitGzipTasks(queue &q,
   // engineID.
   if (engineID == 0) {
     SubmitGzipTasksSingleEngine<0>(q, block_size, pibuf, pobuf, gzip_out_buf,
-                                   result_crc, last_block, e_crc, e_lz, e_huff);
+                                   result_crc, last_block, dynamic_huffman,
+                                   dyn, e_crc, e_lz, e_huff);
   }
 
   #if NUM_ENGINES > 1
     if (engineID == 1) {
       SubmitGzipTasksSingleEngine<1>(q, block_size, pibuf, pobuf, gzip_out_buf,
-                                     result_crc, last_block, e_crc, e_lz, e_huff);
+                                     result_crc, last_block, dynamic_huffman,
+                                     dyn, e_crc, e_lz, e_huff);
     }
   #endif
 
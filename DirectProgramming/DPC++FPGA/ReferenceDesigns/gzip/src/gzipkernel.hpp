@@ -4,14 +4,28 @@
 
 #include <CL/sycl.hpp>
 
+#include "kernels.hpp"
+
 using namespace cl::sycl;
 
+// Buffers used by the dynamic Huffman path of one gzip engine invocation.
+// In static Huffman mode they are still bound to the LZ kernel, but are not
+// accessed, so single-element buffers suffice.
+struct DynamicHuffmanBuffers {
+  buffer<struct DistLen, 1> *lz_buf;    // LZ records, block_size / kVec + 1
+  buffer<unsigned, 1> *hist_buf;        // kDynHistSize symbol counts
+  buffer<struct CtData, 1> *tree_buf;   // kLCodes + kDCodes codes
+  buffer<struct HuffHeaderChunk, 1> *header_buf;  // kMaxHeaderChunks chunks
+};
+
 extern "C" void SubmitGzipTasks(
     queue &sycl_device,
     size_t block_size,  // size of block to compress.
     buffer<char, 1> *pibuf, buffer<char, 1> *pobuf,
     buffer<struct GzipOutInfo, 1> *gzip_out_buf,
-    buffer<unsigned, 1> *current_crc, bool last_block, event &e_crc,
-    event &e_lz, event &e_huff, size_t engineID);
+    buffer<unsigned, 1> *current_crc, bool last_block,
+    bool dynamic_huffman,  // emit a BTYPE=2 block instead of BTYPE=1
+    struct DynamicHuffmanBuffers *dyn, event &e_crc, event &e_lz,
+    event &e_huff, size_t engineID);
 
 #endif  //__GZIPKERNEL_H__
@@ -125,6 +125,36 @@ constexpr int kMaxDistance = ((32 * 1024));
 
 constexpr int kMinBufferSize = 16384;
 
+// Code length limits for dynamic Huffman (BTYPE=2) blocks. A length/distance
+// pair is packed into one 32-bit code slot by the Huffman encoder: literal/length
+// code, at most 1 extra length bit (matches are at most kLen bytes), distance
+// code and up to 13 extra distance bits.
+constexpr int kMaxDynLitBits = 11;
+constexpr int kMaxDynDistBits = 7;
+static_assert(kMaxDynLitBits + 1 + kMaxDynDistBits + 13 <= 32,
+              "dynamic Huffman length/distance pair exceeds 32 bits");
+
+// Code length code lengths are 3 bit fields in the block header.
+constexpr int kMaxDynCLBits = 7;
+
+// Number of histogram bins collected by the LZ kernel for dynamic Huffman:
+// kLCodes literal/length symbols followed by kDCodes distance symbols.
+constexpr int kDynHistSize = kLCodes + kDCodes;
+
+// The dynamic block header is built on the host and emitted by the
+// DynamicHuffman kernel as a sequence of bit chunks, kVec chunks per cycle.
+// Unused chunks have len == 0.
+struct HuffHeaderChunk {
+  unsigned short bits;
+  unsigned short len;
+};
+
+// block type bits + HLIT/HDIST/HCLEN + 19 code length code lengths + one chunk
+// per literal/length and distance code length
+constexpr int kMaxHeaderChunksRaw = 1 + 3 + kBLCodes + kLCodes + kDCodes;
+constexpr int kMaxHeaderChunks =
+    ((kMaxHeaderChunksRaw + kVec - 1) / kVec) * kVec;
+
 struct DictString {
   unsigned char s[kLen];
 };
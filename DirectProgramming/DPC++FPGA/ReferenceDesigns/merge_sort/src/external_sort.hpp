@@ -0,0 +1,257 @@
+#ifndef __EXTERNAL_SORT_HPP__
+#define __EXTERNAL_SORT_HPP__
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+// The external sort is used when the data to sort does not fit in device
+// memory (or host memory). It is done in two phases:
+//  1. Run formation: the input file is split into runs of 'run_size' elements
+//     that are each sorted by the FPGA and spilled, in order, to a runs file.
+//  2. Merge: the runs file is memory mapped and the runs are merged with a
+//     k-way merge on the host, which streams each run from disk in order and
+//     writes the sorted output file in blocks.
+// Both phases only touch a sliding window of each file, so the operating
+// system can page the files in and out as needed and 'count' is only bounded
+// by the size of the disk.
+//
+
+// the number of elements written to the output file at once by the merge
+constexpr size_t kExternalSortWriteBlock = 1 << 16;
+
+//
+// A read-only memory mapping of a whole file
+//
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& path) {
+#if defined(_WIN32)
+    file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) return;
+    size_ = size.QuadPart;
+    if (size_ == 0) {
+      valid_ = true;
+      return;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_ == nullptr) return;
+    data_ = static_cast<const char*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    valid_ = data_ != nullptr;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      size_ = st.st_size;
+      if (size_ == 0) {
+        valid_ = true;
+      } else {
+        void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+          // the files are read front to back (per run, for the runs file), so
+          // let the kernel read ahead and drop the pages behind us
+          madvise(map, size_, MADV_SEQUENTIAL);
+          data_ = static_cast<const char*>(map);
+          valid_ = true;
+        }
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile() {
+#if defined(_WIN32)
+    if (data_ != nullptr) UnmapViewOfFile(data_);
+    if (mapping_ != nullptr) CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+    if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool valid() const { return valid_; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool valid_ = false;
+#if defined(_WIN32)
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+#endif
+};
+
+//
+// The timing of the two phases of the external sort, in milliseconds
+//
+struct ExternalSortTimes {
+  size_t runs = 0;         // the number of sorted runs
+  double run_ms = 0;       // run formation, including the file I/O
+  double run_sort_ms = 0;  // the part of 'run_ms' spent in 'sort_run'
+  double merge_ms = 0;     // the k-way merge, including the file I/O
+};
+
+//
+// Sorts the 'count' elements of the binary file 'in_path' into 'out_path',
+// using 'run_path' for the sorted runs.
+//
+// 'sort_run(in, out, n)' must sort the 'n' elements at 'in' into 'out' and
+// return the time it took in ms. It is called with at most 'run_size'
+// elements. The merge is stable with respect to the runs, so it preserves the
+// order of equal elements if 'sort_run' does.
+//
+template <typename ValueT, typename SortRunFn,
+          typename Compare = std::less<ValueT>>
+bool ExternalSort(const std::string& in_path, const std::string& out_path,
+                  const std::string& run_path, size_t count, size_t run_size,
+                  SortRunFn&& sort_run, ExternalSortTimes& times,
+                  Compare comp = Compare()) {
+  using std::chrono::duration;
+  using std::chrono::high_resolution_clock;
+
+  /////////////////////////////////////////////////////////////
+  // Phase 1: run formation
+  auto run_start = high_resolution_clock::now();
+  {
+    MappedFile in_file(in_path);
+    if (!in_file.valid() || in_file.size() < count * sizeof(ValueT)) {
+      std::cerr << "ERROR: could not map the input file '" << in_path << "'\n";
+      return false;
+    }
+    const ValueT* in = reinterpret_cast<const ValueT*>(in_file.data());
+
+    std::ofstream run_file(run_path, std::ios::binary | std::ios::trunc);
+    if (!run_file.is_open()) {
+      std::cerr << "ERROR: could not create the runs file '" << run_path
+                << "'\n";
+      return false;
+    }
+
+    std::vector<ValueT> sorted(run_size);
+    times.runs = 0;
+    times.run_sort_ms = 0;
+    for (size_t offset = 0; offset < count; offset += run_size) {
+      const size_t n = std::min(run_size, count - offset);
+      times.run_sort_ms += sort_run(in + offset, sorted.data(), n);
+      run_file.write(reinterpret_cast<const char*>(sorted.data()),
+                     n * sizeof(ValueT));
+      times.runs++;
+    }
+
+    if (!run_file.good()) {
+      std::cerr << "ERROR: could not write the runs file '" << run_path
+                << "'\n";
+      return false;
+    }
+  }
+  auto run_end = high_resolution_clock::now();
+  times.run_ms = duration<double, std::milli>(run_end - run_start).count();
+  /////////////////////////////////////////////////////////////
+
+  /////////////////////////////////////////////////////////////
+  // Phase 2: k-way merge of the runs
+  auto merge_start = high_resolution_clock::now();
+  {
+    MappedFile run_file(run_path);
+    if (!run_file.valid() || run_file.size() < count * sizeof(ValueT)) {
+      std::cerr << "ERROR: could not map the runs file '" << run_path << "'\n";
+      return false;
+    }
+    const ValueT* runs = reinterpret_cast<const ValueT*>(run_file.data());
+
+    std::ofstream out_file(out_path, std::ios::binary | std::ios::trunc);
+    if (!out_file.is_open()) {
+      std::cerr << "ERROR: could not create the output file '" << out_path
+                << "'\n";
+      return false;
+    }
+
+    // the read position and the end of each run
+    std::vector<std::pair<size_t, size_t>> cursor(times.runs);
+    for (size_t r = 0; r < times.runs; r++) {
+      cursor[r] = {r * run_size, std::min(count, (r + 1) * run_size)};
+    }
+
+    // A min-heap of the run indices, ordered by the next element of each run.
+    // Ties are broken by the run index, which makes the merge stable.
+    auto heap_order = [&](size_t a, size_t b) {
+      const ValueT& va = runs[cursor[a].first];
+      const ValueT& vb = runs[cursor[b].first];
+      if (comp(vb, va)) return true;
+      if (comp(va, vb)) return false;
+      return a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(heap_order)>
+        heap(heap_order);
+    for (size_t r = 0; r < times.runs; r++) {
+      heap.push(r);
+    }
+
+    std::vector<ValueT> block;
+    block.reserve(kExternalSortWriteBlock);
+    while (!heap.empty()) {
+      const size_t r = heap.top();
+      heap.pop();
+
+      block.push_back(runs[cursor[r].first++]);
+      if (block.size() == kExternalSortWriteBlock) {
+        out_file.write(reinterpret_cast<const char*>(block.data()),
+                       block.size() * sizeof(ValueT));
+        block.clear();
+      }
+
+      if (cursor[r].first < cursor[r].second) {
+        heap.push(r);
+      }
+    }
+    out_file.write(reinterpret_cast<const char*>(block.data()),
+                   block.size() * sizeof(ValueT));
+
+    if (!out_file.good()) {
+      std::cerr << "ERROR: could not write the output file '" << out_path
+                << "'\n";
+      return false;
+    }
+  }
+  auto merge_end = high_resolution_clock::now();
+  times.merge_ms =
+      duration<double, std::milli>(merge_end - merge_start).count();
+  /////////////////////////////////////////////////////////////
+
+  return true;
+}
+
+#endif /* __EXTERNAL_SORT_HPP__ */
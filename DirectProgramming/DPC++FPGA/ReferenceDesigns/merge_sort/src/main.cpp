@@ -1,8 +1,13 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <limits>
 #include <numeric>
+#include <string>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -14,7 +19,9 @@
 // e.g., $ONEAPI_ROOT/dev-utilities/include/dpc_common.hpp
 #include "dpc_common.hpp"
 
+#include "external_sort.hpp"
 #include "merge_sort.hpp"
+#include "records.hpp"
 
 // Included from DirectProgramming/DPC++FPGA/include/
 #include "constexpr_math.hpp"
@@ -52,19 +59,60 @@ constexpr size_t kSortWidth = SORT_WIDTH;
 static_assert(kSortWidth >= 1);
 static_assert(fpga_tools::IsPow2(kSortWidth));
 
+// The type to sort and its comparators.
+// This can be set by defining the preprocessor macro 'RECORD_BYTES' to 8, 16
+// or 32 to sort the key-value records of that size in records.hpp, otherwise
+// 'int' values are sorted. The sorter orders the records by key and row index
+// ('SortCompare'), which must give the same result as a std::stable_sort by
+// key ('RefCompare').
+#ifndef RECORD_BYTES
+#define RECORD_BYTES 0
+#endif
+#if RECORD_BYTES == 0
+using SortValueT = int;
+using SortCompare = LessThan;
+using RefCompare = LessThan;
+#elif RECORD_BYTES == 8
+using SortValueT = KeyIndex32;
+using SortCompare = KeyIndexLess;
+using RefCompare = KeyLess;
+#elif RECORD_BYTES == 16
+using SortValueT = KeyIndex64;
+using SortCompare = KeyIndexLess;
+using RefCompare = KeyLess;
+#elif RECORD_BYTES == 32
+using SortValueT = KeyPayload64;
+using SortCompare = KeyIndexLess;
+using RefCompare = KeyLess;
+#else
+#error "RECORD_BYTES must be 0, 8, 16 or 32"
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Forward declare functions used in this file by main()
-template <typename ValueT, typename IndexT, typename KernelPtrType>
-double FPGASort(queue &q, ValueT *in_vec, ValueT *out_vec, IndexT count);
+template <typename ValueT, typename IndexT, typename KernelPtrType,
+          typename Compare>
+double FPGASort(queue &q, ValueT *in_vec, ValueT *out_vec, IndexT count,
+                Compare comp);
+
+template <typename ValueT>
+ValueT RandomElement(size_t row);
+
+template <typename ValueT>
+ValueT PaddingElement();
 
 template <typename T>
 bool Validate(T *val, T *ref, unsigned int count);
+
+template <typename ValueT, typename IndexT, typename Compare>
+bool RunExternalSort(queue &q, size_t count, size_t run_size, int seed,
+                     const std::string &dir, Compare comp);
 ////////////////////////////////////////////////////////////////////////////////
 
 
 int main(int argc, char *argv[]) {
-  // the type to sort, needs a compare function!
-  using ValueT = int;
+  // the type to sort, needs a compare function! (see SortValueT above)
+  using ValueT = SortValueT;
 
   // the type used to index in the sorter
   // below we do a runtime check to make sure this type has enough bits to
@@ -84,19 +132,45 @@ int main(int argc, char *argv[]) {
 #endif
   int seed = 777;
 
-  // get the size of the input as the first command line argument
-  if (argc > 1) {
-    count = atoi(argv[1]);
+  // the external sort mode, see RunExternalSort below
+  std::string external_dir;
+#ifdef FPGA_EMULATOR
+  size_t run_size = 64;
+#else
+  size_t run_size = 1 << 24;
+#endif
+
+  // '--external=<dir>' and '--run-size=<n>' can be given anywhere, the other
+  // arguments are positional
+  std::vector<std::string> positional;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg.rfind("--external=", 0) == 0) {
+      external_dir = arg.substr(arg.find('=') + 1);
+    } else if (arg.rfind("--run-size=", 0) == 0) {
+      run_size = std::strtoull(arg.c_str() + arg.find('=') + 1, nullptr, 10);
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  const bool external = !external_dir.empty();
+
+  // get the size of the input as the first command line argument. In the
+  // external mode, the input is 16 runs by default and may be larger than
+  // what IndexT can count, since only the runs are sorted on the device.
+  size_t total_count = external ? 16 * run_size : count;
+  if (positional.size() > 0) {
+    total_count = std::strtoull(positional[0].c_str(), nullptr, 10);
   }
 
   // get the number of runs as the second command line argument
-  if (argc > 2) {
-    runs = atoi(argv[2]);
+  if (positional.size() > 1) {
+    runs = atoi(positional[1].c_str());
   }
 
   // get the random number generator seed as the third command line argument
-  if (argc > 3) {
-    seed = atoi(argv[3]);
+  if (positional.size() > 2) {
+    seed = atoi(positional[2].c_str());
   }
 
   // enforce at least two runs
@@ -105,18 +179,32 @@ int main(int argc, char *argv[]) {
     std::terminate();
   }
 
+  // in the external mode, the device sorts runs of 'run_size' elements
+  const size_t device_count = external ? run_size : total_count;
+
   // check args
-  if (count <= kMergeUnits) {
+  if (device_count <= kMergeUnits) {
     std::cerr << "ERROR: 'count' must be greater than number of merge units\n";
     std::terminate();
-  } else if (count > std::numeric_limits<IndexT>::max()) {
+  } else if (device_count > std::numeric_limits<IndexT>::max()) {
     std::cerr << "ERROR: the index type (IndexT) does not have enough bits to "
               << "count to 'count'\n";
     std::terminate();
-  } else if ((count % kSortWidth) != 0) {
+  } else if ((device_count % kSortWidth) != 0 ||
+             (total_count % kSortWidth) != 0) {
     std::cerr << "ERROR: 'count' must be a multiple of the sorter width\n";
     std::terminate();
   }
+  // the row index of the records must not wrap around, which the external
+  // mode could otherwise do with KeyIndex32 records
+  if constexpr (!std::is_arithmetic_v<ValueT>) {
+    if (total_count > MaxRecordRows<ValueT>()) {
+      std::cerr << "ERROR: the row index of the records does not have enough "
+                << "bits to count to 'count'\n";
+      std::terminate();
+    }
+  }
+  count = device_count;
   /////////////////////////////////////////////////////////////
 
   // the device selector
@@ -145,16 +233,32 @@ int main(int argc, char *argv[]) {
     std::terminate();
   }
 
+  // the external sort streams the data through files instead
+  if (external) {
+    try {
+      passed = RunExternalSort<ValueT, IndexT>(q, total_count, run_size, seed,
+                                               external_dir, SortCompare());
+    } catch (exception const &e) {
+      std::cout << "Caught a synchronous SYCL exception: " << e.what() << "\n";
+      std::terminate();
+    }
+
+    std::cout << (passed ? "PASSED\n" : "FAILED\n");
+    return passed ? 0 : 1;
+  }
+
   // the input, output, and reference data
   std::vector<ValueT> in_vec(count), out_vec(count), ref(count);
 
   // generate some random input data
   srand(seed);
-  std::generate(in_vec.begin(), in_vec.end(), [] { return rand() % 100; });
+  for (size_t i = 0; i < count; i++) {
+    in_vec[i] = RandomElement<ValueT>(i);
+  }
 
   // copy the input to the output reference and compute the expected result
   std::copy(in_vec.begin(), in_vec.end(), ref.begin());
-  std::sort(ref.begin(), ref.end());
+  std::stable_sort(ref.begin(), ref.end(), RefCompare());
 
   // allocate the input and output data either in USM host or device allocations
   ValueT *in, *out;
@@ -178,7 +282,7 @@ int main(int argc, char *argv[]) {
     // input is always in 'in_vec' and this portion of the code is not part of
     // the performance timing.
     std::copy(in_vec.begin(), in_vec.end(), in);
-    std::fill(out, out + count, ValueT(0));
+    std::fill(out, out + count, ValueT{});
   } else {
     // using device allocations
     if ((in = malloc_device<ValueT>(count, q)) == nullptr) {
@@ -203,6 +307,8 @@ int main(int argc, char *argv[]) {
     std::cout << "Running sort " << runs << " times for an "
               << "input size of " << count << " using " << kMergeUnits
               << " " << kSortWidth << "-way merge units\n";
+    std::cout << "Sorting " << sizeof(ValueT) << "-byte "
+              << (RECORD_BYTES == 0 ? "values" : "records") << "\n";
     std::cout << "Streaming data from "
               << (kUseUSMHostAllocation ? "host" : "device") << " memory\n";
 
@@ -215,7 +321,8 @@ int main(int argc, char *argv[]) {
     // run the sort multiple times to increase the accuracy of the timing
     for (int i = 0; i < runs; i++) {
       // run the sort
-      time[i] = FPGASort<ValueT, IndexT, KernelPtrType>(q, in, out, count);
+      time[i] = FPGASort<ValueT, IndexT, KernelPtrType>(q, in, out, count,
+                                                        SortCompare());
 
       // Copy the output to 'out_vec'. In the case where we are using USM host
       // allocations this is unnecessary since we could simply deference
@@ -243,11 +350,13 @@ int main(int argc, char *argv[]) {
     double avg_time_ms =
       std::accumulate(time.begin() + 1, time.end(), 0.0) / (runs - 1);
 
-    IndexT input_count_mega = count * 1e-6;
+    double input_count_mega = count * 1e-6;
 
     std::cout << "Execution time: " << avg_time_ms << " ms\n";
     std::cout << "Throughput: " << (input_count_mega / (avg_time_ms * 1e-3))
-              << " Melements/s\n";
+              << " Melements/s ("
+              << (input_count_mega * sizeof(ValueT) / (avg_time_ms * 1e-3))
+              << " MB/s)\n";
 
     std::cout << "PASSED\n";
     return 0;
@@ -266,13 +375,15 @@ class SortOutPipeID;
 //
 // perform the actual sort on the FPGA.
 //
-template <typename ValueT, typename IndexT, typename KernelPtrType>
-double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count) {
+template <typename ValueT, typename IndexT, typename KernelPtrType,
+          typename Compare>
+double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count,
+                Compare comp) {
   // the input and output pipe for the sorter
   using SortInPipe =
-      sycl::ext::intel::pipe<SortInPipeID, sycl::vec<ValueT, kSortWidth>>;
+      sycl::ext::intel::pipe<SortInPipeID, std::array<ValueT, kSortWidth>>;
   using SortOutPipe =
-      sycl::ext::intel::pipe<SortOutPipeID, sycl::vec<ValueT, kSortWidth>>;
+      sycl::ext::intel::pipe<SortOutPipeID, std::array<ValueT, kSortWidth>>;
 
   // the sorter must sort a power of 2, so round up the requested count
   // to the nearest power of 2; we will pad the input to make sure the
@@ -293,10 +404,9 @@ double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count) {
   // This is the element we will pad the input with. In the case of this design,
   // we are sorting from smallest to largest and we want the last elements out
   // to be this element, so pad with MAX. If you are sorting from largest to
-  // smallest, make this the MIN element. If you are sorting custom types
-  // which are not supported by std::numeric_limits, then you will have to set
-  // this padding element differently.
-  const auto padding_element = std::numeric_limits<ValueT>::max();
+  // smallest, make this the MIN element. Custom types, which are not supported
+  // by std::numeric_limits, provide it themselves (see PaddingElement).
+  const auto padding_element = PaddingElement<ValueT>();
 
   // We are sorting kSortWidth elements per cycle, so we will have 
   // sorter_count/kSortWidth pipe reads/writes from/to the sorter
@@ -313,7 +423,7 @@ double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count) {
         bool in_range = i * kSortWidth < count;
 
         // build the input pipe data
-        sycl::vec<ValueT, kSortWidth> data;
+        std::array<ValueT, kSortWidth> data;
         #pragma unroll
         for (unsigned char j = 0; j < kSortWidth; j++) {
           data[j] = in_range ? in[i * kSortWidth + j] : padding_element;
@@ -351,7 +461,7 @@ double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count) {
   // launch the merge sort kernels
   auto merge_sort_events =
       SubmitMergeSort<ValueT, IndexT, SortInPipe, SortOutPipe, kSortWidth,
-                      kMergeUnits>(q, sorter_count, buf_0, buf_1);
+                      kMergeUnits>(q, sorter_count, buf_0, buf_1, comp);
 
   // wait for the input and output kernels to finish
   auto start = high_resolution_clock::now();
@@ -373,6 +483,204 @@ double FPGASort(queue &q, ValueT *in_ptr, ValueT *out_ptr, IndexT count) {
   return diff.count();
 }
 
+//
+// A random element for row 'row' of the input: a value in [0, 100) or a
+// record (see records.hpp)
+//
+template <typename ValueT>
+ValueT RandomElement(size_t row) {
+  if constexpr (std::is_arithmetic_v<ValueT>) {
+    return rand() % 100;
+  } else {
+    return RandomRecord<ValueT>(row);
+  }
+}
+
+//
+// the element used to pad the input of the sorter, which must sort last
+//
+template <typename ValueT>
+ValueT PaddingElement() {
+  if constexpr (std::is_arithmetic_v<ValueT>) {
+    return std::numeric_limits<ValueT>::max();
+  } else {
+    return ValueT::Max();
+  }
+}
+
+//
+// an order independent checksum of a sequence of elements, used to check that
+// the output of the external sort is a permutation of its input without
+// keeping either in memory
+//
+template <typename ValueT>
+uint64_t ChecksumElement(const ValueT &v) {
+  // hash the bytes of the element with the splitmix64 finalizer, so that the
+  // sum of the elements does not hide swapped values
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&v);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < sizeof(ValueT); i += sizeof(uint64_t)) {
+    uint64_t x = 0;
+    std::memcpy(&x, bytes + i, std::min(sizeof(uint64_t), sizeof(ValueT) - i));
+    x += 0x9E3779B97F4A7C15ULL * (i / sizeof(uint64_t) + 1);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    sum += x ^ (x >> 31);
+  }
+  return sum;
+}
+
+//
+// Sorts 'count' elements that do not have to fit in device (or host) memory.
+// The random input is written to a file in 'dir', sorted by ExternalSort (see
+// external_sort.hpp) in runs of 'run_size' elements on the FPGA and merged
+// on the host, and the output file is validated.
+//
+template <typename ValueT, typename IndexT, typename Compare>
+bool RunExternalSort(queue &q, size_t count, size_t run_size, int seed,
+                     const std::string &dir, Compare comp) {
+  const std::string in_path = dir + "/merge_sort_input.bin";
+  const std::string run_path = dir + "/merge_sort_runs.bin";
+  const std::string out_path = dir + "/merge_sort_output.bin";
+
+  std::cout << "Running external sort for an input size of " << count
+            << " in runs of " << run_size << " using " << kMergeUnits << " "
+            << kSortWidth << "-way merge units\n";
+  std::cout << "Spilling data to " << dir << "\n";
+
+  // generate the random input file, in blocks
+  uint64_t in_checksum = 0;
+  {
+    std::ofstream in_file(in_path, std::ios::binary | std::ios::trunc);
+    if (!in_file.is_open()) {
+      std::cerr << "ERROR: could not create '" << in_path << "'\n";
+      return false;
+    }
+
+    srand(seed);
+    std::vector<ValueT> block(kExternalSortWriteBlock);
+    for (size_t offset = 0; offset < count; offset += block.size()) {
+      const size_t n = std::min(block.size(), count - offset);
+      for (size_t i = 0; i < n; i++) {
+        block[i] = RandomElement<ValueT>(offset + i);
+        in_checksum += ChecksumElement(block[i]);
+      }
+      in_file.write(reinterpret_cast<const char *>(block.data()),
+                    n * sizeof(ValueT));
+    }
+
+    if (!in_file.good()) {
+      std::cerr << "ERROR: could not write '" << in_path << "'\n";
+      return false;
+    }
+  }
+
+  // allocate space for one run either in USM host or device allocations
+  ValueT *in, *out;
+  if constexpr (kUseUSMHostAllocation) {
+    in = malloc_host<ValueT>(run_size, q);
+    out = malloc_host<ValueT>(run_size, q);
+  } else {
+    in = malloc_device<ValueT>(run_size, q);
+    out = malloc_device<ValueT>(run_size, q);
+  }
+  if (in == nullptr || out == nullptr) {
+    std::cerr << "ERROR: could not allocate space for a run\n";
+    std::terminate();
+  }
+
+  using KernelPtrType =
+      typename std::conditional_t<kUseUSMHostAllocation, host_ptr<ValueT>,
+                                  device_ptr<ValueT>>;
+
+  // sort one run on the FPGA
+  auto sort_run = [&](const ValueT *src, ValueT *dst, size_t n) {
+    // The last run can be too small for the merge units, which only happens
+    // if it has at most kMergeUnits elements, so sort it on the host.
+    if (n <= kMergeUnits) {
+      std::copy(src, src + n, dst);
+      std::sort(dst, dst + n, comp);
+      return 0.0;
+    }
+
+    if constexpr (kUseUSMHostAllocation) {
+      std::copy(src, src + n, in);
+    } else {
+      q.memcpy(in, src, n * sizeof(ValueT)).wait();
+    }
+
+    double time =
+        FPGASort<ValueT, IndexT, KernelPtrType>(q, in, out, n, comp);
+
+    if constexpr (kUseUSMHostAllocation) {
+      std::copy(out, out + n, dst);
+    } else {
+      q.memcpy(dst, out, n * sizeof(ValueT)).wait();
+    }
+
+    return time;
+  };
+
+  // run the external sort
+  ExternalSortTimes times;
+  bool passed = ExternalSort<ValueT>(in_path, out_path, run_path, count,
+                                     run_size, sort_run, times, comp);
+
+  sycl::free(in, q);
+  sycl::free(out, q);
+
+  // validate the output: it must be in order and have the same elements as
+  // the input
+  if (passed) {
+    MappedFile out_file(out_path);
+    if (!out_file.valid() || out_file.size() != count * sizeof(ValueT)) {
+      std::cout << "ERROR: the output file has the wrong size\n";
+      passed = false;
+    } else {
+      const ValueT *sorted = reinterpret_cast<const ValueT *>(out_file.data());
+      uint64_t out_checksum = 0;
+      for (size_t i = 0; i < count && passed; i++) {
+        if (i > 0 && comp(sorted[i], sorted[i - 1])) {
+          std::cout << "ERROR: the output is out of order at entry " << i
+                    << "\n";
+          passed = false;
+        }
+        out_checksum += ChecksumElement(sorted[i]);
+      }
+      if (passed && out_checksum != in_checksum) {
+        std::cout << "ERROR: the output is not a permutation of the input\n";
+        passed = false;
+      }
+    }
+  }
+
+  // remove the spilled files
+  std::remove(in_path.c_str());
+  std::remove(run_path.c_str());
+  std::remove(out_path.c_str());
+
+  // print the performance of each phase
+  if (passed) {
+    // NOTE: when run in emulation, these results do not accurately represent
+    // the performance of the kernels in actual FPGA hardware
+    const double count_mega = count * 1e-6;
+    const double total_ms = times.run_ms + times.merge_ms;
+
+    std::cout << "Run formation: " << times.runs << " runs in " << times.run_ms
+              << " ms (" << (count_mega / (times.run_ms * 1e-3))
+              << " Melements/s), " << times.run_sort_ms
+              << " ms of it sorting on the FPGA\n";
+    std::cout << "Merge: " << times.runs << "-way merge in " << times.merge_ms
+              << " ms (" << (count_mega / (times.merge_ms * 1e-3))
+              << " Melements/s)\n";
+    std::cout << "Execution time: " << total_ms << " ms\n";
+    std::cout << "Throughput: " << (count_mega / (total_ms * 1e-3))
+              << " Melements/s\n";
+  }
+
+  return passed;
+}
+
 //
 // simple function to check if two regions of memory contain the same values
 //
@@ -1,6 +1,8 @@
 #ifndef __PRODUCE_HPP__
 #define __PRODUCE_HPP__
 
+#include <array>
+
 #include <CL/sycl.hpp>
 #include <sycl/ext/intel/fpga_extensions.hpp>
 
@@ -28,7 +30,7 @@ event Produce(queue& q, ValueT *in_ptr, IndexT count, IndexT in_block_count,
 
       for (IndexT i = 0; i < iterations; i++) {
         // read 'k_width' elements from device memory
-        sycl::vec<ValueT, k_width> pipe_data;
+        std::array<ValueT, k_width> pipe_data;
         #pragma unroll
         for (unsigned char j = 0; j < k_width; j++) {
           pipe_data[j] = in[start_offset + i*k_width + j];
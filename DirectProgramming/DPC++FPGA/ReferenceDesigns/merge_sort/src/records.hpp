@@ -0,0 +1,132 @@
+#ifndef __RECORDS_HPP__
+#define __RECORDS_HPP__
+
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+
+//
+// Key-value records that can be sorted by the merge sort design, instead of
+// bare values. The sorter moves whole records through its pipes and sorting
+// networks, so the cost of a record grows with its size: a k_width-wide
+// sorter moves 'k_width * sizeof(record)' bytes per cycle.
+//
+// Each record carries the index of the row it came from. Comparing records by
+// key and then by index (KeyIndexLess) makes the result the same as a stable
+// sort by key, even though the sorting networks themselves are not stable.
+// For records with large payloads, sort KeyIndex records and use the sorted
+// indices to gather the payloads afterwards, rather than moving the payloads
+// through the sorter.
+//
+
+// 8 bytes: a 32-bit key and a 32-bit row index
+struct KeyIndex32 {
+  uint32_t key;
+  uint32_t index;
+
+  static KeyIndex32 Max() {
+    return {std::numeric_limits<uint32_t>::max(),
+            std::numeric_limits<uint32_t>::max()};
+  }
+};
+
+// 16 bytes: a 64-bit key and a 64-bit row index
+struct KeyIndex64 {
+  uint64_t key;
+  uint64_t index;
+
+  static KeyIndex64 Max() {
+    return {std::numeric_limits<uint64_t>::max(),
+            std::numeric_limits<uint64_t>::max()};
+  }
+};
+
+// 32 bytes: a 64-bit key, a 64-bit row index and 16 bytes of payload
+struct KeyPayload64 {
+  uint64_t key;
+  uint64_t index;
+  uint64_t payload[2];
+
+  static KeyPayload64 Max() {
+    return {std::numeric_limits<uint64_t>::max(),
+            std::numeric_limits<uint64_t>::max(),
+            {0, 0}};
+  }
+};
+
+static_assert(sizeof(KeyIndex32) == 8);
+static_assert(sizeof(KeyIndex64) == 16);
+static_assert(sizeof(KeyPayload64) == 32);
+
+//
+// Comparators for the records
+//
+// orders records by key only, e.g. for std::stable_sort
+struct KeyLess {
+  template <class T>
+  bool operator()(T const& a, T const& b) const {
+    return a.key < b.key;
+  }
+};
+
+// orders records by key and then by row index
+struct KeyIndexLess {
+  template <class T>
+  bool operator()(T const& a, T const& b) const {
+    return (a.key < b.key) || (a.key == b.key && a.index < b.index);
+  }
+};
+
+//
+// Random records for row 'row'. The keys are drawn from a small range so that
+// many records have equal keys, which checks that the sort is stable.
+//
+template <typename RecordT>
+RecordT RandomRecord(size_t row) {
+  RecordT r = RecordT::Max();
+  r.key = rand() % 100;
+  r.index = row;
+  if constexpr (std::is_same_v<RecordT, KeyPayload64>) {
+    r.payload[0] = rand();
+    r.payload[1] = rand();
+  }
+  return r;
+}
+
+//
+// The largest number of rows that records of type RecordT can index, e.g.
+// 2^32 - 1 for KeyIndex32. The padding record (Max) has the largest index, so
+// the rows must stay below it.
+//
+template <typename RecordT>
+constexpr size_t MaxRecordRows() {
+  return std::numeric_limits<decltype(RecordT::index)>::max();
+}
+
+//
+// equality and printing, for validating the output
+//
+inline bool operator!=(const KeyIndex32& a, const KeyIndex32& b) {
+  return a.key != b.key || a.index != b.index;
+}
+inline bool operator!=(const KeyIndex64& a, const KeyIndex64& b) {
+  return a.key != b.key || a.index != b.index;
+}
+inline bool operator!=(const KeyPayload64& a, const KeyPayload64& b) {
+  return a.key != b.key || a.index != b.index ||
+         a.payload[0] != b.payload[0] || a.payload[1] != b.payload[1];
+}
+
+inline std::ostream& operator<<(std::ostream& os, const KeyIndex32& r) {
+  return os << "{key=" << r.key << ", index=" << r.index << "}";
+}
+inline std::ostream& operator<<(std::ostream& os, const KeyIndex64& r) {
+  return os << "{key=" << r.key << ", index=" << r.index << "}";
+}
+inline std::ostream& operator<<(std::ostream& os, const KeyPayload64& r) {
+  return os << "{key=" << r.key << ", index=" << r.index << "}";
+}
+
+#endif /* __RECORDS_HPP__ */
@@ -0,0 +1,187 @@
+#ifndef __CRC32_UTILS_HPP__
+#define __CRC32_UTILS_HPP__
+
+//
+// Host-side CRC-32 utilities for the GZIP polynomial (0xEDB88320), shared by
+// the compression and decompression reference designs.
+//
+//    Crc32          CRC-32 of a buffer, using slicing-by-16 table lookups
+//    Crc32Combine   CRC-32 of A|B given CRC-32(A), CRC-32(B) and len(B)
+//    Crc32Parallel  CRC-32 of a buffer, split across threads and combined
+//
+// All functions follow the zlib convention: the initial CRC is 0, and the
+// value returned by one call can be passed as 'init' to the next call to
+// continue the CRC over more data.
+//
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace fpga_tools {
+
+namespace crc32_detail {
+
+constexpr uint32_t kPolynomial = 0xEDB88320;
+
+// number of bytes consumed per step by Crc32
+constexpr int kSlices = 16;
+
+using SliceTables = std::array<std::array<uint32_t, 256>, kSlices>;
+
+// tables[k][b] is the CRC-32 update for byte 'b' followed by 'k' zero bytes
+constexpr SliceTables MakeSliceTables() {
+  SliceTables t{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int j = 0; j < 8; j++) {
+      c = (c & 1) ? (kPolynomial ^ (c >> 1)) : (c >> 1);
+    }
+    t[0][i] = c;
+  }
+  for (int k = 1; k < kSlices; k++) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = t[k - 1][i];
+      t[k][i] = (c >> 8) ^ t[0][c & 0xFF];
+    }
+  }
+  return t;
+}
+
+inline constexpr SliceTables kSliceTables = MakeSliceTables();
+
+// Multiplies a(x) by b(x) modulo the CRC polynomial. Both are bit-reflected,
+// i.e. x^0 is the most significant bit.
+constexpr uint32_t MultModP(uint32_t a, uint32_t b) {
+  uint32_t m = 1u << 31;
+  uint32_t p = 0;
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? ((b >> 1) ^ kPolynomial) : (b >> 1);
+  }
+  return p;
+}
+
+// x2n_table[k] = x^(2^k) modulo the CRC polynomial
+constexpr std::array<uint32_t, 32> MakeX2nTable() {
+  std::array<uint32_t, 32> t{};
+  uint32_t p = 1u << 30;  // x^1
+  t[0] = p;
+  for (int n = 1; n < 32; n++) {
+    p = MultModP(p, p);
+    t[n] = p;
+  }
+  return t;
+}
+
+inline constexpr std::array<uint32_t, 32> kX2nTable = MakeX2nTable();
+
+// returns x^(n * 2^k) modulo the CRC polynomial
+constexpr uint32_t X2nModP(size_t n, int k) {
+  uint32_t p = 1u << 31;  // x^0
+  while (n) {
+    if (n & 1) p = MultModP(kX2nTable[k & 31], p);
+    n >>= 1;
+    k++;
+  }
+  return p;
+}
+
+}  // namespace crc32_detail
+
+//
+// Computes the CRC-32 of 'len' bytes at 'buf', continuing from 'init'.
+// The main loop consumes 16 bytes per step with independent table lookups
+// (slicing-by-16), instead of one dependent lookup per byte.
+//
+inline uint32_t Crc32(uint32_t init, const void* buf, size_t len) {
+  const auto& t = crc32_detail::kSliceTables;
+  const uint8_t* p = static_cast<const uint8_t*>(buf);
+  uint32_t c = ~init;
+
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  while (len >= crc32_detail::kSlices) {
+    uint32_t w0, w1, w2, w3;
+    std::memcpy(&w0, p, 4);
+    std::memcpy(&w1, p + 4, 4);
+    std::memcpy(&w2, p + 8, 4);
+    std::memcpy(&w3, p + 12, 4);
+    w0 ^= c;
+    c = t[15][w0 & 0xFF] ^ t[14][(w0 >> 8) & 0xFF] ^
+        t[13][(w0 >> 16) & 0xFF] ^ t[12][w0 >> 24] ^
+        t[11][w1 & 0xFF] ^ t[10][(w1 >> 8) & 0xFF] ^
+        t[9][(w1 >> 16) & 0xFF] ^ t[8][w1 >> 24] ^
+        t[7][w2 & 0xFF] ^ t[6][(w2 >> 8) & 0xFF] ^
+        t[5][(w2 >> 16) & 0xFF] ^ t[4][w2 >> 24] ^
+        t[3][w3 & 0xFF] ^ t[2][(w3 >> 8) & 0xFF] ^
+        t[1][(w3 >> 16) & 0xFF] ^ t[0][w3 >> 24];
+    p += crc32_detail::kSlices;
+    len -= crc32_detail::kSlices;
+  }
+#endif
+
+  while (len--) {
+    c = t[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+  }
+  return ~c;
+}
+
+//
+// Given crc1 = CRC-32 of buffer A and crc2 = CRC-32 of buffer B (each
+// computed with init 0), returns the CRC-32 of A followed by B. 'len2' is the
+// length of B in bytes. Runs in O(log(len2)) time.
+//
+constexpr uint32_t Crc32Combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  return crc32_detail::MultModP(crc32_detail::X2nModP(len2, 3), crc1) ^ crc2;
+}
+
+//
+// Computes the CRC-32 of 'len' bytes at 'buf', continuing from 'init', using
+// up to 'num_threads' threads. The buffer is split into one contiguous chunk
+// per thread and the partial CRCs are merged with Crc32Combine.
+//
+inline uint32_t Crc32Parallel(uint32_t init, const void* buf, size_t len,
+                              unsigned num_threads) {
+  // below this size per thread, spawning threads costs more than it saves
+  constexpr size_t kMinBytesPerThread = 1 << 20;
+
+  if (num_threads > len / kMinBytesPerThread) {
+    num_threads = len / kMinBytesPerThread;
+  }
+  if (num_threads <= 1) return Crc32(init, buf, len);
+
+  const uint8_t* p = static_cast<const uint8_t*>(buf);
+  size_t chunk = len / num_threads;
+  std::vector<uint32_t> partial(num_threads);
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+
+  for (unsigned i = 1; i < num_threads; i++) {
+    size_t size = (i == num_threads - 1) ? len - i * chunk : chunk;
+    threads.emplace_back(
+        [&partial, p, chunk, size, i] {
+          partial[i] = Crc32(0, p + i * chunk, size);
+        });
+  }
+  partial[0] = Crc32(init, p, chunk);
+
+  for (auto& t : threads) t.join();
+
+  uint32_t crc = partial[0];
+  for (unsigned i = 1; i < num_threads; i++) {
+    size_t size = (i == num_threads - 1) ? len - i * chunk : chunk;
+    crc = Crc32Combine(crc, partial[i], size);
+  }
+  return crc;
+}
+
+}  // namespace fpga_tools
+
+#endif /* __CRC32_UTILS_HPP__ */
@@ -42,14 +42,29 @@
 /*  5. Absolutely no warranty is expressed or implied.                   */
 /*-----------------------------------------------------------------------*/
 # include <stdio.h>
+# include <stdint.h>
+# include <string.h>
+# include <errno.h>
 # include <unistd.h>
 # include <math.h>
 # include <float.h>
 # include <limits.h>
+# include <sys/syscall.h>
 # include <sys/time.h>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#ifdef __SSE2__
+# include <immintrin.h>
+#endif
 
 # include <CL/sycl.hpp>
+# include <algorithm>
+# include <fstream>
 # include <iostream>
+# include <random>
+# include <string>
+# include <vector>
 
 /*-----------------------------------------------------------------------
  * INSTRUCTIONS:
@@ -195,24 +210,122 @@ static double	bytes[4] = {
     };
 
 extern double mysecond();
-extern void checkSTREAMresults ();
-#ifdef TUNED
+extern void checkSTREAMresults (ssize_t n, int ntimes);
 extern void tuned_STREAM_Copy();
 extern void tuned_STREAM_Scale(STREAM_TYPE scalar);
 extern void tuned_STREAM_Add();
 extern void tuned_STREAM_Triad(STREAM_TYPE scalar);
-#endif
-#ifdef _OPENMP
-extern int omp_get_num_threads();
-#endif
 int checktick();
 
+/* oneAPI modifications: */
+/* The array sizes of the sweep mode, see stream_sweep below. */
+std::vector<ssize_t> sweep_sizes(double ratio);
+
+/* oneAPI modifications: */
+/* The kernel implementations, allocation kinds and NUMA placements that the
+ * additional modes can choose from. The omp variant is the loops of the main
+ * loop, and the sycl variant is the tuned_* kernels. The omp-nt variant is
+ * the same loops with non-temporal stores, and the sycl-nd variant is
+ * nd_range kernels that process a vector of elements per work-item. */
+enum stream_variant { VARIANT_OMP, VARIANT_SYCL, VARIANT_OMP_NT, VARIANT_SYCL_ND };
+enum alloc_kind { ALLOC_DEVICE, ALLOC_HOST, ALLOC_SHARED, ALLOC_SYSTEM };
+enum placement_policy { PLACE_FIRST_TOUCH, PLACE_INTERLEAVE, PLACE_NODE };
+struct placement {
+    placement_policy	policy;
+    int			node;
+};
+static const char	*variant_name[] = {"omp", "sycl", "omp-nt", "sycl-nd"};
+static const char	*alloc_name[] = {"device", "host", "shared", "system"};
+#ifdef TUNED
+static const stream_variant default_variant = VARIANT_SYCL;
+#else
+static const stream_variant default_variant = VARIANT_OMP;
+#endif
+
+/* the work-group size and the elements per work-item of sycl-nd */
+static size_t	stream_wg_size = 256;
+static int	stream_vec_width = 4;
+static void omp_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar);
+extern void nt_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar);
+extern void nd_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar);
+
+/* The sweep mode runs the kernels over a range of working set sizes in one
+ * run, instead of the single compile time STREAM_ARRAY_SIZE. */
+int stream_sweep(std::vector<ssize_t> sizes, std::vector<stream_variant> variants,
+    int ntimes);
+
+/* The allocation matrix mode runs the kernels for each combination of
+ * allocation kind, placement and OpenMP thread count. */
+int stream_alloc_matrix(std::vector<ssize_t> sizes, std::vector<alloc_kind> allocs,
+    std::vector<placement> placements, std::vector<int> threads,
+    std::vector<stream_variant> variants, int ntimes);
+std::vector<placement> default_placements();
+std::vector<int> default_threads();
+
+/* The latency mode runs a pointer chase over a range of working set sizes,
+ * with the allocation options of the allocation matrix mode. */
+int stream_latency(std::vector<ssize_t> sizes, std::vector<alloc_kind> allocs,
+    std::vector<placement> placements, std::vector<int> threads, int ntimes);
+
 /* oneAPI modifications: */
 /* This is a global variable to allow the tuned_* implementations
  * to have the same function signature as the original version. */
 sycl::queue q;
 
-int main(void)
+/* oneAPI modifications: */
+/* Splits a comma separated command line list. */
+static std::vector<std::string> split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    size_t pos = 0;
+    while (pos < list.size()) {
+	size_t end = list.find(',', pos);
+	if (end == std::string::npos) end = list.size();
+	items.push_back(list.substr(pos, end - pos));
+	pos = end + 1;
+    }
+    return items;
+}
+
+static bool parse_alloc(const std::string &name, alloc_kind *kind)
+{
+    for (int i = 0; i < 4; i++) {
+	if (name == alloc_name[i]) {
+	    *kind = (alloc_kind) i;
+	    return true;
+	}
+    }
+    return false;
+}
+
+static bool parse_variant(const std::string &name, stream_variant *variant)
+{
+    for (int i = 0; i < 4; i++) {
+	if (name == variant_name[i]) {
+	    *variant = (stream_variant) i;
+	    return true;
+	}
+    }
+    return false;
+}
+
+static bool parse_placement(const std::string &name, placement *place)
+{
+    place->node = 0;
+    if (name == "first-touch") {
+	place->policy = PLACE_FIRST_TOUCH;
+    } else if (name == "interleave") {
+	place->policy = PLACE_INTERLEAVE;
+    } else if (name.rfind("node=", 0) == 0 && name.size() > 5) {
+	place->policy = PLACE_NODE;
+	place->node = atoi(name.c_str() + 5);
+    } else {
+	return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
 {
     /* oneAPI modifications: */
     /* The default selector will likely choose a GPU, then a CPU.
@@ -224,6 +337,123 @@ int main(void)
     std::cerr << "SYCL Platform: " << p.get_info<sycl::info::platform::name>() << std::endl;
     std::cerr << "SYCL Device:   " << d.get_info<sycl::info::device::name>() << std::endl;
 
+    /* oneAPI modifications: */
+    /* Command line options for the additional modes. Without any, this is
+     * the original STREAM run over STREAM_ARRAY_SIZE elements. */
+    std::vector<ssize_t> sweep;
+    int sweep_ntimes = NTIMES;
+    bool ntimes_set = false;
+    bool matrix = false;
+    bool latency = false;
+    std::vector<alloc_kind> allocs = {ALLOC_DEVICE, ALLOC_HOST, ALLOC_SHARED, ALLOC_SYSTEM};
+    std::vector<placement> placements = default_placements();
+    std::vector<int> threads = default_threads();
+    std::vector<stream_variant> variants;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        bool valid = true;
+        if (arg == "--sweep") {
+            sweep = sweep_sizes(1.4142135623730951);
+        } else if (arg.rfind("--sizes=", 0) == 0) {
+            for (auto &item : split_list(arg.substr(8))) {
+                ssize_t n = atoll(item.c_str());
+                if (n > 0) sweep.push_back(n);
+            }
+        } else if (arg.rfind("--ntimes=", 0) == 0) {
+            sweep_ntimes = MAX(2, atoi(arg.c_str() + 9));
+            ntimes_set = true;
+        } else if (arg == "--matrix") {
+            matrix = true;
+        } else if (arg == "--latency") {
+            latency = true;
+        } else if (arg.rfind("--alloc=", 0) == 0) {
+            matrix = true;
+            allocs.clear();
+            for (auto &item : split_list(arg.substr(8))) {
+                alloc_kind kind;
+                valid = valid && parse_alloc(item, &kind);
+                allocs.push_back(kind);
+            }
+        } else if (arg.rfind("--placement=", 0) == 0) {
+            matrix = true;
+            placements.clear();
+            for (auto &item : split_list(arg.substr(12))) {
+                placement place;
+                valid = valid && parse_placement(item, &place);
+                placements.push_back(place);
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            matrix = true;
+            threads.clear();
+            for (auto &item : split_list(arg.substr(10))) {
+                if (atoi(item.c_str()) > 0) threads.push_back(atoi(item.c_str()));
+            }
+            valid = !threads.empty();
+        } else if (arg.rfind("--variant=", 0) == 0) {
+            for (auto &item : split_list(arg.substr(10))) {
+                stream_variant variant;
+                valid = valid && parse_variant(item, &variant);
+                variants.push_back(variant);
+            }
+        } else if (arg.rfind("--wg-size=", 0) == 0) {
+            stream_wg_size = atoi(arg.c_str() + 10);
+            valid = stream_wg_size > 0;
+        } else if (arg.rfind("--vec=", 0) == 0) {
+            stream_vec_width = atoi(arg.c_str() + 6);
+            valid = stream_vec_width > 0 && stream_vec_width <= 16 &&
+                (stream_vec_width & (stream_vec_width - 1)) == 0;
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            printf("Usage: %s [--sweep | --sizes=n1,n2,...] [--ntimes=k]\n", argv[0]);
+            printf("          [--matrix | --latency] [--alloc=...] [--placement=...] [--threads=...]\n");
+            printf("  --sweep        run over a geometric series of array sizes, from L1\n");
+            printf("                 resident to 4 times the last level cache\n");
+            printf("  --sizes=...    run over the given array sizes (elements per array)\n");
+            printf("  --ntimes=k     the number of times each kernel is run per size\n");
+            printf("                 in the sweep or matrix (default NTIMES=%d)\n", NTIMES);
+            printf("  --matrix       run over each combination of the options below, at\n");
+            printf("                 STREAM_ARRAY_SIZE or the given --sizes\n");
+            printf("  --latency      run a pointer chase over the sweep (or --sizes) for\n");
+            printf("                 each combination of the options below\n");
+            printf("  --alloc=...    allocation kinds: device,host,shared,system\n");
+            printf("  --placement=.. NUMA placements: first-touch,interleave,node=N\n");
+            printf("  --threads=...  OpenMP thread counts for the omp variants and the\n");
+            printf("                 pointer chase\n");
+            printf("  --variant=...  kernel variants: omp,omp-nt,sycl,sycl-nd, at\n");
+            printf("                 STREAM_ARRAY_SIZE or the given --sizes\n");
+            printf("  --wg-size=n    the work-group size of sycl-nd (default 256)\n");
+            printf("  --vec=n        the elements per work-item of sycl-nd: 1, 2, 4,\n");
+            printf("                 8 or 16 (default 4)\n");
+            return 1;
+        }
+    }
+    stream_wg_size = MIN(stream_wg_size,
+        d.get_info<sycl::info::device::max_work_group_size>());
+    if (latency) {
+        if (sweep.empty()) sweep = sweep_sizes(1.4142135623730951);
+        return stream_latency(sweep, allocs, placements, threads,
+            ntimes_set ? sweep_ntimes : 5);
+    }
+    if (matrix) {
+        if (sweep.empty()) sweep.push_back(STREAM_ARRAY_SIZE);
+        if (variants.empty()) variants = {VARIANT_OMP, VARIANT_SYCL};
+        return stream_alloc_matrix(sweep, allocs, placements, threads, variants,
+            sweep_ntimes);
+    }
+    if (!variants.empty() && sweep.empty()) {
+        sweep.push_back(STREAM_ARRAY_SIZE);
+    }
+    if (!sweep.empty()) {
+        /* On a CPU the sweep sizes are the host caches, and the OpenMP loops
+         * have much less overhead per run than a kernel launch, which would
+         * otherwise dominate the L1 and L2 sizes. */
+        if (variants.empty())
+            variants = {q.get_device().is_cpu() ? VARIANT_OMP : default_variant};
+        return stream_sweep(sweep, variants, sweep_ntimes);
+    }
+
     /* oneAPI modifications: */
     /* SYCL 2020 unified shared memory keeps the oneAPI implemenation as similar
      * to the original version as possible. */
@@ -424,7 +654,7 @@ int main(void)
     printf(HLINE);
 
     /* --- Check Results --- */
-    checkSTREAMresults ();
+    checkSTREAMresults (STREAM_ARRAY_SIZE, NTIMES);
     printf(HLINE);
 
     /* oneAPI modifications: */
@@ -489,7 +719,7 @@ double mysecond()
 #ifndef abs
 #define abs(a) ((a) >= 0 ? (a) : -(a))
 #endif
-void checkSTREAMresults()
+void checkSTREAMresults(ssize_t n, int ntimes)
 {
 	STREAM_TYPE aj,bj,cj,scalar;
 	STREAM_TYPE aSumErr,bSumErr,cSumErr;
@@ -506,7 +736,7 @@ void checkSTREAMresults()
 	aj = 2.0E0 * aj;
     /* now execute timing loop */
 	scalar = 3.0;
-	for (k=0; k<NTIMES; k++)
+	for (k=0; k<ntimes; k++)
         {
             cj = aj;
             bj = scalar*cj;
@@ -518,15 +748,15 @@ void checkSTREAMresults()
 	aSumErr = 0.0;
 	bSumErr = 0.0;
 	cSumErr = 0.0;
-	for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+	for (j=0; j<n; j++) {
 		aSumErr += abs(a[j] - aj);
 		bSumErr += abs(b[j] - bj);
 		cSumErr += abs(c[j] - cj);
 		// if (j == 417) printf("Index 417: c[j]: %f, cj: %f\n",c[j],cj);	// MCCALPIN
 	}
-	aAvgErr = aSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	bAvgErr = bSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
-	cAvgErr = cSumErr / (STREAM_TYPE) STREAM_ARRAY_SIZE;
+	aAvgErr = aSumErr / (STREAM_TYPE) n;
+	bAvgErr = bSumErr / (STREAM_TYPE) n;
+	cAvgErr = cSumErr / (STREAM_TYPE) n;
 
 	if (sizeof(STREAM_TYPE) == 4) {
 		epsilon = 1.e-6;
@@ -545,7 +775,7 @@ void checkSTREAMresults()
 		printf ("Failed Validation on array a[], AvgRelAbsErr > epsilon (%e)\n",epsilon);
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",aj,aAvgErr,abs(aAvgErr)/aj);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<n; j++) {
 			if (abs(a[j]/aj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -564,7 +794,7 @@ void checkSTREAMresults()
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",bj,bAvgErr,abs(bAvgErr)/bj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<n; j++) {
 			if (abs(b[j]/bj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -583,7 +813,7 @@ void checkSTREAMresults()
 		printf ("     Expected Value: %e, AvgAbsErr: %e, AvgRelAbsErr: %e\n",cj,cAvgErr,abs(cAvgErr)/cj);
 		printf ("     AvgRelAbsErr > Epsilon (%e)\n",epsilon);
 		ierr = 0;
-		for (j=0; j<STREAM_ARRAY_SIZE; j++) {
+		for (j=0; j<n; j++) {
 			if (abs(c[j]/cj-1.0) > epsilon) {
 				ierr++;
 #ifdef VERBOSE
@@ -607,19 +837,668 @@ void checkSTREAMresults()
 #endif
 }
 
+/* oneAPI modifications: */
+/* The number of elements the tuned kernels process. This is
+ * STREAM_ARRAY_SIZE, except in the additional modes. */
+static ssize_t	stream_n = STREAM_ARRAY_SIZE;
+
+/* whether 'variant' runs on the host threads rather than on the SYCL device */
+static bool host_variant(stream_variant variant)
+{
+    return variant == VARIANT_OMP || variant == VARIANT_OMP_NT;
+}
+
+static void print_variants(const std::vector<stream_variant> &variants)
+{
+    for (stream_variant variant : variants) {
+	if (variant == VARIANT_SYCL_ND)
+	    printf(" sycl-nd: work-group size %zu, %d elements per work-item.\n",
+		stream_wg_size, stream_vec_width);
+	if (variant == VARIANT_OMP_NT)
+	    printf(" omp-nt: non-temporal stores, so the stores do not read the\n"
+		   " destination into the caches first.\n");
+    }
+}
+
+/* Runs kernel 'kernel' (0: Copy, 1: Scale, 2: Add, 3: Triad) of 'variant'
+ * 'reps' times over the first 'n' elements of the arrays and waits for them
+ * to finish. These are the same loops (or tuned kernels) as in the main loop.
+ * The SYCL kernels are all submitted before a single wait, so that the host
+ * does not add a round trip per run; each kernel writes an array that it
+ * does not read, so the runs give the same results in any order. */
+void run_kernel(stream_variant variant, int kernel, ssize_t n, STREAM_TYPE scalar,
+    ssize_t reps)
+{
+    if (variant == VARIANT_SYCL) {
+	stream_n = n;
+	for (ssize_t r=0; r<reps; r++) {
+	    switch (kernel) {
+		case 0: tuned_STREAM_Copy(); break;
+		case 1: tuned_STREAM_Scale(scalar); break;
+		case 2: tuned_STREAM_Add(); break;
+		case 3: tuned_STREAM_Triad(scalar); break;
+	    }
+	}
+	q.wait();
+	return;
+    }
+    if (variant == VARIANT_SYCL_ND) {
+	for (ssize_t r=0; r<reps; r++)
+	    nd_STREAM_kernel(kernel, n, scalar);
+	q.wait();
+	return;
+    }
+    for (ssize_t r=0; r<reps; r++) {
+	if (variant == VARIANT_OMP_NT)
+	    nt_STREAM_kernel(kernel, n, scalar);
+	else
+	    omp_STREAM_kernel(kernel, n, scalar);
+    }
+}
+
+/* The loops of the main loop, as kernel 'kernel' of the omp variant. */
+static void omp_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar)
+{
+    ssize_t	j;
+
+    switch (kernel) {
+	case 0:
+#pragma omp parallel for
+	    for (j=0; j<n; j++)
+		c[j] = a[j];
+	    break;
+	case 1:
+#pragma omp parallel for
+	    for (j=0; j<n; j++)
+		b[j] = scalar*c[j];
+	    break;
+	case 2:
+#pragma omp parallel for
+	    for (j=0; j<n; j++)
+		c[j] = a[j]+b[j];
+	    break;
+	case 3:
+#pragma omp parallel for
+	    for (j=0; j<n; j++)
+		a[j] = b[j]+scalar*c[j];
+	    break;
+    }
+}
+
+/* Returns the index of the first element of the arrays x, y and z that
+ * differs from the expected value of a, b and c after 'ntimes' iterations
+ * from a = 2, b = 2, c = 0, or -1 if they are all correct. */
+static ssize_t find_error(const STREAM_TYPE *x, const STREAM_TYPE *y,
+    const STREAM_TYPE *z, ssize_t n, int ntimes, STREAM_TYPE scalar)
+{
+    STREAM_TYPE aj = 2.0, bj = 2.0, cj = 0.0;
+    for (int k=0; k<ntimes; k++) {
+	cj = aj;
+	bj = scalar*cj;
+	cj = aj+bj;
+	aj = bj+scalar*cj;
+    }
+    const double epsilon = sizeof(STREAM_TYPE) == 4 ? 1.e-6 : 1.e-13;
+    for (ssize_t j=0; j<n; j++) {
+	if (abs(x[j]/aj-1.0) > epsilon || abs(y[j]/bj-1.0) > epsilon ||
+	    abs(z[j]/cj-1.0) > epsilon)
+	    return j;
+    }
+    return -1;
+}
+
+/* The size in bytes of the level 'level' data cache, from sysfs.
+ * Returns 0 if it is not known. */
+static long cache_size(int level)
+{
+    long size = 0;
+    for (int index = 0; index < 16; index++) {
+	std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" +
+	    std::to_string(index) + "/";
+	std::ifstream level_file(dir + "level"), type_file(dir + "type"),
+	    size_file(dir + "size");
+	int l;
+	std::string type, size_str;
+	if (!(level_file >> l) || !(type_file >> type) || !(size_file >> size_str))
+	    break;
+	if (l != level || type == "Instruction")
+	    continue;
+	long s = atol(size_str.c_str());
+	if (size_str.back() == 'K') s *= 1024;
+	if (size_str.back() == 'M') s *= 1024 * 1024;
+	size = MAX(size, s);
+    }
+    return size;
+}
+
+/* A geometric series of array sizes with the given ratio, from a total
+ * working set of half the L1 data cache to arrays of 4 times the size of the
+ * last level cache (see rule 1a above). For a GPU, the last level cache is
+ * the device's global memory cache. */
+std::vector<ssize_t> sweep_sizes(double ratio)
+{
+    long l1 = cache_size(1);
+    long llc = MAX(cache_size(2), cache_size(3));
+    if (!q.get_device().is_cpu()) {
+	llc = q.get_device().get_info<sycl::info::device::global_mem_cache_size>();
+    }
+    if (l1 == 0) l1 = 32 * 1024;
+    if (llc == 0) llc = 32 * 1024 * 1024;
+
+    printf("L1 data cache = %ld KiB, last level cache = %ld KiB\n",
+	l1 / 1024, llc / 1024);
+
+    std::vector<ssize_t> sizes;
+    const double first = l1 / 2.0 / (3 * sizeof(STREAM_TYPE));
+    const double last = 4.0 * llc / sizeof(STREAM_TYPE);
+    for (double n = first; n <= last * 1.0001; n *= ratio) {
+	/* round to a whole cache line of elements */
+	ssize_t rounded = ((ssize_t) n + 7) / 8 * 8;
+	if (sizes.empty() || sizes.back() != rounded)
+	    sizes.push_back(rounded);
+    }
+    return sizes;
+}
+
+/* The sweep mode: runs each kernel 'ntimes' times at each array size and
+ * prints the best bandwidth per size. Small arrays are run many times in a
+ * row per timed sample, so that a sample is well above the clock
+ * granularity; each kernel writes an array that it does not read, so
+ * repeating it does not change the results. */
+int stream_sweep(std::vector<ssize_t> sizes, std::vector<stream_variant> variants,
+    int ntimes)
+{
+    const ssize_t	max_n = *std::max_element(sizes.begin(), sizes.end());
+    /* the minimum number of elements processed per timed sample */
+    const ssize_t	min_sample = 1 << 23;
+    const STREAM_TYPE	scalar = 3.0;
+    int			err = 0;
+
+    a = sycl::malloc_shared<STREAM_TYPE>(max_n, q);
+    b = sycl::malloc_shared<STREAM_TYPE>(max_n, q);
+    c = sycl::malloc_shared<STREAM_TYPE>(max_n, q);
+
+    printf(HLINE);
+    printf("STREAM version $Revision: 5.10 $, working set sweep\n");
+    printf(HLINE);
+    printf("Each kernel will be executed %d times per size.\n", ntimes);
+    printf(" The *best* time for each kernel (excluding the first iteration)\n");
+    printf(" will be used to compute the reported bandwidth.\n");
+    printf(" Total KiB is the memory of all three arrays; Copy and Scale\n");
+    printf(" touch two of them.\n");
+    print_variants(variants);
+    printf(HLINE);
+    printf("%12s %12s %-8s %12s %12s %12s %12s\n", "Elements", "Total KiB",
+	"Variant", "Copy MB/s", "Scale MB/s", "Add MB/s", "Triad MB/s");
+
+    for (ssize_t n : sizes) {
+      for (stream_variant variant : variants) {
+	const ssize_t reps = MAX(1, min_sample / n);
+	double mintime[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+	ssize_t j;
+
+	/* the same values as the main loop has after its timing check */
+#pragma omp parallel for
+	for (j=0; j<n; j++) {
+	    a[j] = 2.0;
+	    b[j] = 2.0;
+	    c[j] = 0.0;
+	}
+
+	for (int k=0; k<ntimes; k++) {
+	    for (int kernel=0; kernel<4; kernel++) {
+		double t = mysecond();
+		run_kernel(variant, kernel, n, scalar, reps);
+		t = (mysecond() - t) / reps;
+		if (k > 0) /* note -- skip first iteration */
+		    mintime[kernel] = MIN(mintime[kernel], t);
+	    }
+	}
+
+	const double words = (double) sizeof(STREAM_TYPE) * n;
+	printf("%12lld %12.1f %-8s %12.1f %12.1f %12.1f %12.1f\n",
+	    (long long) n, 3.0 * words / 1024.0, variant_name[variant],
+	    1.0E-06 * 2 * words / mintime[0], 1.0E-06 * 2 * words / mintime[1],
+	    1.0E-06 * 3 * words / mintime[2], 1.0E-06 * 3 * words / mintime[3]);
+
+	/* check the results quietly, and report the sizes that fail */
+	j = find_error(a, b, c, n, ntimes, scalar);
+	if (j >= 0) {
+	    printf("Failed Validation for %lld elements at index %lld\n",
+		(long long) n, (long long) j);
+	    err++;
+	}
+      }
+    }
+    printf(HLINE);
+    if (err == 0)
+	printf("Solution Validates on all sizes\n");
+    printf(HLINE);
+
+    sycl::free(c, q);
+    sycl::free(b, q);
+    sycl::free(a, q);
+
+    return err == 0 ? 0 : 1;
+}
+
+/* oneAPI modifications: */
+/* The NUMA memory policies for the mbind system call, from numaif.h, which
+ * is not installed everywhere. */
+#ifndef MPOL_BIND
+# define MPOL_BIND 2
+# define MPOL_INTERLEAVE 3
+# define MPOL_MF_MOVE (1 << 1)
+#endif
+
+/* The number of NUMA nodes, from sysfs (e.g. "0-1" for two nodes). */
+static int numa_nodes()
+{
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string list;
+    if (!(online >> list))
+	return 1;
+    size_t pos = list.find_last_of(",-");
+    return atoi(list.c_str() + (pos == std::string::npos ? 0 : pos + 1)) + 1;
+}
+
+/* first-touch, and on a multi-socket system, interleave and each node */
+std::vector<placement> default_placements()
+{
+    std::vector<placement> placements = {{PLACE_FIRST_TOUCH, 0}};
+    const int nodes = numa_nodes();
+    if (nodes > 1) {
+	placements.push_back({PLACE_INTERLEAVE, 0});
+	for (int node = 0; node < nodes; node++)
+	    placements.push_back({PLACE_NODE, node});
+    }
+    return placements;
+}
+
+/* powers of 2 up to the number of OpenMP threads, and that number */
+std::vector<int> default_threads()
+{
+    std::vector<int> threads;
+#ifdef _OPENMP
+    const int max_threads = omp_get_max_threads();
+    for (int t = 1; t < max_threads; t *= 2)
+	threads.push_back(t);
+    threads.push_back(max_threads);
+#else
+    threads.push_back(1);
+#endif
+    return threads;
+}
+
+static std::string placement_name(placement place)
+{
+    switch (place.policy) {
+	case PLACE_INTERLEAVE: return "interleave";
+	case PLACE_NODE: return "node=" + std::to_string(place.node);
+	default: return "first-touch";
+    }
+}
+
+template <typename T>
+static T *stream_alloc(alloc_kind kind, ssize_t n)
+{
+    const size_t page = sysconf(_SC_PAGESIZE);
+    switch (kind) {
+	case ALLOC_DEVICE: return sycl::malloc_device<T>(n, q);
+	case ALLOC_HOST: return sycl::malloc_host<T>(n, q);
+	case ALLOC_SHARED: return sycl::malloc_shared<T>(n, q);
+	default:
+	    return (T *) aligned_alloc(page, (n * sizeof(T) + page - 1) / page * page);
+    }
+}
+
+static void stream_free(alloc_kind kind, void *p)
+{
+    if (p == NULL)
+	return;
+    if (kind == ALLOC_SYSTEM)
+	free(p);
+    else
+	sycl::free(p, q);
+}
+
+/* Applies the placement to the pages of [p, p + bytes). Pages that are
+ * already in memory (e.g. pinned by malloc_host) are moved. First-touch
+ * leaves the pages to be placed by the threads that initialize them. */
+static bool place_memory(void *p, size_t bytes, placement place, int nodes)
+{
+    if (place.policy == PLACE_FIRST_TOUCH)
+	return true;
+    if (place.node < 0 || place.node >= nodes) {
+	errno = EINVAL;
+	return false;
+    }
+
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = (uintptr_t) p / page * page;
+    const uintptr_t end = ((uintptr_t) p + bytes + page - 1) / page * page;
+
+    std::vector<unsigned long> mask((nodes + 63) / 64, 0);
+    for (int node = 0; node < nodes; node++) {
+	if (place.policy == PLACE_INTERLEAVE || node == place.node)
+	    mask[node / 64] |= 1UL << (node % 64);
+    }
+    const int mode = place.policy == PLACE_INTERLEAVE ? MPOL_INTERLEAVE : MPOL_BIND;
+    /* the kernel ignores the last bit of the node mask */
+    return syscall(SYS_mbind, start, end - start, mode, mask.data(),
+	mask.size() * 64 + 1, MPOL_MF_MOVE) == 0;
+}
+
+/* The same values as the main loop has after its timing check. Device
+ * allocations are initialized on the device, and the others by the OpenMP
+ * threads, which places their pages for first-touch. */
+static void init_arrays(alloc_kind kind, ssize_t n)
+{
+    ssize_t	j;
+
+    if (kind == ALLOC_DEVICE) {
+	q.fill(a, (STREAM_TYPE) 2.0, n);
+	q.fill(b, (STREAM_TYPE) 2.0, n);
+	q.fill(c, (STREAM_TYPE) 0.0, n);
+	q.wait();
+	return;
+    }
+#pragma omp parallel for
+    for (j=0; j<n; j++) {
+	a[j] = 2.0;
+	b[j] = 2.0;
+	c[j] = 0.0;
+    }
+}
+
+/* The allocation matrix mode: for each array size, runs each kernel 'ntimes'
+ * times for each combination of allocation kind, placement, variant and
+ * thread count, and prints the best bandwidth per combination. The omp
+ * variants are run with each thread count, and the sycl variants once on the
+ * SYCL device. Device allocations are only accessible to the sycl variants,
+ * and are placed by the SYCL runtime. */
+int stream_alloc_matrix(std::vector<ssize_t> sizes, std::vector<alloc_kind> allocs,
+    std::vector<placement> placements, std::vector<int> threads,
+    std::vector<stream_variant> variants, int ntimes)
+{
+    const STREAM_TYPE	scalar = 3.0;
+    const int		nodes = numa_nodes();
+    const bool		system_usm = q.get_device().has(sycl::aspect::usm_system_allocations);
+    int			err = 0;
+#ifdef _OPENMP
+    const int		max_threads = omp_get_max_threads();
+#endif
+
+    printf(HLINE);
+    printf("STREAM version $Revision: 5.10 $, allocation matrix\n");
+    printf(HLINE);
+    printf("This system has %d NUMA node(s).\n", nodes);
+    printf("Each kernel will be executed %d times per combination.\n", ntimes);
+    printf(" The *best* time for each kernel (excluding the first iteration)\n");
+    printf(" will be used to compute the reported bandwidth.\n");
+    printf(" First MB/s is the Copy bandwidth of the first iteration, which\n");
+    printf(" includes the page faults and migrations of the allocation.\n");
+#ifndef _OPENMP
+    printf(" This binary is built without OpenMP, so the omp variants are serial.\n");
+#endif
+    print_variants(variants);
+
+    for (ssize_t n : sizes) {
+	const double words = (double) sizeof(STREAM_TYPE) * n;
+	printf(HLINE);
+	printf("Array size = %lld (elements), Memory per array = %.1f MiB\n",
+	    (long long) n, words / 1024.0 / 1024.0);
+	printf("%-8s %-12s %-8s %7s %11s %11s %11s %11s %11s\n", "Alloc",
+	    "Placement", "Variant", "Threads", "Copy MB/s", "Scale MB/s",
+	    "Add MB/s", "Triad MB/s", "First MB/s");
+
+	for (alloc_kind kind : allocs) {
+	    for (placement place : placements) {
+		if (kind == ALLOC_DEVICE && place.policy != PLACE_FIRST_TOUCH)
+		    continue;
+		for (stream_variant variant : variants) {
+		    const bool host = host_variant(variant);
+		    if (host && kind == ALLOC_DEVICE)
+			continue;
+		    if (!host && kind == ALLOC_SYSTEM && !system_usm)
+			continue;
+
+		    for (int nthreads : host ? threads : std::vector<int>{0}) {
+#ifdef _OPENMP
+			omp_set_num_threads(nthreads > 0 ? nthreads : max_threads);
+#endif
+			std::string threads_str = nthreads > 0 ? std::to_string(nthreads) : "-";
+			printf("%-8s %-12s %-8s %7s", alloc_name[kind],
+			    placement_name(place).c_str(), variant_name[variant],
+			    threads_str.c_str());
+			fflush(stdout);
+
+			a = stream_alloc<STREAM_TYPE>(kind, n);
+			b = stream_alloc<STREAM_TYPE>(kind, n);
+			c = stream_alloc<STREAM_TYPE>(kind, n);
+			if (a == NULL || b == NULL || c == NULL) {
+			    printf(" allocation failed\n");
+			} else if (!place_memory(a, words, place, nodes) ||
+				   !place_memory(b, words, place, nodes) ||
+				   !place_memory(c, words, place, nodes)) {
+			    printf(" placement failed: %s\n", strerror(errno));
+			} else {
+			    double mintime[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+			    double first = 0;
+
+			    init_arrays(kind, n);
+			    for (int k=0; k<ntimes; k++) {
+				for (int kernel=0; kernel<4; kernel++) {
+				    double t = mysecond();
+				    run_kernel(variant, kernel, n, scalar, 1);
+				    t = mysecond() - t;
+				    if (k == 0 && kernel == 0)
+					first = t;
+				    if (k > 0) /* note -- skip first iteration */
+					mintime[kernel] = MIN(mintime[kernel], t);
+				}
+			    }
+
+			    printf(" %11.1f %11.1f %11.1f %11.1f %11.1f\n",
+				1.0E-06 * 2 * words / mintime[0],
+				1.0E-06 * 2 * words / mintime[1],
+				1.0E-06 * 3 * words / mintime[2],
+				1.0E-06 * 3 * words / mintime[3],
+				1.0E-06 * 2 * words / first);
+
+			    ssize_t j;
+			    if (kind == ALLOC_DEVICE) {
+				std::vector<STREAM_TYPE> ha(n), hb(n), hc(n);
+				q.memcpy(ha.data(), a, words);
+				q.memcpy(hb.data(), b, words);
+				q.memcpy(hc.data(), c, words);
+				q.wait();
+				j = find_error(ha.data(), hb.data(), hc.data(), n, ntimes, scalar);
+			    } else {
+				j = find_error(a, b, c, n, ntimes, scalar);
+			    }
+			    if (j >= 0) {
+				printf("Failed Validation at index %lld\n", (long long) j);
+				err++;
+			    }
+			}
+			stream_free(kind, c);
+			stream_free(kind, b);
+			stream_free(kind, a);
+		    }
+		}
+	    }
+	}
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(max_threads);
+#endif
+    printf(HLINE);
+    if (err == 0)
+	printf("Solution Validates on all combinations\n");
+    printf(HLINE);
+
+    return err == 0 ? 0 : 1;
+}
+
+/* oneAPI modifications: */
+/* The latency mode: a pointer chase through a random cyclic permutation of
+ * the cache lines of a working set, so that each load depends on the one
+ * before it, and neither the caches' spatial locality nor the prefetchers
+ * can hide its latency. The working set of each size is the memory of the
+ * three arrays of the bandwidth runs, so the two line up.
+ *
+ * With several threads, the threads chase the same cycle from evenly spaced
+ * starting points, which keeps the working set the same and measures the
+ * latency under the load of the other threads. Device allocations are
+ * chased by a single work-item on the SYCL device. */
+static const ssize_t	chase_line = 64 / sizeof(size_t);
+static const ssize_t	chase_steps = 1 << 20;
+
+/* Links the first 'lines' cache lines of 'next' (on the host) into a random
+ * cycle, and returns the order of the lines along the cycle. */
+static std::vector<size_t> chase_cycle(size_t *next, ssize_t lines)
+{
+    std::vector<size_t> order(lines);
+    for (ssize_t i = 0; i < lines; i++)
+	order[i] = i * chase_line;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(lines));
+    for (ssize_t i = 0; i < lines; i++)
+	next[order[i]] = order[(i + 1) % lines];
+    return order;
+}
+
+/* Chases 'next' from start[0], ..., start[threads - 1] on as many threads,
+ * 'chase_steps' loads each, and returns the time it took. */
+static double chase(alloc_kind kind, const size_t *next, const std::vector<size_t> &start,
+    size_t *sink)
+{
+    double t = mysecond();
+    if (kind == ALLOC_DEVICE) {
+	const size_t first = start[0];
+	q.single_task([=]() {
+	    size_t p = first;
+	    for (ssize_t s = 0; s < chase_steps; s++)
+		p = next[p];
+	    *sink = p;
+	}).wait();
+    } else {
+	const int threads = start.size();
+#pragma omp parallel for num_threads(threads)
+	for (int i = 0; i < threads; i++) {
+	    size_t p = start[i];
+	    for (ssize_t s = 0; s < chase_steps; s++)
+		p = next[p];
+	    sink[i] = p;
+	}
+    }
+    return mysecond() - t;
+}
+
+int stream_latency(std::vector<ssize_t> sizes, std::vector<alloc_kind> allocs,
+    std::vector<placement> placements, std::vector<int> threads, int ntimes)
+{
+    const ssize_t	max_n = *std::max_element(sizes.begin(), sizes.end());
+    const ssize_t	max_bytes = 3 * sizeof(STREAM_TYPE) * max_n;
+    const ssize_t	max_lines = max_bytes / (chase_line * sizeof(size_t));
+    const int		nodes = numa_nodes();
+    const int		max_threads = *std::max_element(threads.begin(), threads.end());
+    size_t		*sink = sycl::malloc_shared<size_t>(max_threads, q);
+
+    printf(HLINE);
+    printf("STREAM version $Revision: 5.10 $, pointer chase latency\n");
+    printf(HLINE);
+    printf("Each working set will be chased %d times, %lld loads per thread.\n",
+	ntimes, (long long) chase_steps);
+    printf(" The *best* time (excluding the first time) will be used to\n");
+    printf(" compute the reported latency, in ns per load.\n");
+    printf(" Total KiB is the working set: the memory of all three arrays of\n");
+    printf(" the bandwidth runs at the same array size.\n");
+#ifndef _OPENMP
+    printf(" This binary is built without OpenMP, so the threads run one by one.\n");
+#endif
+
+    for (alloc_kind kind : allocs) {
+	for (placement place : placements) {
+	    if (kind == ALLOC_DEVICE && place.policy != PLACE_FIRST_TOUCH)
+		continue;
+	    const std::vector<int> runs = kind == ALLOC_DEVICE ? std::vector<int>{1} : threads;
+
+	    printf(HLINE);
+	    printf("Alloc = %s, Placement = %s\n", alloc_name[kind],
+		placement_name(place).c_str());
+
+	    size_t *next = stream_alloc<size_t>(kind, max_lines * chase_line);
+	    if (next == NULL) {
+		printf("allocation failed\n");
+		continue;
+	    }
+	    if (!place_memory(next, max_lines * chase_line * sizeof(size_t), place, nodes)) {
+		printf("placement failed: %s\n", strerror(errno));
+		stream_free(kind, next);
+		continue;
+	    }
+
+	    printf("%12s", "Total KiB");
+	    for (int t : runs) {
+		std::string label = kind == ALLOC_DEVICE ? "device ns" :
+		    std::to_string(t) + (t == 1 ? " thread ns" : " threads ns");
+		printf(" %14s", label.c_str());
+	    }
+	    printf("\n");
+
+	    for (ssize_t n : sizes) {
+		const ssize_t lines = MAX(2, 3 * sizeof(STREAM_TYPE) * n /
+		    (chase_line * sizeof(size_t)));
+		std::vector<size_t> order;
+		if (kind == ALLOC_DEVICE) {
+		    std::vector<size_t> host(lines * chase_line);
+		    order = chase_cycle(host.data(), lines);
+		    q.memcpy(next, host.data(), host.size() * sizeof(size_t)).wait();
+		} else {
+		    order = chase_cycle(next, lines);
+		}
+
+		printf("%12.1f", lines * chase_line * sizeof(size_t) / 1024.0);
+		for (int t : runs) {
+		    std::vector<size_t> start(t);
+		    for (int i = 0; i < t; i++)
+			start[i] = order[i * lines / t];
+
+		    double best = FLT_MAX;
+		    for (int k=0; k<ntimes; k++) {
+			double time = chase(kind, next, start, sink);
+			if (k > 0) /* note -- skip first iteration */
+			    best = MIN(best, time);
+		    }
+		    printf(" %14.2f", 1.0E09 * best / chase_steps);
+		}
+		printf("\n");
+	    }
+	    stream_free(kind, next);
+	}
+    }
+    printf(HLINE);
+
+    sycl::free(sink, q);
+    return 0;
+}
+
 /* oneAPI modifications: */
 /* These are straightforward SYCL implementations of the STREAM kernels.
  * Other implenentations may be better in some cases, e.g. using nd_range
  * and prescibing the dimensions to be an integer multiple of a device parameter.
  * Please see SYCL or oneAPI performance tuning documentation if necessary, */
+/* The sycl-nd variant at the end of this file is such an implementation. */
 /* SYCL requires global variables to be captured explicitly, which is why there
  * are a=a, b=b, c=c below.  This is odd, but consistent with how C++ lambdas work. */
 
-#ifdef TUNED
+/* These are built without TUNED too, as the sycl variant of the additional
+ * modes. */
 /* stubs for "tuned" versions of the kernels */
 void tuned_STREAM_Copy()
 {
-    q.parallel_for(sycl::range{STREAM_ARRAY_SIZE}, [=,a=a,c=c](sycl::item<1> i) {
+    q.parallel_for(sycl::range<1>(stream_n), [=,a=a,c=c](sycl::item<1> i) {
         const auto j = i[0];
         c[j] = a[j];
     });
@@ -627,7 +1506,7 @@ void tuned_STREAM_Copy()
 
 void tuned_STREAM_Scale(STREAM_TYPE scalar)
 {
-    q.parallel_for(sycl::range{STREAM_ARRAY_SIZE}, [=,b=b,c=c](sycl::item<1> i) {
+    q.parallel_for(sycl::range<1>(stream_n), [=,b=b,c=c](sycl::item<1> i) {
         const auto j = i[0];
         b[j] = scalar*c[j];
     });
@@ -635,7 +1514,7 @@ void tuned_STREAM_Scale(STREAM_TYPE scalar)
 
 void tuned_STREAM_Add()
 {
-    q.parallel_for(sycl::range{STREAM_ARRAY_SIZE}, [=,a=a,b=b,c=c](sycl::item<1> i) {
+    q.parallel_for(sycl::range<1>(stream_n), [=,a=a,b=b,c=c](sycl::item<1> i) {
         const auto j = i[0];
         c[j] = a[j]+b[j];
     });
@@ -643,10 +1522,111 @@ void tuned_STREAM_Add()
 
 void tuned_STREAM_Triad(STREAM_TYPE scalar)
 {
-    q.parallel_for(sycl::range{STREAM_ARRAY_SIZE}, [=,a=a,b=b,c=c](sycl::item<1> i) {
+    q.parallel_for(sycl::range<1>(stream_n), [=,a=a,b=b,c=c](sycl::item<1> i) {
         const auto j = i[0];
         a[j] = b[j]+scalar*c[j];
     });
 }
 /* end of stubs for the "tuned" versions of the kernels */
-#endif
\ No newline at end of file
+/* oneAPI modifications: */
+/* The sycl-nd variant: nd_range kernels in which each work-item loads and
+ * stores a sycl::vec of 'V' elements, so that each memory access is wider,
+ * and fewer work-items cover the arrays. The global range is rounded up to
+ * a whole number of work-groups, and the work-items past the last full
+ * vector handle the remaining elements one at a time. The vectors are
+ * loaded and stored with vec::load and vec::store, which only need the
+ * alignment of an element: a vec of 16 doubles is 128 bytes, more than the
+ * alignment USM allocations guarantee. */
+template <int V, typename Op>
+static void nd_STREAM_op(ssize_t n, STREAM_TYPE *dst, const STREAM_TYPE *x,
+    const STREAM_TYPE *y, Op op)
+{
+    using vec_t = sycl::vec<STREAM_TYPE, V>;
+    const size_t items = (n + V - 1) / V;
+    const size_t global = (items + stream_wg_size - 1) / stream_wg_size * stream_wg_size;
+
+    q.parallel_for(sycl::nd_range<1>(sycl::range<1>(global), sycl::range<1>(stream_wg_size)),
+        [=](sycl::nd_item<1> it) {
+        const ssize_t j = it.get_global_id(0) * V;
+        if (j + V <= n) {
+            vec_t vx, vy;
+            vx.load(0, sycl::make_ptr<const STREAM_TYPE, sycl::access::address_space::global_space>(x + j));
+            vy.load(0, sycl::make_ptr<const STREAM_TYPE, sycl::access::address_space::global_space>(y + j));
+            vec_t r = op(vx, vy);
+            r.store(0, sycl::make_ptr<STREAM_TYPE, sycl::access::address_space::global_space>(dst + j));
+        } else {
+            for (ssize_t i = j; i < n; i++)
+                dst[i] = op(x[i], y[i]);
+        }
+    });
+}
+
+template <int V>
+static void nd_STREAM(int kernel, ssize_t n, STREAM_TYPE scalar)
+{
+    switch (kernel) {
+        case 0: nd_STREAM_op<V>(n, c, a, a, [](auto x, auto) { return x; }); break;
+        case 1: nd_STREAM_op<V>(n, b, c, c, [=](auto x, auto) { return scalar*x; }); break;
+        case 2: nd_STREAM_op<V>(n, c, a, b, [](auto x, auto y) { return x+y; }); break;
+        case 3: nd_STREAM_op<V>(n, a, b, c, [=](auto x, auto y) { return x+scalar*y; }); break;
+    }
+}
+
+void nd_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar)
+{
+    switch (stream_vec_width) {
+        case 1: nd_STREAM<1>(kernel, n, scalar); break;
+        case 2: nd_STREAM<2>(kernel, n, scalar); break;
+        case 8: nd_STREAM<8>(kernel, n, scalar); break;
+        case 16: nd_STREAM<16>(kernel, n, scalar); break;
+        default: nd_STREAM<4>(kernel, n, scalar); break;
+    }
+}
+
+/* oneAPI modifications: */
+/* The omp-nt variant: the OpenMP loops with non-temporal (streaming)
+ * stores. A normal store first reads the cache line it writes into the
+ * caches (write allocate), so Copy moves 3 words per element rather than
+ * the 2 that STREAM counts. Non-temporal stores write around the caches,
+ * which removes the extra read when the arrays do not fit in the caches,
+ * but make arrays that do fit slower. The stores are weakly ordered, so each
+ * thread fences them before the end of the parallel region. */
+#if defined(__clang__)
+# define STREAM_NT_STORE(p, v) __builtin_nontemporal_store((v), (p))
+#else
+# define STREAM_NT_STORE(p, v) (*(p) = (v))
+#endif
+
+void nt_STREAM_kernel(int kernel, ssize_t n, STREAM_TYPE scalar)
+{
+    ssize_t	j;
+
+#pragma omp parallel
+    {
+	switch (kernel) {
+	    case 0:
+#pragma omp for simd
+		for (j=0; j<n; j++)
+		    STREAM_NT_STORE(&c[j], a[j]);
+		break;
+	    case 1:
+#pragma omp for simd
+		for (j=0; j<n; j++)
+		    STREAM_NT_STORE(&b[j], scalar*c[j]);
+		break;
+	    case 2:
+#pragma omp for simd
+		for (j=0; j<n; j++)
+		    STREAM_NT_STORE(&c[j], a[j]+b[j]);
+		break;
+	    case 3:
+#pragma omp for simd
+		for (j=0; j<n; j++)
+		    STREAM_NT_STORE(&a[j], b[j]+scalar*c[j]);
+		break;
+	}
+#ifdef __SSE2__
+	_mm_sfence();
+#endif
+    }
+}